@@ -0,0 +1,777 @@
+//! Disk-resident B+Tree whose nodes are buffer pool pages
+//!
+//! Nodes use the prefix-compressed layout of
+//! [`btree_node`](crate::index::btree_node) and live in the
+//! [`BufferPool`], so the upper levels stay resident while leaves come and
+//! go. New nodes come from the [`PageAllocator`]. The root keeps its page
+//! ID for the life of the tree: when it splits, its entries move to two new
+//! children. That page ID is all a caller needs to store to reopen the tree.
+//!
+//! Access is optimistic. Nodes are read with
+//! [`BufferPool::read_versioned`], which copies a node without pinning or
+//! latching it, so readers write no shared memory and scale with cores.
+//! After copying a child, a reader checks that its parent is unchanged. A
+//! split changes the parent, so a reader that may have followed a stale
+//! pointer starts over from the root.
+//!
+//! A writer finds the path to the leaf the same way. It then takes
+//! exclusive latches top-down on the part of the path that can change: the
+//! leaf, plus each ancestor up to the first one with room for another
+//! separator. If any of those nodes changed since it was read, the writer
+//! drops its latches and starts over. Writers to different leaves never
+//! wait for each other. The range of keys a node covers only shrinks when
+//! that node splits, so an unchanged node is still the right one, whatever
+//! happened to its ancestors.
+//!
+//! Leaves are linked to their neighbours for range scans (see
+//! [`btree_cursor`](crate::index::btree_cursor)). A leaf split also
+//! latches the old right neighbour to point it back at the new leaf. That
+//! latch is taken after the whole path and only ever to the right, so
+//! writers still acquire latches in one global order.
+//!
+//! Keys compare as byte strings. Deletes do not merge nodes; emptied leaves
+//! stay in the tree and are refilled by later inserts into their range.
+//!
+//! With a [`Wal`](crate::storage::wal::Wal) attached to the pool, every
+//! node change is logged before its latch is released.
+
+use crate::common::error::Error;
+use crate::index::btree_node::{
+    self, fits, shortest_separator, Entry, NodeRef, Payload, MAX_KEY_LEN, MAX_SEPARATOR_SPACE,
+    MAX_VALUE_LEN, SLOT_SIZE,
+};
+use crate::storage::buffer_pool::{BufferPool, PageVersion, PageWriteGuard, PinnedPage};
+use crate::storage::page::Page;
+use crate::storage::page_allocator::PageAllocator;
+use crate::storage::page_constants::{PageId, INVALID_PAGE_ID, PAGE_USABLE_SIZE};
+use crate::storage::page_type::PageType;
+use std::sync::Arc;
+
+/// Restarts after which an operation pins the nodes it reads
+const OPTIMISTIC_RESTARTS: usize = 4;
+
+/// A node on the path to a leaf, with the version it was read at
+struct PathNode<'a> {
+    page_id: PageId,
+    version: PageVersion,
+    /// Set once an operation has fallen back to pinning its path
+    pinned: Option<PinnedPage<'a>>,
+}
+
+/// An ordered map from byte-string keys to byte-string values
+pub struct BTree {
+    pool: Arc<BufferPool>,
+    allocator: Arc<PageAllocator>,
+    root: PageId,
+}
+
+impl BTree {
+    /// Create an empty tree with a new root page
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the root page cannot be allocated or created
+    pub fn create(pool: Arc<BufferPool>, allocator: Arc<PageAllocator>) -> Result<Self, Error> {
+        let root = allocator.allocate_page()?;
+        {
+            let pinned = pool.new_page(root, PageType::BTreeLeaf)?;
+            let mut guard = pinned.write()?;
+            btree_node::init_leaf(&mut guard, root);
+            log_node(&pool, root, &mut guard, PAGE_USABLE_SIZE)?;
+        }
+        Ok(Self {
+            pool,
+            allocator,
+            root,
+        })
+    }
+
+    /// Open the tree rooted at `root`
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the root page cannot be read or is not a node
+    pub fn open(
+        pool: Arc<BufferPool>,
+        allocator: Arc<PageAllocator>,
+        root: PageId,
+    ) -> Result<Self, Error> {
+        {
+            let guard = pool.read_page(root)?;
+            NodeRef::new(root, &guard)?;
+        }
+        Ok(Self {
+            pool,
+            allocator,
+            root,
+        })
+    }
+
+    /// Page ID of the root node, which never changes
+    pub fn root(&self) -> PageId {
+        self.root
+    }
+
+    /// Number of levels, 1 for a tree that is a single leaf
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a node cannot be read
+    pub fn height(&self) -> Result<usize, Error> {
+        let mut height = 1;
+        let mut guard = self.pool.read_page(self.root)?;
+        loop {
+            let node = NodeRef::new(guard.page_id(), &guard)?;
+            if node.is_leaf() {
+                return Ok(height);
+            }
+            let child = node.leftmost_child();
+            guard = self.pool.read_page(child)?;
+            height += 1;
+        }
+    }
+
+    /// Look up `key` and pass its value, borrowed from the leaf page, to `f`
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a node cannot be read
+    pub fn get_with<R>(&self, key: &[u8], f: impl FnOnce(&[u8]) -> R) -> Result<Option<R>, Error> {
+        let mut copy = Page::new();
+        let (page_id, _) = self.find_leaf(key, &mut copy, |_| {})?;
+        let node = NodeRef::new(page_id, &copy)?;
+        Ok(node.search(key).ok().map(|index| f(node.value(index))))
+    }
+
+    /// Look up `key`
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a node cannot be read
+    pub fn get(&self, key: &[u8]) -> Result<Option<Vec<u8>>, Error> {
+        self.get_with(key, <[u8]>::to_vec)
+    }
+
+    /// Insert or replace `key`; returns the previous value
+    ///
+    /// The pages and buffer pool frames a split needs are taken before any
+    /// node changes, so running out of either leaves the tree as it was.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the key or value is too long, or an
+    /// error if a node cannot be read, written or allocated
+    pub fn insert(&self, key: &[u8], value: &[u8]) -> Result<Option<Vec<u8>>, Error> {
+        check_entry(key, value)?;
+        let mut copy = Page::new();
+        let mut attempt = 0;
+        loop {
+            if let Some(previous) = self.try_insert(key, value, &mut copy, attempt)? {
+                return Ok(previous);
+            }
+            attempt += 1;
+        }
+    }
+
+    /// Remove `key`; returns its value
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a node cannot be read or written
+    pub fn remove(&self, key: &[u8]) -> Result<Option<Vec<u8>>, Error> {
+        let mut copy = Page::new();
+        let mut attempt = 0;
+        loop {
+            attempt += 1;
+            let Some(leaf) = self
+                .find_path(key, &mut copy, attempt - 1, |_| {})?
+                .and_then(|mut path| path.pop())
+            else {
+                continue;
+            };
+            let (page_id, version) = (leaf.page_id, leaf.version);
+            let pinned = self.pin(leaf)?;
+            let mut guard = pinned.latch()?;
+            if !guard.is_unchanged_since(&version) {
+                continue;
+            }
+            let found = {
+                let node = NodeRef::new(page_id, &guard)?;
+                node.search(key)
+                    .ok()
+                    .map(|index| (index, node.value(index).to_vec()))
+            };
+            let Some((index, value)) = found else {
+                return Ok(None);
+            };
+            btree_node::remove(&mut guard, page_id, index);
+            log_node(&self.pool, page_id, &mut guard, 0)?;
+            return Ok(Some(value));
+        }
+    }
+
+    /// Buffer pool holding the nodes
+    pub(crate) fn pool(&self) -> &BufferPool {
+        &self.pool
+    }
+
+    /// Copy the leaf for `key` into `copy`, starting over until the path
+    /// to it reads consistently; returns the leaf's page ID and version.
+    /// `visit` sees each node read, including those of abandoned attempts.
+    pub(crate) fn find_leaf(
+        &self,
+        key: &[u8],
+        copy: &mut Page,
+        mut visit: impl FnMut(&NodeRef<'_>),
+    ) -> Result<(PageId, PageVersion), Error> {
+        let mut attempt = 0;
+        loop {
+            if let Some(leaf) = self
+                .find_path(key, copy, attempt, &mut visit)?
+                .and_then(|mut path| path.pop())
+            {
+                return Ok((leaf.page_id, leaf.version));
+            }
+            attempt += 1;
+        }
+    }
+
+    /// Read the path from the root to the leaf for `key`, passing each node
+    /// to `visit` on the way down; `None` if a node changed under the
+    /// reader. `copy` is left holding the leaf.
+    ///
+    /// Once `attempt` reaches [`OPTIMISTIC_RESTARTS`], the path is pinned
+    /// as it is read, so evictions cannot keep forcing restarts.
+    fn find_path(
+        &self,
+        key: &[u8],
+        copy: &mut Page,
+        attempt: usize,
+        mut visit: impl FnMut(&NodeRef<'_>),
+    ) -> Result<Option<Vec<PathNode<'_>>>, Error> {
+        let mut path: Vec<PathNode<'_>> = Vec::new();
+        let mut page_id = self.root;
+        loop {
+            let (version, pinned) = if attempt < OPTIMISTIC_RESTARTS {
+                (self.pool.read_versioned(page_id, copy)?, None)
+            } else {
+                let pinned = self.pool.fetch_page(page_id)?;
+                (pinned.read_versioned(copy), Some(pinned))
+            };
+            if path
+                .last()
+                .is_some_and(|parent| !self.pool.is_unchanged(&parent.version))
+            {
+                return Ok(None);
+            }
+            path.push(PathNode {
+                page_id,
+                version,
+                pinned,
+            });
+            let node = NodeRef::new(page_id, copy)?;
+            visit(&node);
+            if node.is_leaf() {
+                return Ok(Some(path));
+            }
+            page_id = node.child_for(key)?;
+        }
+    }
+
+    /// Pin a node of a path, unless it was pinned as it was read
+    fn pin<'a>(&'a self, node: PathNode<'a>) -> Result<PinnedPage<'a>, Error> {
+        match node.pinned {
+            Some(pinned) => Ok(pinned),
+            None => self.pool.fetch_page(node.page_id),
+        }
+    }
+
+    /// One attempt at [`insert`](Self::insert); `None` if a node changed
+    /// under the writer and it has to start over
+    #[allow(clippy::option_option)]
+    fn try_insert(
+        &self,
+        key: &[u8],
+        value: &[u8],
+        copy: &mut Page,
+        attempt: usize,
+    ) -> Result<Option<Option<Vec<u8>>>, Error> {
+        // Find the path and the highest node that has to change
+        let mut first_changed = 0;
+        let mut depth = 0;
+        let found = self.find_path(key, copy, attempt, |node| {
+            let safe = if node.is_leaf() {
+                leaf_can_take(node, key, value)
+            } else {
+                // A separator outside the node prefix shrinks it, growing
+                // every entry by up to the old prefix length
+                node.free_space() >= MAX_SEPARATOR_SPACE + node.len() * node.prefix().len()
+            };
+            if safe {
+                first_changed = depth;
+            }
+            depth += 1;
+        })?;
+        let Some(path) = found else {
+            return Ok(None);
+        };
+
+        // Latch top-down, checking that nothing changed since the read
+        let mut pins = Vec::with_capacity(path.len() - first_changed);
+        let mut versions = Vec::with_capacity(pins.capacity());
+        for node in path.into_iter().skip(first_changed) {
+            versions.push(node.version);
+            pins.push(self.pin(node)?);
+        }
+        let mut guards: Vec<PageWriteGuard<'_>> = Vec::with_capacity(pins.len());
+        for (pinned, version) in pins.iter().zip(&versions) {
+            let guard = pinned.latch()?;
+            if !guard.is_unchanged_since(version) {
+                return Ok(None);
+            }
+            guards.push(guard);
+        }
+
+        // Inserts that fit extend each entry area down from its start
+        let mut entries_ends: Vec<usize> = pins
+            .iter()
+            .zip(&guards)
+            .map(|(pinned, guard)| Ok(NodeRef::new(pinned.page_id(), guard)?.heap_start()))
+            .collect::<Result<_, Error>>()?;
+        let leaf = guards.len() - 1;
+        let leaf_id = pins[leaf].page_id();
+        let entry = Entry::value(key, value);
+        let (previous, index, in_place) = {
+            let node = NodeRef::new(leaf_id, &guards[leaf])?;
+            match node.search(key) {
+                Ok(index) => (Some(node.value(index).to_vec()), index, false),
+                Err(index) => (None, index, node.fits_in_place(&entry)),
+            }
+        };
+        // Most inserts fit in the leaf as it is and cannot fail part way
+        if in_place {
+            btree_node::try_insert(&mut guards[leaf], leaf_id, index, &entry);
+            log_node(&self.pool, leaf_id, &mut guards[leaf], entries_ends[leaf])?;
+            return Ok(Some(None));
+        }
+
+        // Anything else is worked out on copies of the latched nodes, and
+        // every page, frame and latch it needs is taken before the tree
+        // changes, so a failure leaves the tree as it was
+        let mut nodes: Vec<Page> = guards
+            .iter()
+            .map(|guard| {
+                let mut node = Page::new();
+                node.raw_mut().copy_from_slice(guard.raw());
+                node
+            })
+            .collect();
+        let mut plan = SplitPlan::default();
+        let replace = previous.is_some().then_some(index);
+        let top = match self.plan_insert(
+            &pins,
+            &mut nodes,
+            replace,
+            entry,
+            &mut entries_ends,
+            &mut plan,
+        ) {
+            Ok(top) => top,
+            Err(err) => return Err(self.abandon(plan, Vec::new(), err)),
+        };
+        self.commit_insert(&pins, &mut guards, &nodes, top, &entries_ends, plan)?;
+        Ok(Some(previous))
+    }
+
+    /// Apply an insert to `nodes`, copies of the latched nodes with the leaf
+    /// last, replacing the entry at `replace` if the key is present; returns
+    /// the highest level changed
+    fn plan_insert(
+        &self,
+        pins: &[PinnedPage<'_>],
+        nodes: &mut [Page],
+        replace: Option<usize>,
+        entry: Entry,
+        entries_ends: &mut [usize],
+        plan: &mut SplitPlan,
+    ) -> Result<usize, Error> {
+        let mut level = nodes.len() - 1;
+        if let Some(index) = replace {
+            btree_node::remove(&mut nodes[level], pins[level].page_id(), index);
+        }
+        let mut pending = Some(entry);
+        while let Some(entry) = pending.take() {
+            let page_id = pins[level].page_id();
+            pending = self.insert_entry(
+                page_id,
+                &mut nodes[level],
+                entry,
+                &mut entries_ends[level],
+                plan,
+            )?;
+            if pending.is_some() {
+                if level == 0 {
+                    return Err(Error::internal(
+                        "B+Tree split reached a node that was not latched",
+                    ));
+                }
+                level -= 1;
+            }
+        }
+        Ok(level)
+    }
+
+    /// Insert `entry` into `page`, a copy of latched node `page_id`,
+    /// splitting it if needed; returns the separator entry for the parent
+    /// after a split
+    ///
+    /// New nodes, the page IDs they take and the leaf link to fix are
+    /// added to `plan`. Raises `entries_end` to the end of the node if it
+    /// is rebuilt.
+    fn insert_entry(
+        &self,
+        page_id: PageId,
+        page: &mut Page,
+        entry: Entry,
+        entries_end: &mut usize,
+        plan: &mut SplitPlan,
+    ) -> Result<Option<Entry>, Error> {
+        let (index, leaf, leftmost, prev_leaf, next_leaf) = {
+            let node = NodeRef::new(page_id, page)?;
+            let Err(index) = node.search(&entry.key) else {
+                return Err(Error::internal(format!(
+                    "Key already present in B+Tree node {page_id}"
+                )));
+            };
+            (
+                index,
+                node.is_leaf(),
+                node.leftmost_child(),
+                node.prev_leaf(),
+                node.next_leaf(),
+            )
+        };
+        if btree_node::try_insert(page, page_id, index, &entry) {
+            return Ok(None);
+        }
+        // Every path from here rebuilds the node
+        *entries_end = PAGE_USABLE_SIZE;
+
+        let mut entries = NodeRef::new(page_id, page)?.entries()?;
+        entries.insert(index, entry);
+        if fits(page_id, &entries) {
+            btree_node::build(page, page_id, leaf, leftmost, &entries)?;
+            return Ok(None);
+        }
+
+        let right = self.allocator.allocate_page()?;
+        plan.allocated.push(right);
+        // The root keeps its page ID by moving both halves out of it
+        let left = if page_id == self.root {
+            let left = self.allocator.allocate_page()?;
+            plan.allocated.push(left);
+            left
+        } else {
+            page_id
+        };
+        let split = split_point(&entries, leaf, left, right)?;
+        let (separator, right_leftmost, right_entries) = if leaf {
+            let separator = shortest_separator(&entries[split - 1].key, &entries[split].key);
+            (separator, INVALID_PAGE_ID, &entries[split..])
+        } else {
+            // The middle separator moves up; its child leads the right node
+            (
+                entries[split].key.clone(),
+                child_of(&entries[split], page_id)?,
+                &entries[split + 1..],
+            )
+        };
+        let left_entries = &entries[..split];
+
+        let no_links = (INVALID_PAGE_ID, INVALID_PAGE_ID);
+        if left == page_id {
+            let right_links = if leaf { (left, next_leaf) } else { no_links };
+            let right_node = new_node(right, leaf, right_leftmost, right_links, right_entries)?;
+            plan.nodes.push((right, right_node));
+            btree_node::build(page, page_id, leaf, leftmost, left_entries)?;
+            if leaf {
+                btree_node::set_next_leaf(page, right);
+                if next_leaf != INVALID_PAGE_ID {
+                    plan.relink = Some((next_leaf, page_id, right));
+                }
+            }
+            return Ok(Some(Entry::child(&separator, right)));
+        }
+        // Only a root that is the tree's single leaf splits into leaves here
+        let (left_links, right_links) = if leaf {
+            ((prev_leaf, right), (left, next_leaf))
+        } else {
+            (no_links, no_links)
+        };
+        let right_node = new_node(right, leaf, right_leftmost, right_links, right_entries)?;
+        plan.nodes.push((right, right_node));
+        let left_node = new_node(left, leaf, leftmost, left_links, left_entries)?;
+        plan.nodes.push((left, left_node));
+        btree_node::build(
+            page,
+            page_id,
+            false,
+            left,
+            &[Entry::child(&separator, right)],
+        )?;
+        Ok(None)
+    }
+
+    /// Take what `plan` needs, then copy `nodes` from level `top` down into
+    /// the latched nodes and create the new ones, logging each
+    ///
+    /// If taking anything fails, the reservations are given back and the
+    /// tree is left unchanged.
+    fn commit_insert(
+        &self,
+        pins: &[PinnedPage<'_>],
+        guards: &mut [PageWriteGuard<'_>],
+        nodes: &[Page],
+        top: usize,
+        entries_ends: &[usize],
+        plan: SplitPlan,
+    ) -> Result<(), Error> {
+        let mut created = Vec::with_capacity(plan.nodes.len());
+        let mut neighbour = None;
+        let reserved = self
+            .reserve(&plan, &mut created, &mut neighbour)
+            .and_then(|()| match (&neighbour, plan.relink) {
+                (Some(pinned), Some((next, old, _))) => {
+                    let guard = pinned.latch()?;
+                    if NodeRef::new(next, &guard)?.prev_leaf() != old {
+                        return Err(Error::corruption(format!(
+                            "B+Tree leaf {next} does not link back to leaf {old}"
+                        )));
+                    }
+                    Ok(Some(guard))
+                }
+                _ => Ok(None),
+            });
+        let neighbour_guard = match reserved {
+            Ok(guard) => guard,
+            Err(err) => return Err(self.abandon(plan, created, err)),
+        };
+
+        for (pinned, (page_id, node)) in created.iter().zip(&plan.nodes) {
+            let mut guard = pinned.write()?;
+            guard.data_mut().copy_from_slice(node.data());
+            log_node(&self.pool, *page_id, &mut guard, PAGE_USABLE_SIZE)?;
+        }
+        if let (Some(mut guard), Some((next, _, new))) = (neighbour_guard, plan.relink) {
+            btree_node::set_prev_leaf(&mut guard, new);
+            log_node(&self.pool, next, &mut guard, 0)?;
+        }
+        // Ancestors above `top` were only latched
+        for level in top..guards.len() {
+            let guard = &mut guards[level];
+            guard.header_mut().page_type = nodes[level].header().page_type;
+            guard.data_mut().copy_from_slice(nodes[level].data());
+            log_node(
+                &self.pool,
+                pins[level].page_id(),
+                guard,
+                entries_ends[level],
+            )?;
+        }
+        Ok(())
+    }
+
+    /// Create the planned nodes in the pool, adding their pins to
+    /// `created`, and pin the leaf to relink into `neighbour`
+    fn reserve<'a>(
+        &'a self,
+        plan: &SplitPlan,
+        created: &mut Vec<PinnedPage<'a>>,
+        neighbour: &mut Option<PinnedPage<'a>>,
+    ) -> Result<(), Error> {
+        for (page_id, node) in &plan.nodes {
+            created.push(self.pool.new_page(*page_id, node.header().page_type)?);
+        }
+        if let Some((next, _, _)) = plan.relink {
+            *neighbour = Some(self.pool.fetch_page(next)?);
+        }
+        Ok(())
+    }
+
+    /// Give back what an insert took before it failed; returns `err`
+    fn abandon(&self, plan: SplitPlan, created: Vec<PinnedPage<'_>>, err: Error) -> Error {
+        for pinned in created {
+            pinned.discard();
+        }
+        for page_id in plan.allocated {
+            if let Err(free_err) = self.allocator.free_page(page_id) {
+                log::warn!("Failed to free B+Tree page {page_id}: {free_err}");
+            }
+        }
+        err
+    }
+}
+
+/// What an insert needs beyond its latched nodes, gathered before any of
+/// them changes
+#[derive(Default)]
+struct SplitPlan {
+    /// Page IDs taken from the allocator
+    allocated: Vec<PageId>,
+    /// New nodes, built and ready to copy into the pool
+    nodes: Vec<(PageId, Page)>,
+    /// Leaf `next`, formerly after `old`, to point back at leaf `new`
+    relink: Option<(PageId, PageId, PageId)>,
+}
+
+/// Build node `page_id` holding `entries`, with leaf sibling links
+/// `(prev, next)`
+fn new_node(
+    page_id: PageId,
+    leaf: bool,
+    leftmost: PageId,
+    (prev, next): (PageId, PageId),
+    entries: &[Entry],
+) -> Result<Page, Error> {
+    let mut page = Page::new();
+    page.header_mut().set_page_id(page_id);
+    btree_node::build(&mut page, page_id, leaf, leftmost, entries)?;
+    if leaf {
+        btree_node::set_prev_leaf(&mut page, prev);
+        btree_node::set_next_leaf(&mut page, next);
+    }
+    Ok(page)
+}
+
+/// Reject keys and values over the size limits
+pub(crate) fn check_entry(key: &[u8], value: &[u8]) -> Result<(), Error> {
+    if key.len() > MAX_KEY_LEN {
+        return Err(Error::invalid_input(format!(
+            "Key of {} bytes exceeds the {MAX_KEY_LEN}-byte limit",
+            key.len()
+        )));
+    }
+    if value.len() > MAX_VALUE_LEN {
+        return Err(Error::invalid_input(format!(
+            "Value of {} bytes exceeds the {MAX_VALUE_LEN}-byte limit",
+            value.len()
+        )));
+    }
+    Ok(())
+}
+
+/// Whether a leaf can store the entry without splitting
+fn leaf_can_take(node: &NodeRef<'_>, key: &[u8], value: &[u8]) -> bool {
+    let reclaimed = node.search(key).map_or(0, |index| node.value(index).len());
+    key.starts_with(node.prefix())
+        && node.free_space() + reclaimed
+            >= SLOT_SIZE + 4 + key.len() - node.prefix().len() + value.len()
+}
+
+pub(crate) fn child_of(entry: &Entry, page_id: PageId) -> Result<PageId, Error> {
+    match entry.payload {
+        Payload::Child(child) => Ok(child),
+        Payload::Value(_) => Err(Error::corruption(format!(
+            "B+Tree node {page_id} mixes entry kinds"
+        ))),
+    }
+}
+
+/// Where to split an overfull node into nodes `left` and `right`
+///
+/// Starts at the point that halves the bytes and moves it until both
+/// halves fit. In internal nodes the entry at the split point moves up to
+/// the parent.
+fn split_point(entries: &[Entry], leaf: bool, left: PageId, right: PageId) -> Result<usize, Error> {
+    let total: usize = entries.iter().map(Entry::approximate_size).sum();
+    let mut split = 1;
+    let mut bytes = 0;
+    for (index, entry) in entries.iter().enumerate() {
+        bytes += entry.approximate_size();
+        if bytes * 2 >= total {
+            split = index + 1;
+            break;
+        }
+    }
+    let skip = usize::from(!leaf);
+    let last = entries.len() - 1 - skip;
+    split = split.clamp(1, last);
+    while split > 1 && !fits(left, &entries[..split]) {
+        split -= 1;
+    }
+    while split < last && !fits(right, &entries[split + skip..]) {
+        split += 1;
+    }
+    if fits(left, &entries[..split]) && fits(right, &entries[split + skip..]) {
+        Ok(split)
+    } else {
+        Err(Error::internal("No split point gives two nodes that fit"))
+    }
+}
+
+/// Log a changed node if the pool has a write-ahead log
+///
+/// Logs the node's headers and slot arrays, and its entry area up to
+/// data-area offset `entries_end`: `PAGE_USABLE_SIZE` after a rebuild, the
+/// entry area start from before the change after in-place inserts, or 0
+/// when no entry bytes changed.
+fn log_node(
+    pool: &BufferPool,
+    page_id: PageId,
+    guard: &mut PageWriteGuard<'_>,
+    entries_end: usize,
+) -> Result<(), Error> {
+    if pool.wal().is_some() {
+        let ranges = NodeRef::new(page_id, guard)?.changed_ranges(entries_end);
+        guard.log_changes(&ranges)?;
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::storage::buffer_pool::BufferPoolConfig;
+    use crate::storage::page_constants::PAGE_SIZE;
+    use tempfile::NamedTempFile;
+
+    fn tree(frames: usize) -> (NamedTempFile, BTree) {
+        let temp = NamedTempFile::new().unwrap();
+        let config = BufferPoolConfig {
+            memory_budget: frames * PAGE_SIZE,
+            ..Default::default()
+        };
+        let pool = Arc::new(BufferPool::open(temp.path(), config).unwrap());
+        let tree = BTree::create(pool, Arc::new(PageAllocator::new())).unwrap();
+        (temp, tree)
+    }
+
+    #[test]
+    fn test_split_point_balances_bytes() {
+        let entries: Vec<Entry> = (0u8..)
+            .zip([10, 10, 10, 100])
+            .map(|(key, len)| Entry::value(&[key], &vec![0; len]))
+            .collect();
+        assert_eq!(split_point(&entries, true, 1, 2).unwrap(), 3);
+        assert_eq!(split_point(&entries[..2], true, 1, 2).unwrap(), 1);
+
+        let big: Vec<Entry> = (0..5u8)
+            .map(|i| Entry::value(&[i], &[0; MAX_VALUE_LEN]))
+            .collect();
+        let split = split_point(&big, true, 1, 2).unwrap();
+        assert!(fits(1, &big[..split]) && fits(2, &big[split..]));
+    }
+
+    #[test]
+    fn test_root_split_keeps_root_page() {
+        let (_temp, tree) = tree(64);
+        let root = tree.root();
+        for i in 0..200u32 {
+            tree.insert(&i.to_be_bytes(), &[1; 100]).unwrap();
+        }
+        assert_eq!(tree.root(), root);
+        assert!(tree.height().unwrap() >= 2);
+        let guard = tree.pool.read_page(root).unwrap();
+        assert!(!NodeRef::new(root, &guard).unwrap().is_leaf());
+    }
+}
@@ -0,0 +1,376 @@
+//! Range scans over a B+Tree
+//!
+//! A [`RangeCursor`] descends to the first leaf of a range once and then
+//! follows the leaves' sibling links, forward or backward, working from a
+//! copy of one leaf at a time. It keeps that leaf pinned, so reading the
+//! next one cannot evict it. Before stepping to the next leaf it checks
+//! that the current one is unchanged. A split would have changed it, and
+//! then the next leaf might not follow the last key returned, so the
+//! cursor descends again from that key.
+//!
+//! Cold scans would otherwise wait on one leaf read at a time. To overlap
+//! those reads with consumption, the descent also collects the page IDs of
+//! the next [`SCAN_PREFETCH_LEAVES`] leaves from the leaf's parent and
+//! hands them to [`BufferPool::prefetch`], which asks the OS to start
+//! reading the ones that are not resident. As the cursor moves, it tops
+//! the queue up from the parent of the leaf it is on; leaves past the end
+//! of the range are never prefetched.
+//!
+//! A scan is not a snapshot of the tree. Each key is returned at most once
+//! and in order, and an entry changed during the scan may be seen either
+//! before or after the change.
+
+use crate::common::error::Error;
+use crate::index::btree::BTree;
+use crate::index::btree_node::{NodeRef, MAX_KEY_LEN};
+use crate::storage::buffer_pool::{PageVersion, PinnedPage};
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PageId, INVALID_PAGE_ID};
+use std::collections::VecDeque;
+use std::ops::Bound;
+
+/// Leaves ahead of the cursor that a scan asks to have read
+pub const SCAN_PREFETCH_LEAVES: usize = 16;
+
+/// A key and its value
+type KeyValue = (Vec<u8>, Vec<u8>);
+
+/// Iterator over the entries of a B+Tree key range, in key order or in
+/// reverse
+///
+/// Created by [`BTree::range`] and [`BTree::range_rev`]. It yields owned
+/// key-value pairs; after an error it yields nothing more. While it has a
+/// current leaf, it holds one buffer pool frame pinned.
+pub struct RangeCursor<'a> {
+    tree: &'a BTree,
+    forward: bool,
+    /// Where the scan starts: the lower bound going forward, the upper one
+    /// going backward
+    from: Bound<Vec<u8>>,
+    /// Where the scan stops
+    to: Bound<Vec<u8>>,
+    /// Copy of the current leaf, the version it was copied at and its pin;
+    /// no version before the first descent
+    leaf: Box<Page>,
+    leaf_id: PageId,
+    version: Option<PageVersion>,
+    pinned: Option<PinnedPage<'a>>,
+    /// Index of the next entry to return going forward, or one past it
+    /// going backward
+    position: usize,
+    last_key: Option<Vec<u8>>,
+    /// Leaves expected after the current one, already prefetched
+    upcoming: VecDeque<PageId>,
+    /// Whether `upcoming` runs to the end of its parent or of the range,
+    /// so that reading the parent again would add nothing
+    upcoming_complete: bool,
+    scratch: Box<Page>,
+    done: bool,
+}
+
+impl BTree {
+    /// Scan the keys within `start` and `end` in ascending order
+    pub fn range(&self, start: Bound<&[u8]>, end: Bound<&[u8]>) -> RangeCursor<'_> {
+        RangeCursor::new(self, true, start, end)
+    }
+
+    /// Scan the keys within `start` and `end` in descending order
+    pub fn range_rev(&self, start: Bound<&[u8]>, end: Bound<&[u8]>) -> RangeCursor<'_> {
+        RangeCursor::new(self, false, end, start)
+    }
+}
+
+impl<'a> RangeCursor<'a> {
+    fn new(tree: &'a BTree, forward: bool, from: Bound<&[u8]>, to: Bound<&[u8]>) -> Self {
+        Self {
+            tree,
+            forward,
+            from: from.map(<[u8]>::to_vec),
+            to: to.map(<[u8]>::to_vec),
+            leaf: Box::new(Page::new()),
+            leaf_id: INVALID_PAGE_ID,
+            version: None,
+            pinned: None,
+            position: 0,
+            last_key: None,
+            upcoming: VecDeque::with_capacity(SCAN_PREFETCH_LEAVES),
+            upcoming_complete: false,
+            scratch: Box::new(Page::new()),
+            done: false,
+        }
+    }
+
+    /// Next entry, or `None` at the end of the range
+    fn step(&mut self) -> Result<Option<KeyValue>, Error> {
+        if self.version.is_none() {
+            self.seek()?;
+        }
+        loop {
+            let version = self
+                .version
+                .ok_or_else(|| Error::internal("Range cursor has no leaf"))?;
+            let (entry, sibling) = {
+                let node = NodeRef::new(self.leaf_id, &self.leaf)?;
+                let index = if self.forward {
+                    Some(self.position).filter(|&index| index < node.len())
+                } else {
+                    self.position.checked_sub(1)
+                };
+                let sibling = if self.forward {
+                    node.next_leaf()
+                } else {
+                    node.prev_leaf()
+                };
+                let entry = index.map(|index| (index, node.key(index), node.value(index).to_vec()));
+                (entry, sibling)
+            };
+            if let Some((index, key, value)) = entry {
+                if !self.before_end(&key) {
+                    return Ok(None);
+                }
+                self.position = if self.forward { index + 1 } else { index };
+                self.last_key = Some(key.clone());
+                return Ok(Some((key, value)));
+            }
+
+            let pool = self.tree.pool();
+            if sibling == INVALID_PAGE_ID {
+                // The leaf ends the chain, unless a split just extended it
+                if pool.is_unchanged(&version) {
+                    return Ok(None);
+                }
+                self.seek()?;
+            } else {
+                let pinned = pool.fetch_page(sibling)?;
+                let next = pinned.read_versioned(&mut self.scratch);
+                if pool.is_unchanged(&version) {
+                    self.enter(pinned, next)?;
+                } else {
+                    self.seek()?;
+                }
+            }
+        }
+    }
+
+    /// Whether `key` has not yet passed the end of the range
+    fn before_end(&self, key: &[u8]) -> bool {
+        match (&self.to, self.forward) {
+            (Bound::Unbounded, _) => true,
+            (Bound::Included(to), true) => key <= to.as_slice(),
+            (Bound::Excluded(to), true) => key < to.as_slice(),
+            (Bound::Included(to), false) => key >= to.as_slice(),
+            (Bound::Excluded(to), false) => key > to.as_slice(),
+        }
+    }
+
+    /// Descend to the leaf holding the next key to return: the one after
+    /// the last key returned, or the start of the range
+    fn seek(&mut self) -> Result<(), Error> {
+        // Above every key, as no key is longer than `MAX_KEY_LEN`
+        let top = [0xFF; MAX_KEY_LEN + 1];
+        let (key, inclusive) = match (&self.last_key, &self.from) {
+            (Some(last), _) => (last.as_slice(), false),
+            (None, Bound::Included(from)) => (from.as_slice(), true),
+            (None, Bound::Excluded(from)) => (from.as_slice(), false),
+            (None, Bound::Unbounded) if self.forward => (&[][..], true),
+            (None, Bound::Unbounded) => (&top[..], true),
+        };
+        let mut upcoming = Vec::new();
+        let mut complete = false;
+        let (forward, to) = (self.forward, &self.to);
+        let (leaf_id, version) = loop {
+            let (leaf_id, version) = self.tree.find_leaf(key, &mut self.leaf, |node| {
+                if !node.is_leaf() {
+                    (upcoming, complete) = upcoming_from(forward, to, node, key);
+                }
+            })?;
+            // Unchanged once pinned means the copy is still current
+            let pinned = self.tree.pool().fetch_page(leaf_id)?;
+            if self.tree.pool().is_unchanged(&version) {
+                self.pinned = Some(pinned);
+                break (leaf_id, version);
+            }
+        };
+        let node = NodeRef::new(leaf_id, &self.leaf)?;
+        self.position = match (node.search(key), self.forward, inclusive) {
+            (Ok(index), true, false) | (Ok(index), false, true) => index + 1,
+            (Ok(index) | Err(index), _, _) => index,
+        };
+        self.leaf_id = leaf_id;
+        self.version = Some(version);
+        self.upcoming.clear();
+        self.replace_upcoming(upcoming, complete)
+    }
+
+    /// Make the pinned sibling, copied into `scratch`, the current leaf
+    fn enter(&mut self, pinned: PinnedPage<'a>, version: PageVersion) -> Result<(), Error> {
+        let page_id = pinned.page_id();
+        std::mem::swap(&mut self.leaf, &mut self.scratch);
+        self.leaf_id = page_id;
+        self.version = Some(version);
+        self.pinned = Some(pinned);
+        let node = NodeRef::new(page_id, &self.leaf)?;
+        if !node.is_leaf() {
+            return Err(Error::corruption(format!(
+                "B+Tree leaf sibling {page_id} is not a leaf"
+            )));
+        }
+        self.position = if self.forward { 0 } else { node.len() };
+
+        if self.upcoming.front() == Some(&page_id) {
+            self.upcoming.pop_front();
+        } else {
+            // Splits moved the leaves; the queue no longer predicts them
+            self.upcoming.clear();
+            self.upcoming_complete = false;
+        }
+        if self.upcoming.len() >= SCAN_PREFETCH_LEAVES / 2
+            || self.upcoming_complete
+            || node.is_empty()
+        {
+            return Ok(());
+        }
+        // Any key of the leaf leads back to it through its parent
+        let key = node.key(0);
+        let mut upcoming = Vec::new();
+        let mut complete = false;
+        let (forward, to) = (self.forward, &self.to);
+        self.tree.find_leaf(&key, &mut self.scratch, |node| {
+            if !node.is_leaf() {
+                (upcoming, complete) = upcoming_from(forward, to, node, &key);
+            }
+        })?;
+        self.replace_upcoming(upcoming, complete)
+    }
+
+    /// Queue `leaves` as the ones after the current leaf and prefetch those
+    /// not queued before
+    fn replace_upcoming(&mut self, leaves: Vec<PageId>, complete: bool) -> Result<(), Error> {
+        let fresh: Vec<PageId> = leaves
+            .iter()
+            .copied()
+            .filter(|page_id| !self.upcoming.contains(page_id))
+            .collect();
+        self.upcoming = leaves.into();
+        self.upcoming_complete = complete;
+        self.tree.pool().prefetch(&fresh)
+    }
+}
+
+/// Leaves after the child of internal `node` that holds `key`, in scan
+/// order, up to [`SCAN_PREFETCH_LEAVES`] and within the range ending at
+/// `to`; and whether they run to the end of the node or the range
+///
+/// A descent calls this for each internal node, so the leaf's parent has
+/// the last word.
+fn upcoming_from(
+    forward: bool,
+    to: &Bound<Vec<u8>>,
+    node: &NodeRef<'_>,
+    key: &[u8],
+) -> (Vec<PageId>, bool) {
+    let position = node.child_position(key);
+    let mut leaves = Vec::with_capacity(SCAN_PREFETCH_LEAVES);
+    for step in 1..=SCAN_PREFETCH_LEAVES {
+        let child = if forward {
+            position + step
+        } else if let Some(child) = position.checked_sub(step) {
+            child
+        } else {
+            return (leaves, true);
+        };
+        if child > node.len() || !child_in_range(forward, to, node, child) {
+            return (leaves, true);
+        }
+        // A pointer that does not decode only costs its prefetch; the scan
+        // reports the corruption if it gets there
+        let Ok(page_id) = node.child_at(child) else {
+            return (leaves, true);
+        };
+        leaves.push(page_id);
+    }
+    (leaves, false)
+}
+
+/// Whether child `position` of `node` may hold keys before `to`
+fn child_in_range(forward: bool, to: &Bound<Vec<u8>>, node: &NodeRef<'_>, position: usize) -> bool {
+    if forward {
+        // The child holds keys from separator `position - 1` up
+        position == 0
+            || match to {
+                Bound::Unbounded => true,
+                Bound::Included(to) => node.key(position - 1) <= *to,
+                Bound::Excluded(to) => node.key(position - 1) < *to,
+            }
+    } else {
+        // The child holds keys below separator `position`
+        position == node.len()
+            || match to {
+                Bound::Unbounded => true,
+                Bound::Included(to) | Bound::Excluded(to) => node.key(position) > *to,
+            }
+    }
+}
+
+impl Iterator for RangeCursor<'_> {
+    type Item = Result<KeyValue, Error>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.done {
+            return None;
+        }
+        let result = self.step();
+        if !matches!(result, Ok(Some(_))) {
+            self.done = true;
+            self.pinned = None;
+        }
+        result.transpose()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::index::btree_node::{self, Entry};
+
+    /// Internal node with children 100..=140 between separators 10, 20, ... 400
+    fn internal(page: &mut Page) -> NodeRef<'_> {
+        let entries: Vec<Entry> = (1..=40u16)
+            .map(|i| Entry::child(&(i * 10).to_be_bytes(), 100 + PageId::from(i)))
+            .collect();
+        btree_node::build(page, 7, false, 100, &entries).unwrap();
+        NodeRef::new(7, page).unwrap()
+    }
+
+    #[test]
+    fn test_upcoming_follows_direction_and_stops_at_range_end() {
+        let mut page = Page::new();
+        let node = internal(&mut page);
+        let key = 55u16.to_be_bytes();
+
+        let (leaves, complete) = upcoming_from(true, &Bound::Unbounded, &node, &key);
+        assert_eq!(
+            leaves,
+            (106..106 + SCAN_PREFETCH_LEAVES as PageId).collect::<Vec<_>>()
+        );
+        assert!(!complete);
+        let (leaves, complete) = upcoming_from(false, &Bound::Unbounded, &node, &key);
+        assert_eq!(leaves, [104, 103, 102, 101, 100]);
+        assert!(complete);
+
+        // The child from 80 still holds 80; the one from 90 does not
+        let to = Bound::Included(80u16.to_be_bytes().to_vec());
+        assert_eq!(upcoming_from(true, &to, &node, &key).0, [106, 107, 108]);
+        let to = Bound::Excluded(80u16.to_be_bytes().to_vec());
+        assert_eq!(upcoming_from(true, &to, &node, &key).0, [106, 107]);
+        // The child below 30 holds nothing at or above 30
+        let to = Bound::Included(30u16.to_be_bytes().to_vec());
+        assert_eq!(upcoming_from(false, &to, &node, &key).0, [104, 103]);
+
+        let last = 400u16.to_be_bytes();
+        assert_eq!(
+            upcoming_from(true, &Bound::Unbounded, &node, &last),
+            (vec![], true)
+        );
+    }
+}
@@ -0,0 +1,391 @@
+//! Bottom-up B+Tree construction from sorted input
+//!
+//! [`BulkLoader`] builds a tree from entries given in ascending key order
+//! without descending it once per key. Each level has one open node.
+//! Entries go into the leaf level's node until the next one would take it
+//! past the fill factor. The node is then sealed, and a separator for the
+//! next node goes into the level above, which seals its own nodes the same
+//! way. Sealed nodes are never read again, so they are written straight
+//! to the file rather than through the buffer pool.
+//!
+//! Every level takes its pages from whole extents of the
+//! [`PageAllocator`], in order. Leaves are therefore written as long
+//! sequential runs, and a later scan reads them back the same way. Each
+//! leaf's page is chosen before its predecessor is sealed, so leaves are
+//! written with their sibling links already set. The unused pages of each
+//! level's last extent are freed when the load finishes.
+
+use crate::common::error::Error;
+use crate::index::btree::{check_entry, child_of, BTree};
+use crate::index::btree_node::{
+    self, common_prefix_len, shortest_separator, Entry, NODE_HEADER_SIZE,
+};
+use crate::storage::buffer_pool::BufferPool;
+use crate::storage::page::Page;
+use crate::storage::page_allocator::{Extent, PageAllocator, EXTENT_PAGES};
+use crate::storage::page_constants::{PageId, INVALID_PAGE_ID, PAGE_USABLE_SIZE};
+use std::sync::Arc;
+
+/// Default share of each node, in percent, that a bulk load fills
+pub const DEFAULT_FILL_PERCENT: usize = 90;
+
+/// Lowest accepted fill percentage
+pub const MIN_FILL_PERCENT: usize = 10;
+
+/// Sealed nodes a level collects before writing them as one batch
+#[allow(clippy::cast_possible_truncation)]
+const WRITE_BATCH_PAGES: usize = EXTENT_PAGES as usize;
+
+/// Bulk load configuration
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct BulkLoadConfig {
+    /// Share of each node, in percent, filled before the next node is
+    /// started. Below 100 leaves room for later inserts without splits.
+    pub fill_percent: usize,
+}
+
+impl Default for BulkLoadConfig {
+    fn default() -> Self {
+        Self {
+            fill_percent: DEFAULT_FILL_PERCENT,
+        }
+    }
+}
+
+/// The open node of one tree level
+struct Level {
+    leaf: bool,
+    page_id: PageId,
+    leftmost: PageId,
+    /// Last sealed node, the open leaf's previous sibling
+    prev: PageId,
+    entries: Vec<Entry>,
+    /// Sum of the entries' sizes without prefix compression
+    raw_size: usize,
+    /// Extent the level takes pages from, and pages used from it
+    extent: Option<Extent>,
+    used: u64,
+    /// Sealed nodes not yet written
+    pending: Vec<(PageId, Page)>,
+}
+
+impl Level {
+    fn new(leaf: bool, leftmost: PageId) -> Self {
+        Self {
+            leaf,
+            page_id: INVALID_PAGE_ID,
+            leftmost,
+            prev: INVALID_PAGE_ID,
+            entries: Vec::new(),
+            raw_size: 0,
+            extent: None,
+            used: 0,
+            pending: Vec::with_capacity(WRITE_BATCH_PAGES),
+        }
+    }
+
+    /// Node size if `entry` were added
+    fn size_with(&self, entry: &Entry) -> usize {
+        let prefix_len = self.entries.first().map_or(entry.key.len(), |first| {
+            common_prefix_len(&first.key, &entry.key)
+        });
+        let count = self.entries.len() + 1;
+        NODE_HEADER_SIZE + prefix_len + self.raw_size + entry.encoded_size(self.page_id, 0)
+            - count * prefix_len
+    }
+
+    fn push(&mut self, entry: Entry) {
+        self.raw_size += entry.encoded_size(self.page_id, 0);
+        self.entries.push(entry);
+    }
+
+    /// Build the open node into a pending page; a leaf links to `next`
+    fn seal(&mut self, next: PageId) -> Result<(), Error> {
+        let mut page = Page::new();
+        page.header_mut().set_page_id(self.page_id);
+        btree_node::build(
+            &mut page,
+            self.page_id,
+            self.leaf,
+            self.leftmost,
+            &self.entries,
+        )?;
+        if self.leaf {
+            btree_node::set_prev_leaf(&mut page, self.prev);
+            btree_node::set_next_leaf(&mut page, next);
+        }
+        self.prev = self.page_id;
+        self.pending.push((self.page_id, page));
+        self.entries.clear();
+        self.raw_size = 0;
+        Ok(())
+    }
+}
+
+/// Builds a B+Tree from entries in ascending key order
+///
+/// Call [`finish`](Self::finish) to complete the tree. Dropping the loader
+/// without finishing releases its pages.
+pub struct BulkLoader {
+    pool: Arc<BufferPool>,
+    allocator: Arc<PageAllocator>,
+    /// Bytes of a node filled before it is sealed
+    fill_bytes: usize,
+    /// Open node of each level, leaves first
+    levels: Vec<Level>,
+    /// Extents taken so far
+    extents: Vec<Extent>,
+    entries: u64,
+    finished: bool,
+}
+
+impl BulkLoader {
+    /// Start an empty tree
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the fill percentage is outside
+    /// `MIN_FILL_PERCENT..=100`, or an error if no extent can be allocated
+    pub fn new(
+        pool: Arc<BufferPool>,
+        allocator: Arc<PageAllocator>,
+        config: BulkLoadConfig,
+    ) -> Result<Self, Error> {
+        if !(MIN_FILL_PERCENT..=100).contains(&config.fill_percent) {
+            return Err(Error::invalid_input(format!(
+                "Fill percentage {} is outside {MIN_FILL_PERCENT}..=100",
+                config.fill_percent
+            )));
+        }
+        let mut loader = Self {
+            pool,
+            allocator,
+            fill_bytes: PAGE_USABLE_SIZE * config.fill_percent / 100,
+            levels: vec![Level::new(true, INVALID_PAGE_ID)],
+            extents: Vec::new(),
+            entries: 0,
+            finished: false,
+        };
+        loader.levels[0].page_id = loader.next_page(0)?;
+        Ok(loader)
+    }
+
+    /// Number of entries added so far
+    pub fn len(&self) -> u64 {
+        self.entries
+    }
+
+    /// Whether no entry has been added yet
+    pub fn is_empty(&self) -> bool {
+        self.entries == 0
+    }
+
+    /// Append an entry; keys must be strictly ascending
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the key is not above the previous
+    /// one or the key or value is too long, or an error if a page cannot
+    /// be allocated or written
+    pub fn push(&mut self, key: &[u8], value: &[u8]) -> Result<(), Error> {
+        check_entry(key, value)?;
+        if let Some(last) = self.levels[0].entries.last() {
+            if key <= last.key.as_slice() {
+                return Err(Error::invalid_input(format!(
+                    "Bulk load key {} is not above the previous key",
+                    self.entries
+                )));
+            }
+        }
+        self.add(0, Entry::value(key, value))?;
+        self.entries += 1;
+        Ok(())
+    }
+
+    /// Seal and write the open nodes and return the tree
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a node cannot be written, the unused pages
+    /// cannot be released, or the file cannot be synced
+    pub fn finish(mut self) -> Result<BTree, Error> {
+        for level in &mut self.levels {
+            level.seal(INVALID_PAGE_ID)?;
+        }
+        for level in 0..self.levels.len() {
+            self.write_pending(level)?;
+        }
+        self.finished = true;
+        for level in &self.levels {
+            if let Some(extent) = level.extent {
+                for page_id in extent.start + level.used..extent.start + extent.len {
+                    self.allocator.free_page(page_id)?;
+                }
+            }
+        }
+        self.pool.sync_data()?;
+        let root = self
+            .levels
+            .last()
+            .map_or(INVALID_PAGE_ID, |top| top.page_id);
+        BTree::open(Arc::clone(&self.pool), Arc::clone(&self.allocator), root)
+    }
+
+    /// Add `entry` to the open node of `level`, sealing it first if the
+    /// entry would take it past the fill factor
+    fn add(&mut self, level: usize, entry: Entry) -> Result<(), Error> {
+        let open = &self.levels[level];
+        if open.entries.is_empty() || open.size_with(&entry) <= self.fill_bytes {
+            self.levels[level].push(entry);
+            return Ok(());
+        }
+
+        let (separator, leftmost, first) = if open.leaf {
+            let last = &open.entries[open.entries.len() - 1];
+            (
+                shortest_separator(&last.key, &entry.key),
+                INVALID_PAGE_ID,
+                Some(entry),
+            )
+        } else {
+            // The entry moves up; its child leads the next node
+            let child = child_of(&entry, open.page_id)?;
+            (entry.key, child, None)
+        };
+        let sealed = open.page_id;
+        let next = self.next_page(level)?;
+        self.levels[level].seal(next)?;
+        if self.levels[level].pending.len() >= WRITE_BATCH_PAGES {
+            self.write_pending(level)?;
+        }
+
+        let open = &mut self.levels[level];
+        open.page_id = next;
+        open.leftmost = leftmost;
+        if let Some(first) = first {
+            open.push(first);
+        }
+
+        if level + 1 == self.levels.len() {
+            self.levels.push(Level::new(false, sealed));
+            self.levels[level + 1].page_id = self.next_page(level + 1)?;
+        }
+        self.add(level + 1, Entry::child(&separator, next))
+    }
+
+    /// Next page of `level`'s extent, taking a new extent when it runs out
+    fn next_page(&mut self, level: usize) -> Result<PageId, Error> {
+        let open = &mut self.levels[level];
+        match open.extent {
+            Some(extent) if open.used < extent.len => {
+                open.used += 1;
+                Ok(extent.start + open.used - 1)
+            }
+            _ => {
+                let extent = self.allocator.allocate_extent()?;
+                self.extents.push(extent);
+                open.extent = Some(extent);
+                open.used = 1;
+                Ok(extent.start)
+            }
+        }
+    }
+
+    fn write_pending(&mut self, level: usize) -> Result<(), Error> {
+        let pending = &mut self.levels[level].pending;
+        if !pending.is_empty() {
+            self.pool.write_unbuffered(pending)?;
+            pending.clear();
+        }
+        Ok(())
+    }
+}
+
+impl Drop for BulkLoader {
+    fn drop(&mut self) {
+        if !self.finished {
+            for extent in &self.extents {
+                // Best effort: the pages are unreferenced either way
+                let _ = self.allocator.free_extent(*extent);
+            }
+        }
+    }
+}
+
+impl BTree {
+    /// Build a tree from `entries`, which must be in strictly ascending
+    /// key order
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the entries are out of order or
+    /// too long, or an error if a node cannot be allocated or written
+    pub fn bulk_load<K, V>(
+        pool: Arc<BufferPool>,
+        allocator: Arc<PageAllocator>,
+        config: BulkLoadConfig,
+        entries: impl IntoIterator<Item = (K, V)>,
+    ) -> Result<Self, Error>
+    where
+        K: AsRef<[u8]>,
+        V: AsRef<[u8]>,
+    {
+        let mut loader = BulkLoader::new(pool, allocator, config)?;
+        for (key, value) in entries {
+            loader.push(key.as_ref(), value.as_ref())?;
+        }
+        loader.finish()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::index::btree_node::{fits, NodeRef};
+    use crate::storage::buffer_pool::BufferPoolConfig;
+    use crate::storage::page_constants::PAGE_SIZE;
+    use tempfile::NamedTempFile;
+
+    #[test]
+    fn test_size_with_matches_built_node() {
+        let mut level = Level::new(true, INVALID_PAGE_ID);
+        level.page_id = 70;
+        for i in 0..50u32 {
+            let entry = Entry::value(format!("key-{:06}", i * 37).as_bytes(), &[0; 9]);
+            let expected = level.size_with(&entry);
+            level.push(entry);
+            assert_eq!(expected, btree_node::node_size(70, &level.entries));
+        }
+        assert!(fits(70, &level.entries));
+    }
+
+    #[test]
+    fn test_leaves_are_consecutive_pages() {
+        let temp = NamedTempFile::new().unwrap();
+        let config = BufferPoolConfig {
+            memory_budget: 16 * PAGE_SIZE,
+            ..Default::default()
+        };
+        let pool = Arc::new(BufferPool::open(temp.path(), config).unwrap());
+        let entries = (0..5000u32).map(|i| (i.to_be_bytes(), [7u8; 40]));
+        let tree = BTree::bulk_load(
+            Arc::clone(&pool),
+            Arc::new(PageAllocator::new()),
+            BulkLoadConfig::default(),
+            entries,
+        )
+        .unwrap();
+        assert_eq!(tree.height().unwrap(), 2);
+
+        let guard = pool.read_page(tree.root()).unwrap();
+        let root = NodeRef::new(tree.root(), &guard).unwrap();
+        let mut children = vec![root.leftmost_child()];
+        for index in 0..root.len() {
+            children.push(root.child(index).unwrap());
+        }
+        // Leaves fill whole extents, in order
+        assert!(children.windows(2).all(|pair| pair[1] == pair[0] + 1
+            || ((pair[0] + 1) % EXTENT_PAGES == 0 && pair[1] % EXTENT_PAGES == 0)));
+        assert!(children.len() > WRITE_BATCH_PAGES);
+    }
+}
@@ -0,0 +1,603 @@
+//! Page layout of B+Tree nodes
+//!
+//! A node is a `PageType::BTreeLeaf` or `PageType::BTreeInternal` page.
+//! Every key in a node starts with the node's prefix, which is stored once
+//! in the node header. Entries only hold the rest of the key. Slots are
+//! sorted by key and split into two dense arrays, the [`key_head`]s of the
+//! entries and their offsets; the entries grow down from the end of the
+//! page:
+//!
+//! ```text
+//! | header | prefix | heads 0..n | offsets 0..n | ->  free  <- | entry 1 | entry 0 |
+//! ```
+//!
+//! The prefix is the common prefix of the node's first and last key, so
+//! adjacent keys such as `user:000123`, `user:000124` store only a few
+//! bytes each. Internal nodes hold separators cut down to the shortest
+//! byte string between two leaves (see [`shortest_separator`]), and child
+//! pointers are relative [`page_pointer`](crate::storage::page_pointer)
+//! varints. Together they keep fan-out close to the page size divided by a
+//! few bytes.
+//!
+//! Node header layout (start of the data area):
+//!
+//! | Offset | Size | Field                                          |
+//! |--------|------|------------------------------------------------|
+//! | 0      | 2    | entry count (LE)                               |
+//! | 2      | 2    | start of the entry area (LE)                   |
+//! | 4      | 2    | bytes of holes in the entry area (LE)          |
+//! | 6      | 2    | prefix length (LE)                             |
+//! | 8      | 8    | leftmost child (internal nodes), 0 in leaves   |
+//! | 16     | 8    | previous leaf (leaves), 0 in internal nodes    |
+//! | 24     | 8    | next leaf (leaves), 0 in internal nodes        |
+//! | 32     | n    | prefix                                         |
+//!
+//! A slot is the 4-byte head of the entry's suffix and the u16 offset of
+//! the entry. Searches run over the head array (see
+//! [`key_head`](crate::index::key_head)) and only read entries whose head
+//! ties with the key. Leaf entries are
+//! `suffix length u16, value length u16, suffix, value`. Internal entries
+//! are `suffix length u16, child pointer, suffix`; the child holds keys at
+//! or above the separator and below the next one, and the leftmost child
+//! holds keys below the first separator.
+//!
+//! Leaves are linked to their neighbours in key order, with 0 at either
+//! end, so range scans move between leaves without going back up the tree.
+
+use crate::common::error::Error;
+use crate::index::key_head::{self, encode_head, key_head, HEAD_SIZE};
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PageId, INVALID_PAGE_ID, PAGE_HEADER_SIZE, PAGE_USABLE_SIZE};
+use crate::storage::page_pointer::{decode_pointer, encode_pointer, pointer_len, MAX_POINTER_LEN};
+use crate::storage::page_type::PageType;
+use std::cmp::Ordering;
+use std::ops::Range;
+
+/// Bytes of the node header before the prefix
+pub const NODE_HEADER_SIZE: usize = 32;
+
+/// Longest key a tree accepts
+pub const MAX_KEY_LEN: usize = 256;
+
+/// Longest value a tree accepts; larger values belong in overflow pages
+pub const MAX_VALUE_LEN: usize = 1024;
+
+/// Space an internal node needs to take one more separator of any length
+pub const MAX_SEPARATOR_SPACE: usize = SLOT_SIZE + 2 + MAX_POINTER_LEN + MAX_KEY_LEN;
+
+const COUNT_OFFSET: usize = 0;
+const HEAP_START_OFFSET: usize = 2;
+const FRAGMENTED_OFFSET: usize = 4;
+const PREFIX_LEN_OFFSET: usize = 6;
+const LEFTMOST_OFFSET: usize = 8;
+const PREV_LEAF_OFFSET: usize = 16;
+const NEXT_LEAF_OFFSET: usize = 24;
+const OFFSET_SIZE: usize = 2;
+
+/// Bytes of one slot: the entry's key head and offset
+pub const SLOT_SIZE: usize = HEAD_SIZE + OFFSET_SIZE;
+
+/// What an entry maps its key to
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum Payload {
+    /// Value stored in a leaf
+    Value(Vec<u8>),
+    /// Child page of an internal node
+    Child(PageId),
+}
+
+/// A decoded node entry with its full key
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Entry {
+    /// Full key, including the node prefix
+    pub key: Vec<u8>,
+    /// Value or child page
+    pub payload: Payload,
+}
+
+impl Entry {
+    /// Leaf entry
+    pub fn value(key: &[u8], value: &[u8]) -> Self {
+        Self {
+            key: key.to_vec(),
+            payload: Payload::Value(value.to_vec()),
+        }
+    }
+
+    /// Internal entry
+    pub fn child(key: &[u8], child: PageId) -> Self {
+        Self {
+            key: key.to_vec(),
+            payload: Payload::Child(child),
+        }
+    }
+
+    /// Bytes of key and payload, ignoring prefix compression
+    pub fn approximate_size(&self) -> usize {
+        self.key.len()
+            + match &self.payload {
+                Payload::Value(value) => value.len(),
+                Payload::Child(_) => 4,
+            }
+    }
+
+    /// Bytes the entry takes in node `page_id`, slot included, when
+    /// `prefix_len` bytes of its key are in the node prefix
+    pub fn encoded_size(&self, page_id: PageId, prefix_len: usize) -> usize {
+        let suffix = self.key.len() - prefix_len;
+        SLOT_SIZE
+            + match &self.payload {
+                Payload::Value(value) => 4 + suffix + value.len(),
+                Payload::Child(child) => 2 + pointer_len(page_id, *child) + suffix,
+            }
+    }
+}
+
+fn read_u64(data: &[u8], offset: usize) -> u64 {
+    let mut bytes = [0u8; 8];
+    bytes.copy_from_slice(&data[offset..offset + 8]);
+    u64::from_le_bytes(bytes)
+}
+
+fn read_u16(data: &[u8], offset: usize) -> usize {
+    usize::from(u16::from_le_bytes([data[offset], data[offset + 1]]))
+}
+
+#[allow(clippy::cast_possible_truncation)]
+fn write_u16(data: &mut [u8], offset: usize, value: usize) {
+    data[offset..offset + 2].copy_from_slice(&(value as u16).to_le_bytes());
+}
+
+/// Length of the common prefix of two byte strings
+pub fn common_prefix_len(a: &[u8], b: &[u8]) -> usize {
+    a.iter().zip(b).take_while(|(x, y)| x == y).count()
+}
+
+/// Shortest key `s` with `left < s <= right`, for `left < right`
+///
+/// Used as the separator when a leaf splits between `left` and `right`.
+pub fn shortest_separator(left: &[u8], right: &[u8]) -> Vec<u8> {
+    right[..(common_prefix_len(left, right) + 1).min(right.len())].to_vec()
+}
+
+/// Read-only view of a node page
+#[derive(Clone, Copy)]
+pub struct NodeRef<'a> {
+    data: &'a [u8],
+    page_id: PageId,
+    leaf: bool,
+}
+
+impl<'a> NodeRef<'a> {
+    /// View node `page_id`
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidPageType` if the page is not a B+Tree node,
+    /// or `Error::Corruption` if its header is inconsistent
+    pub fn new(page_id: PageId, page: &'a Page) -> Result<Self, Error> {
+        let leaf = match page.header().page_type {
+            PageType::BTreeLeaf => true,
+            PageType::BTreeInternal => false,
+            other => return Err(Error::InvalidPageType(other as u8)),
+        };
+        let data = page.data();
+        let node = Self {
+            data,
+            page_id,
+            leaf,
+        };
+        if node.slots_end() > read_u16(data, HEAP_START_OFFSET)
+            || read_u16(data, HEAP_START_OFFSET) > data.len()
+        {
+            return Err(Error::corruption(format!(
+                "B+Tree node {page_id} has an invalid header"
+            )));
+        }
+        Ok(node)
+    }
+
+    /// Whether the node is a leaf
+    pub fn is_leaf(&self) -> bool {
+        self.leaf
+    }
+
+    /// Number of entries
+    pub fn len(&self) -> usize {
+        read_u16(self.data, COUNT_OFFSET)
+    }
+
+    /// Whether the node has no entries
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Bytes every key in the node starts with
+    pub fn prefix(&self) -> &'a [u8] {
+        let len = read_u16(self.data, PREFIX_LEN_OFFSET);
+        &self.data[NODE_HEADER_SIZE..NODE_HEADER_SIZE + len]
+    }
+
+    /// Child holding keys below the first separator
+    pub fn leftmost_child(&self) -> PageId {
+        read_u64(self.data, LEFTMOST_OFFSET)
+    }
+
+    /// Leaf before this one in key order, `INVALID_PAGE_ID` for the first
+    pub fn prev_leaf(&self) -> PageId {
+        read_u64(self.data, PREV_LEAF_OFFSET)
+    }
+
+    /// Leaf after this one in key order, `INVALID_PAGE_ID` for the last
+    pub fn next_leaf(&self) -> PageId {
+        read_u64(self.data, NEXT_LEAF_OFFSET)
+    }
+
+    /// Start of the entry area, as an offset into the data area
+    pub fn heap_start(&self) -> usize {
+        read_u16(self.data, HEAP_START_OFFSET)
+    }
+
+    /// Raw page ranges to log after a change: the headers, prefix and slot
+    /// arrays, then the entry area up to data-area offset `entries_end`
+    ///
+    /// The free space between the slot arrays and the entry area is left
+    /// out; nothing reads it.
+    pub fn changed_ranges(&self, entries_end: usize) -> Vec<Range<usize>> {
+        let mut ranges = Vec::with_capacity(2);
+        ranges.push(0..PAGE_HEADER_SIZE + self.slots_end());
+        if entries_end > self.heap_start() {
+            ranges.push(PAGE_HEADER_SIZE + self.heap_start()..PAGE_HEADER_SIZE + entries_end);
+        }
+        ranges
+    }
+
+    /// Whether [`try_insert`] would place `entry` without a rebuild
+    pub fn fits_in_place(&self, entry: &Entry) -> bool {
+        entry.key.starts_with(self.prefix())
+            && entry.encoded_size(self.page_id, self.prefix().len())
+                <= self.heap_start() - self.slots_end()
+    }
+
+    /// Bytes available for entries, counting holes
+    pub fn free_space(&self) -> usize {
+        read_u16(self.data, HEAP_START_OFFSET) - self.slots_end()
+            + read_u16(self.data, FRAGMENTED_OFFSET)
+    }
+
+    /// Key of entry `index` without the node prefix
+    pub fn suffix(&self, index: usize) -> &'a [u8] {
+        let offset = self.entry_offset(index);
+        let len = read_u16(self.data, offset);
+        let start = offset + 2 + self.payload_header_len(offset);
+        &self.data[start..start + len]
+    }
+
+    /// Full key of entry `index`
+    pub fn key(&self, index: usize) -> Vec<u8> {
+        [self.prefix(), self.suffix(index)].concat()
+    }
+
+    /// Value of leaf entry `index`
+    pub fn value(&self, index: usize) -> &'a [u8] {
+        debug_assert!(self.leaf);
+        let offset = self.entry_offset(index);
+        let start = offset + 4 + read_u16(self.data, offset);
+        &self.data[start..start + read_u16(self.data, offset + 2)]
+    }
+
+    /// Child page of internal entry `index`
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if the pointer cannot be decoded
+    pub fn child(&self, index: usize) -> Result<PageId, Error> {
+        debug_assert!(!self.leaf);
+        let offset = self.entry_offset(index) + 2;
+        Ok(decode_pointer(self.page_id, &self.data[offset..])?.0)
+    }
+
+    /// Find `key` the way `slice::binary_search` does
+    ///
+    /// # Errors
+    ///
+    /// Returns `Err` with the index where `key` would be inserted if it is
+    /// not in the node
+    pub fn search(&self, key: &[u8]) -> Result<usize, usize> {
+        let prefix = self.prefix();
+        let shared = prefix.len().min(key.len());
+        match key[..shared].cmp(&prefix[..shared]) {
+            Ordering::Less => return Err(0),
+            Ordering::Greater => return Err(self.len()),
+            Ordering::Equal if key.len() < prefix.len() => return Err(0),
+            Ordering::Equal => {}
+        }
+        let rest = &key[prefix.len()..];
+        let (mut low, mut high) = key_head::equal_range(self.heads(), key_head(rest));
+        while low < high {
+            let mid = usize::midpoint(low, high);
+            match self.suffix(mid).cmp(rest) {
+                Ordering::Less => low = mid + 1,
+                Ordering::Greater => high = mid,
+                Ordering::Equal => return Ok(mid),
+            }
+        }
+        Err(low)
+    }
+
+    /// Position of the child whose range holds `key`: 0 for the leftmost
+    /// child, `i + 1` for the child of entry `i`
+    pub fn child_position(&self, key: &[u8]) -> usize {
+        match self.search(key) {
+            Ok(index) => index + 1,
+            Err(index) => index,
+        }
+    }
+
+    /// Child at a [`child_position`](Self::child_position)
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if the pointer cannot be decoded
+    pub fn child_at(&self, position: usize) -> Result<PageId, Error> {
+        if position == 0 {
+            Ok(self.leftmost_child())
+        } else {
+            self.child(position - 1)
+        }
+    }
+
+    /// Child whose range holds `key`
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if the pointer cannot be decoded
+    pub fn child_for(&self, key: &[u8]) -> Result<PageId, Error> {
+        self.child_at(self.child_position(key))
+    }
+
+    /// Decode every entry with its full key
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if a child pointer cannot be decoded
+    pub fn entries(&self) -> Result<Vec<Entry>, Error> {
+        (0..self.len())
+            .map(|index| {
+                let payload = if self.leaf {
+                    Payload::Value(self.value(index).to_vec())
+                } else {
+                    Payload::Child(self.child(index)?)
+                };
+                Ok(Entry {
+                    key: self.key(index),
+                    payload,
+                })
+            })
+            .collect()
+    }
+
+    /// Bytes entry `index` takes, slot included
+    fn entry_size(&self, index: usize) -> usize {
+        let offset = self.entry_offset(index);
+        let suffix = read_u16(self.data, offset);
+        let value = if self.leaf {
+            read_u16(self.data, offset + 2)
+        } else {
+            0
+        };
+        SLOT_SIZE + 2 + self.payload_header_len(offset) + suffix + value
+    }
+
+    /// Bytes between an entry's suffix length and its suffix
+    fn payload_header_len(&self, offset: usize) -> usize {
+        if self.leaf {
+            2
+        } else {
+            decode_pointer(self.page_id, &self.data[offset + 2..]).map_or(0, |(_, len)| len)
+        }
+    }
+
+    fn entry_offset(&self, index: usize) -> usize {
+        read_u16(self.data, self.offsets_start() + index * OFFSET_SIZE)
+    }
+
+    fn heads(&self) -> &'a [u8] {
+        &self.data[self.slots_start()..self.offsets_start()]
+    }
+
+    fn slots_start(&self) -> usize {
+        NODE_HEADER_SIZE + read_u16(self.data, PREFIX_LEN_OFFSET)
+    }
+
+    fn offsets_start(&self) -> usize {
+        self.slots_start() + self.len() * HEAD_SIZE
+    }
+
+    fn slots_end(&self) -> usize {
+        self.slots_start() + self.len() * SLOT_SIZE
+    }
+}
+
+/// Bytes a node built from `entries` needs, header and prefix included
+pub fn node_size(page_id: PageId, entries: &[Entry]) -> usize {
+    let prefix_len = entries_prefix_len(entries);
+    NODE_HEADER_SIZE
+        + prefix_len
+        + entries
+            .iter()
+            .map(|entry| entry.encoded_size(page_id, prefix_len))
+            .sum::<usize>()
+}
+
+/// Whether `entries` fit in one node
+pub fn fits(page_id: PageId, entries: &[Entry]) -> bool {
+    node_size(page_id, entries) <= PAGE_USABLE_SIZE
+}
+
+fn entries_prefix_len(entries: &[Entry]) -> usize {
+    match (entries.first(), entries.last()) {
+        (Some(first), Some(last)) => common_prefix_len(&first.key, &last.key),
+        _ => 0,
+    }
+}
+
+/// Rewrite `page` as a node holding `entries`, which must be sorted and
+/// fit (see [`fits`])
+///
+/// A leaf rebuilt as a leaf keeps its sibling links; any other node starts
+/// without them.
+///
+/// # Errors
+///
+/// Returns `Error::InvalidInput` if the entries do not fit, or
+/// `Error::Internal` if a leaf is given child entries or the reverse
+pub fn build(
+    page: &mut Page,
+    page_id: PageId,
+    leaf: bool,
+    leftmost: PageId,
+    entries: &[Entry],
+) -> Result<(), Error> {
+    if !fits(page_id, entries) {
+        return Err(Error::invalid_input(format!(
+            "{} entries do not fit in node {page_id}",
+            entries.len()
+        )));
+    }
+    let mut links = [0u8; 16];
+    if leaf && page.header().page_type == PageType::BTreeLeaf {
+        links.copy_from_slice(&page.data()[PREV_LEAF_OFFSET..NEXT_LEAF_OFFSET + 8]);
+    }
+    page.header_mut().page_type = if leaf {
+        PageType::BTreeLeaf
+    } else {
+        PageType::BTreeInternal
+    };
+    let prefix_len = entries_prefix_len(entries);
+    let data = page.data_mut();
+    data.fill(0);
+    data[PREV_LEAF_OFFSET..NEXT_LEAF_OFFSET + 8].copy_from_slice(&links);
+    write_u16(data, PREFIX_LEN_OFFSET, prefix_len);
+    write_u16(data, HEAP_START_OFFSET, data.len());
+    data[LEFTMOST_OFFSET..LEFTMOST_OFFSET + 8].copy_from_slice(&leftmost.to_le_bytes());
+    if let Some(first) = entries.first() {
+        data[NODE_HEADER_SIZE..NODE_HEADER_SIZE + prefix_len]
+            .copy_from_slice(&first.key[..prefix_len]);
+    }
+    let heads_start = NODE_HEADER_SIZE + prefix_len;
+    let offsets_start = heads_start + entries.len() * HEAD_SIZE;
+    for (index, entry) in entries.iter().enumerate() {
+        if leaf != matches!(entry.payload, Payload::Value(_)) {
+            return Err(Error::internal(format!(
+                "Wrong entry kind for node {page_id}"
+            )));
+        }
+        let offset = write_entry(data, page_id, prefix_len, entry);
+        let head = heads_start + index * HEAD_SIZE;
+        data[head..head + HEAD_SIZE]
+            .copy_from_slice(&encode_head(key_head(&entry.key[prefix_len..])));
+        write_u16(data, offsets_start + index * OFFSET_SIZE, offset);
+    }
+    write_u16(data, COUNT_OFFSET, entries.len());
+    Ok(())
+}
+
+/// Format `page` as an empty leaf
+///
+/// # Panics
+///
+/// Never panics; an empty leaf always fits
+pub fn init_leaf(page: &mut Page, page_id: PageId) {
+    build(page, page_id, true, INVALID_PAGE_ID, &[]).expect("an empty leaf always fits");
+}
+
+/// Set the previous-leaf link of leaf `page`
+pub fn set_prev_leaf(page: &mut Page, prev: PageId) {
+    page.data_mut()[PREV_LEAF_OFFSET..PREV_LEAF_OFFSET + 8].copy_from_slice(&prev.to_le_bytes());
+}
+
+/// Set the next-leaf link of leaf `page`
+pub fn set_next_leaf(page: &mut Page, next: PageId) {
+    page.data_mut()[NEXT_LEAF_OFFSET..NEXT_LEAF_OFFSET + 8].copy_from_slice(&next.to_le_bytes());
+}
+
+/// Carve an entry off the front of the entry area; returns its offset
+fn write_entry(data: &mut [u8], page_id: PageId, prefix_len: usize, entry: &Entry) -> usize {
+    let size = entry.encoded_size(page_id, prefix_len) - SLOT_SIZE;
+    let offset = read_u16(data, HEAP_START_OFFSET) - size;
+    write_u16(data, HEAP_START_OFFSET, offset);
+    let suffix = &entry.key[prefix_len..];
+    write_u16(data, offset, suffix.len());
+    let start = match &entry.payload {
+        Payload::Value(value) => {
+            write_u16(data, offset + 2, value.len());
+            let start = offset + 4 + suffix.len();
+            data[start..start + value.len()].copy_from_slice(value);
+            offset + 4
+        }
+        Payload::Child(child) => {
+            let len = encode_pointer(page_id, *child, &mut data[offset + 2..])
+                .expect("entry space includes the pointer");
+            offset + 2 + len
+        }
+    };
+    data[start..start + suffix.len()].copy_from_slice(suffix);
+    offset
+}
+
+/// Insert `entry` at slot `index` without rebuilding the node
+///
+/// Returns `false`, leaving the node unchanged, if the key does not start
+/// with the node prefix or there is no contiguous room for the entry; the
+/// caller then rebuilds or splits the node, which also closes holes.
+pub fn try_insert(page: &mut Page, page_id: PageId, index: usize, entry: &Entry) -> bool {
+    let (prefix_len, slots_end, count) = match NodeRef::new(page_id, page) {
+        Ok(node) if node.fits_in_place(entry) => {
+            (node.prefix().len(), node.slots_end(), node.len())
+        }
+        _ => return false,
+    };
+    let data = page.data_mut();
+    let offset = write_entry(data, page_id, prefix_len, entry);
+    // Both arrays grow by one slot: offsets after the new one move past
+    // the new head and offset, the ones before it past the new head only,
+    // and heads after it past the new head
+    let heads_start = NODE_HEADER_SIZE + prefix_len;
+    let offsets_start = heads_start + count * HEAD_SIZE;
+    let split = offsets_start + index * OFFSET_SIZE;
+    data.copy_within(split..slots_end, split + SLOT_SIZE);
+    data.copy_within(offsets_start..split, offsets_start + HEAD_SIZE);
+    let head = heads_start + index * HEAD_SIZE;
+    data.copy_within(head..offsets_start, head + HEAD_SIZE);
+    data[head..head + HEAD_SIZE].copy_from_slice(&encode_head(key_head(&entry.key[prefix_len..])));
+    write_u16(data, split + SLOT_SIZE - OFFSET_SIZE, offset);
+    write_u16(data, COUNT_OFFSET, count + 1);
+    true
+}
+
+/// Remove entry `index`, leaving a hole in the entry area
+///
+/// # Panics
+///
+/// Panics if `page` is not a node or `index` is out of range
+pub fn remove(page: &mut Page, page_id: PageId, index: usize) {
+    let (size, slots_start, count) = {
+        let node = NodeRef::new(page_id, page).expect("caller checked the node");
+        (node.entry_size(index), node.slots_start(), node.len())
+    };
+    let data = page.data_mut();
+    // The reverse of the moves in `try_insert`
+    let offsets_start = slots_start + count * HEAD_SIZE;
+    let head = slots_start + index * HEAD_SIZE;
+    data.copy_within(head + HEAD_SIZE..offsets_start, head);
+    let split = offsets_start + index * OFFSET_SIZE;
+    data.copy_within(offsets_start..split, offsets_start - HEAD_SIZE);
+    data.copy_within(
+        split + OFFSET_SIZE..slots_start + count * SLOT_SIZE,
+        split - HEAD_SIZE,
+    );
+    write_u16(data, COUNT_OFFSET, count - 1);
+    let fragmented = read_u16(data, FRAGMENTED_OFFSET) + size - SLOT_SIZE;
+    write_u16(data, FRAGMENTED_OFFSET, fragmented);
+}
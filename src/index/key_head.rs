@@ -0,0 +1,212 @@
+//! Fixed-width key heads for in-node search
+//!
+//! A key head is the first four bytes of a key suffix, zero padded and
+//! read big-endian, so comparing heads as `u32` agrees with comparing the
+//! suffixes bytewise wherever the heads differ. B+Tree nodes keep the
+//! heads of their entries in one dense array, stored little-endian so a
+//! vector load yields the `u32` values directly. A lookup counts heads in
+//! that array and only compares full keys within the run of entries whose
+//! head ties with the search key.
+//!
+//! With the `simd` feature the count uses AVX2 or NEON when the CPU has
+//! them, chosen once at runtime; otherwise, and without the feature, it
+//! is a scalar loop.
+
+/// Bytes of a key head
+pub const HEAD_SIZE: usize = 4;
+
+/// Narrow by binary search until at most this many heads are left, then
+/// count the rest in one pass
+const SCAN_WINDOW: usize = 32;
+
+/// Head of a key suffix
+pub fn key_head(suffix: &[u8]) -> u32 {
+    let mut bytes = [0u8; HEAD_SIZE];
+    let len = suffix.len().min(HEAD_SIZE);
+    bytes[..len].copy_from_slice(&suffix[..len]);
+    u32::from_be_bytes(bytes)
+}
+
+/// Bytes of `head` as stored in a head array
+pub fn encode_head(head: u32) -> [u8; HEAD_SIZE] {
+    head.to_le_bytes()
+}
+
+/// Head `index` of a head array
+pub fn head_at(heads: &[u8], index: usize) -> u32 {
+    let start = index * HEAD_SIZE;
+    let mut bytes = [0u8; HEAD_SIZE];
+    bytes.copy_from_slice(&heads[start..start + HEAD_SIZE]);
+    u32::from_le_bytes(bytes)
+}
+
+/// Range of entries whose head equals `head` in a sorted head array
+///
+/// Entries before the range have smaller keys than any key with this
+/// head, and entries after it larger ones, so only the range needs full
+/// key comparisons.
+pub fn equal_range(heads: &[u8], head: u32) -> (usize, usize) {
+    let low = partition(heads, head);
+    let high = match head.checked_add(1) {
+        Some(next) => low + partition(&heads[low * HEAD_SIZE..], next),
+        None => heads.len() / HEAD_SIZE,
+    };
+    (low, high)
+}
+
+/// Number of heads below `target` in a sorted head array
+fn partition(heads: &[u8], target: u32) -> usize {
+    let (mut low, mut high) = (0, heads.len() / HEAD_SIZE);
+    while high - low > SCAN_WINDOW {
+        let mid = usize::midpoint(low, high);
+        if head_at(heads, mid) < target {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    low + count_below(&heads[low * HEAD_SIZE..high * HEAD_SIZE], target)
+}
+
+/// Number of heads below `target` in a head array
+#[cfg(not(feature = "simd"))]
+pub fn count_below(heads: &[u8], target: u32) -> usize {
+    count_below_scalar(heads, target)
+}
+
+/// Number of heads below `target` in a head array
+#[cfg(feature = "simd")]
+pub fn count_below(heads: &[u8], target: u32) -> usize {
+    use std::sync::OnceLock;
+
+    static KERNEL: OnceLock<fn(&[u8], u32) -> usize> = OnceLock::new();
+    KERNEL.get_or_init(simd::select)(heads, target)
+}
+
+/// Portable [`count_below`]
+pub fn count_below_scalar(heads: &[u8], target: u32) -> usize {
+    heads
+        .chunks_exact(HEAD_SIZE)
+        .filter(|head| u32::from_le_bytes([head[0], head[1], head[2], head[3]]) < target)
+        .count()
+}
+
+#[cfg(feature = "simd")]
+mod simd {
+    pub(super) fn select() -> fn(&[u8], u32) -> usize {
+        #[cfg(target_arch = "x86_64")]
+        if is_x86_feature_detected!("avx2") {
+            return x86::count_below;
+        }
+        #[cfg(target_arch = "aarch64")]
+        if std::arch::is_aarch64_feature_detected!("neon") {
+            return arm::count_below;
+        }
+        super::count_below_scalar
+    }
+
+    #[cfg(target_arch = "x86_64")]
+    mod x86 {
+        use super::super::{count_below_scalar, HEAD_SIZE};
+        use std::arch::x86_64::{
+            __m256i, _mm256_castsi256_ps, _mm256_cmpgt_epi32, _mm256_loadu_si256,
+            _mm256_movemask_ps, _mm256_set1_epi32, _mm256_xor_si256,
+        };
+
+        const LANES: usize = 8;
+
+        pub(super) fn count_below(heads: &[u8], target: u32) -> usize {
+            // SAFETY: only selected after AVX2 was detected at runtime
+            unsafe { count_below_avx2(heads, target) }
+        }
+
+        #[target_feature(enable = "avx2")]
+        // `loadu` has no alignment requirement
+        #[allow(
+            clippy::cast_possible_wrap,
+            clippy::cast_sign_loss,
+            clippy::cast_ptr_alignment
+        )]
+        unsafe fn count_below_avx2(heads: &[u8], target: u32) -> usize {
+            // AVX2 only compares signed lanes; flipping the sign bit of
+            // both sides makes that an unsigned comparison
+            let sign = _mm256_set1_epi32(i32::MIN);
+            let broadcast = _mm256_xor_si256(_mm256_set1_epi32(target as i32), sign);
+            let mut chunks = heads.chunks_exact(LANES * HEAD_SIZE);
+            let mut count = 0;
+            for chunk in &mut chunks {
+                // SAFETY: the chunk holds exactly one unaligned 256-bit load
+                let lanes = unsafe { _mm256_loadu_si256(chunk.as_ptr().cast::<__m256i>()) };
+                let below = _mm256_cmpgt_epi32(broadcast, _mm256_xor_si256(lanes, sign));
+                count += (_mm256_movemask_ps(_mm256_castsi256_ps(below)) as u32).count_ones();
+            }
+            count as usize + count_below_scalar(chunks.remainder(), target)
+        }
+    }
+
+    #[cfg(target_arch = "aarch64")]
+    mod arm {
+        use super::super::{count_below_scalar, HEAD_SIZE};
+        use std::arch::aarch64::{
+            vaddq_u32, vaddvq_u32, vcltq_u32, vdupq_n_u32, vld1q_u8, vreinterpretq_u32_u8,
+            vshrq_n_u32,
+        };
+
+        const LANES: usize = 4;
+
+        pub(super) fn count_below(heads: &[u8], target: u32) -> usize {
+            // SAFETY: only selected after NEON was detected at runtime
+            unsafe { count_below_neon(heads, target) }
+        }
+
+        #[target_feature(enable = "neon")]
+        unsafe fn count_below_neon(heads: &[u8], target: u32) -> usize {
+            let broadcast = vdupq_n_u32(target);
+            let mut totals = vdupq_n_u32(0);
+            let mut chunks = heads.chunks_exact(LANES * HEAD_SIZE);
+            for chunk in &mut chunks {
+                // SAFETY: the chunk holds exactly one 128-bit byte load
+                let lanes = vreinterpretq_u32_u8(unsafe { vld1q_u8(chunk.as_ptr()) });
+                // Below lanes are all ones; keep one bit of each
+                totals = vaddq_u32(totals, vshrq_n_u32::<31>(vcltq_u32(lanes, broadcast)));
+            }
+            vaddvq_u32(totals) as usize + count_below_scalar(chunks.remainder(), target)
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn heads(values: &[u32]) -> Vec<u8> {
+        values.iter().flat_map(|&head| encode_head(head)).collect()
+    }
+
+    #[test]
+    fn test_count_below_matches_scalar() {
+        let values: Vec<u32> = (0..100u32).map(|i| i.wrapping_mul(0x9E37_79B9)).collect();
+        let heads = heads(&values);
+        for len in 0..values.len() {
+            let window = &heads[..len * HEAD_SIZE];
+            for target in [0, 1, u32::MAX, 0x8000_0000, 0x7FFF_FFFF, values[len]] {
+                assert_eq!(
+                    count_below(window, target),
+                    count_below_scalar(window, target)
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn test_equal_range_finds_ties() {
+        let mut values: Vec<u32> = (0..200u32).map(|i| i / 3 * 0x0101_0101).collect();
+        values.push(u32::MAX);
+        values.push(u32::MAX);
+        let heads = heads(&values);
+        assert_eq!(equal_range(&heads, 0), (0, 3));
+        assert_eq!(equal_range(&heads, 10 * 0x0101_0101), (30, 33));
+        assert_eq!(equal_range(&heads, 5), (3, 3));
+        assert_eq!(equal_range(&heads, u32::MAX), (200, 202));
+    }
+}
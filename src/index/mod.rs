@@ -1,4 +1,7 @@
 //! Index implementations (B+Tree, Vector indexes, etc.)
 
-// Will be implemented in Phase 4+
-// pub mod btree;
+pub mod btree;
+pub mod btree_cursor;
+pub mod btree_loader;
+pub mod btree_node;
+pub mod key_head;
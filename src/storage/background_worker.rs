@@ -0,0 +1,129 @@
+//! Periodic background thread used by storage maintenance tasks
+//!
+//! A [`BackgroundWorker`] runs a task on a dedicated thread every `interval`,
+//! or sooner when [`wake`](BackgroundWorker::wake) is called. The thread is
+//! stopped and joined when the worker is dropped.
+
+use crate::common::error::Error;
+use parking_lot::{Condvar, Mutex};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::Duration;
+
+#[derive(Debug, Default)]
+struct Signal {
+    stop: bool,
+    woken: bool,
+}
+
+#[derive(Debug, Default)]
+struct Shared {
+    signal: Mutex<Signal>,
+    condvar: Condvar,
+}
+
+/// Handle to a periodic background thread
+#[derive(Debug)]
+pub struct BackgroundWorker {
+    shared: Arc<Shared>,
+    handle: Option<JoinHandle<()>>,
+}
+
+impl BackgroundWorker {
+    /// Spawn a thread that runs `task` every `interval` until stopped
+    ///
+    /// The thread also exits on its own once `task` returns `false`.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the thread cannot be spawned
+    pub fn spawn<F>(name: &str, interval: Duration, mut task: F) -> Result<Self, Error>
+    where
+        F: FnMut() -> bool + Send + 'static,
+    {
+        let shared = Arc::new(Shared::default());
+        let thread_shared = Arc::clone(&shared);
+        let handle = std::thread::Builder::new()
+            .name(name.to_string())
+            .spawn(move || loop {
+                {
+                    let mut signal = thread_shared.signal.lock();
+                    if !signal.stop && !signal.woken {
+                        thread_shared.condvar.wait_for(&mut signal, interval);
+                    }
+                    if signal.stop {
+                        return;
+                    }
+                    signal.woken = false;
+                }
+                if !task() {
+                    return;
+                }
+            })?;
+
+        Ok(Self {
+            shared,
+            handle: Some(handle),
+        })
+    }
+
+    /// Run the task as soon as possible instead of waiting for the interval
+    pub fn wake(&self) {
+        self.shared.signal.lock().woken = true;
+        self.shared.condvar.notify_one();
+    }
+
+    /// Stop the thread and wait for the current run of the task to finish
+    pub fn stop(mut self) {
+        self.shutdown();
+    }
+
+    fn shutdown(&mut self) {
+        self.shared.signal.lock().stop = true;
+        self.shared.condvar.notify_one();
+        if let Some(handle) = self.handle.take() {
+            if handle.join().is_err() {
+                log::error!("Background worker thread panicked");
+            }
+        }
+    }
+}
+
+impl Drop for BackgroundWorker {
+    fn drop(&mut self) {
+        self.shutdown();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    #[test]
+    fn test_worker_runs_on_wake_and_stops() {
+        let runs = Arc::new(AtomicUsize::new(0));
+        let counter = Arc::clone(&runs);
+        let worker = BackgroundWorker::spawn("test-worker", Duration::from_secs(3600), move || {
+            counter.fetch_add(1, Ordering::SeqCst);
+            true
+        })
+        .unwrap();
+
+        worker.wake();
+        while runs.load(Ordering::SeqCst) == 0 {
+            std::thread::yield_now();
+        }
+        worker.stop();
+        let after_stop = runs.load(Ordering::SeqCst);
+        std::thread::sleep(Duration::from_millis(10));
+        assert_eq!(runs.load(Ordering::SeqCst), after_stop);
+    }
+
+    #[test]
+    fn test_worker_exits_when_task_returns_false() {
+        let worker =
+            BackgroundWorker::spawn("test-worker", Duration::from_millis(1), || false).unwrap();
+        drop(worker);
+    }
+}
@@ -0,0 +1,1609 @@
+//! Buffer pool - a fixed set of 4KB page frames cached in memory
+//!
+//! The pool owns `capacity` aligned [`Page`] frames and maps resident page IDs
+//! to frames. Callers pin a page with [`BufferPool::fetch_page`], take a
+//! shared or exclusive latch on the frame through the returned
+//! [`PinnedPage`], and the pin is released when the handle is dropped.
+//! Unpinned frames are recycled with an [`LruKReplacer`]; dirty victims are
+//! written back (with a fresh checksum) before their frame is reused.
+//!
+//! The `PAGE_FLAG_PINNED` / `PAGE_FLAG_DIRTY` bits of each resident page
+//! header mirror the frame state. Both bits are excluded from the page
+//! checksum, so they never invalidate a resident page.
+//!
+//! Checksums are verified according to the configured
+//! [`VerificationPolicy`]. Resident pages are never re-verified. With
+//! `Deferred`, pages read from disk are queued for
+//! [`verify_pending`](BufferPool::verify_pending) (run periodically by
+//! [`spawn_verifier`](BufferPool::spawn_verifier)) instead of being checked
+//! inline. A page is always verified before [`PinnedPage::write`] hands it
+//! out, and a page found corrupt is never written back.
+//!
+//! Dirty pages can also be written out off the request path with
+//! [`flush_dirty`](BufferPool::flush_dirty), which the
+//! [`BackgroundFlusher`](crate::storage::page_flusher::BackgroundFlusher)
+//! threads call periodically. It copies each dirty page under a shared latch,
+//! writes the copies in page-ID order with vectored I/O, and only then clears
+//! the dirty bit (unless the page changed meanwhile), so readers are never
+//! blocked by disk writes. Each frame remembers the LSN of the change that
+//! first dirtied it; the smallest such LSN bounds the
+//! [`checkpoint_lsn`](BufferPool::checkpoint_lsn), after which recovery
+//! must replay the log.
+//!
+//! With a [`Wal`] attached ([`attach_wal`](BufferPool::attach_wal)), writers
+//! record their changes through [`PageWriteGuard::log_change`], which logs
+//! a full page image for the first change after the page was last clean and
+//! byte-range deltas afterwards. Every page write flushes the log up to the
+//! page's LSN first, LSNs are tracked in full 64-bit form, and
+//! [`checkpoint`](BufferPool::checkpoint) also checkpoints the log.
+//!
+//! Resident pages can also be read optimistically with
+//! [`read_versioned`](BufferPool::read_versioned), which neither pins nor
+//! latches. Each frame has a sequence number that is odd while its
+//! contents change: it is bumped when a [`PageWriteGuard`] is handed out
+//! and again when the guard is dropped, and when a page is loaded into the
+//! frame. A reader copies the page between two reads of the sequence and
+//! retries if they differ, so it writes to no shared memory. The
+//! [`PageVersion`] it gets back tells later whether the page has changed
+//! since the copy. Write-back and pinning only touch the header's flags
+//! and checksum, which optimistic readers do not rely on, so they leave
+//! the sequence alone.
+//!
+//! No disk I/O happens under the pool state mutex. A fetch that misses maps
+//! the page to a frame and takes the frame's exclusive latch under the
+//! mutex, then releases the mutex for the read; other fetchers of the same
+//! page pin the frame and wait on its latch. A dirty victim is written back
+//! under its own pin before its frame is reused.
+//!
+//! Lock ordering: the pool state mutex may be taken before a frame latch only
+//! for unpinned frames. Pinned frames are latched with the state mutex
+//! released, so holding a page guard while fetching another page cannot
+//! deadlock against a flush.
+
+use crate::common::error::Error;
+use crate::storage::background_worker::BackgroundWorker;
+use crate::storage::checksum::ChecksumAlgorithm;
+use crate::storage::file_growth::DEFAULT_PREALLOCATION_CHUNK;
+use crate::storage::file_header::FileHeader;
+use crate::storage::lru_k_replacer::{FrameId, LruKReplacer, DEFAULT_LRU_K};
+use crate::storage::lsn::{widen, Lsn};
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PageId, INVALID_PAGE_ID, PAGE_SIZE};
+use crate::storage::page_file::PageFile;
+use crate::storage::page_header::{PAGE_FLAGS_TRANSIENT, PAGE_FLAG_DIRTY};
+use crate::storage::page_ref::PageRef;
+use crate::storage::page_type::PageType;
+use crate::storage::verification::VerificationPolicy;
+use crate::storage::wal::Wal;
+use parking_lot::{Mutex, MutexGuard, RwLock, RwLockReadGuard, RwLockWriteGuard};
+use std::cell::UnsafeCell;
+use std::collections::{HashMap, VecDeque};
+use std::fs::File;
+use std::ops::{Deref, DerefMut, Range};
+use std::path::Path;
+use std::sync::atomic::{fence, AtomicBool, AtomicU32, AtomicU64, AtomicU8, AtomicUsize, Ordering};
+use std::sync::{Arc, OnceLock};
+use std::time::Duration;
+
+/// Default memory budget for buffered pages (32 MiB)
+pub const DEFAULT_BUFFER_POOL_BYTES: usize = 32 * 1024 * 1024;
+
+/// Buffer pool configuration
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct BufferPoolConfig {
+    /// Bytes of page frames the pool may hold (rounded down to whole pages)
+    pub memory_budget: usize,
+    /// K parameter of the LRU-K replacement policy
+    pub lru_k: usize,
+    /// Algorithm for checksums written and verified by the pool in files
+    /// without a [`FileHeader`]; a header's recorded algorithm takes
+    /// precedence
+    pub checksum: ChecksumAlgorithm,
+    /// When pages loaded from disk are verified. The pool never re-reads
+    /// resident pages, so `Always` behaves like `OnLoad`.
+    pub verification: VerificationPolicy,
+    /// Bytes by which the file grows, preallocated, when a write-back lands
+    /// past its end; 0 extends it one page at a time
+    pub preallocation_chunk: u64,
+}
+
+impl Default for BufferPoolConfig {
+    fn default() -> Self {
+        Self {
+            memory_budget: DEFAULT_BUFFER_POOL_BYTES,
+            lru_k: DEFAULT_LRU_K,
+            checksum: ChecksumAlgorithm::default(),
+            verification: VerificationPolicy::default(),
+            preallocation_chunk: DEFAULT_PREALLOCATION_CHUNK,
+        }
+    }
+}
+
+impl BufferPoolConfig {
+    /// Number of page frames that fit in the memory budget
+    pub fn frame_count(&self) -> usize {
+        self.memory_budget / PAGE_SIZE
+    }
+}
+
+/// Frame contents passed checksum verification (or were created in memory)
+const FRAME_VERIFIED: u8 = 0;
+/// Frame was loaded without verification and is queued for it
+const FRAME_PENDING: u8 = 1;
+/// Frame failed verification; it is never written back
+const FRAME_CORRUPT: u8 = 2;
+/// Frame is being loaded; its loader holds the exclusive latch
+const FRAME_LOADING: u8 = 3;
+/// Frame's load failed; it maps no page
+const FRAME_UNLOADED: u8 = 4;
+
+/// `rec_lsn` value of a clean frame
+const NO_REC_LSN: u64 = u64::MAX;
+
+/// Frame hint slot that names no frame
+const NO_FRAME: usize = usize::MAX;
+
+/// Optimistic copies tried before a read falls back to pinning
+const OPTIMISTIC_ATTEMPTS: usize = 4;
+
+/// Seqlock state of a frame, on its own cache line so that writers to one
+/// frame do not disturb readers of its neighbours
+#[repr(align(64))]
+struct FrameSequence {
+    /// Odd while the frame contents are being changed
+    sequence: AtomicU64,
+    /// Page mapped to the frame, `INVALID_PAGE_ID` while unmapped
+    page_id: AtomicU64,
+}
+
+impl FrameSequence {
+    fn new() -> Self {
+        Self {
+            sequence: AtomicU64::new(0),
+            page_id: AtomicU64::new(INVALID_PAGE_ID),
+        }
+    }
+
+    /// Mark the frame as changing; the caller holds its exclusive latch
+    fn begin_change(&self) {
+        self.sequence.fetch_add(1, Ordering::Relaxed);
+        fence(Ordering::Release);
+    }
+
+    fn end_change(&self) {
+        self.sequence.fetch_add(1, Ordering::Release);
+    }
+}
+
+/// The version of a page that [`BufferPool::read_versioned`] copied
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct PageVersion {
+    page_id: PageId,
+    frame: FrameId,
+    sequence: u64,
+}
+
+impl PageVersion {
+    /// ID of the copied page
+    pub fn page_id(&self) -> PageId {
+        self.page_id
+    }
+}
+
+/// Per-frame write-back bookkeeping, readable without the frame latch
+struct FlushState {
+    /// Mirrors the header dirty bit so flushers can scan without latching
+    dirty: AtomicBool,
+    /// Bumped whenever a write guard is handed out
+    version: AtomicU64,
+    /// LSN of the change that first dirtied the frame, or `NO_REC_LSN`
+    rec_lsn: AtomicU64,
+    /// A full page image was logged since the frame was last clean
+    imaged: AtomicBool,
+}
+
+impl FlushState {
+    fn new() -> Self {
+        Self {
+            dirty: AtomicBool::new(false),
+            version: AtomicU64::new(0),
+            rec_lsn: AtomicU64::new(NO_REC_LSN),
+            imaged: AtomicBool::new(false),
+        }
+    }
+
+    fn mark_clean(&self) {
+        self.dirty.store(false, Ordering::Release);
+        self.rec_lsn.store(NO_REC_LSN, Ordering::Release);
+        self.imaged.store(false, Ordering::Release);
+    }
+}
+
+/// Mutable pool bookkeeping guarded by a single mutex
+struct PoolState {
+    page_table: HashMap<PageId, FrameId>,
+    frame_pages: Vec<Option<PageId>>,
+    free_frames: Vec<FrameId>,
+    replacer: LruKReplacer,
+    /// Pages loaded under `Deferred` verification, oldest first
+    verify_queue: VecDeque<PageId>,
+}
+
+/// Result of [`BufferPool::claim_frame`]
+enum Slot<'a> {
+    /// The page already has a frame, now pinned; it may still be loading
+    Resident(PinnedPage<'a>),
+    /// A frame now mapped to the page, pinned and held under this latch
+    /// until the caller fills it
+    Claimed(FrameId, RwLockWriteGuard<'a, ()>),
+}
+
+/// Fixed-capacity page cache backed by a database file
+pub struct BufferPool {
+    frames: Box<[UnsafeCell<Page>]>,
+    latches: Box<[RwLock<()>]>,
+    pin_counts: Box<[AtomicU32]>,
+    /// `FRAME_*` verification state, changed only under the frame latch
+    verify_states: Box<[AtomicU8]>,
+    flush_states: Box<[FlushState]>,
+    sequences: Box<[FrameSequence]>,
+    /// Direct-mapped page ID to frame cache for optimistic readers; may be
+    /// stale, so readers check the frame's page ID
+    frame_hints: Box<[AtomicUsize]>,
+    state: Mutex<PoolState>,
+    file: PageFile,
+    verification: VerificationPolicy,
+    /// Highest page LSN written to disk so far, synced or not
+    flushed_lsn: AtomicU64,
+    /// `flushed_lsn` as of the start of the last successful sync
+    synced_lsn: AtomicU64,
+    /// Oldest `rec_lsn` of the pages written back since the last sync
+    /// began, or `NO_REC_LSN`; they stay unsafe to skip in recovery until
+    /// the next sync
+    unsynced_rec_lsn: AtomicU64,
+    /// Serializes syncs with checkpoint advances, so a page handed from
+    /// `unsynced_rec_lsn` to a running sync is never overlooked
+    sync_latch: Mutex<()>,
+    /// Log position from which recovery must replay; only moves forward
+    checkpoint_lsn: AtomicU64,
+    wal: OnceLock<Arc<Wal>>,
+}
+
+// SAFETY: Page contents in `frames` are only accessed while holding the
+// corresponding entry of `latches` (shared for reads, exclusive for writes).
+// All other state is behind mutexes or atomics.
+unsafe impl Sync for BufferPool {}
+unsafe impl Send for BufferPool {}
+
+impl BufferPool {
+    /// Create a buffer pool over an already opened database file
+    ///
+    /// If the file starts with a [`FileHeader`], pages are verified with the
+    /// checksum algorithm it records.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the memory budget is smaller than one
+    /// page or the header records pages other than 4 KiB, or an error if the
+    /// header cannot be read
+    pub fn new(file: File, config: BufferPoolConfig) -> Result<Self, Error> {
+        let capacity = config.frame_count();
+        if capacity == 0 {
+            return Err(Error::invalid_input(format!(
+                "Buffer pool budget of {} bytes is smaller than one page",
+                config.memory_budget
+            )));
+        }
+
+        let file = PageFile::from_file(file);
+        let checksum = match FileHeader::read_if_present(&file)? {
+            Some(header) if header.page_size != PAGE_SIZE => {
+                return Err(Error::invalid_input(format!(
+                    "Buffer pool frames hold {PAGE_SIZE}-byte pages, the file uses {}-byte pages",
+                    header.page_size
+                )));
+            }
+            Some(header) => header.checksum_algorithm,
+            None => config.checksum,
+        };
+        let mut file = file.with_checksum_algorithm(checksum);
+        if config.preallocation_chunk > 0 {
+            file = file.with_preallocation(config.preallocation_chunk)?;
+        }
+
+        Ok(Self {
+            frames: (0..capacity)
+                .map(|_| UnsafeCell::new(Page::new()))
+                .collect(),
+            latches: (0..capacity).map(|_| RwLock::new(())).collect(),
+            pin_counts: (0..capacity).map(|_| AtomicU32::new(0)).collect(),
+            verify_states: (0..capacity)
+                .map(|_| AtomicU8::new(FRAME_VERIFIED))
+                .collect(),
+            flush_states: (0..capacity).map(|_| FlushState::new()).collect(),
+            sequences: (0..capacity).map(|_| FrameSequence::new()).collect(),
+            frame_hints: (0..capacity.next_power_of_two() * 2)
+                .map(|_| AtomicUsize::new(NO_FRAME))
+                .collect(),
+            state: Mutex::new(PoolState {
+                page_table: HashMap::with_capacity(capacity),
+                frame_pages: vec![None; capacity],
+                // Pop from the back so frame 0 is handed out first
+                free_frames: (0..capacity).rev().collect(),
+                replacer: LruKReplacer::new(capacity, config.lru_k),
+                verify_queue: VecDeque::new(),
+            }),
+            file,
+            verification: config.verification,
+            flushed_lsn: AtomicU64::new(0),
+            synced_lsn: AtomicU64::new(0),
+            unsynced_rec_lsn: AtomicU64::new(NO_REC_LSN),
+            sync_latch: Mutex::new(()),
+            checkpoint_lsn: AtomicU64::new(0),
+            wal: OnceLock::new(),
+        })
+    }
+
+    /// Open (or create) a database file and wrap it in a buffer pool
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be opened or the configuration is invalid
+    pub fn open<P: AsRef<Path>>(path: P, config: BufferPoolConfig) -> Result<Self, Error> {
+        let file = std::fs::OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(false)
+            .open(path)?;
+        Self::new(file, config)
+    }
+
+    /// Log page changes to `wal` and keep it ahead of page writes
+    ///
+    /// Attach the log before any page is modified, after
+    /// [`Wal::recover`] has run.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if a log is already attached
+    pub fn attach_wal(&self, wal: Arc<Wal>) -> Result<(), Error> {
+        let redo_lsn = wal.redo_lsn();
+        self.wal.set(wal).map_err(|_| {
+            Error::invalid_input("A write-ahead log is already attached to the buffer pool")
+        })?;
+        self.checkpoint_lsn.fetch_max(redo_lsn, Ordering::AcqRel);
+        Ok(())
+    }
+
+    /// The attached write-ahead log, if any
+    pub fn wal(&self) -> Option<&Arc<Wal>> {
+        self.wal.get()
+    }
+
+    /// Number of frames in the pool
+    pub fn capacity(&self) -> usize {
+        self.frames.len()
+    }
+
+    /// Number of pages currently resident
+    pub fn resident_pages(&self) -> usize {
+        self.state.lock().page_table.len()
+    }
+
+    /// Check whether a page is currently cached
+    pub fn is_resident(&self, page_id: PageId) -> bool {
+        self.state.lock().page_table.contains_key(&page_id)
+    }
+
+    /// Pin count of a resident page (0 if not resident)
+    pub fn pin_count(&self, page_id: PageId) -> u32 {
+        let state = self.state.lock();
+        state
+            .page_table
+            .get(&page_id)
+            .map_or(0, |&frame| self.pin_counts[frame].load(Ordering::Acquire))
+    }
+
+    /// Pin a page, loading it from disk if it is not resident
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::OutOfMemory` if every frame is pinned, or an I/O or
+    /// corruption error if the page cannot be loaded or failed deferred
+    /// verification
+    pub fn fetch_page(&self, page_id: PageId) -> Result<PinnedPage<'_>, Error> {
+        loop {
+            let (frame, latch) = match self.claim_frame(page_id)? {
+                Slot::Resident(pinned) => {
+                    let verify_state = &self.verify_states[pinned.frame];
+                    if verify_state.load(Ordering::Acquire) == FRAME_LOADING {
+                        // The loading thread holds the exclusive latch until
+                        // the page is in
+                        drop(self.latches[pinned.frame].read());
+                    }
+                    match verify_state.load(Ordering::Acquire) {
+                        // The load failed; try it again from this thread
+                        FRAME_UNLOADED => continue,
+                        FRAME_CORRUPT => return Err(Self::corrupt_page_error(page_id)),
+                        _ => return Ok(pinned),
+                    }
+                }
+                Slot::Claimed(frame, latch) => (frame, latch),
+            };
+
+            // SAFETY: we hold the frame's exclusive latch
+            let page = unsafe { &mut *self.frames[frame].get() };
+            let deferred = self.verification == VerificationPolicy::Deferred;
+            let loaded = if deferred {
+                self.file.read_page_unverified(page_id, page)
+            } else {
+                self.file.read_page_into(page_id, page)
+            };
+            let pinned = PinnedPage {
+                pool: self,
+                frame,
+                page_id,
+            };
+            let header = page.header_mut();
+            header.set_dirty(false);
+            header.set_pinned(true);
+            self.flush_states[frame].mark_clean();
+            if let Err(err) = loaded {
+                {
+                    let mut state = self.state.lock();
+                    state.page_table.remove(&page_id);
+                    state.frame_pages[frame] = None;
+                }
+                self.sequences[frame]
+                    .page_id
+                    .store(INVALID_PAGE_ID, Ordering::Release);
+                self.verify_states[frame].store(FRAME_UNLOADED, Ordering::Release);
+                self.sequences[frame].end_change();
+                drop(latch);
+                return Err(err);
+            }
+            let verify_state = if deferred {
+                self.state.lock().verify_queue.push_back(page_id);
+                FRAME_PENDING
+            } else {
+                FRAME_VERIFIED
+            };
+            self.verify_states[frame].store(verify_state, Ordering::Release);
+            self.sequences[frame].end_change();
+            drop(latch);
+            return Ok(pinned);
+        }
+    }
+
+    /// Pin a page and take a shared latch on it in one step
+    ///
+    /// The returned guard exposes the frame in place; no page bytes are copied.
+    ///
+    /// # Errors
+    ///
+    /// Same as [`fetch_page`](Self::fetch_page)
+    pub fn read_page(&self, page_id: PageId) -> Result<PageGuard<'_>, Error> {
+        let pinned = self.fetch_page(page_id)?;
+        let latch = self.latches[pinned.frame].read();
+        // SAFETY: the shared latch is held for the lifetime of the guard
+        let page = unsafe { &*self.frames[pinned.frame].get() };
+        Ok(PageGuard {
+            _latch: latch,
+            page,
+            pinned,
+        })
+    }
+
+    /// Create a fresh, dirty page in the pool without reading it from disk
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the page is already resident, or
+    /// `Error::OutOfMemory` if every frame is pinned
+    pub fn new_page(&self, page_id: PageId, page_type: PageType) -> Result<PinnedPage<'_>, Error> {
+        let Slot::Claimed(frame, latch) = self.claim_frame(page_id)? else {
+            return Err(Error::invalid_input(format!(
+                "Page {page_id} is already resident in the buffer pool"
+            )));
+        };
+        // SAFETY: we hold the frame's exclusive latch
+        let page = unsafe { &mut *self.frames[frame].get() };
+        *page = Page::new();
+        self.verify_states[frame].store(FRAME_VERIFIED, Ordering::Release);
+        let flush_state = &self.flush_states[frame];
+        flush_state.dirty.store(true, Ordering::Release);
+        flush_state.rec_lsn.store(
+            self.wal.get().map_or(0, |wal| wal.next_lsn()),
+            Ordering::Release,
+        );
+        flush_state.imaged.store(false, Ordering::Release);
+        let header = page.header_mut();
+        header.set_page_id(page_id);
+        header.page_type = page_type;
+        header.set_dirty(true);
+        header.set_pinned(true);
+        self.sequences[frame].end_change();
+        drop(latch);
+        Ok(PinnedPage {
+            pool: self,
+            frame,
+            page_id,
+        })
+    }
+
+    /// Write a resident page back to disk if it is dirty
+    ///
+    /// Returns `true` if the page was resident.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the write fails
+    pub fn flush_page(&self, page_id: PageId) -> Result<bool, Error> {
+        let pinned = {
+            let mut state = self.state.lock();
+            let Some(&frame) = state.page_table.get(&page_id) else {
+                return Ok(false);
+            };
+            self.pin(&mut state, frame);
+            PinnedPage {
+                pool: self,
+                frame,
+                page_id,
+            }
+        };
+
+        let _latch = self.latches[pinned.frame].write();
+        // SAFETY: we hold the frame's exclusive latch
+        let page = unsafe { &mut *self.frames[pinned.frame].get() };
+        self.write_back(pinned.frame, page_id, page)?;
+        Ok(true)
+    }
+
+    /// Write every dirty resident page back to disk and sync the file
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if any write or the final sync fails
+    pub fn flush_all(&self) -> Result<(), Error> {
+        let resident: Vec<PageId> = self.state.lock().page_table.keys().copied().collect();
+        for page_id in resident {
+            self.flush_page(page_id)?;
+        }
+        self.file.sync_all()?;
+        Ok(())
+    }
+
+    /// Copy a page into `out` and return the version that was copied
+    ///
+    /// A resident page is copied optimistically: no pin, no latch and no
+    /// write to shared memory. While a writer holds the page the copy is
+    /// retried a few times; after that, or if the page is not resident, it
+    /// is fetched and copied under a shared latch instead.
+    ///
+    /// # Errors
+    ///
+    /// Same as [`fetch_page`](Self::fetch_page)
+    pub fn read_versioned(&self, page_id: PageId, out: &mut Page) -> Result<PageVersion, Error> {
+        for _ in 0..OPTIMISTIC_ATTEMPTS {
+            if let Some(version) = self.try_read_optimistic(page_id, out) {
+                return Ok(version);
+            }
+            std::hint::spin_loop();
+        }
+        Ok(self.fetch_page(page_id)?.read_versioned(out))
+    }
+
+    /// Whether the page is still resident and unchanged since `version`
+    /// was copied
+    pub fn is_unchanged(&self, version: &PageVersion) -> bool {
+        let state = &self.sequences[version.frame];
+        state.sequence.load(Ordering::Acquire) == version.sequence
+            && state.page_id.load(Ordering::Acquire) == version.page_id
+    }
+
+    /// Write new pages straight to the file, bypassing the cache
+    ///
+    /// For bulk builds of pages nothing references yet. Clean, unpinned
+    /// copies of the pages in the pool are dropped so later fetches read
+    /// the new contents. The pages are checksummed and written as one
+    /// batch. They are not logged, and the file is not synced; see
+    /// [`sync_data`](Self::sync_data).
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if one of the pages is pinned or dirty
+    /// in the pool, or an error if the write fails
+    pub fn write_unbuffered(&self, pages: &mut [(PageId, Page)]) -> Result<(), Error> {
+        {
+            let mut state = self.state.lock();
+            let mut resident: Vec<(PageId, FrameId)> = pages
+                .iter()
+                .filter_map(|(page_id, _)| Some((*page_id, *state.page_table.get(page_id)?)))
+                .collect();
+            resident.sort_unstable();
+            resident.dedup();
+            // Check them all first, so an error leaves the pool unchanged
+            if let Some((page_id, _)) = resident.iter().find(|&&(_, frame)| {
+                self.pin_counts[frame].load(Ordering::Acquire) > 0
+                    || self.flush_states[frame].dirty.load(Ordering::Acquire)
+            }) {
+                return Err(Error::invalid_input(format!(
+                    "Page {page_id} is pinned or dirty in the buffer pool"
+                )));
+            }
+            for (page_id, frame) in resident {
+                self.drop_frame(&mut state, page_id, frame);
+            }
+        }
+        for (_, page) in pages.iter_mut() {
+            page.calculate_checksum_with(self.file.checksum_algorithm())?;
+        }
+        let batch: Vec<(PageId, &Page)> = pages
+            .iter()
+            .map(|(page_id, page)| (*page_id, page))
+            .collect();
+        self.file.write_pages(&batch)
+    }
+
+    /// Sync file data, making [`write_unbuffered`](Self::write_unbuffered)
+    /// pages durable
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the sync fails
+    pub fn sync_data(&self) -> Result<(), Error> {
+        self.sync_file()
+    }
+
+    /// Ask the OS to start reading pages that are about to be fetched
+    ///
+    /// Pages found resident through their lock-free hint are skipped, and
+    /// the rest are sorted and hinted as runs of consecutive pages. Nothing
+    /// is loaded into the pool; a later [`fetch_page`](Self::fetch_page)
+    /// finds the data in the OS page cache instead of waiting on the disk.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the hint is rejected
+    pub fn prefetch(&self, page_ids: &[PageId]) -> Result<(), Error> {
+        let mut missing: Vec<PageId> = page_ids
+            .iter()
+            .copied()
+            .filter(|&page_id| {
+                let frame = self.frame_hint(page_id).load(Ordering::Relaxed);
+                self.sequences
+                    .get(frame)
+                    .is_none_or(|state| state.page_id.load(Ordering::Relaxed) != page_id)
+            })
+            .collect();
+        missing.sort_unstable();
+        missing.dedup();
+        let mut runs = missing.into_iter().peekable();
+        while let Some(start) = runs.next() {
+            let mut count = 1;
+            while runs.next_if_eq(&(start + count)).is_some() {
+                count += 1;
+            }
+            self.file.prefetch(start, count)?;
+        }
+        Ok(())
+    }
+
+    /// Number of resident pages with unwritten changes
+    pub fn dirty_pages(&self) -> usize {
+        self.flush_states
+            .iter()
+            .filter(|flush_state| flush_state.dirty.load(Ordering::Acquire))
+            .count()
+    }
+
+    /// Log position from which crash recovery must replay
+    ///
+    /// Every change with a smaller LSN is already on disk and synced. Pages
+    /// written back by eviction or [`flush_page`](Self::flush_page) hold it
+    /// back until the next sync. Advanced by [`flush_dirty`](Self::flush_dirty)
+    /// and [`checkpoint`](Self::checkpoint).
+    pub fn checkpoint_lsn(&self) -> u64 {
+        self.checkpoint_lsn.load(Ordering::Acquire)
+    }
+
+    /// Write up to `max_pages` dirty pages in page-ID order without blocking
+    /// readers, sync them, and advance the checkpoint LSN
+    ///
+    /// Returns the number of pages written.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a write or the sync fails; the affected pages stay
+    /// dirty
+    pub fn flush_dirty(&self, max_pages: usize) -> Result<usize, Error> {
+        self.flush_dirty_partition(0, 1, max_pages)
+    }
+
+    /// Fuzzy checkpoint: flush every page that is dirty now and return the
+    /// new checkpoint LSN
+    ///
+    /// Foreground work continues while the checkpoint runs; pages dirtied
+    /// meanwhile keep the checkpoint LSN below their first change. Pages
+    /// written back by eviction since the last sync are synced too. With a
+    /// log attached, the log is then checkpointed at the new LSN.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a write or the sync fails
+    pub fn checkpoint(&self) -> Result<u64, Error> {
+        self.flush_dirty(self.capacity())?;
+        if self.unsynced_rec_lsn.load(Ordering::Acquire) != NO_REC_LSN {
+            self.sync_file()?;
+            self.advance_checkpoint();
+        }
+        let checkpoint_lsn = self.checkpoint_lsn();
+        if let Some(wal) = self.wal.get() {
+            wal.checkpoint(checkpoint_lsn)?;
+        }
+        Ok(checkpoint_lsn)
+    }
+
+    /// [`flush_dirty`](Self::flush_dirty) restricted to frames with
+    /// `frame % partitions == partition`, so several flushers can share a pool
+    pub(crate) fn flush_dirty_partition(
+        &self,
+        partition: usize,
+        partitions: usize,
+        max_pages: usize,
+    ) -> Result<usize, Error> {
+        // Pin candidates so they cannot be evicted while we work on them
+        let mut pinned: Vec<PinnedPage<'_>> = {
+            let mut state = self.state.lock();
+            let candidates: Vec<(FrameId, PageId)> = state
+                .frame_pages
+                .iter()
+                .enumerate()
+                .filter(|&(frame, _)| {
+                    frame % partitions == partition
+                        && self.flush_states[frame].dirty.load(Ordering::Acquire)
+                        && self.verify_states[frame].load(Ordering::Acquire) != FRAME_CORRUPT
+                })
+                .filter_map(|(frame, page_id)| page_id.map(|page_id| (frame, page_id)))
+                .collect();
+            candidates
+                .into_iter()
+                .map(|(frame, page_id)| {
+                    self.pin(&mut state, frame);
+                    PinnedPage {
+                        pool: self,
+                        frame,
+                        page_id,
+                    }
+                })
+                .collect()
+        };
+        pinned.sort_by_key(PinnedPage::page_id);
+        pinned.truncate(max_pages);
+
+        // Snapshot the dirty pages under shared latches
+        let mut copies = Vec::with_capacity(pinned.len());
+        for handle in &pinned {
+            let _latch = self.latches[handle.frame].read();
+            // SAFETY: we hold the frame's shared latch
+            let page = unsafe { &*self.frames[handle.frame].get() };
+            if !page.header().is_dirty() {
+                continue;
+            }
+            let version = self.flush_states[handle.frame]
+                .version
+                .load(Ordering::Acquire);
+            let mut copy = Page::new();
+            copy.raw_mut().copy_from_slice(page.raw());
+            let header = copy.header_mut();
+            header.flags &= !PAGE_FLAGS_TRANSIENT;
+            copy.calculate_checksum_with(self.file.checksum_algorithm())?;
+            copies.push((handle, version, copy));
+        }
+
+        let batch: Vec<(PageId, &Page)> = copies
+            .iter()
+            .map(|(handle, _, copy)| (handle.page_id, copy))
+            .collect();
+        if let Some(newest) = batch.iter().map(|(_, copy)| copy.header().lsn).max() {
+            self.flush_log_to(newest)?;
+        }
+        self.file.write_pages(&batch)?;
+        for (_, copy) in &batch {
+            self.flushed_lsn
+                .fetch_max(self.full_lsn(copy.header().lsn), Ordering::AcqRel);
+        }
+        if !batch.is_empty() || self.unsynced_rec_lsn.load(Ordering::Acquire) != NO_REC_LSN {
+            self.sync_file()?;
+        }
+
+        // Clear the dirty bit unless the page was modified after the snapshot
+        for (handle, version, _) in &copies {
+            let _latch = self.latches[handle.frame].write();
+            let flush_state = &self.flush_states[handle.frame];
+            if flush_state.version.load(Ordering::Acquire) == *version {
+                // SAFETY: we hold the frame's exclusive latch
+                let page = unsafe { &mut *self.frames[handle.frame].get() };
+                page.header_mut().set_dirty(false);
+                flush_state.mark_clean();
+            }
+        }
+        let written = copies.len();
+        drop(copies);
+        drop(pinned);
+
+        self.advance_checkpoint();
+        Ok(written)
+    }
+
+    /// Sync file data; afterwards the pages written back before the sync
+    /// no longer hold back the checkpoint LSN
+    fn sync_file(&self) -> Result<(), Error> {
+        let _sync = self.sync_latch.lock();
+        let written = self.flushed_lsn.load(Ordering::Acquire);
+        let unsynced = self.unsynced_rec_lsn.swap(NO_REC_LSN, Ordering::AcqRel);
+        if let Err(error) = self.file.sync_data() {
+            self.unsynced_rec_lsn.fetch_min(unsynced, Ordering::AcqRel);
+            return Err(error);
+        }
+        self.synced_lsn.fetch_max(written, Ordering::AcqRel);
+        Ok(())
+    }
+
+    /// Move the checkpoint LSN up to the oldest change not yet synced
+    fn advance_checkpoint(&self) {
+        let _sync = self.sync_latch.lock();
+        // Read before the scan: a page dirtied during it has a later rec_lsn
+        let log_end = self.wal.get().map(|wal| wal.next_lsn());
+        let oldest_dirty = self
+            .flush_states
+            .iter()
+            .map(|flush_state| flush_state.rec_lsn.load(Ordering::Acquire))
+            .min()
+            .unwrap_or(NO_REC_LSN);
+        // Read after the scan: a page written back during it is recorded
+        // here before its frame is marked clean
+        let oldest = oldest_dirty.min(self.unsynced_rec_lsn.load(Ordering::Acquire));
+        let target = if oldest == NO_REC_LSN {
+            log_end.unwrap_or_else(|| self.synced_lsn.load(Ordering::Acquire))
+        } else {
+            oldest
+        };
+        self.checkpoint_lsn.fetch_max(target, Ordering::AcqRel);
+    }
+
+    /// Widen a page LSN to its full form; without a log the page LSN is used
+    /// as is
+    fn full_lsn(&self, page_lsn: u32) -> Lsn {
+        self.wal
+            .get()
+            .map_or(u64::from(page_lsn), |wal| widen(page_lsn, wal.next_lsn()))
+    }
+
+    /// Write-ahead rule: make the log durable through a page's last change
+    /// before the page is written
+    fn flush_log_to(&self, page_lsn: u32) -> Result<(), Error> {
+        match self.wal.get() {
+            Some(wal) => wal.flush_to(widen(page_lsn, wal.next_lsn())),
+            None => Ok(()),
+        }
+    }
+
+    /// Number of loaded pages still waiting for deferred verification
+    pub fn pending_verifications(&self) -> usize {
+        self.state.lock().verify_queue.len()
+    }
+
+    /// Verify every page queued by `Deferred` loading
+    ///
+    /// Returns the number of pages checked. Pages evicted or already verified
+    /// (for example by [`PinnedPage::write`]) are skipped.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` for the first page that fails; it is marked
+    /// corrupt and later fetches of it fail. Remaining pages stay queued.
+    pub fn verify_pending(&self) -> Result<usize, Error> {
+        let mut verified = 0;
+        loop {
+            let pinned = {
+                let mut state = self.state.lock();
+                let Some(page_id) = state.verify_queue.pop_front() else {
+                    return Ok(verified);
+                };
+                let Some(&frame) = state.page_table.get(&page_id) else {
+                    continue;
+                };
+                if self.verify_states[frame].load(Ordering::Acquire) != FRAME_PENDING {
+                    continue;
+                }
+                self.pin(&mut state, frame);
+                PinnedPage {
+                    pool: self,
+                    frame,
+                    page_id,
+                }
+            };
+
+            let intact = {
+                let _latch = self.latches[pinned.frame].read();
+                // SAFETY: we hold the frame's shared latch
+                let page = unsafe { &*self.frames[pinned.frame].get() };
+                self.verify_frame(pinned.frame, page)
+            };
+            if !intact {
+                return Err(Self::corrupt_page_error(pinned.page_id));
+            }
+            verified += 1;
+        }
+    }
+
+    /// Start a thread that runs [`verify_pending`](Self::verify_pending)
+    /// every `interval`
+    ///
+    /// The thread holds only a weak reference and exits once the pool is
+    /// dropped; dropping the returned worker stops it earlier. Corruption is
+    /// logged and surfaces to readers through [`fetch_page`](Self::fetch_page).
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the thread cannot be spawned
+    pub fn spawn_verifier(pool: &Arc<Self>, interval: Duration) -> Result<BackgroundWorker, Error> {
+        let pool = Arc::downgrade(pool);
+        BackgroundWorker::spawn("lumen-verifier", interval, move || {
+            let Some(pool) = pool.upgrade() else {
+                return false;
+            };
+            if let Err(err) = pool.verify_pending() {
+                log::error!("Deferred page verification failed: {err}");
+            }
+            true
+        })
+    }
+
+    /// Check a `FRAME_PENDING` frame's checksum and record the outcome
+    ///
+    /// The caller must hold the frame latch. Returns `false` if the frame is
+    /// corrupt.
+    fn verify_frame(&self, frame: FrameId, page: &Page) -> bool {
+        let verify_state = &self.verify_states[frame];
+        match verify_state.load(Ordering::Acquire) {
+            FRAME_PENDING => {
+                let intact = page.verify_checksum_with(self.file.checksum_algorithm());
+                let outcome = if intact {
+                    FRAME_VERIFIED
+                } else {
+                    FRAME_CORRUPT
+                };
+                // Concurrent shared-latch verifiers reach the same outcome
+                let _ = verify_state.compare_exchange(
+                    FRAME_PENDING,
+                    outcome,
+                    Ordering::AcqRel,
+                    Ordering::Acquire,
+                );
+                intact
+            }
+            FRAME_CORRUPT => false,
+            _ => true,
+        }
+    }
+
+    fn corrupt_page_error(page_id: PageId) -> Error {
+        Error::corruption(format!("Checksum verification failed for page {page_id}"))
+    }
+
+    /// Pin `page_id` if it is resident or being loaded, otherwise map it
+    /// to a frame of its own: a free frame first, otherwise an LRU-K victim
+    ///
+    /// Dirty victims are written back with the state mutex released, so a
+    /// slow write does not hold up other fetches; the victim is chosen
+    /// again afterwards, as it may have been fetched meanwhile. A claimed
+    /// frame is pinned, mapped, exclusively latched and marked
+    /// `FRAME_LOADING`, with its sequence odd, so other fetchers of the
+    /// page wait on the latch until the caller has filled it.
+    fn claim_frame(&self, page_id: PageId) -> Result<Slot<'_>, Error> {
+        let mut state = self.state.lock();
+        loop {
+            if let Some(&frame) = state.page_table.get(&page_id) {
+                self.pin(&mut state, frame);
+                self.set_frame_hint(page_id, frame);
+                return Ok(Slot::Resident(PinnedPage {
+                    pool: self,
+                    frame,
+                    page_id,
+                }));
+            }
+
+            let frame = match state.free_frames.pop() {
+                Some(frame) => frame,
+                None => state.replacer.evict().ok_or(Error::OutOfMemory)?,
+            };
+            if let Some(victim) = state.frame_pages[frame] {
+                let corrupt = self.verify_states[frame].load(Ordering::Acquire) == FRAME_CORRUPT;
+                if corrupt && self.flush_states[frame].dirty.load(Ordering::Acquire) {
+                    log::warn!("Discarding corrupt page {victim} without writing it back");
+                    self.flush_states[frame].mark_clean();
+                } else if self.flush_states[frame].dirty.load(Ordering::Acquire) {
+                    // Pin the victim without counting an access, so a
+                    // fetch of it meanwhile keeps it
+                    self.pin_frame(frame);
+                    let pinned = PinnedPage {
+                        pool: self,
+                        frame,
+                        page_id: victim,
+                    };
+                    let written = MutexGuard::unlocked(&mut state, || {
+                        let _latch = self.latches[frame].write();
+                        // SAFETY: we hold the frame's exclusive latch
+                        let page = unsafe { &mut *self.frames[frame].get() };
+                        self.write_back(frame, victim, page)
+                    });
+                    if written.is_err() {
+                        // Keep the victim resident so its changes are not lost
+                        state.replacer.record_access(frame);
+                    }
+                    drop(state);
+                    drop(pinned);
+                    written?;
+                    state = self.state.lock();
+                    continue;
+                }
+                state.page_table.remove(&victim);
+            }
+
+            // The frame is unmapped and unpinned, so its latch is uncontended
+            self.pin(&mut state, frame);
+            let latch = self.latches[frame].write();
+            self.sequences[frame].begin_change();
+            self.sequences[frame]
+                .page_id
+                .store(page_id, Ordering::Release);
+            self.verify_states[frame].store(FRAME_LOADING, Ordering::Release);
+            state.page_table.insert(page_id, frame);
+            state.frame_pages[frame] = Some(page_id);
+            self.set_frame_hint(page_id, frame);
+            return Ok(Slot::Claimed(frame, latch));
+        }
+    }
+
+    /// Write a dirty page to disk with a freshly calculated checksum
+    ///
+    /// Transient flag bits are cleared in the on-disk image and restored
+    /// afterwards, except for the dirty bit which is cleared on success.
+    fn write_back(&self, frame: FrameId, page_id: PageId, page: &mut Page) -> Result<(), Error> {
+        if !page.header().is_dirty() {
+            return Ok(());
+        }
+        if self.verify_states[frame].load(Ordering::Acquire) == FRAME_CORRUPT {
+            return Err(Self::corrupt_page_error(page_id));
+        }
+        self.flush_log_to(page.header().lsn)?;
+        let flags = page.header().flags;
+        page.header_mut().flags = flags & !PAGE_FLAGS_TRANSIENT;
+        page.calculate_checksum_with(self.file.checksum_algorithm())?;
+        let written = self.file.write_page(page_id, page);
+        page.header_mut().flags = if written.is_ok() {
+            // Not synced yet: recorded after the write, so a sync that takes
+            // the record covers the write, and before the frame turns clean
+            let flush_state = &self.flush_states[frame];
+            self.unsynced_rec_lsn.fetch_min(
+                flush_state.rec_lsn.load(Ordering::Acquire),
+                Ordering::AcqRel,
+            );
+            flush_state.mark_clean();
+            self.flushed_lsn
+                .fetch_max(self.full_lsn(page.header().lsn), Ordering::AcqRel);
+            flags & !PAGE_FLAG_DIRTY
+        } else {
+            flags
+        };
+        written
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    fn frame_hint(&self, page_id: PageId) -> &AtomicUsize {
+        &self.frame_hints[page_id as usize & (self.frame_hints.len() - 1)]
+    }
+
+    fn set_frame_hint(&self, page_id: PageId, frame: FrameId) {
+        let hint = self.frame_hint(page_id);
+        // Skip the store when the hint is right, keeping the line shared
+        if hint.load(Ordering::Relaxed) != frame {
+            hint.store(frame, Ordering::Relaxed);
+        }
+    }
+
+    /// Copy a resident page without pinning or latching it; `None` if the
+    /// page is not found through its hint or changed during the copy
+    fn try_read_optimistic(&self, page_id: PageId, out: &mut Page) -> Option<PageVersion> {
+        let frame = self.frame_hint(page_id).load(Ordering::Relaxed);
+        let state = self.sequences.get(frame)?;
+        let sequence = state.sequence.load(Ordering::Acquire);
+        if sequence % 2 == 1
+            || state.page_id.load(Ordering::Acquire) != page_id
+            || self.verify_states[frame].load(Ordering::Acquire) == FRAME_CORRUPT
+        {
+            return None;
+        }
+        let source = self.frames[frame].get().cast::<u64>().cast_const();
+        for (index, word) in out.raw_mut().chunks_exact_mut(8).enumerate() {
+            // SAFETY: the frame is a live, 4096-byte aligned page. A writer
+            // may change it concurrently; such a copy is discarded below.
+            let value = unsafe { std::ptr::read_volatile(source.add(index)) };
+            word.copy_from_slice(&value.to_ne_bytes());
+        }
+        fence(Ordering::Acquire);
+        (state.sequence.load(Ordering::Relaxed) == sequence
+            && state.page_id.load(Ordering::Relaxed) == page_id)
+            .then_some(PageVersion {
+                page_id,
+                frame,
+                sequence,
+            })
+    }
+
+    /// Unmap a clean, unpinned frame and return it to the free list
+    ///
+    /// Bumps the frame's sequence so optimistic copies of the page taken
+    /// before are rejected.
+    fn drop_frame(&self, state: &mut PoolState, page_id: PageId, frame: FrameId) {
+        state.page_table.remove(&page_id);
+        state.frame_pages[frame] = None;
+        state.replacer.remove(frame);
+        state.free_frames.push(frame);
+        // The frame is unpinned, so its latch is uncontended
+        let _latch = self.latches[frame].write();
+        self.sequences[frame].begin_change();
+        self.sequences[frame]
+            .page_id
+            .store(INVALID_PAGE_ID, Ordering::Release);
+        self.verify_states[frame].store(FRAME_UNLOADED, Ordering::Release);
+        self.sequences[frame].end_change();
+    }
+
+    fn pin(&self, state: &mut PoolState, frame: FrameId) {
+        self.pin_frame(frame);
+        state.replacer.record_access(frame);
+        state.replacer.set_evictable(frame, false);
+    }
+
+    /// Raise the pin count; the caller holds the state mutex and keeps the
+    /// frame out of the replacer
+    fn pin_frame(&self, frame: FrameId) {
+        if self.pin_counts[frame].fetch_add(1, Ordering::AcqRel) == 0 {
+            // No guards exist on an unpinned frame, so this latch is uncontended
+            let _latch = self.latches[frame].write();
+            // SAFETY: we hold the frame's exclusive latch
+            unsafe { (*self.frames[frame].get()).header_mut().set_pinned(true) };
+        }
+    }
+
+    fn unpin(&self, frame: FrameId) {
+        let mut state = self.state.lock();
+        if self.pin_counts[frame].fetch_sub(1, Ordering::AcqRel) == 1 {
+            let _latch = self.latches[frame].write();
+            // SAFETY: we hold the frame's exclusive latch
+            unsafe { (*self.frames[frame].get()).header_mut().set_pinned(false) };
+            state.replacer.set_evictable(frame, true);
+        }
+    }
+}
+
+impl Drop for BufferPool {
+    fn drop(&mut self) {
+        if let Err(err) = self.flush_all() {
+            log::error!("Failed to flush buffer pool on drop: {err}");
+        }
+    }
+}
+
+/// A page pinned in the buffer pool; the pin is released on drop
+pub struct PinnedPage<'a> {
+    pool: &'a BufferPool,
+    frame: FrameId,
+    page_id: PageId,
+}
+
+impl PinnedPage<'_> {
+    /// ID of the pinned page
+    pub fn page_id(&self) -> PageId {
+        self.page_id
+    }
+
+    /// Copy the page into `out` under a shared latch and return the version
+    /// that was copied
+    ///
+    /// Unlike [`BufferPool::read_versioned`], the page cannot be evicted
+    /// while this handle lives, so the version only goes stale if a writer
+    /// changes the page.
+    pub fn read_versioned(&self, out: &mut Page) -> PageVersion {
+        let guard = self.read();
+        out.raw_mut().copy_from_slice(guard.raw());
+        PageVersion {
+            page_id: self.page_id,
+            frame: self.frame,
+            sequence: self.pool.sequences[self.frame]
+                .sequence
+                .load(Ordering::Acquire),
+        }
+    }
+
+    /// Take a shared latch on the page
+    pub fn read(&self) -> PageReadGuard<'_> {
+        let latch = self.pool.latches[self.frame].read();
+        // SAFETY: the shared latch is held for the lifetime of the guard
+        let page = unsafe { &*self.pool.frames[self.frame].get() };
+        PageReadGuard {
+            _latch: latch,
+            page,
+        }
+    }
+
+    /// Take an exclusive latch on the page and mark it dirty
+    ///
+    /// A page still awaiting deferred verification is verified first.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if the page failed checksum verification;
+    /// it is left clean, since a corrupt page is never written back
+    pub fn write(&self) -> Result<PageWriteGuard<'_>, Error> {
+        let mut guard = self.latch()?;
+        guard.mark_changing();
+        Ok(guard)
+    }
+
+    /// Take an exclusive latch on the page without marking it dirty
+    ///
+    /// The page is marked dirty, and optimistic readers see it change, only
+    /// once the guard hands out mutable access. A caller that checks
+    /// [`is_unchanged_since`](PageWriteGuard::is_unchanged_since) and backs
+    /// off leaves the page as it found it.
+    ///
+    /// # Errors
+    ///
+    /// Same as [`write`](Self::write)
+    pub fn latch(&self) -> Result<PageWriteGuard<'_>, Error> {
+        let latch = self.pool.latches[self.frame].write();
+        // SAFETY: the exclusive latch is held for the lifetime of the guard
+        let page = unsafe { &mut *self.pool.frames[self.frame].get() };
+        if !self.pool.verify_frame(self.frame, page) {
+            return Err(BufferPool::corrupt_page_error(self.page_id));
+        }
+        Ok(PageWriteGuard {
+            _latch: latch,
+            page,
+            changing: false,
+            rec_lsn: None,
+            pool: self.pool,
+            frame: self.frame,
+            page_id: self.page_id,
+        })
+    }
+
+    /// Drop a page made by [`BufferPool::new_page`] from the pool without
+    /// writing it back, returning its frame
+    ///
+    /// For undoing the creation of a page nothing refers to yet. If the page
+    /// has been pinned again meanwhile, it is only unpinned.
+    pub fn discard(self) {
+        let (pool, frame, page_id) = (self.pool, self.frame, self.page_id);
+        std::mem::forget(self);
+        let mut state = pool.state.lock();
+        if pool.pin_counts[frame].fetch_sub(1, Ordering::AcqRel) == 1 {
+            pool.flush_states[frame].mark_clean();
+            pool.drop_frame(&mut state, page_id, frame);
+        } else {
+            log::warn!("Page {page_id} was pinned while being discarded; keeping it");
+        }
+    }
+}
+
+impl Drop for PinnedPage<'_> {
+    fn drop(&mut self) {
+        self.pool.unpin(self.frame);
+    }
+}
+
+/// Shared access to a pinned page
+pub struct PageReadGuard<'a> {
+    _latch: RwLockReadGuard<'a, ()>,
+    page: &'a Page,
+}
+
+impl Deref for PageReadGuard<'_> {
+    type Target = Page;
+
+    fn deref(&self) -> &Page {
+        self.page
+    }
+}
+
+/// A pinned, shared-latched page that owns its pin
+///
+/// Fields drop in declaration order: the latch is released before the pin.
+pub struct PageGuard<'a> {
+    _latch: RwLockReadGuard<'a, ()>,
+    page: &'a Page,
+    pinned: PinnedPage<'a>,
+}
+
+impl PageGuard<'_> {
+    /// ID of the guarded page
+    pub fn page_id(&self) -> PageId {
+        self.pinned.page_id
+    }
+
+    /// Borrowed view of the frame contents
+    pub fn page_ref(&self) -> PageRef<'_> {
+        self.page.as_page_ref()
+    }
+}
+
+impl Deref for PageGuard<'_> {
+    type Target = Page;
+
+    fn deref(&self) -> &Page {
+        self.page
+    }
+}
+
+/// Exclusive access to a pinned page
+///
+/// Without a log attached, if this guard dirtied a clean page, the page LSN
+/// it leaves behind becomes the frame's recovery LSN.
+pub struct PageWriteGuard<'a> {
+    _latch: RwLockWriteGuard<'a, ()>,
+    page: &'a mut Page,
+    /// Whether the page has been marked dirty and its sequence made odd
+    changing: bool,
+    rec_lsn: Option<&'a AtomicU64>,
+    pool: &'a BufferPool,
+    frame: FrameId,
+    page_id: PageId,
+}
+
+impl PageWriteGuard<'_> {
+    /// Whether the page is unchanged between `version` being copied and
+    /// this guard being taken
+    pub fn is_unchanged_since(&self, version: &PageVersion) -> bool {
+        // A guard that is changing the page made the sequence odd
+        version.frame == self.frame
+            && version.page_id == self.page_id
+            && self.pool.sequences[self.frame]
+                .sequence
+                .load(Ordering::Acquire)
+                == version.sequence + u64::from(self.changing)
+    }
+
+    /// Whether this guard has handed out mutable access to the page
+    pub fn is_changed(&self) -> bool {
+        self.changing
+    }
+
+    /// Mark the page dirty and make optimistic readers retry, once
+    fn mark_changing(&mut self) {
+        if self.changing {
+            return;
+        }
+        self.changing = true;
+        self.pool.sequences[self.frame].begin_change();
+        self.page.header_mut().set_dirty(true);
+
+        let flush_state = &self.pool.flush_states[self.frame];
+        flush_state.version.fetch_add(1, Ordering::AcqRel);
+        flush_state.dirty.store(true, Ordering::Release);
+        // Any record logged for this change lands at or after the end of
+        // the log. Without a log, the page's previous LSN is a safe lower
+        // bound until the caller stamps the new one.
+        let wal = self.pool.wal.get();
+        let first_change = flush_state.rec_lsn.load(Ordering::Acquire) == NO_REC_LSN;
+        if first_change {
+            let bound = wal.map_or(u64::from(self.page.header().lsn), |wal| wal.next_lsn());
+            flush_state.rec_lsn.store(bound, Ordering::Release);
+        }
+        self.rec_lsn = (first_change && wal.is_none()).then_some(&flush_state.rec_lsn);
+    }
+
+    /// Log the change just made to the bytes in `range` (raw page offsets)
+    /// and stamp its LSN into the page
+    ///
+    /// The first change logged after the page was last clean records a full
+    /// page image; later ones record only `range`.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if no log is attached or the range is
+    /// invalid, or an error from the log
+    pub fn log_change(&mut self, range: Range<usize>) -> Result<Lsn, Error> {
+        self.log_with(|wal, page_id, page| wal.log_page_delta(page_id, page, range))
+    }
+
+    /// Log the change just made to the bytes in each of `ranges` (raw page
+    /// offsets) as one record and stamp its LSN into the page
+    ///
+    /// Like [`log_change`](Self::log_change), the first change logged after
+    /// the page was last clean records a full page image instead.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if no log is attached or the ranges are
+    /// invalid, or an error from the log
+    pub fn log_changes(&mut self, ranges: &[Range<usize>]) -> Result<Lsn, Error> {
+        self.log_with(|wal, page_id, page| wal.log_page_ranges(page_id, page, ranges))
+    }
+
+    /// Log a full page image if the page has none since it was last clean,
+    /// or else the record written by `delta`
+    fn log_with<F>(&mut self, delta: F) -> Result<Lsn, Error>
+    where
+        F: FnOnce(&Wal, PageId, &mut Page) -> Result<Lsn, Error>,
+    {
+        let wal = self.pool.wal.get().ok_or_else(|| {
+            Error::invalid_input("No write-ahead log is attached to the buffer pool")
+        })?;
+        // Stamping the record's LSN changes the page
+        self.mark_changing();
+        let imaged = &self.pool.flush_states[self.frame].imaged;
+        if imaged.load(Ordering::Acquire) {
+            delta(wal, self.page_id, self.page)
+        } else {
+            let lsn = wal.log_page_image(self.page_id, self.page)?;
+            imaged.store(true, Ordering::Release);
+            Ok(lsn)
+        }
+    }
+}
+
+impl Drop for PageWriteGuard<'_> {
+    fn drop(&mut self) {
+        if !self.changing {
+            return;
+        }
+        if let Some(rec_lsn) = self.rec_lsn {
+            rec_lsn.store(u64::from(self.page.header().lsn), Ordering::Release);
+        }
+        self.pool.sequences[self.frame].end_change();
+    }
+}
+
+impl Deref for PageWriteGuard<'_> {
+    type Target = Page;
+
+    fn deref(&self) -> &Page {
+        self.page
+    }
+}
+
+impl DerefMut for PageWriteGuard<'_> {
+    fn deref_mut(&mut self) -> &mut Page {
+        self.mark_changing();
+        self.page
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tempfile::NamedTempFile;
+
+    fn small_pool(frames: usize) -> (NamedTempFile, BufferPool) {
+        let temp_file = NamedTempFile::new().unwrap();
+        let config = BufferPoolConfig {
+            memory_budget: frames * PAGE_SIZE,
+            ..Default::default()
+        };
+        let pool = BufferPool::open(temp_file.path(), config).unwrap();
+        (temp_file, pool)
+    }
+
+    #[test]
+    fn test_budget_must_hold_a_page() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let config = BufferPoolConfig {
+            memory_budget: PAGE_SIZE - 1,
+            ..Default::default()
+        };
+        let result = BufferPool::open(temp_file.path(), config);
+        assert!(matches!(result, Err(Error::InvalidInput(_))));
+    }
+
+    #[test]
+    fn test_pin_flags_mirror_pin_count() {
+        let (_file, pool) = small_pool(2);
+        let pinned = pool.new_page(1, PageType::Data).unwrap();
+        assert!(pinned.read().header().is_pinned());
+        assert!(pinned.read().header().is_dirty());
+        assert_eq!(pool.pin_count(1), 1);
+        drop(pinned);
+
+        assert_eq!(pool.pin_count(1), 0);
+        let pinned = pool.fetch_page(1).unwrap();
+        assert_eq!(pool.pin_count(1), 1);
+        drop(pinned);
+    }
+
+    #[test]
+    fn test_all_frames_pinned() {
+        let (_file, pool) = small_pool(1);
+        let _pinned = pool.new_page(1, PageType::Data).unwrap();
+        assert!(matches!(
+            pool.new_page(2, PageType::Data),
+            Err(Error::OutOfMemory)
+        ));
+    }
+
+    #[test]
+    fn test_dirty_page_written_on_eviction() {
+        let (_file, pool) = small_pool(1);
+        {
+            let pinned = pool.new_page(3, PageType::Data).unwrap();
+            pinned.write().unwrap().data_mut()[0] = 0x7E;
+        }
+        // Evicts page 3, which must be written back first
+        drop(pool.new_page(4, PageType::Data).unwrap());
+        assert!(!pool.is_resident(3));
+
+        let pinned = pool.fetch_page(3).unwrap();
+        let page = pinned.read();
+        assert_eq!(page.data()[0], 0x7E);
+        assert!(!page.header().is_dirty());
+        assert!(page.verify_checksum());
+    }
+
+    #[test]
+    fn test_unsynced_write_back_holds_checkpoint() {
+        let (_file, pool) = small_pool(1);
+        let stamp = |page_id, lsn| {
+            let pinned = pool.fetch_page(page_id).unwrap();
+            pinned.write().unwrap().header_mut().lsn = lsn;
+        };
+        drop(pool.new_page(4, PageType::Data).unwrap());
+        drop(pool.new_page(3, PageType::Data).unwrap());
+        stamp(3, 10);
+        pool.flush_dirty(1).unwrap();
+        assert_eq!(pool.checkpoint_lsn(), 10);
+
+        // Each stamp evicts the other page, writing it back without a sync
+        stamp(4, 20);
+        stamp(3, 30);
+        drop(pool.fetch_page(4).unwrap());
+        assert_eq!(pool.dirty_pages(), 0);
+        pool.advance_checkpoint();
+        assert_eq!(pool.checkpoint_lsn(), 20);
+
+        assert_eq!(pool.checkpoint().unwrap(), 30);
+    }
+
+    #[test]
+    fn test_failed_load_releases_its_frame() {
+        let (_file, pool) = small_pool(1);
+        // Past the end of the empty file
+        assert!(pool.fetch_page(9).is_err());
+        assert!(!pool.is_resident(9));
+        assert_eq!(pool.resident_pages(), 0);
+
+        // The only frame is usable again
+        drop(pool.new_page(9, PageType::Data).unwrap());
+        assert_eq!(
+            pool.fetch_page(9).unwrap().read().header().page_type,
+            PageType::Data
+        );
+    }
+
+    #[test]
+    fn test_page_guard_is_zero_copy() {
+        let (_file, pool) = small_pool(2);
+        drop(pool.new_page(5, PageType::BTreeLeaf).unwrap());
+
+        let guard = pool.read_page(5).unwrap();
+        assert_eq!(pool.pin_count(5), 1);
+        let page_ref = guard.page_ref();
+        assert_eq!(page_ref.raw().as_ptr(), guard.raw().as_ptr());
+        assert_eq!(page_ref.header().page_type, PageType::BTreeLeaf);
+        drop(guard);
+        assert_eq!(pool.pin_count(5), 0);
+    }
+}
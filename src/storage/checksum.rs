@@ -1,9 +1,49 @@
-//! CRC32 checksum implementation for page integrity
+//! Page checksum algorithms for page integrity
+//!
+//! Three algorithms are supported, chosen per database when it is created and
+//! recorded in the file header (see
+//! [`FileHeader`](crate::storage::file_header::FileHeader)):
+//!
+//! - [`ChecksumAlgorithm::Crc32`] - CRC32 (IEEE) via `crc32fast`, the original
+//!   format and the default
+//! - [`ChecksumAlgorithm::Crc32c`] - CRC32C (Castagnoli), using the SSE4.2 or
+//!   `ARMv8` CRC instructions when the CPU has them
+//! - [`ChecksumAlgorithm::Xxh3`] - 64-bit XXH3 folded to 32 bits, the fastest
+//!   option when only integrity (not a standard CRC) is needed
 
 use crate::common::error::Error;
-use crate::storage::page_constants::PAGE_SIZE;
+use crate::storage::page_constants::{is_valid_page_size, PAGE_HEADER_SIZE};
+use crate::storage::page_header::PAGE_FLAGS_TRANSIENT;
 use crc32fast::Hasher;
 
+/// Page checksum algorithm
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Default)]
+#[repr(u8)]
+pub enum ChecksumAlgorithm {
+    /// CRC32 (IEEE 802.3 polynomial)
+    #[default]
+    Crc32 = 0x00,
+    /// CRC32C (Castagnoli polynomial), hardware accelerated where available
+    Crc32c = 0x01,
+    /// XXH3-64 folded to 32 bits
+    Xxh3 = 0x02,
+}
+
+impl TryFrom<u8> for ChecksumAlgorithm {
+    type Error = Error;
+
+    fn try_from(value: u8) -> Result<Self, Self::Error> {
+        match value {
+            0x00 => Ok(ChecksumAlgorithm::Crc32),
+            0x01 => Ok(ChecksumAlgorithm::Crc32c),
+            0x02 => Ok(ChecksumAlgorithm::Xxh3),
+            _ => Err(Error::corruption(format!(
+                "Unknown checksum algorithm: {value:#04x}"
+            ))),
+        }
+    }
+}
+
 /// Calculate CRC32 checksum for data
 pub fn calculate_crc32(data: &[u8]) -> u32 {
     let mut hasher = Hasher::new();
@@ -11,6 +51,18 @@ pub fn calculate_crc32(data: &[u8]) -> u32 {
     hasher.finalize()
 }
 
+/// Calculate CRC32C checksum for data
+///
+/// Uses the fastest implementation the CPU supports, detected once at runtime.
+pub fn calculate_crc32c(data: &[u8]) -> u32 {
+    !crc32c::update(!0, data)
+}
+
+/// Calculate XXH3-64 of data, folded to 32 bits
+pub fn calculate_xxh3(data: &[u8]) -> u32 {
+    fold_64(xxhash_rust::xxh3::xxh3_64(data))
+}
+
 /// Calculate CRC32 checksum excluding the checksum field itself
 ///
 /// In the 16-byte header (per plan/storage-format.md):
@@ -19,31 +71,200 @@ pub fn calculate_crc32(data: &[u8]) -> u32 {
 /// - lsn(4) at bytes 12-15
 ///
 /// We hash everything except the checksum field to allow verification.
+/// The transient dirty/pinned flag bits are masked out so that toggling
+/// buffer pool state does not invalidate a resident page's checksum.
 ///
 /// # Errors
 ///
-/// Returns `Error::InvalidInput` if `page_data` is not exactly `PAGE_SIZE` bytes
+/// Returns `Error::InvalidInput` if `page_data` is not a supported page size
 pub fn calculate_page_checksum(page_data: &[u8]) -> Result<u32, Error> {
-    if page_data.len() != PAGE_SIZE {
+    calculate_page_checksum_with(ChecksumAlgorithm::Crc32, page_data)
+}
+
+/// Calculate a page checksum with the given algorithm
+///
+/// Covers the same bytes as [`calculate_page_checksum`].
+///
+/// # Errors
+///
+/// Returns `Error::InvalidInput` if `page_data` is not a supported page size
+pub fn calculate_page_checksum_with(
+    algorithm: ChecksumAlgorithm,
+    page_data: &[u8],
+) -> Result<u32, Error> {
+    if !is_valid_page_size(page_data.len()) {
         return Err(Error::InvalidInput(format!(
-            "Invalid page size: expected {}, got {}",
-            PAGE_SIZE,
+            "Invalid page size: {}",
             page_data.len()
         )));
     }
 
-    let mut hasher = Hasher::new();
+    // Header bytes covered by the checksum: page_id + page_type, persistent
+    // flag bits, free_space, then lsn (skipping the checksum at bytes 8-11)
+    let mut header = [0u8; PAGE_HEADER_SIZE - 4];
+    header[0..5].copy_from_slice(&page_data[0..5]);
+    header[5] = page_data[5] & !PAGE_FLAGS_TRANSIENT;
+    header[6..8].copy_from_slice(&page_data[6..8]);
+    header[8..12].copy_from_slice(&page_data[12..16]);
+    let body = &page_data[PAGE_HEADER_SIZE..];
+
+    Ok(match algorithm {
+        ChecksumAlgorithm::Crc32 => {
+            let mut hasher = Hasher::new();
+            hasher.update(&header);
+            hasher.update(body);
+            hasher.finalize()
+        }
+        ChecksumAlgorithm::Crc32c => !crc32c::update(crc32c::update(!0, &header), body),
+        ChecksumAlgorithm::Xxh3 => {
+            let seed = xxhash_rust::xxh3::xxh3_64(&header);
+            fold_64(xxhash_rust::xxh3::xxh3_64_with_seed(body, seed))
+        }
+    })
+}
+
+#[allow(clippy::cast_possible_truncation)]
+fn fold_64(hash: u64) -> u32 {
+    (hash ^ (hash >> 32)) as u32
+}
+
+/// CRC32C kernels with one-time runtime dispatch
+///
+/// `update` works on the raw (pre-inverted) register value.
+mod crc32c {
+    use std::sync::OnceLock;
+
+    type Kernel = fn(u32, &[u8]) -> u32;
+
+    /// Reflected Castagnoli polynomial
+    const POLYNOMIAL: u32 = 0x82F6_3B78;
+
+    pub(super) fn update(crc: u32, data: &[u8]) -> u32 {
+        static KERNEL: OnceLock<Kernel> = OnceLock::new();
+        KERNEL.get_or_init(select)(crc, data)
+    }
+
+    fn select() -> Kernel {
+        #[cfg(target_arch = "x86_64")]
+        if is_x86_feature_detected!("sse4.2") {
+            return x86::update;
+        }
+        #[cfg(target_arch = "aarch64")]
+        if std::arch::is_aarch64_feature_detected!("crc") {
+            return arm::update;
+        }
+        software
+    }
+
+    /// Slicing-by-8 lookup tables
+    static TABLES: [[u32; 256]; 8] = build_tables();
+
+    #[allow(clippy::cast_possible_truncation)]
+    const fn build_tables() -> [[u32; 256]; 8] {
+        let mut tables = [[0u32; 256]; 8];
+        let mut i = 0;
+        while i < 256 {
+            let mut crc = i as u32;
+            let mut bit = 0;
+            while bit < 8 {
+                crc = if crc & 1 == 1 {
+                    (crc >> 1) ^ POLYNOMIAL
+                } else {
+                    crc >> 1
+                };
+                bit += 1;
+            }
+            tables[0][i] = crc;
+            i += 1;
+        }
+        let mut t = 1;
+        while t < 8 {
+            let mut i = 0;
+            while i < 256 {
+                let prev = tables[t - 1][i];
+                tables[t][i] = (prev >> 8) ^ tables[0][(prev & 0xFF) as usize];
+                i += 1;
+            }
+            t += 1;
+        }
+        tables
+    }
 
-    // Hash everything except the checksum field (bytes 8-11 in header)
-    hasher.update(&page_data[0..8]); // Before checksum
-    hasher.update(&page_data[12..]); // After checksum (lsn + all page data)
+    /// Portable fallback
+    pub(super) fn software(mut crc: u32, data: &[u8]) -> u32 {
+        let mut chunks = data.chunks_exact(8);
+        for chunk in &mut chunks {
+            let lo = u32::from_le_bytes([chunk[0], chunk[1], chunk[2], chunk[3]]) ^ crc;
+            let hi = u32::from_le_bytes([chunk[4], chunk[5], chunk[6], chunk[7]]);
+            crc = TABLES[7][(lo & 0xFF) as usize]
+                ^ TABLES[6][((lo >> 8) & 0xFF) as usize]
+                ^ TABLES[5][((lo >> 16) & 0xFF) as usize]
+                ^ TABLES[4][(lo >> 24) as usize]
+                ^ TABLES[3][(hi & 0xFF) as usize]
+                ^ TABLES[2][((hi >> 8) & 0xFF) as usize]
+                ^ TABLES[1][((hi >> 16) & 0xFF) as usize]
+                ^ TABLES[0][(hi >> 24) as usize];
+        }
+        for &byte in chunks.remainder() {
+            crc = (crc >> 8) ^ TABLES[0][((crc ^ u32::from(byte)) & 0xFF) as usize];
+        }
+        crc
+    }
+
+    #[cfg(target_arch = "x86_64")]
+    pub(super) mod x86 {
+        use std::arch::x86_64::{_mm_crc32_u64, _mm_crc32_u8};
+
+        pub(in super::super) fn update(crc: u32, data: &[u8]) -> u32 {
+            // SAFETY: only selected after SSE4.2 was detected at runtime
+            unsafe { update_sse42(crc, data) }
+        }
+
+        #[target_feature(enable = "sse4.2")]
+        unsafe fn update_sse42(crc: u32, data: &[u8]) -> u32 {
+            let mut crc = u64::from(crc);
+            let mut chunks = data.chunks_exact(8);
+            for chunk in &mut chunks {
+                let word = u64::from_le_bytes(chunk.try_into().unwrap_or_default());
+                crc = _mm_crc32_u64(crc, word);
+            }
+            #[allow(clippy::cast_possible_truncation)]
+            let mut crc = crc as u32;
+            for &byte in chunks.remainder() {
+                crc = _mm_crc32_u8(crc, byte);
+            }
+            crc
+        }
+    }
 
-    Ok(hasher.finalize())
+    #[cfg(target_arch = "aarch64")]
+    pub(super) mod arm {
+        use std::arch::aarch64::{__crc32cb, __crc32cd};
+
+        pub(in super::super) fn update(crc: u32, data: &[u8]) -> u32 {
+            // SAFETY: only selected after the CRC extension was detected at runtime
+            unsafe { update_crc(crc, data) }
+        }
+
+        #[target_feature(enable = "crc")]
+        unsafe fn update_crc(mut crc: u32, data: &[u8]) -> u32 {
+            let mut chunks = data.chunks_exact(8);
+            for chunk in &mut chunks {
+                let word = u64::from_le_bytes(chunk.try_into().unwrap_or_default());
+                crc = __crc32cd(crc, word);
+            }
+            for &byte in chunks.remainder() {
+                crc = __crc32cb(crc, byte);
+            }
+            crc
+        }
+    }
 }
 
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::storage::page_constants::PAGE_SIZE;
 
     #[test]
     fn test_crc32_empty_data() {
@@ -74,6 +295,10 @@ mod tests {
         let page_data = vec![0u8; 1024];
         let result = calculate_page_checksum(&page_data);
         assert!(matches!(result, Err(Error::InvalidInput(_))));
+
+        let page_data = vec![0u8; 3 * PAGE_SIZE];
+        let result = calculate_page_checksum(&page_data);
+        assert!(matches!(result, Err(Error::InvalidInput(_))));
     }
 
     #[test]
@@ -100,4 +325,83 @@ mod tests {
 
         assert_eq!(checksum1, checksum2);
     }
+
+    #[test]
+    fn test_transient_flags_excluded() {
+        let mut page = vec![0u8; PAGE_SIZE];
+        page[100] = 0x5A;
+        let clean = calculate_page_checksum(&page).unwrap();
+
+        page[5] = PAGE_FLAGS_TRANSIENT;
+        assert_eq!(calculate_page_checksum(&page).unwrap(), clean);
+
+        // Persistent flag bits are still covered
+        page[5] = 0x80;
+        assert_ne!(calculate_page_checksum(&page).unwrap(), clean);
+    }
+
+    #[test]
+    fn test_crc32c_known_values() {
+        assert_eq!(calculate_crc32c(b""), 0);
+        assert_eq!(calculate_crc32c(b"123456789"), 0xE306_9283);
+        assert_eq!(
+            calculate_crc32c(b"The quick brown fox jumps over the lazy dog"),
+            0x2262_0404
+        );
+    }
+
+    #[test]
+    fn test_crc32c_kernels_agree() {
+        #[allow(clippy::cast_possible_truncation)]
+        let data: Vec<u8> = (0..1000u32).map(|i| (i * 7 + 3) as u8).collect();
+        for len in [0, 1, 7, 8, 9, 63, 64, 1000] {
+            let expected = crc32c::software(!0, &data[..len]);
+            assert_eq!(crc32c::update(!0, &data[..len]), expected);
+        }
+    }
+
+    #[test]
+    fn test_algorithm_round_trip() {
+        for algorithm in [
+            ChecksumAlgorithm::Crc32,
+            ChecksumAlgorithm::Crc32c,
+            ChecksumAlgorithm::Xxh3,
+        ] {
+            assert_eq!(
+                ChecksumAlgorithm::try_from(algorithm as u8).unwrap(),
+                algorithm
+            );
+        }
+        assert!(ChecksumAlgorithm::try_from(0x7F).is_err());
+        assert_eq!(ChecksumAlgorithm::default(), ChecksumAlgorithm::Crc32);
+    }
+
+    #[test]
+    fn test_page_checksum_algorithms_differ() {
+        let mut page = vec![0u8; PAGE_SIZE];
+        page[200] = 0x33;
+        let crc32 = calculate_page_checksum_with(ChecksumAlgorithm::Crc32, &page).unwrap();
+        let crc32c = calculate_page_checksum_with(ChecksumAlgorithm::Crc32c, &page).unwrap();
+        let xxh3 = calculate_page_checksum_with(ChecksumAlgorithm::Xxh3, &page).unwrap();
+        assert_eq!(crc32, calculate_page_checksum(&page).unwrap());
+        assert_ne!(crc32, crc32c);
+        assert_ne!(crc32c, xxh3);
+
+        // Every algorithm skips the checksum field and transient flags
+        for algorithm in [ChecksumAlgorithm::Crc32c, ChecksumAlgorithm::Xxh3] {
+            let before = calculate_page_checksum_with(algorithm, &page).unwrap();
+            page[8..12].copy_from_slice(&[1, 2, 3, 4]);
+            page[5] = PAGE_FLAGS_TRANSIENT;
+            assert_eq!(
+                calculate_page_checksum_with(algorithm, &page).unwrap(),
+                before
+            );
+            page[13] ^= 0x01;
+            assert_ne!(
+                calculate_page_checksum_with(algorithm, &page).unwrap(),
+                before
+            );
+            page[13] ^= 0x01;
+        }
+    }
 }
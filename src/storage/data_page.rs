@@ -0,0 +1,496 @@
+//! Slotted row layout for `PageType::Data` pages
+//!
+//! The data area starts with a small header, followed by a slot directory
+//! that grows toward the end of the page. Tuples are packed from the end of
+//! the page toward the front, so the free space is the gap between the two:
+//!
+//! ```text
+//! | header | slot 0 | slot 1 | ... ->   free   <- ... | tuple 1 | tuple 0 |
+//! ```
+//!
+//! Each slot is a packed `(offset u16, length u16)` pair, 16 slots to a
+//! cache line. A point read touches the slot's line and the tuple's first
+//! line beyond the page header.
+//!
+//! Inserts take space from the gap in O(1) and reuse deleted slots through a
+//! free-slot chain, so [`SlotId`]s of live tuples never change. Deletes
+//! leave a tombstone slot and a hole in the tuple area. Holes are counted
+//! as fragmented bytes. When those exceed [`COMPACTION_THRESHOLD_PERCENT`]
+//! of the data area, or an insert needs them, live tuples are slid
+//! together in place. `PageHeader::free_space` holds the bytes available
+//! after compaction.
+//!
+//! Data area header layout:
+//!
+//! | Offset | Size | Field                                    |
+//! |--------|------|------------------------------------------|
+//! | 0      | 2    | slot count (LE)                          |
+//! | 2      | 2    | start of the tuple area (LE)             |
+//! | 4      | 2    | fragmented bytes in the tuple area (LE)  |
+//! | 6      | 2    | first free slot + 1, 0 if none (LE)      |
+//!
+//! A tombstone slot has offset 0, which no tuple can have, and holds the
+//! next free slot + 1 in its length field.
+
+use crate::common::error::Error;
+use crate::storage::page::GenericPage;
+use crate::storage::page_type::PageType;
+
+/// Index of a tuple's slot within its page
+pub type SlotId = u16;
+
+/// Bytes of the data page header at the start of the data area
+pub const DATA_PAGE_HEADER_SIZE: usize = 8;
+
+/// Bytes per slot directory entry
+pub const SLOT_SIZE: usize = 4;
+
+/// Fragmented share of the data area, in percent, above which deletes and
+/// updates compact the page
+pub const COMPACTION_THRESHOLD_PERCENT: usize = 25;
+
+const SLOT_COUNT_OFFSET: usize = 0;
+const TUPLE_START_OFFSET: usize = 2;
+const FRAGMENTED_OFFSET: usize = 4;
+const FREE_SLOT_OFFSET: usize = 6;
+
+/// Offset value marking a deleted slot
+const TOMBSTONE: u16 = 0;
+
+fn read_u16(data: &[u8], offset: usize) -> u16 {
+    u16::from_le_bytes([data[offset], data[offset + 1]])
+}
+
+fn write_u16(data: &mut [u8], offset: usize, value: u16) {
+    data[offset..offset + 2].copy_from_slice(&value.to_le_bytes());
+}
+
+fn slot_position(slot: SlotId) -> usize {
+    DATA_PAGE_HEADER_SIZE + usize::from(slot) * SLOT_SIZE
+}
+
+/// Look up a live tuple in a data area
+fn tuple_in(data: &[u8], slot: SlotId) -> Option<&[u8]> {
+    if slot >= read_u16(data, SLOT_COUNT_OFFSET) {
+        return None;
+    }
+    let position = slot_position(slot);
+    let offset = read_u16(data, position);
+    if offset == TOMBSTONE {
+        return None;
+    }
+    let start = usize::from(offset);
+    data.get(start..start + usize::from(read_u16(data, position + 2)))
+}
+
+/// Check that a data area holds a consistent slotted layout
+///
+/// Besides bounds, this checks the two invariants inserts rely on: the
+/// free-slot chain only visits tombstones and ends, and the tuple area
+/// holds exactly the live tuple bytes plus the fragmented bytes.
+fn validate(data: &[u8]) -> Result<(), Error> {
+    let slot_count = usize::from(read_u16(data, SLOT_COUNT_OFFSET));
+    let tuple_start = usize::from(read_u16(data, TUPLE_START_OFFSET));
+    let directory_end = DATA_PAGE_HEADER_SIZE + slot_count * SLOT_SIZE;
+    if directory_end > tuple_start || tuple_start > data.len() {
+        return Err(Error::corruption(format!(
+            "Data page has {slot_count} slots and tuples from {tuple_start}"
+        )));
+    }
+    let mut live_bytes = 0;
+    for slot in 0..slot_count {
+        let position = DATA_PAGE_HEADER_SIZE + slot * SLOT_SIZE;
+        let offset = usize::from(read_u16(data, position));
+        let len = usize::from(read_u16(data, position + 2));
+        let in_bounds = if offset == usize::from(TOMBSTONE) {
+            len <= slot_count
+        } else {
+            live_bytes += len;
+            offset >= tuple_start && offset + len <= data.len()
+        };
+        if !in_bounds {
+            return Err(Error::corruption(format!(
+                "Data page slot {slot} is out of bounds"
+            )));
+        }
+    }
+    let fragmented = usize::from(read_u16(data, FRAGMENTED_OFFSET));
+    if live_bytes + fragmented != data.len() - tuple_start {
+        return Err(Error::corruption(format!(
+            "Data page has {live_bytes} live and {fragmented} fragmented bytes in a \
+             {}-byte tuple area",
+            data.len() - tuple_start
+        )));
+    }
+
+    // Each step visits a distinct tombstone, so a longer chain has a cycle
+    let mut next = usize::from(read_u16(data, FREE_SLOT_OFFSET));
+    for _ in 0..=slot_count {
+        if next == 0 {
+            return Ok(());
+        }
+        let position = DATA_PAGE_HEADER_SIZE + (next - 1) * SLOT_SIZE;
+        if next > slot_count || read_u16(data, position) != TOMBSTONE {
+            return Err(Error::corruption(format!(
+                "Data page free-slot chain reaches slot {} that is not a tombstone",
+                next - 1
+            )));
+        }
+        next = usize::from(read_u16(data, position + 2));
+    }
+    Err(Error::corruption("Data page free-slot chain has a cycle"))
+}
+
+/// Slotted view of a data page being modified
+pub struct DataPage<'a, const N: usize> {
+    page: &'a mut GenericPage<N>,
+}
+
+impl<'a, const N: usize> DataPage<'a, N> {
+    /// Format `page` as an empty data page and return a view of it
+    pub fn init(page: &'a mut GenericPage<N>) -> Self {
+        page.header_mut().page_type = PageType::Data;
+        let data = page.data_mut();
+        data.fill(0);
+        #[allow(clippy::cast_possible_truncation)]
+        let end = data.len() as u16;
+        write_u16(data, TUPLE_START_OFFSET, end);
+        let mut view = Self { page };
+        view.update_free_space();
+        view
+    }
+
+    /// View an existing data page
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidPageType` if the page is not a data page, or
+    /// `Error::Corruption` if its slot layout is inconsistent
+    pub fn open(page: &'a mut GenericPage<N>) -> Result<Self, Error> {
+        let page_type = page.header().page_type;
+        if page_type != PageType::Data {
+            return Err(Error::InvalidPageType(page_type as u8));
+        }
+        validate(page.data())?;
+        Ok(Self { page })
+    }
+
+    /// Number of slots, including tombstones
+    pub fn slot_count(&self) -> u16 {
+        read_u16(self.page.data(), SLOT_COUNT_OFFSET)
+    }
+
+    /// Bytes held by holes in the tuple area
+    pub fn fragmented_bytes(&self) -> usize {
+        usize::from(read_u16(self.page.data(), FRAGMENTED_OFFSET))
+    }
+
+    /// Bytes between the slot directory and the tuple area
+    pub fn contiguous_free(&self) -> usize {
+        let data = self.page.data();
+        usize::from(read_u16(data, TUPLE_START_OFFSET)) - self.directory_end()
+    }
+
+    /// Bytes available for tuples and slots once the page is compacted
+    pub fn free_space(&self) -> usize {
+        self.contiguous_free() + self.fragmented_bytes()
+    }
+
+    /// Whether a tuple of `len` bytes can be inserted
+    pub fn fits(&self, len: usize) -> bool {
+        len + self.new_slot_cost() <= self.free_space()
+    }
+
+    /// A live tuple, or `None` for tombstones and unknown slots
+    pub fn get(&self, slot: SlotId) -> Option<&[u8]> {
+        tuple_in(self.page.data(), slot)
+    }
+
+    /// Mutable access to a live tuple's bytes
+    pub fn get_mut(&mut self, slot: SlotId) -> Option<&mut [u8]> {
+        let (start, len) = self.live_slot(slot)?;
+        Some(&mut self.page.data_mut()[start..start + len])
+    }
+
+    /// Store a tuple; returns its slot, or `None` if the page lacks space
+    ///
+    /// Compacts the page first when only fragmented space is large enough.
+    pub fn insert(&mut self, tuple: &[u8]) -> Option<SlotId> {
+        if !self.fits(tuple.len()) {
+            return None;
+        }
+        if tuple.len() + self.new_slot_cost() > self.contiguous_free() {
+            self.compact();
+        }
+
+        let offset = self.reserve(tuple.len());
+        let data = self.page.data_mut();
+        data[offset..offset + tuple.len()].copy_from_slice(tuple);
+
+        let free_head = read_u16(data, FREE_SLOT_OFFSET);
+        let slot = if free_head == 0 {
+            let slot = read_u16(data, SLOT_COUNT_OFFSET);
+            write_u16(data, SLOT_COUNT_OFFSET, slot + 1);
+            slot
+        } else {
+            let slot = free_head - 1;
+            let next = read_u16(data, slot_position(slot) + 2);
+            write_u16(data, FREE_SLOT_OFFSET, next);
+            slot
+        };
+        self.set_slot(slot, offset, tuple.len());
+        self.update_free_space();
+        Some(slot)
+    }
+
+    /// Delete a tuple, leaving a tombstone slot for reuse
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::NotFound` if the slot holds no live tuple
+    pub fn delete(&mut self, slot: SlotId) -> Result<(), Error> {
+        let (_, len) = self
+            .live_slot(slot)
+            .ok_or_else(|| Error::not_found(format!("No tuple in slot {slot}")))?;
+        let data = self.page.data_mut();
+        let next = read_u16(data, FREE_SLOT_OFFSET);
+        let position = slot_position(slot);
+        write_u16(data, position, TOMBSTONE);
+        write_u16(data, position + 2, next);
+        write_u16(data, FREE_SLOT_OFFSET, slot + 1);
+        self.add_fragmented(len);
+        self.compact_if_fragmented();
+        self.update_free_space();
+        Ok(())
+    }
+
+    /// Replace a tuple's bytes, keeping its slot
+    ///
+    /// Shrinking tuples stay in place. Growing ones move within the page.
+    /// Returns `Ok(false)`, with the page unchanged, if the new tuple does
+    /// not fit.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::NotFound` if the slot holds no live tuple
+    pub fn update(&mut self, slot: SlotId, tuple: &[u8]) -> Result<bool, Error> {
+        let (start, len) = self
+            .live_slot(slot)
+            .ok_or_else(|| Error::not_found(format!("No tuple in slot {slot}")))?;
+        if tuple.len() <= len {
+            self.page.data_mut()[start..start + tuple.len()].copy_from_slice(tuple);
+            self.set_slot(slot, start, tuple.len());
+            self.add_fragmented(len - tuple.len());
+        } else {
+            if tuple.len() > self.free_space() + len {
+                return Ok(false);
+            }
+            // Release the old bytes first so compaction can reclaim them
+            self.set_slot(slot, start, 0);
+            self.add_fragmented(len);
+            if tuple.len() > self.contiguous_free() {
+                self.compact();
+            }
+            let offset = self.reserve(tuple.len());
+            self.page.data_mut()[offset..offset + tuple.len()].copy_from_slice(tuple);
+            self.set_slot(slot, offset, tuple.len());
+        }
+        self.compact_if_fragmented();
+        self.update_free_space();
+        Ok(true)
+    }
+
+    /// Slide live tuples to the end of the page so all free space is
+    /// contiguous; slot IDs are unchanged
+    pub fn compact(&mut self) {
+        let slot_count = self.slot_count();
+        let data = self.page.data_mut();
+        let mut live: Vec<(SlotId, usize, usize)> = (0..slot_count)
+            .filter_map(|slot| {
+                let position = slot_position(slot);
+                let offset = read_u16(data, position);
+                (offset != TOMBSTONE).then(|| {
+                    (
+                        slot,
+                        usize::from(offset),
+                        usize::from(read_u16(data, position + 2)),
+                    )
+                })
+            })
+            .collect();
+        // Moving the highest tuple first means no move overwrites a tuple
+        // that has not moved yet
+        live.sort_unstable_by(|a, b| b.1.cmp(&a.1));
+
+        let mut end = data.len();
+        for (slot, offset, len) in live {
+            end -= len;
+            data.copy_within(offset..offset + len, end);
+            #[allow(clippy::cast_possible_truncation)]
+            write_u16(data, slot_position(slot), end as u16);
+        }
+        #[allow(clippy::cast_possible_truncation)]
+        write_u16(data, TUPLE_START_OFFSET, end as u16);
+        write_u16(data, FRAGMENTED_OFFSET, 0);
+        self.update_free_space();
+    }
+
+    fn directory_end(&self) -> usize {
+        slot_position(self.slot_count())
+    }
+
+    /// Directory bytes an insert needs, 0 when a tombstone can be reused
+    fn new_slot_cost(&self) -> usize {
+        if read_u16(self.page.data(), FREE_SLOT_OFFSET) == 0 {
+            SLOT_SIZE
+        } else {
+            0
+        }
+    }
+
+    fn live_slot(&self, slot: SlotId) -> Option<(usize, usize)> {
+        let data = self.page.data();
+        if slot >= read_u16(data, SLOT_COUNT_OFFSET) {
+            return None;
+        }
+        let position = slot_position(slot);
+        let offset = read_u16(data, position);
+        (offset != TOMBSTONE).then(|| {
+            (
+                usize::from(offset),
+                usize::from(read_u16(data, position + 2)),
+            )
+        })
+    }
+
+    /// Carve `len` bytes off the front of the tuple area
+    fn reserve(&mut self, len: usize) -> usize {
+        let data = self.page.data_mut();
+        let offset = usize::from(read_u16(data, TUPLE_START_OFFSET)) - len;
+        #[allow(clippy::cast_possible_truncation)]
+        write_u16(data, TUPLE_START_OFFSET, offset as u16);
+        offset
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    fn set_slot(&mut self, slot: SlotId, offset: usize, len: usize) {
+        let data = self.page.data_mut();
+        let position = slot_position(slot);
+        write_u16(data, position, offset as u16);
+        write_u16(data, position + 2, len as u16);
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    fn add_fragmented(&mut self, len: usize) {
+        let fragmented = self.fragmented_bytes() + len;
+        write_u16(self.page.data_mut(), FRAGMENTED_OFFSET, fragmented as u16);
+    }
+
+    fn compact_if_fragmented(&mut self) {
+        let threshold = self.page.data().len() * COMPACTION_THRESHOLD_PERCENT / 100;
+        if self.fragmented_bytes() > threshold {
+            self.compact();
+        }
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    fn update_free_space(&mut self) {
+        let free_space = self.free_space() as u16;
+        self.page.header_mut().free_space = free_space;
+    }
+}
+
+/// Read-only slotted view of a data page's data area
+///
+/// Works over any page data, for example
+/// [`PageRef::data`](crate::storage::page_ref::PageRef::data) on a buffer
+/// pool frame, without copying.
+#[derive(Clone, Copy)]
+pub struct DataPageRef<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> DataPageRef<'a> {
+    /// View the data area of a data page
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if the slot layout is inconsistent
+    pub fn new(data: &'a [u8]) -> Result<Self, Error> {
+        if data.len() < DATA_PAGE_HEADER_SIZE {
+            return Err(Error::corruption("Data area too small for a data page"));
+        }
+        validate(data)?;
+        Ok(Self { data })
+    }
+
+    /// Number of slots, including tombstones
+    pub fn slot_count(&self) -> u16 {
+        read_u16(self.data, SLOT_COUNT_OFFSET)
+    }
+
+    /// A live tuple, or `None` for tombstones and unknown slots
+    pub fn get(&self, slot: SlotId) -> Option<&'a [u8]> {
+        tuple_in(self.data, slot)
+    }
+
+    /// Live tuples with their slots, in slot order
+    pub fn iter(&self) -> impl Iterator<Item = (SlotId, &'a [u8])> + 'a {
+        let data = self.data;
+        (0..self.slot_count()).filter_map(move |slot| tuple_in(data, slot).map(|t| (slot, t)))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::storage::page::Page;
+    use crate::storage::page_constants::PAGE_USABLE_SIZE;
+
+    #[test]
+    fn test_empty_page_layout() {
+        let mut page = Page::new();
+        let view = DataPage::init(&mut page);
+        assert_eq!(view.slot_count(), 0);
+        assert_eq!(view.free_space(), PAGE_USABLE_SIZE - DATA_PAGE_HEADER_SIZE);
+        let free_space = page.header().free_space;
+        assert_eq!(
+            usize::from(free_space),
+            PAGE_USABLE_SIZE - DATA_PAGE_HEADER_SIZE
+        );
+    }
+
+    #[test]
+    fn test_tombstones_chain_in_delete_order() {
+        let mut page = Page::new();
+        let mut view = DataPage::init(&mut page);
+        for byte in 0..4u8 {
+            view.insert(&[byte; 10]).unwrap();
+        }
+        view.delete(1).unwrap();
+        view.delete(3).unwrap();
+        // Most recently deleted slot is reused first
+        assert_eq!(view.insert(b"x"), Some(3));
+        assert_eq!(view.insert(b"y"), Some(1));
+        assert_eq!(view.insert(b"z"), Some(4));
+    }
+
+    #[test]
+    fn test_compaction_keeps_slots() {
+        let mut page = Page::new();
+        let mut view = DataPage::init(&mut page);
+        let slots: Vec<SlotId> = (0..6u8).map(|b| view.insert(&[b; 100]).unwrap()).collect();
+        view.delete(slots[1]).unwrap();
+        view.delete(slots[4]).unwrap();
+        assert_eq!(view.fragmented_bytes(), 200);
+
+        let free = view.free_space();
+        view.compact();
+        assert_eq!(view.fragmented_bytes(), 0);
+        assert_eq!(view.free_space(), free);
+        assert_eq!(view.contiguous_free(), free);
+        for byte in [0u8, 2, 3, 5] {
+            assert_eq!(view.get(u16::from(byte)).unwrap(), &[byte; 100]);
+        }
+    }
+}
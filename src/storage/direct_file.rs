@@ -0,0 +1,305 @@
+//! Persistent direct I/O file handle
+//!
+//! [`page_io::write_page_direct`] and [`page_io::read_page_direct`] open a
+//! fresh descriptor per page. [`DirectFile`] opens the file once with
+//! `O_DIRECT` (`F_NOCACHE` on macOS), checks that page buffers satisfy the
+//! file's direct I/O alignment rules, and then serves single and batched page
+//! transfers that bypass the OS page cache. It is meant for a buffer pool that
+//! does its own caching.
+//!
+//! [`page_io::write_page_direct`]: crate::storage::page_io::write_page_direct
+//! [`page_io::read_page_direct`]: crate::storage::page_io::read_page_direct
+
+use crate::common::error::Error;
+use crate::storage::checksum::ChecksumAlgorithm;
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PageId, PAGE_SIZE};
+use crate::storage::page_file::PageFile;
+use std::fs::{File, OpenOptions};
+use std::path::Path;
+
+/// Logical block size assumed when the platform cannot report one
+pub const DEFAULT_LOGICAL_BLOCK_SIZE: usize = 512;
+
+/// Alignment rules for direct I/O on a particular file
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct DirectIoAlignment {
+    /// Required alignment of user buffers in memory
+    pub memory: usize,
+    /// Required alignment of file offsets and transfer lengths (the logical
+    /// block size)
+    pub offset: usize,
+}
+
+impl Default for DirectIoAlignment {
+    fn default() -> Self {
+        Self {
+            memory: DEFAULT_LOGICAL_BLOCK_SIZE,
+            offset: DEFAULT_LOGICAL_BLOCK_SIZE,
+        }
+    }
+}
+
+impl DirectIoAlignment {
+    /// Check that `Page` buffers and page-sized transfers meet these rules
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if either requirement is not met
+    pub fn validate(&self) -> Result<(), Error> {
+        let page_align = std::mem::align_of::<Page>();
+        if self.memory == 0 || !page_align.is_multiple_of(self.memory) {
+            return Err(Error::invalid_input(format!(
+                "Page alignment {page_align} does not satisfy direct I/O memory alignment {}",
+                self.memory
+            )));
+        }
+        if self.offset == 0 || !PAGE_SIZE.is_multiple_of(self.offset) {
+            return Err(Error::invalid_input(format!(
+                "Page size {PAGE_SIZE} is not a multiple of the logical block size {}",
+                self.offset
+            )));
+        }
+        Ok(())
+    }
+}
+
+/// A database file opened once for cache-bypassing page I/O
+#[derive(Debug)]
+pub struct DirectFile {
+    file: PageFile,
+    alignment: DirectIoAlignment,
+}
+
+impl DirectFile {
+    /// Open (or create) a file for direct I/O
+    ///
+    /// On platforms without a direct I/O mode the file is opened normally and
+    /// behaves like a [`PageFile`].
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be opened in direct mode (for
+    /// example on tmpfs), or if `Page` buffers do not meet its alignment
+    /// requirements
+    pub fn open<P: AsRef<Path>>(path: P) -> Result<Self, Error> {
+        let mut options = OpenOptions::new();
+        options.read(true).write(true).create(true).truncate(false);
+        #[cfg(target_os = "linux")]
+        {
+            use std::os::unix::fs::OpenOptionsExt;
+            options.custom_flags(libc::O_DIRECT);
+        }
+        let file = options.open(path)?;
+        #[cfg(target_os = "macos")]
+        platform::disable_caching(&file)?;
+
+        let alignment = platform::alignment(&file)?;
+        alignment.validate()?;
+        Ok(Self {
+            file: PageFile::from_file(file),
+            alignment,
+        })
+    }
+
+    /// Use `algorithm` to verify pages read through this handle
+    #[must_use]
+    pub fn with_checksum_algorithm(mut self, algorithm: ChecksumAlgorithm) -> Self {
+        self.file = self.file.with_checksum_algorithm(algorithm);
+        self
+    }
+
+    /// Grow the file in preallocated chunks (see
+    /// [`PageFile::with_preallocation`])
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file metadata cannot be read
+    pub fn with_preallocation(mut self, chunk_bytes: u64) -> Result<Self, Error> {
+        self.file = self.file.with_preallocation(chunk_bytes)?;
+        Ok(self)
+    }
+
+    /// Alignment rules reported for this file
+    pub fn alignment(&self) -> DirectIoAlignment {
+        self.alignment
+    }
+
+    /// The underlying file
+    pub fn file(&self) -> &File {
+        self.file.file()
+    }
+
+    /// Number of whole pages in the file
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file metadata cannot be read
+    pub fn page_count(&self) -> Result<u64, Error> {
+        self.file.page_count()
+    }
+
+    /// Read a page and verify its checksum
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the read fails or the checksum does not match
+    pub fn read_page(&self, page_id: PageId) -> Result<Page, Error> {
+        self.file.read_page(page_id)
+    }
+
+    /// Read a page into an existing buffer and verify its checksum
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the read fails or the checksum does not match
+    pub fn read_page_into(&self, page_id: PageId, page: &mut Page) -> Result<(), Error> {
+        self.file.read_page_into(page_id, page)
+    }
+
+    /// Write a page at its position in the file
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the write fails
+    pub fn write_page(&self, page_id: PageId, page: &Page) -> Result<(), Error> {
+        self.file.write_page(page_id, page)
+    }
+
+    /// Read many pages, merging adjacent page IDs into single vectored reads
+    ///
+    /// Each iovec targets a whole `Page`, so every segment stays aligned.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if any read or checksum verification fails
+    pub fn read_pages(&self, page_ids: &[PageId]) -> Result<Vec<Page>, Error> {
+        self.file.read_pages(page_ids)
+    }
+
+    /// Write many pages, merging adjacent page IDs into single vectored writes
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if any write fails
+    pub fn write_pages(&self, pages: &[(PageId, &Page)]) -> Result<(), Error> {
+        self.file.write_pages(pages)
+    }
+
+    /// Flush device caches and any metadata needed to read the data back
+    ///
+    /// Direct writes skip the page cache but may still sit in the drive's
+    /// volatile cache until this returns.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the sync fails
+    pub fn sync_data(&self) -> Result<(), Error> {
+        self.file.sync_data()
+    }
+}
+
+#[cfg(all(target_os = "linux", target_env = "gnu"))]
+mod platform {
+    use super::DirectIoAlignment;
+    use crate::common::error::Error;
+    use std::fs::File;
+    use std::io;
+    use std::os::unix::io::AsRawFd;
+
+    /// Query `STATX_DIOALIGN`, falling back to the defaults on kernels older
+    /// than 6.1 that do not report it
+    pub(super) fn alignment(file: &File) -> Result<DirectIoAlignment, Error> {
+        // SAFETY: statx only writes into the zeroed struct we pass it
+        let stx = unsafe {
+            let mut stx: libc::statx = std::mem::zeroed();
+            let rc = libc::statx(
+                file.as_raw_fd(),
+                c"".as_ptr(),
+                libc::AT_EMPTY_PATH,
+                libc::STATX_DIOALIGN,
+                std::ptr::addr_of_mut!(stx),
+            );
+            if rc != 0 {
+                return Err(io::Error::last_os_error().into());
+            }
+            stx
+        };
+        if stx.stx_mask & libc::STATX_DIOALIGN == 0 {
+            return Ok(DirectIoAlignment::default());
+        }
+        if stx.stx_dio_offset_align == 0 {
+            return Err(Error::invalid_input(
+                "File system does not support direct I/O for this file",
+            ));
+        }
+        Ok(DirectIoAlignment {
+            memory: stx.stx_dio_mem_align as usize,
+            offset: stx.stx_dio_offset_align as usize,
+        })
+    }
+}
+
+#[cfg(not(all(target_os = "linux", target_env = "gnu")))]
+mod platform {
+    use super::DirectIoAlignment;
+    use crate::common::error::Error;
+    use std::fs::File;
+
+    /// No portable query exists; assume the traditional 512-byte sector
+    pub(super) fn alignment(_file: &File) -> Result<DirectIoAlignment, Error> {
+        Ok(DirectIoAlignment::default())
+    }
+
+    /// Turn off page caching for this descriptor
+    #[cfg(target_os = "macos")]
+    pub(super) fn disable_caching(file: &File) -> Result<(), Error> {
+        use std::os::unix::io::AsRawFd;
+
+        // SAFETY: F_NOCACHE takes an integer argument and touches no memory
+        if unsafe { libc::fcntl(file.as_raw_fd(), libc::F_NOCACHE, 1) } == -1 {
+            return Err(std::io::Error::last_os_error().into());
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_alignment_validation() {
+        assert!(DirectIoAlignment::default().validate().is_ok());
+        assert!(DirectIoAlignment {
+            memory: 4096,
+            offset: 4096
+        }
+        .validate()
+        .is_ok());
+
+        let too_strict_memory = DirectIoAlignment {
+            memory: 8192,
+            offset: 512,
+        };
+        assert!(matches!(
+            too_strict_memory.validate(),
+            Err(Error::InvalidInput(_))
+        ));
+
+        let block_larger_than_page = DirectIoAlignment {
+            memory: 512,
+            offset: PAGE_SIZE * 2,
+        };
+        assert!(matches!(
+            block_larger_than_page.validate(),
+            Err(Error::InvalidInput(_))
+        ));
+
+        let unknown = DirectIoAlignment {
+            memory: 0,
+            offset: 0,
+        };
+        assert!(unknown.validate().is_err());
+    }
+}
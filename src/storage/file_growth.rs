@@ -0,0 +1,344 @@
+//! Chunked file preallocation and compaction
+//!
+//! Writing past the end of a file extends it one page at a time, so almost
+//! every append pays for a file-system metadata update and the file's
+//! blocks end up scattered. [`FileGrowth`] instead reserves space in large
+//! chunks with `fallocate` (`F_PREALLOCATE` on Apple platforms). It tracks
+//! the logical high-water page, the end of the pages actually written,
+//! separately from the physical size, which includes the preallocated tail.
+//!
+//! [`compact`](FileGrowth::compact) hands space back to the file system: free
+//! pages at the end of the file are truncated away, and wholly free extents
+//! inside it are punched out where the platform supports hole punching.
+//!
+//! On platforms without a preallocation call, files are extended with
+//! `set_len` to the same chunk boundaries.
+
+use crate::common::error::Error;
+use crate::storage::file_header::FileHeader;
+use crate::storage::page_allocator::PageAllocator;
+use crate::storage::page_file::PageFile;
+use parking_lot::Mutex;
+use std::fs::File;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// Default preallocation chunk (64 MiB)
+pub const DEFAULT_PREALLOCATION_CHUNK: u64 = 64 * 1024 * 1024;
+
+/// Space returned to the file system by [`FileGrowth::compact`]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct CompactionStats {
+    /// Pages cut off the end of the file
+    pub truncated_pages: u64,
+    /// Free pages inside the file whose blocks were deallocated
+    pub punched_pages: u64,
+}
+
+/// Tracks logical and physical file size and grows files in chunks
+#[derive(Debug)]
+pub struct FileGrowth {
+    page_size: u64,
+    chunk_pages: u64,
+    /// One past the highest page written
+    high_water: AtomicU64,
+    /// Pages backed by the file's length; changed under `resize`
+    physical: AtomicU64,
+    /// Serializes changes to the physical size
+    resize: Mutex<()>,
+}
+
+impl FileGrowth {
+    /// Track `file`, made of `page_size` pages, growing it by `chunk_bytes`
+    /// (rounded up to whole pages) at a time
+    ///
+    /// The high-water mark starts at the current file size; use
+    /// [`with_high_water`](Self::with_high_water) when the logical size is
+    /// known, for example from the file header.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file metadata cannot be read
+    pub fn new(file: &File, page_size: usize, chunk_bytes: u64) -> Result<Self, Error> {
+        let page_size = page_size as u64;
+        let pages = file.metadata()?.len() / page_size;
+        Ok(Self {
+            page_size,
+            chunk_pages: chunk_bytes.div_ceil(page_size).max(1),
+            high_water: AtomicU64::new(pages),
+            physical: AtomicU64::new(pages),
+            resize: Mutex::new(()),
+        })
+    }
+
+    /// Set the logical size in pages
+    #[must_use]
+    pub fn with_high_water(self, pages: u64) -> Self {
+        self.high_water.store(pages, Ordering::Release);
+        self
+    }
+
+    /// Pages per preallocation chunk
+    pub fn chunk_pages(&self) -> u64 {
+        self.chunk_pages
+    }
+
+    /// One past the highest page written (the logical size in pages)
+    pub fn high_water(&self) -> u64 {
+        self.high_water.load(Ordering::Acquire)
+    }
+
+    /// Pages covered by the file's length, including preallocated ones
+    pub fn physical_pages(&self) -> u64 {
+        self.physical.load(Ordering::Acquire)
+    }
+
+    /// Make sure pages `0..end_page` are backed by the file before writing
+    /// them, and raise the high-water mark
+    ///
+    /// Only the first write past the preallocated region touches file
+    /// metadata; it grows the file to the next chunk boundary.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be extended
+    pub fn reserve(&self, file: &File, end_page: u64) -> Result<(), Error> {
+        if self.physical_pages() < end_page {
+            let _resize = self.resize.lock();
+            let physical = self.physical_pages();
+            if physical < end_page {
+                let target = end_page.div_ceil(self.chunk_pages) * self.chunk_pages;
+                preallocate(file, target * self.page_size)?;
+                self.physical.store(target, Ordering::Release);
+            }
+        }
+        self.high_water.fetch_max(end_page, Ordering::AcqRel);
+        Ok(())
+    }
+
+    /// Return free space to the file system
+    ///
+    /// Free pages at the end of the allocator's range are released and the
+    /// file is truncated after the last page in use, dropping the
+    /// preallocated tail too. Before truncating, the allocator is saved and
+    /// `header` updated, so the header never counts pages past the end of
+    /// the file. Wholly free extents inside the file are then punched out
+    /// where supported.
+    ///
+    /// Run this while no pages are being allocated.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the allocator cannot be saved, the file cannot be
+    /// truncated or a hole cannot be punched
+    pub fn compact(
+        &self,
+        file: &PageFile,
+        allocator: &PageAllocator,
+        header: &mut FileHeader,
+    ) -> Result<CompactionStats, Error> {
+        let mut stats = CompactionStats::default();
+
+        if allocator.trim_free_tail() < self.physical_pages() {
+            allocator.save(file, header)?;
+        }
+        let _resize = self.resize.lock();
+        // Saving may have taken pages for the free list past the old end
+        let end = allocator.allocated_pages();
+        let physical = self.physical_pages();
+        if end < physical {
+            file.file().set_len(end * self.page_size)?;
+            self.physical.store(end, Ordering::Release);
+            stats.truncated_pages = physical - end;
+        }
+        self.high_water.fetch_min(end, Ordering::AcqRel);
+
+        for extent in allocator.free_extents() {
+            let offset = extent.start * self.page_size;
+            let len = extent.len * self.page_size;
+            if !punch_hole(file.file(), offset, len)? {
+                break;
+            }
+            stats.punched_pages += extent.len;
+        }
+        Ok(stats)
+    }
+}
+
+/// Extend `file` to `len` bytes with its new blocks allocated up front
+///
+/// Does nothing if the file is already at least `len` bytes long. Falls back
+/// to a plain (possibly sparse) `set_len` if the file system cannot
+/// preallocate.
+///
+/// # Errors
+///
+/// Returns an error if the file cannot be extended
+pub fn preallocate(file: &File, len: u64) -> Result<(), Error> {
+    let current = file.metadata()?.len();
+    if current >= len {
+        return Ok(());
+    }
+    platform::allocate(file, current, len - current)?;
+    if file.metadata()?.len() < len {
+        file.set_len(len)?;
+    }
+    Ok(())
+}
+
+/// Deallocate the blocks behind `len` bytes at `offset`, keeping the file
+/// size; the range reads back as zeros
+///
+/// Returns `false` if the platform or file system cannot punch holes.
+///
+/// # Errors
+///
+/// Returns an error if the call fails for another reason
+pub fn punch_hole(file: &File, offset: u64, len: u64) -> Result<bool, Error> {
+    platform::punch_hole(file, offset, len)
+}
+
+#[cfg(any(target_os = "linux", target_os = "android"))]
+mod platform {
+    use crate::common::error::Error;
+    use std::fs::File;
+    use std::io;
+    use std::os::unix::io::AsRawFd;
+
+    fn fallocate(file: &File, mode: libc::c_int, offset: u64, len: u64) -> Result<bool, Error> {
+        let (Ok(offset), Ok(len)) = (libc::off_t::try_from(offset), libc::off_t::try_from(len))
+        else {
+            return Err(Error::invalid_input("File range exceeds off_t"));
+        };
+        // SAFETY: fallocate only operates on the descriptor
+        if unsafe { libc::fallocate(file.as_raw_fd(), mode, offset, len) } == 0 {
+            return Ok(true);
+        }
+        let err = io::Error::last_os_error();
+        match err.raw_os_error() {
+            Some(libc::EOPNOTSUPP | libc::ENOSYS) => Ok(false),
+            _ => Err(err.into()),
+        }
+    }
+
+    pub(super) fn allocate(file: &File, offset: u64, len: u64) -> Result<bool, Error> {
+        fallocate(file, 0, offset, len)
+    }
+
+    pub(super) fn punch_hole(file: &File, offset: u64, len: u64) -> Result<bool, Error> {
+        fallocate(
+            file,
+            libc::FALLOC_FL_PUNCH_HOLE | libc::FALLOC_FL_KEEP_SIZE,
+            offset,
+            len,
+        )
+    }
+}
+
+#[cfg(any(target_os = "macos", target_os = "ios"))]
+mod platform {
+    use crate::common::error::Error;
+    use std::fs::File;
+    use std::io;
+    use std::os::unix::io::AsRawFd;
+
+    fn off_t(value: u64) -> Result<libc::off_t, Error> {
+        libc::off_t::try_from(value).map_err(|_| Error::invalid_input("File range exceeds off_t"))
+    }
+
+    /// Reserve `len` bytes past the physical end of file; the caller then
+    /// sets the logical size
+    pub(super) fn allocate(file: &File, _offset: u64, len: u64) -> Result<bool, Error> {
+        let mut store = libc::fstore_t {
+            fst_flags: libc::F_ALLOCATECONTIG | libc::F_ALLOCATEALL,
+            fst_posmode: libc::F_PEOFPOSMODE,
+            fst_offset: 0,
+            fst_length: off_t(len)?,
+            fst_bytesalloc: 0,
+        };
+        // SAFETY: F_PREALLOCATE reads and updates the fstore_t we pass
+        unsafe {
+            if libc::fcntl(file.as_raw_fd(), libc::F_PREALLOCATE, &mut store) != -1 {
+                return Ok(true);
+            }
+            // No contiguous run available; accept a fragmented allocation
+            store.fst_flags = libc::F_ALLOCATEALL;
+            if libc::fcntl(file.as_raw_fd(), libc::F_PREALLOCATE, &mut store) != -1 {
+                return Ok(true);
+            }
+        }
+        Ok(false)
+    }
+
+    pub(super) fn punch_hole(file: &File, offset: u64, len: u64) -> Result<bool, Error> {
+        let hole = libc::fpunchhole_t {
+            fp_flags: 0,
+            reserved: 0,
+            fp_offset: off_t(offset)?,
+            fp_length: off_t(len)?,
+        };
+        // SAFETY: F_PUNCHHOLE only reads the fpunchhole_t we pass
+        if unsafe { libc::fcntl(file.as_raw_fd(), libc::F_PUNCHHOLE, &hole) } != -1 {
+            return Ok(true);
+        }
+        let err = io::Error::last_os_error();
+        match err.raw_os_error() {
+            Some(libc::ENOTSUP | libc::EINVAL) => Ok(false),
+            _ => Err(err.into()),
+        }
+    }
+}
+
+#[cfg(not(any(
+    target_os = "linux",
+    target_os = "android",
+    target_os = "macos",
+    target_os = "ios"
+)))]
+mod platform {
+    use crate::common::error::Error;
+    use std::fs::File;
+
+    /// No preallocation call; `preallocate` falls back to `set_len`
+    pub(super) fn allocate(_file: &File, _offset: u64, _len: u64) -> Result<bool, Error> {
+        Ok(false)
+    }
+
+    pub(super) fn punch_hole(_file: &File, _offset: u64, _len: u64) -> Result<bool, Error> {
+        Ok(false)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::storage::page_constants::PAGE_SIZE;
+    use tempfile::tempfile;
+
+    #[test]
+    fn test_reserve_grows_in_chunks() {
+        let file = tempfile().unwrap();
+        let growth = FileGrowth::new(&file, PAGE_SIZE, 10 * PAGE_SIZE as u64 - 1).unwrap();
+        assert_eq!(growth.chunk_pages(), 10);
+        assert_eq!(growth.physical_pages(), 0);
+
+        growth.reserve(&file, 1).unwrap();
+        assert_eq!(growth.high_water(), 1);
+        assert_eq!(growth.physical_pages(), 10);
+        assert_eq!(file.metadata().unwrap().len(), 10 * PAGE_SIZE as u64);
+
+        growth.reserve(&file, 7).unwrap();
+        assert_eq!(growth.physical_pages(), 10);
+        growth.reserve(&file, 11).unwrap();
+        assert_eq!(growth.high_water(), 11);
+        assert_eq!(growth.physical_pages(), 20);
+    }
+
+    #[test]
+    fn test_preallocate_never_shrinks() {
+        let file = tempfile().unwrap();
+        preallocate(&file, 3 * PAGE_SIZE as u64).unwrap();
+        assert_eq!(file.metadata().unwrap().len(), 3 * PAGE_SIZE as u64);
+        preallocate(&file, PAGE_SIZE as u64).unwrap();
+        assert_eq!(file.metadata().unwrap().len(), 3 * PAGE_SIZE as u64);
+    }
+}
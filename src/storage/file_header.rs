@@ -0,0 +1,340 @@
+//! Database file header stored in page 0
+//!
+//! The header page identifies the file and records settings fixed at
+//! database creation, such as the page [`ChecksumAlgorithm`], plus the
+//! roots of the persisted free list and free-space map. Its data area starts with:
+//!
+//! | Offset | Size | Field                            |
+//! |--------|------|----------------------------------|
+//! | 0      | 8    | magic `LUMENDB\0`                |
+//! | 8      | 2    | format version (LE)              |
+//! | 10     | 1    | checksum algorithm               |
+//! | 12     | 4    | first free-list page, 0 if none  |
+//! | 16     | 4    | allocated page count, 0 if unset |
+//! | 20     | 4    | page size in bytes, 0 for 4 KiB  |
+//! | 24     | 4    | free-list page, high 32 bits     |
+//! | 28     | 4    | allocated page count, high bits  |
+//! | 32     | 8    | first free-space map page, or 0  |
+//!
+//! The allocator, page size and free-space map fields read as zero in headers written
+//! before they existed, which means "not recorded" or "default", so the
+//! format version is unchanged. 4 KiB databases still store 0, and files
+//! with fewer than 2^32 pages leave the high halves zero, so such files are
+//! identical to the original format.
+//!
+//! The header page itself is always a 4 KiB page checksummed with CRC32, so
+//! that it can be read and verified before the page size and algorithm are
+//! known. With larger pages it occupies the start of page 0's slot.
+
+use crate::common::error::Error;
+use crate::storage::checksum::ChecksumAlgorithm;
+use crate::storage::page::Page;
+use crate::storage::page_constants::{is_valid_page_size, PageId, INVALID_PAGE_ID, PAGE_SIZE};
+use crate::storage::page_file::PageFile;
+use crate::storage::page_type::PageType;
+
+/// Page ID of the file header
+pub const HEADER_PAGE_ID: PageId = 0;
+
+/// Magic bytes at the start of the header page data area
+pub const FILE_MAGIC: [u8; 8] = *b"LUMENDB\0";
+
+/// Current on-disk format version
+pub const FILE_FORMAT_VERSION: u16 = 1;
+
+const MAGIC_OFFSET: usize = 0;
+const VERSION_OFFSET: usize = 8;
+const CHECKSUM_OFFSET: usize = 10;
+const FREE_LIST_ROOT_OFFSET: usize = 12;
+const ALLOCATED_PAGES_OFFSET: usize = 16;
+const PAGE_SIZE_OFFSET: usize = 20;
+const FREE_LIST_ROOT_HIGH_OFFSET: usize = 24;
+const ALLOCATED_PAGES_HIGH_OFFSET: usize = 28;
+const SPACE_MAP_ROOT_OFFSET: usize = 32;
+
+/// Settings recorded in the database file header
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FileHeader {
+    /// Algorithm used for every page checksum except the header's own
+    pub checksum_algorithm: ChecksumAlgorithm,
+    /// First page of the persisted free list, or `INVALID_PAGE_ID`
+    pub free_list_root: PageId,
+    /// Pages `0..allocated_pages` have been handed out by the allocator at
+    /// some point; 0 if no allocator state was saved
+    pub allocated_pages: u64,
+    /// First page of the persisted free-space map, or `INVALID_PAGE_ID`
+    pub space_map_root: PageId,
+    /// Size of every page but the header, in bytes
+    pub page_size: usize,
+}
+
+impl Default for FileHeader {
+    fn default() -> Self {
+        Self::new(ChecksumAlgorithm::default())
+    }
+}
+
+impl FileHeader {
+    /// Create a header for a new database
+    pub fn new(checksum_algorithm: ChecksumAlgorithm) -> Self {
+        Self {
+            checksum_algorithm,
+            free_list_root: INVALID_PAGE_ID,
+            allocated_pages: 0,
+            space_map_root: INVALID_PAGE_ID,
+            page_size: PAGE_SIZE,
+        }
+    }
+
+    /// Use pages of `page_size` bytes
+    #[must_use]
+    pub fn with_page_size(mut self, page_size: usize) -> Self {
+        self.page_size = page_size;
+        self
+    }
+
+    /// Encode the header into a checksummed header page
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the page size is not supported, or an
+    /// error if the checksum cannot be calculated
+    pub fn to_page(&self) -> Result<Page, Error> {
+        if !is_valid_page_size(self.page_size) {
+            return Err(Error::invalid_input(format!(
+                "Unsupported page size {}",
+                self.page_size
+            )));
+        }
+        let page_size = if self.page_size == PAGE_SIZE {
+            0
+        } else {
+            #[allow(clippy::cast_possible_truncation)]
+            let size = self.page_size as u32;
+            size
+        };
+
+        let mut page = Page::new();
+        page.header_mut().set_page_id(HEADER_PAGE_ID);
+        page.header_mut().page_type = PageType::Header;
+
+        let data = page.data_mut();
+        data[MAGIC_OFFSET..MAGIC_OFFSET + 8].copy_from_slice(&FILE_MAGIC);
+        data[VERSION_OFFSET..VERSION_OFFSET + 2]
+            .copy_from_slice(&FILE_FORMAT_VERSION.to_le_bytes());
+        data[CHECKSUM_OFFSET] = self.checksum_algorithm as u8;
+        write_split_u64(
+            data,
+            FREE_LIST_ROOT_OFFSET,
+            FREE_LIST_ROOT_HIGH_OFFSET,
+            self.free_list_root,
+        );
+        write_split_u64(
+            data,
+            ALLOCATED_PAGES_OFFSET,
+            ALLOCATED_PAGES_HIGH_OFFSET,
+            self.allocated_pages,
+        );
+        data[PAGE_SIZE_OFFSET..PAGE_SIZE_OFFSET + 4].copy_from_slice(&page_size.to_le_bytes());
+        data[SPACE_MAP_ROOT_OFFSET..SPACE_MAP_ROOT_OFFSET + 8]
+            .copy_from_slice(&self.space_map_root.to_le_bytes());
+
+        page.calculate_checksum()?;
+        Ok(page)
+    }
+
+    /// Decode and validate a header page
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if the page is not a valid header page or
+    /// records an unknown format version, checksum algorithm or page size
+    pub fn from_page(page: &Page) -> Result<Self, Error> {
+        // Verify the raw bytes before decoding the type byte, which may hold
+        // a value that is not a valid `PageType`
+        if !page.verify_checksum() {
+            return Err(Error::corruption("Invalid database header page"));
+        }
+        match PageType::try_from(page.raw()[4]) {
+            Ok(PageType::Header) => {}
+            _ => return Err(Error::corruption("Invalid database header page")),
+        }
+
+        let data = page.data();
+        if data[MAGIC_OFFSET..MAGIC_OFFSET + 8] != FILE_MAGIC {
+            return Err(Error::corruption("Not a lumen database file"));
+        }
+        let version = u16::from_le_bytes([data[VERSION_OFFSET], data[VERSION_OFFSET + 1]]);
+        if version != FILE_FORMAT_VERSION {
+            return Err(Error::corruption(format!(
+                "Unsupported database format version {version}"
+            )));
+        }
+
+        let read_u32 = |offset: usize| {
+            let mut bytes = [0u8; 4];
+            bytes.copy_from_slice(&data[offset..offset + 4]);
+            u32::from_le_bytes(bytes)
+        };
+        let page_size = match read_u32(PAGE_SIZE_OFFSET) {
+            0 => PAGE_SIZE,
+            size => size as usize,
+        };
+        if !is_valid_page_size(page_size) {
+            return Err(Error::corruption(format!(
+                "Unsupported page size {page_size}"
+            )));
+        }
+        let mut space_map_root = [0u8; 8];
+        space_map_root.copy_from_slice(&data[SPACE_MAP_ROOT_OFFSET..SPACE_MAP_ROOT_OFFSET + 8]);
+        Ok(Self {
+            checksum_algorithm: ChecksumAlgorithm::try_from(data[CHECKSUM_OFFSET])?,
+            free_list_root: u64::from(read_u32(FREE_LIST_ROOT_OFFSET))
+                | u64::from(read_u32(FREE_LIST_ROOT_HIGH_OFFSET)) << 32,
+            allocated_pages: u64::from(read_u32(ALLOCATED_PAGES_OFFSET))
+                | u64::from(read_u32(ALLOCATED_PAGES_HIGH_OFFSET)) << 32,
+            space_map_root: u64::from_le_bytes(space_map_root),
+            page_size,
+        })
+    }
+
+    /// Read the header page from a database file
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the page cannot be read or is not a valid header
+    pub fn read(file: &PageFile) -> Result<Self, Error> {
+        let mut page = Page::new();
+        file.read_header_page(&mut page)?;
+        Self::from_page(&page)
+    }
+
+    /// Read the header page if the file starts with one
+    ///
+    /// Returns `None` for a file shorter than one page or whose first page
+    /// does not carry [`FILE_MAGIC`], such as a bare page file. The page
+    /// type alone does not decide it: `PageType::Header` is also the type
+    /// of a default page.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the page cannot be read, or `Error::Corruption`
+    /// if it carries the magic but is not a valid header
+    pub fn read_if_present(file: &PageFile) -> Result<Option<Self>, Error> {
+        if file.file().metadata()?.len() < PAGE_SIZE as u64 {
+            return Ok(None);
+        }
+        let mut page = Page::new();
+        file.read_header_page(&mut page)?;
+        if page.data()[MAGIC_OFFSET..MAGIC_OFFSET + 8] != FILE_MAGIC {
+            return Ok(None);
+        }
+        Self::from_page(&page).map(Some)
+    }
+
+    /// Write the header page to a database file
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the page cannot be written
+    pub fn write(&self, file: &PageFile) -> Result<(), Error> {
+        file.write_header_page(&self.to_page()?)
+    }
+}
+
+/// Store the low and high 32-bit halves of `value` at separate offsets
+fn write_split_u64(data: &mut [u8], low: usize, high: usize, value: u64) {
+    let bytes = value.to_le_bytes();
+    data[low..low + 4].copy_from_slice(&bytes[..4]);
+    data[high..high + 4].copy_from_slice(&bytes[4..]);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::storage::checksum::calculate_page_checksum_with;
+
+    #[test]
+    fn test_header_round_trip() {
+        for algorithm in [
+            ChecksumAlgorithm::Crc32,
+            ChecksumAlgorithm::Crc32c,
+            ChecksumAlgorithm::Xxh3,
+        ] {
+            let page = FileHeader::new(algorithm).to_page().unwrap();
+            assert!(page.verify_checksum());
+            let header = FileHeader::from_page(&page).unwrap();
+            assert_eq!(header.checksum_algorithm, algorithm);
+        }
+
+        let header = FileHeader {
+            free_list_root: 17 << 32 | 5,
+            allocated_pages: 1 << 40,
+            space_map_root: 3 << 36 | 9,
+            ..FileHeader::default()
+        }
+        .with_page_size(65536);
+        assert_eq!(
+            FileHeader::from_page(&header.to_page().unwrap()).unwrap(),
+            header
+        );
+    }
+
+    #[test]
+    fn test_default_page_size_keeps_format() {
+        let page = FileHeader::default().to_page().unwrap();
+        assert_eq!(page.data()[PAGE_SIZE_OFFSET..PAGE_SIZE_OFFSET + 4], [0; 4]);
+        assert_eq!(FileHeader::from_page(&page).unwrap().page_size, PAGE_SIZE);
+
+        assert!(matches!(
+            FileHeader::default().with_page_size(12288).to_page(),
+            Err(Error::InvalidInput(_))
+        ));
+        let mut page = FileHeader::default().to_page().unwrap();
+        page.data_mut()[PAGE_SIZE_OFFSET + 1] = 0x30;
+        page.calculate_checksum().unwrap();
+        assert!(matches!(
+            FileHeader::from_page(&page),
+            Err(Error::Corruption(_))
+        ));
+    }
+
+    #[test]
+    fn test_header_rejects_bad_pages() {
+        let mut page = FileHeader::default().to_page().unwrap();
+        page.data_mut()[0] = b'X';
+        page.calculate_checksum().unwrap();
+        assert!(matches!(
+            FileHeader::from_page(&page),
+            Err(Error::Corruption(_))
+        ));
+
+        let mut page = FileHeader::default().to_page().unwrap();
+        page.data_mut()[CHECKSUM_OFFSET] = 0xEE;
+        page.calculate_checksum().unwrap();
+        assert!(matches!(
+            FileHeader::from_page(&page),
+            Err(Error::Corruption(_))
+        ));
+
+        let mut page = FileHeader::default().to_page().unwrap();
+        page.header_mut().page_type = PageType::Data;
+        page.calculate_checksum().unwrap();
+        assert!(FileHeader::from_page(&page).is_err());
+
+        // An unknown type byte is reported as corruption whether or not the
+        // checksum still matches
+        let mut page = FileHeader::default().to_page().unwrap();
+        page.raw_mut()[4] = 0xEE;
+        assert!(matches!(
+            FileHeader::from_page(&page),
+            Err(Error::Corruption(_))
+        ));
+        let checksum = calculate_page_checksum_with(ChecksumAlgorithm::Crc32, page.raw()).unwrap();
+        page.raw_mut()[8..12].copy_from_slice(&checksum.to_le_bytes());
+        assert!(matches!(
+            FileHeader::from_page(&page),
+            Err(Error::Corruption(_))
+        ));
+    }
+}
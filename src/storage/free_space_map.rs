@@ -0,0 +1,461 @@
+//! Free-space map for choosing insert target pages without reading them
+//!
+//! [`FreeSpaceMap`] records, for every page, a 4-bit category of the bytes
+//! free on it as reported by `PageHeader::free_space`. Category `c` means
+//! at least `c` steps of 1/16 of the usable page are free, so a page is
+//! never chosen for a tuple it cannot hold. Two summary levels sit above
+//! the per-page categories. Each block entry holds the highest category in
+//! [`BLOCK_PAGES`] pages, and each group entry holds the highest category in
+//! [`GROUP_BLOCKS`] blocks. [`find`](FreeSpaceMap::find) scans the groups,
+//! then 256 block entries, then 256 pages, so finding space costs the same
+//! however full the file is and touches no data pages.
+//!
+//! The map is a hint. Callers re-check the chosen page and report its new
+//! free space with [`update`](FreeSpaceMap::update) after every change.
+//! Pages returned to the [`PageAllocator`] must be dropped from the map with
+//! [`remove`](FreeSpaceMap::remove).
+//!
+//! [`save`](FreeSpaceMap::save) persists the per-page categories in a chain
+//! of `PageType::FreeList` pages of kind
+//! [`FREE_LIST_KIND_SPACE_MAP`]; the summaries are rebuilt on load. Save
+//! the map before [`PageAllocator::save`] in a checkpoint, since the chain
+//! pages come from the allocator. If a crash falls between the two saves,
+//! [`load`](FreeSpaceMap::load) sees chain pages the allocator considers
+//! free and starts with an empty map instead.
+//!
+//! `FreeList` page data area layout for the map:
+//!
+//! | Offset | Size | Field                                          |
+//! |--------|------|------------------------------------------------|
+//! | 0      | 1    | kind ([`FREE_LIST_KIND_SPACE_MAP`])            |
+//! | 4      | 4    | next `FreeList` page, low 32 bits (LE)         |
+//! | 8      | 2    | pages covered (LE)                             |
+//! | 12     | 4    | next `FreeList` page, high 32 bits (LE)        |
+//! | 16     | 8    | first page covered (LE)                        |
+//! | 24     | n/2  | categories, two pages per byte, low nibble first |
+
+use crate::common::error::Error;
+use crate::storage::file_header::FileHeader;
+use crate::storage::page::Page;
+use crate::storage::page_allocator::{PageAllocator, FREE_LIST_KIND_SPACE_MAP};
+use crate::storage::page_constants::{
+    is_valid_page_size, PageId, INVALID_PAGE_ID, PAGE_HEADER_SIZE, PAGE_SIZE, PAGE_USABLE_SIZE,
+};
+use crate::storage::page_file::PageFile;
+use crate::storage::page_type::PageType;
+use parking_lot::RwLock;
+
+/// Number of free-space categories; category 0 means no usable space
+pub const SPACE_CATEGORIES: u8 = 16;
+
+/// Pages summarised by one block entry
+pub const BLOCK_PAGES: usize = 256;
+
+/// Block entries summarised by one group entry
+pub const GROUP_BLOCKS: usize = 256;
+
+const KIND_OFFSET: usize = 0;
+const NEXT_OFFSET: usize = 4;
+const COUNT_OFFSET: usize = 8;
+const NEXT_HIGH_OFFSET: usize = 12;
+const FIRST_PAGE_OFFSET: usize = 16;
+const CATEGORIES_OFFSET: usize = 24;
+
+/// Pages whose categories fit in one `FreeList` page
+pub const SPACE_MAP_PAGES_PER_PAGE: usize = (PAGE_USABLE_SIZE - CATEGORIES_OFFSET) * 2;
+
+#[derive(Debug, Default)]
+struct SpaceMapState {
+    /// Category per page, two pages per byte, low nibble first
+    categories: Vec<u8>,
+    /// Highest category in each block of `BLOCK_PAGES` pages
+    blocks: Vec<u8>,
+    /// Highest category in each group of `GROUP_BLOCKS` blocks
+    groups: Vec<u8>,
+    /// Pages holding the saved map
+    chain: Vec<PageId>,
+}
+
+impl SpaceMapState {
+    fn tracked_pages(&self) -> usize {
+        self.categories.len() * 2
+    }
+
+    fn get(&self, index: usize) -> u8 {
+        self.categories
+            .get(index / 2)
+            .map_or(0, |&byte| byte >> (4 * (index % 2)) & 0x0F)
+    }
+
+    fn set(&mut self, index: usize, category: u8) {
+        if index >= self.tracked_pages() {
+            if category == 0 {
+                return;
+            }
+            // Grow a whole block at a time so summaries stay aligned
+            let pages = (index + 1).next_multiple_of(BLOCK_PAGES);
+            self.categories.resize(pages / 2, 0);
+            self.blocks.resize(pages / BLOCK_PAGES, 0);
+            self.groups
+                .resize(self.blocks.len().div_ceil(GROUP_BLOCKS), 0);
+        }
+        let old = self.get(index);
+        if old == category {
+            return;
+        }
+        let shift = 4 * (index % 2);
+        let byte = &mut self.categories[index / 2];
+        *byte = *byte & !(0x0F << shift) | category << shift;
+
+        let block = index / BLOCK_PAGES;
+        if category > self.blocks[block] {
+            self.blocks[block] = category;
+        } else if old == self.blocks[block] {
+            let start = block * BLOCK_PAGES / 2;
+            self.blocks[block] = self.categories[start..start + BLOCK_PAGES / 2]
+                .iter()
+                .map(|&byte| (byte & 0x0F).max(byte >> 4))
+                .max()
+                .unwrap_or(0);
+        } else {
+            return;
+        }
+        self.refresh_group(block / GROUP_BLOCKS);
+    }
+
+    fn refresh_group(&mut self, group: usize) {
+        let start = group * GROUP_BLOCKS;
+        let end = (start + GROUP_BLOCKS).min(self.blocks.len());
+        self.groups[group] = self.blocks[start..end].iter().copied().max().unwrap_or(0);
+    }
+
+    fn rebuild_summaries(&mut self) {
+        let pages = self.tracked_pages().next_multiple_of(BLOCK_PAGES);
+        self.categories.resize(pages / 2, 0);
+        self.blocks = self
+            .categories
+            .chunks(BLOCK_PAGES / 2)
+            .map(|chunk| {
+                chunk
+                    .iter()
+                    .map(|&byte| (byte & 0x0F).max(byte >> 4))
+                    .max()
+                    .unwrap_or(0)
+            })
+            .collect();
+        self.groups = self
+            .blocks
+            .chunks(GROUP_BLOCKS)
+            .map(|chunk| chunk.iter().copied().max().unwrap_or(0))
+            .collect();
+    }
+
+    /// Lowest page with at least `category`
+    fn find(&self, category: u8) -> Option<usize> {
+        let group = self.groups.iter().position(|&c| c >= category)?;
+        let first_block = group * GROUP_BLOCKS;
+        let block = first_block
+            + self.blocks[first_block..]
+                .iter()
+                .take(GROUP_BLOCKS)
+                .position(|&c| c >= category)?;
+        let first_page = block * BLOCK_PAGES;
+        (first_page..first_page + BLOCK_PAGES).find(|&index| self.get(index) >= category)
+    }
+}
+
+/// Thread-safe map of free space per page
+#[derive(Debug)]
+pub struct FreeSpaceMap {
+    /// Free bytes represented by one category step
+    step: usize,
+    state: RwLock<SpaceMapState>,
+}
+
+impl FreeSpaceMap {
+    /// Empty map for pages of `page_size` bytes
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the page size is not supported
+    pub fn new(page_size: usize) -> Result<Self, Error> {
+        if !is_valid_page_size(page_size) {
+            return Err(Error::invalid_input(format!(
+                "Unsupported page size {page_size}"
+            )));
+        }
+        Ok(Self {
+            step: (page_size - PAGE_HEADER_SIZE) / usize::from(SPACE_CATEGORIES),
+            state: RwLock::new(SpaceMapState::default()),
+        })
+    }
+
+    /// Load the map saved in a database file
+    ///
+    /// Returns an empty map if none was saved, or if the saved chain
+    /// overlaps pages `allocator` considers free because the allocator
+    /// state is older than the map.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if `file` does not use 4 KiB pages,
+    /// `Error::Corruption` if the chain is damaged, or an I/O error
+    pub fn load(
+        file: &PageFile,
+        header: &FileHeader,
+        allocator: &PageAllocator,
+    ) -> Result<Self, Error> {
+        check_chain_page_size(file)?;
+        let map = Self::new(header.page_size)?;
+        let allocated_pages = allocator.allocated_pages();
+        let mut state = SpaceMapState::default();
+
+        let mut next = header.space_map_root;
+        while next != INVALID_PAGE_ID {
+            if next >= allocated_pages || allocator.is_free(next) {
+                return Ok(map);
+            }
+            if state.chain.len() as u64 >= allocated_pages {
+                return Err(Error::corruption(format!(
+                    "Free-space map chain is broken at page {next}"
+                )));
+            }
+            let page = file.read_page(next)?;
+            let data = page.data();
+            if page.header().page_type != PageType::FreeList
+                || data[KIND_OFFSET] != FREE_LIST_KIND_SPACE_MAP
+            {
+                return Err(Error::corruption(format!(
+                    "Page {next} is not a free-space map page"
+                )));
+            }
+            let count = usize::from(read_u16(data, COUNT_OFFSET));
+            let first_page = read_u64(data, FIRST_PAGE_OFFSET);
+            if count > SPACE_MAP_PAGES_PER_PAGE
+                || first_page != state.tracked_pages() as u64
+                || count % 2 != 0
+            {
+                return Err(Error::corruption(format!(
+                    "Free-space map page {next} does not continue the map"
+                )));
+            }
+            state
+                .categories
+                .extend_from_slice(&data[CATEGORIES_OFFSET..CATEGORIES_OFFSET + count / 2]);
+            state.chain.push(next);
+            next = u64::from(read_u32(data, NEXT_OFFSET))
+                | u64::from(read_u32(data, NEXT_HIGH_OFFSET)) << 32;
+        }
+        state.rebuild_summaries();
+        *map.state.write() = state;
+        Ok(map)
+    }
+
+    /// Persist the map and point `header` at it
+    ///
+    /// Writes a new chain into pages from `allocator`, syncs it, then
+    /// writes and syncs the header. The previous chain's pages are returned
+    /// to `allocator` afterwards. If allocating or writing the new chain
+    /// fails, its pages are returned to `allocator` and the header is left
+    /// alone.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if `file` does not use 4 KiB pages, or
+    /// an error if pages cannot be allocated or written
+    pub fn save(
+        &self,
+        file: &PageFile,
+        allocator: &PageAllocator,
+        header: &mut FileHeader,
+    ) -> Result<(), Error> {
+        check_chain_page_size(file)?;
+        let mut state = self.state.write();
+        let chunks: Vec<&[u8]> = state
+            .categories
+            .chunks(SPACE_MAP_PAGES_PER_PAGE / 2)
+            .collect();
+        let mut chain = Vec::with_capacity(chunks.len());
+        let written = chunks
+            .iter()
+            .try_for_each(|_| {
+                chain.push(allocator.allocate_page()?);
+                Ok(())
+            })
+            .and_then(|()| write_chain(file, &chain, &chunks));
+        if let Err(err) = written {
+            for &page_id in &chain {
+                if let Err(free_err) = allocator.free_page(page_id) {
+                    log::warn!("Failed to free space map page {page_id}: {free_err}");
+                }
+            }
+            return Err(err);
+        }
+
+        let mut updated = *header;
+        updated.space_map_root = chain.first().copied().unwrap_or(INVALID_PAGE_ID);
+        updated.write(file)?;
+        file.sync_data()?;
+        *header = updated;
+
+        for page_id in std::mem::replace(&mut state.chain, chain) {
+            allocator.free_page(page_id)?;
+        }
+        Ok(())
+    }
+
+    /// Record that `page_id` has `free_bytes` available
+    pub fn update(&self, page_id: PageId, free_bytes: usize) {
+        let category = self.category(free_bytes);
+        self.state.write().set(index(page_id), category);
+    }
+
+    /// Stop offering `page_id`, for example once it is freed
+    pub fn remove(&self, page_id: PageId) {
+        self.state.write().set(index(page_id), 0);
+    }
+
+    /// Free bytes `page_id` is known to have, rounded down to a category
+    pub fn free_space(&self, page_id: PageId) -> usize {
+        usize::from(self.state.read().get(index(page_id))) * self.step
+    }
+
+    /// Lowest page known to have at least `needed` bytes free
+    ///
+    /// Returns `None` if no page qualifies, or if `needed` exceeds what the
+    /// top category guarantees; the caller then uses a new page.
+    pub fn find(&self, needed: usize) -> Option<PageId> {
+        let category = needed.div_ceil(self.step).max(1);
+        if category >= usize::from(SPACE_CATEGORIES) {
+            return None;
+        }
+        #[allow(clippy::cast_possible_truncation)]
+        let found = self.state.read().find(category as u8)?;
+        Some(found as PageId)
+    }
+
+    /// Free bytes represented by one category step
+    pub fn category_step(&self) -> usize {
+        self.step
+    }
+
+    fn category(&self, free_bytes: usize) -> u8 {
+        #[allow(clippy::cast_possible_truncation)]
+        let category = (free_bytes / self.step).min(usize::from(SPACE_CATEGORIES) - 1) as u8;
+        category
+    }
+}
+
+/// Write and sync `chunks` of categories as the linked pages `chain`
+fn write_chain(file: &PageFile, chain: &[PageId], chunks: &[&[u8]]) -> Result<(), Error> {
+    let mut pages = Vec::with_capacity(chain.len());
+    for (index, (&page_id, chunk)) in chain.iter().zip(chunks).enumerate() {
+        let mut page = Page::new();
+        page.header_mut().set_page_id(page_id);
+        page.header_mut().page_type = PageType::FreeList;
+        let next = chain.get(index + 1).copied().unwrap_or(INVALID_PAGE_ID);
+        let data = page.data_mut();
+        data[KIND_OFFSET] = FREE_LIST_KIND_SPACE_MAP;
+        let next = next.to_le_bytes();
+        data[NEXT_OFFSET..NEXT_OFFSET + 4].copy_from_slice(&next[..4]);
+        data[NEXT_HIGH_OFFSET..NEXT_HIGH_OFFSET + 4].copy_from_slice(&next[4..]);
+        #[allow(clippy::cast_possible_truncation)]
+        data[COUNT_OFFSET..COUNT_OFFSET + 2]
+            .copy_from_slice(&((chunk.len() * 2) as u16).to_le_bytes());
+        let first_page = (index * SPACE_MAP_PAGES_PER_PAGE) as u64;
+        data[FIRST_PAGE_OFFSET..FIRST_PAGE_OFFSET + 8].copy_from_slice(&first_page.to_le_bytes());
+        data[CATEGORIES_OFFSET..CATEGORIES_OFFSET + chunk.len()].copy_from_slice(chunk);
+        page.calculate_checksum_with(file.checksum_algorithm())?;
+        pages.push(page);
+    }
+    let batch: Vec<(PageId, &Page)> = chain.iter().copied().zip(pages.iter()).collect();
+    file.write_pages(&batch)?;
+    file.sync_data()
+}
+
+/// Chain pages are built as 4 KiB [`Page`]s; reject other files before any
+/// page is allocated
+fn check_chain_page_size(file: &PageFile) -> Result<(), Error> {
+    if file.page_size() != PAGE_SIZE {
+        return Err(Error::invalid_input(format!(
+            "Free-space map chains need {PAGE_SIZE}-byte pages, the file uses {}-byte pages",
+            file.page_size()
+        )));
+    }
+    Ok(())
+}
+
+#[allow(clippy::cast_possible_truncation)]
+fn index(page_id: PageId) -> usize {
+    page_id as usize
+}
+
+fn read_u16(data: &[u8], offset: usize) -> u16 {
+    u16::from_le_bytes([data[offset], data[offset + 1]])
+}
+
+fn read_u32(data: &[u8], offset: usize) -> u32 {
+    let mut bytes = [0u8; 4];
+    bytes.copy_from_slice(&data[offset..offset + 4]);
+    u32::from_le_bytes(bytes)
+}
+
+fn read_u64(data: &[u8], offset: usize) -> u64 {
+    let mut bytes = [0u8; 8];
+    bytes.copy_from_slice(&data[offset..offset + 8]);
+    u64::from_le_bytes(bytes)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_summaries_track_maximum() {
+        let mut state = SpaceMapState::default();
+        state.set(10, 5);
+        state.set(BLOCK_PAGES + 3, 9);
+        assert_eq!(state.blocks, vec![5, 9]);
+        assert_eq!(state.groups, vec![9]);
+
+        state.set(BLOCK_PAGES + 3, 2);
+        assert_eq!(state.blocks, vec![5, 2]);
+        assert_eq!(state.groups, vec![5]);
+        assert_eq!(state.find(3), Some(10));
+        assert_eq!(state.find(6), None);
+    }
+
+    #[test]
+    fn test_search_crosses_groups() {
+        let mut state = SpaceMapState::default();
+        let far = BLOCK_PAGES * GROUP_BLOCKS * 3 + 17;
+        state.set(far, 15);
+        state.set(4, 1);
+        assert_eq!(state.groups.len(), 4);
+        assert_eq!(state.find(1), Some(4));
+        assert_eq!(state.find(2), Some(far));
+    }
+
+    #[test]
+    fn test_rebuild_matches_incremental_summaries() {
+        let mut state = SpaceMapState::default();
+        for index in (0..3000).step_by(7) {
+            #[allow(clippy::cast_possible_truncation)]
+            state.set(index, (index % 16) as u8);
+        }
+        let (blocks, groups) = (state.blocks.clone(), state.groups.clone());
+        state.rebuild_summaries();
+        assert_eq!(state.blocks, blocks);
+        assert_eq!(state.groups, groups);
+    }
+
+    #[test]
+    fn test_categories_round_down() {
+        let map = FreeSpaceMap::new(4096).unwrap();
+        let step = map.category_step();
+        map.update(1, step * 3 - 1);
+        assert_eq!(map.free_space(1), step * 2);
+        assert_eq!(map.find(step * 2), Some(1));
+        assert_eq!(map.find(step * 2 + 1), None);
+    }
+}
@@ -0,0 +1,233 @@
+//! Group commit: shared durability barriers for page writes
+//!
+//! Calling `fsync` after every page (as [`page_io::write_page_sync`] does)
+//! caps throughput at the device's flush rate. [`GroupCommit`] separates the
+//! write from the barrier: writers issue their positional writes in parallel,
+//! receive a [`CommitTicket`], and then wait for it. The first waiter becomes
+//! the leader and issues a single `fdatasync` covering every write completed
+//! so far; writers that arrive while that flush is in flight queue up behind
+//! it and are covered by the next one. Under load one flush retires many
+//! commits.
+//!
+//! A failed `fdatasync` poisons the handle: the kernel may already have
+//! dropped the dirty pages, so retrying the flush could report success for
+//! data that never reached the disk. Every pending and future commit fails
+//! with the original error.
+//!
+//! [`page_io::write_page_sync`]: crate::storage::page_io::write_page_sync
+
+use crate::common::error::Error;
+use crate::storage::page::Page;
+use crate::storage::page_constants::PageId;
+use crate::storage::page_file::PageFile;
+use parking_lot::{Condvar, Mutex, MutexGuard};
+use std::path::Path;
+use std::sync::Arc;
+
+/// Handle for a completed write that may not be durable yet
+///
+/// Tickets are ordered: once a ticket is durable, so is every earlier ticket
+/// from the same [`GroupCommit`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct CommitTicket(u64);
+
+impl CommitTicket {
+    /// Sequence number of the write this ticket covers
+    pub fn sequence(self) -> u64 {
+        self.0
+    }
+}
+
+#[derive(Debug, Default)]
+struct CommitState {
+    /// Highest ticket whose write has completed
+    written: u64,
+    /// Highest ticket known to be on stable storage
+    durable: u64,
+    /// A leader is currently inside `fdatasync`
+    syncing: bool,
+    /// Number of flushes issued
+    syncs: u64,
+    /// Error from a failed flush; poisons the handle
+    failure: Option<Error>,
+}
+
+/// Page writer that batches durability barriers across concurrent writers
+#[derive(Debug)]
+pub struct GroupCommit {
+    file: Arc<PageFile>,
+    state: Mutex<CommitState>,
+    synced: Condvar,
+}
+
+impl GroupCommit {
+    /// Create a group commit layer over a shared page file
+    pub fn new(file: Arc<PageFile>) -> Self {
+        Self {
+            file,
+            state: Mutex::new(CommitState::default()),
+            synced: Condvar::new(),
+        }
+    }
+
+    /// Open (or create) a database file with group commit
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be opened
+    pub fn open<P: AsRef<Path>>(path: P) -> Result<Self, Error> {
+        Ok(Self::new(Arc::new(PageFile::open(path)?)))
+    }
+
+    /// The underlying page file
+    pub fn file(&self) -> &Arc<PageFile> {
+        &self.file
+    }
+
+    /// Write a page and return a ticket that can be waited on for durability
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the write fails or an earlier flush failed
+    pub fn write_page(&self, page_id: PageId, page: &Page) -> Result<CommitTicket, Error> {
+        self.check_poisoned()?;
+        self.file.write_page(page_id, page)?;
+        Ok(self.issue_ticket())
+    }
+
+    /// Write a batch of pages with vectored I/O under a single ticket
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if any write fails or an earlier flush failed
+    pub fn write_pages(&self, pages: &[(PageId, &Page)]) -> Result<CommitTicket, Error> {
+        self.check_poisoned()?;
+        self.file.write_pages(pages)?;
+        Ok(self.issue_ticket())
+    }
+
+    /// Block until the write behind `ticket` is on stable storage
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the flush covering this ticket failed
+    pub fn wait(&self, ticket: CommitTicket) -> Result<(), Error> {
+        let mut state = self.state.lock();
+        loop {
+            if state.durable >= ticket.0 {
+                return Ok(());
+            }
+            if let Some(error) = &state.failure {
+                return Err(error.clone());
+            }
+            if state.syncing {
+                // Our write may have finished after the running flush began,
+                // so wait for it and re-check rather than assuming coverage.
+                self.synced.wait(&mut state);
+                continue;
+            }
+
+            // Become the leader: everything written so far rides on this flush
+            state.syncing = true;
+            let target = state.written;
+            let result = MutexGuard::unlocked(&mut state, || self.file.sync_data());
+            state.syncing = false;
+            state.syncs += 1;
+            match result {
+                Ok(()) => state.durable = target,
+                Err(error) => state.failure = Some(error),
+            }
+            self.synced.notify_all();
+        }
+    }
+
+    /// Write a page and wait until it is durable
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the write or the covering flush fails
+    pub fn commit_page(&self, page_id: PageId, page: &Page) -> Result<(), Error> {
+        let ticket = self.write_page(page_id, page)?;
+        self.wait(ticket)
+    }
+
+    /// Make every write completed so far durable
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the flush fails
+    pub fn sync(&self) -> Result<(), Error> {
+        let ticket = CommitTicket(self.state.lock().written);
+        self.wait(ticket)
+    }
+
+    /// Highest ticket known to be durable
+    pub fn durable_ticket(&self) -> CommitTicket {
+        CommitTicket(self.state.lock().durable)
+    }
+
+    /// Number of `fdatasync` calls issued so far
+    pub fn sync_count(&self) -> u64 {
+        self.state.lock().syncs
+    }
+
+    fn issue_ticket(&self) -> CommitTicket {
+        // Tickets are handed out after the write returns, so any flush that
+        // starts once a ticket exists is guaranteed to cover its write.
+        let mut state = self.state.lock();
+        state.written += 1;
+        CommitTicket(state.written)
+    }
+
+    fn check_poisoned(&self) -> Result<(), Error> {
+        match &self.state.lock().failure {
+            Some(error) => Err(error.clone()),
+            None => Ok(()),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::storage::page_type::PageType;
+    use tempfile::NamedTempFile;
+
+    fn make_page(page_id: PageId) -> Page {
+        let mut page = Page::new();
+        page.header_mut().page_type = PageType::Data;
+        page.header_mut().set_page_id(page_id);
+        page.calculate_checksum().unwrap();
+        page
+    }
+
+    #[test]
+    fn test_one_flush_covers_earlier_tickets() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let commit = GroupCommit::open(temp_file.path())?;
+
+        let tickets: Vec<CommitTicket> = (0..10)
+            .map(|id| commit.write_page(id, &make_page(id)))
+            .collect::<Result<_, _>>()?;
+        assert!(tickets.windows(2).all(|pair| pair[0] < pair[1]));
+        assert_eq!(commit.sync_count(), 0);
+
+        commit.wait(tickets[9])?;
+        assert_eq!(commit.sync_count(), 1);
+        for &ticket in &tickets {
+            commit.wait(ticket)?;
+        }
+        assert_eq!(commit.sync_count(), 1);
+        assert_eq!(commit.durable_ticket(), tickets[9]);
+        Ok(())
+    }
+
+    #[test]
+    fn test_sync_without_writes() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let commit = GroupCommit::open(temp_file.path())?;
+        commit.sync()?;
+        assert_eq!(commit.sync_count(), 0);
+        Ok(())
+    }
+}
@@ -0,0 +1,62 @@
+//! 64-bit log sequence numbers and their 32-bit on-page form
+//!
+//! An [`Lsn`] is the byte position of a log record in the write-ahead log,
+//! so it never wraps in practice. `PageHeader.lsn` only has room for the low
+//! 32 bits; the high bits (the *epoch*) are recovered with [`widen`] against
+//! a reference LSN known to be at or after the page's LSN, such as the end
+//! of the log.
+//!
+//! Widening is exact as long as the page LSN lies less than
+//! [`LSN_WINDOW`] bytes behind the reference. The WAL guarantees this for
+//! every page it replays by bounding the distance between checkpoints and
+//! logging a full page image on each page's first change after one.
+
+/// Log sequence number: byte position of a record in the log stream
+pub type Lsn = u64;
+
+/// LSN value meaning "no log record"
+pub const INVALID_LSN: Lsn = 0;
+
+/// Span of LSNs that the 32-bit page LSN can distinguish
+pub const LSN_WINDOW: u64 = 1 << 32;
+
+/// Low 32 bits of an LSN, as stored in `PageHeader.lsn`
+#[allow(clippy::cast_possible_truncation)]
+pub fn page_lsn(lsn: Lsn) -> u32 {
+    lsn as u32
+}
+
+/// Rebuild a full LSN from its low 32 bits
+///
+/// Returns the largest LSN not after `reference` whose low bits equal
+/// `low`. If no such LSN exists, returns `low` itself.
+pub fn widen(low: u32, reference: Lsn) -> Lsn {
+    let candidate = (reference & !(LSN_WINDOW - 1)) | u64::from(low);
+    if candidate <= reference {
+        candidate
+    } else {
+        candidate.checked_sub(LSN_WINDOW).unwrap_or(candidate)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_page_lsn_round_trip() {
+        for lsn in [1, 0xFFFF_FFFF, 0x1_0000_0000, 0x7_1234_5678] {
+            assert_eq!(widen(page_lsn(lsn), lsn), lsn);
+            assert_eq!(widen(page_lsn(lsn), lsn + 1000), lsn);
+        }
+    }
+
+    #[test]
+    fn test_widen_across_epoch_boundary() {
+        // Page written just before the epoch rolled over
+        let lsn = 0x2_FFFF_FF00;
+        assert_eq!(widen(page_lsn(lsn), 0x3_0000_0100), lsn);
+        // Low bits larger than the reference within the first epoch
+        assert_eq!(widen(500, 100), 500);
+    }
+}
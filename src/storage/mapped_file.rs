@@ -0,0 +1,435 @@
+//! Long-lived memory mapping of a database file
+//!
+//! [`MappedFile`] maps the whole file once and hands out page slices by
+//! [`PageId`], instead of creating and tearing down a 4KB mapping per access
+//! like [`read_page_mmap`](crate::storage::page_io::read_page_mmap) does. The
+//! file grows in large chunks so that remapping is rare, and callers can give
+//! the kernel per-region access hints with [`MappedFile::advise`].
+
+use crate::common::error::Error;
+use crate::storage::checksum::ChecksumAlgorithm;
+use crate::storage::file_growth;
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PageId, PAGE_SIZE};
+use crate::storage::page_io::calculate_page_offset;
+use crate::storage::page_ref::PageRef;
+use crate::storage::verification::{VerificationPolicy, VerifiedPages};
+use memmap2::{MmapMut, MmapOptions};
+use parking_lot::{RwLock, RwLockReadGuard};
+use std::fs::{File, OpenOptions};
+use std::ops::Deref;
+use std::path::Path;
+
+/// Default growth step for mapped files (64 MiB)
+pub const DEFAULT_GROWTH_CHUNK: u64 = 64 * 1024 * 1024;
+
+/// Mapped file configuration
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct MappedFileConfig {
+    /// Bytes added to the file (and mapping) whenever it must grow.
+    /// Rounded up to a whole number of pages.
+    pub growth_chunk: u64,
+    /// Algorithm used by [`MappedFile::read_page`] to verify checksums
+    pub checksum: ChecksumAlgorithm,
+    /// When [`MappedFile::read_page`] verifies checksums. `Deferred` behaves
+    /// like `OnLoad`, since mapped reads have no load step to defer.
+    pub verification: VerificationPolicy,
+}
+
+impl Default for MappedFileConfig {
+    fn default() -> Self {
+        Self {
+            growth_chunk: DEFAULT_GROWTH_CHUNK,
+            checksum: ChecksumAlgorithm::default(),
+            verification: VerificationPolicy::default(),
+        }
+    }
+}
+
+/// Expected access pattern for a range of pages (maps to `madvise`)
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum AccessPattern {
+    /// No special treatment
+    Normal,
+    /// Random point lookups - disable kernel read-ahead
+    Random,
+    /// Sequential scan - aggressive read-ahead
+    Sequential,
+    /// The range will be needed soon - start reading it in now
+    WillNeed,
+}
+
+#[cfg(unix)]
+impl From<AccessPattern> for memmap2::Advice {
+    fn from(pattern: AccessPattern) -> Self {
+        match pattern {
+            AccessPattern::Normal => memmap2::Advice::Normal,
+            AccessPattern::Random => memmap2::Advice::Random,
+            AccessPattern::Sequential => memmap2::Advice::Sequential,
+            AccessPattern::WillNeed => memmap2::Advice::WillNeed,
+        }
+    }
+}
+
+/// A database file mapped into memory for its whole lifetime
+pub struct MappedFile {
+    file: File,
+    growth_chunk: u64,
+    checksum: ChecksumAlgorithm,
+    verification: VerificationPolicy,
+    /// Pages verified since they were last written through this handle
+    verified: VerifiedPages,
+    /// `None` while the file is empty (zero-length mappings are not portable)
+    map: RwLock<Option<MmapMut>>,
+}
+
+impl MappedFile {
+    /// Open (or create) a file and map its current contents
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be opened or mapped
+    pub fn open<P: AsRef<Path>>(path: P, config: MappedFileConfig) -> Result<Self, Error> {
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(false)
+            .open(path)?;
+
+        let len = file.metadata()?.len();
+        let map = if len == 0 {
+            None
+        } else {
+            Some(Self::map_file(&file, len)?)
+        };
+
+        Ok(Self {
+            file,
+            growth_chunk: config.growth_chunk.max(1).div_ceil(PAGE_SIZE as u64) * PAGE_SIZE as u64,
+            checksum: config.checksum,
+            verification: config.verification,
+            verified: VerifiedPages::default(),
+            map: RwLock::new(map),
+        })
+    }
+
+    /// Number of whole pages currently mapped
+    pub fn page_capacity(&self) -> u64 {
+        self.map
+            .read()
+            .as_ref()
+            .map_or(0, |map| (map.len() / PAGE_SIZE) as u64)
+    }
+
+    /// Borrow a page slice directly from the mapping
+    ///
+    /// The returned guard blocks growth of the mapping until dropped.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::NotFound` if the page lies beyond the mapped region
+    pub fn page(&self, page_id: PageId) -> Result<MappedPage<'_>, Error> {
+        let map = self.map.read();
+        let offset = Self::page_range(map.as_ref(), page_id)?;
+        Ok(MappedPage { map, offset })
+    }
+
+    /// Copy a page out of the mapping and verify its checksum
+    ///
+    /// Unless the policy is `Always`, a page that verified once is trusted
+    /// until it is next written through [`write_page`](Self::write_page).
+    /// Changes made to the file by other handles are not tracked.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the page is not mapped or its checksum is invalid
+    pub fn read_page(&self, page_id: PageId) -> Result<Page, Error> {
+        let mapped = self.page(page_id)?;
+        let page_ref = mapped.page_ref()?;
+        let trusted =
+            self.verification != VerificationPolicy::Always && self.verified.contains(page_id);
+        if !trusted {
+            if !page_ref.verify_checksum_with(self.checksum) {
+                return Err(Error::corruption(format!(
+                    "Checksum verification failed for page {page_id}"
+                )));
+            }
+            self.verified.insert(page_id);
+        }
+        Ok(page_ref.to_page())
+    }
+
+    /// Copy a page into the mapping, growing the file if needed
+    ///
+    /// The write reaches the page cache immediately; call [`flush`](Self::flush)
+    /// or [`flush_page`](Self::flush_page) for durability.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if `page_id` is out of range, or an
+    /// error if the file cannot be grown or remapped
+    pub fn write_page(&self, page_id: PageId, page: &Page) -> Result<(), Error> {
+        calculate_page_offset(page_id)?;
+        let pages = page_id
+            .checked_add(1)
+            .ok_or_else(|| Error::invalid_input(format!("Cannot map page {page_id}")))?;
+        self.ensure_capacity(pages)?;
+
+        let mut map = self.map.write();
+        let offset = Self::page_range(map.as_ref(), page_id)?;
+        if let Some(map) = map.as_mut() {
+            map[offset..offset + PAGE_SIZE].copy_from_slice(page.raw());
+        }
+        self.verified.remove(page_id);
+        Ok(())
+    }
+
+    /// Grow the file and mapping so that at least `pages` pages are mapped
+    ///
+    /// Growth is rounded up to the configured chunk size.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be extended or remapped
+    pub fn ensure_capacity(&self, pages: u64) -> Result<(), Error> {
+        let needed = pages
+            .checked_mul(PAGE_SIZE as u64)
+            .ok_or_else(|| Error::invalid_input(format!("Cannot map {pages} pages")))?;
+        if self
+            .map
+            .read()
+            .as_ref()
+            .is_some_and(|map| map.len() as u64 >= needed)
+        {
+            return Ok(());
+        }
+
+        let mut map = self.map.write();
+        let current = map.as_ref().map_or(0, |map| map.len() as u64);
+        if current >= needed {
+            return Ok(());
+        }
+
+        let new_len = needed.div_ceil(self.growth_chunk) * self.growth_chunk;
+        // Allocating blocks up front means a full disk fails here rather
+        // than with SIGBUS on a later store through the mapping
+        file_growth::preallocate(&self.file, new_len)?;
+        *map = Some(match map.take() {
+            Some(existing) => self.remap(existing, new_len)?,
+            None => Self::map_file(&self.file, new_len)?,
+        });
+        Ok(())
+    }
+
+    /// Give the kernel an access-pattern hint for a range of pages
+    ///
+    /// Pages beyond the mapped region are ignored.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the `madvise` call fails
+    pub fn advise(
+        &self,
+        first_page: PageId,
+        count: u64,
+        pattern: AccessPattern,
+    ) -> Result<(), Error> {
+        let map = self.map.read();
+        let Some(map) = map.as_ref() else {
+            return Ok(());
+        };
+
+        // Ranges past the end of the mapping are clamped, never wrapped
+        let mapped = map.len() as u64;
+        let start = first_page.saturating_mul(PAGE_SIZE as u64).min(mapped);
+        let end = start
+            .saturating_add(count.saturating_mul(PAGE_SIZE as u64))
+            .min(mapped);
+        if start == end {
+            return Ok(());
+        }
+
+        #[cfg(unix)]
+        {
+            #[allow(clippy::cast_possible_truncation)]
+            map.advise_range(pattern.into(), start as usize, (end - start) as usize)?;
+        }
+        #[cfg(not(unix))]
+        let _ = pattern;
+        Ok(())
+    }
+
+    /// Synchronously write one page of the mapping back to disk
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the page is not mapped or `msync` fails
+    pub fn flush_page(&self, page_id: PageId) -> Result<(), Error> {
+        let map = self.map.read();
+        let offset = Self::page_range(map.as_ref(), page_id)?;
+        if let Some(map) = map.as_ref() {
+            map.flush_range(offset, PAGE_SIZE)?;
+        }
+        Ok(())
+    }
+
+    /// Synchronously write all modified pages of the mapping back to disk
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if `msync` fails
+    pub fn flush(&self) -> Result<(), Error> {
+        if let Some(map) = self.map.read().as_ref() {
+            map.flush()?;
+        }
+        Ok(())
+    }
+
+    /// Byte offset of a page inside the mapping, if it is mapped
+    fn page_range(map: Option<&MmapMut>, page_id: PageId) -> Result<usize, Error> {
+        let mapped = map.map_or(0, |map| map.len() as u64);
+        let offset = page_id.saturating_mul(PAGE_SIZE as u64);
+        if offset.saturating_add(PAGE_SIZE as u64) > mapped {
+            return Err(Error::not_found(format!(
+                "Page {page_id} is beyond the mapped region ({mapped} bytes)"
+            )));
+        }
+        #[allow(clippy::cast_possible_truncation)]
+        Ok(offset as usize)
+    }
+
+    fn map_file(file: &File, len: u64) -> Result<MmapMut, Error> {
+        let len = usize::try_from(len)
+            .map_err(|_| Error::invalid_input(format!("File of {len} bytes cannot be mapped")))?;
+        // SAFETY: the mapping is only accessed through `MappedFile`, which
+        // synchronises readers and writers with its `RwLock`.
+        Ok(unsafe { MmapOptions::new().len(len).map_mut(file)? })
+    }
+
+    #[cfg(target_os = "linux")]
+    #[allow(clippy::unused_self)]
+    fn remap(&self, mut map: MmapMut, new_len: u64) -> Result<MmapMut, Error> {
+        let new_len = usize::try_from(new_len).map_err(|_| {
+            Error::invalid_input(format!("File of {new_len} bytes cannot be mapped"))
+        })?;
+        // SAFETY: we hold the write lock, so no borrowed page slices exist
+        unsafe { map.remap(new_len, memmap2::RemapOptions::new().may_move(true))? };
+        Ok(map)
+    }
+
+    #[cfg(not(target_os = "linux"))]
+    fn remap(&self, map: MmapMut, new_len: u64) -> Result<MmapMut, Error> {
+        map.flush()?;
+        drop(map);
+        Self::map_file(&self.file, new_len)
+    }
+}
+
+/// A page slice borrowed from a [`MappedFile`]
+pub struct MappedPage<'a> {
+    map: RwLockReadGuard<'a, Option<MmapMut>>,
+    offset: usize,
+}
+
+impl MappedPage<'_> {
+    /// Typed zero-copy view of the mapped page
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidPageType` if the region does not hold a valid
+    /// page header (e.g. it was never written)
+    pub fn page_ref(&self) -> Result<PageRef<'_>, Error> {
+        PageRef::new(self)
+    }
+}
+
+impl Deref for MappedPage<'_> {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        match self.map.as_ref() {
+            Some(map) => &map[self.offset..self.offset + PAGE_SIZE],
+            None => &[],
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::storage::page_constants::MAX_PAGE_ID;
+    use crate::storage::page_type::PageType;
+    use tempfile::NamedTempFile;
+
+    fn small_chunks() -> MappedFileConfig {
+        MappedFileConfig {
+            growth_chunk: 4 * PAGE_SIZE as u64,
+            ..Default::default()
+        }
+    }
+
+    #[test]
+    fn test_empty_file_has_no_pages() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let mapped = MappedFile::open(temp_file.path(), small_chunks())?;
+        assert_eq!(mapped.page_capacity(), 0);
+        assert!(matches!(mapped.page(0), Err(Error::NotFound(_))));
+        Ok(())
+    }
+
+    #[test]
+    fn test_growth_in_chunks() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let mapped = MappedFile::open(temp_file.path(), small_chunks())?;
+
+        let mut page = Page::new();
+        page.header_mut().page_type = PageType::Data;
+        page.calculate_checksum()?;
+
+        mapped.write_page(0, &page)?;
+        assert_eq!(mapped.page_capacity(), 4);
+        mapped.write_page(5, &page)?;
+        assert_eq!(mapped.page_capacity(), 8);
+        assert_eq!(temp_file.as_file().metadata()?.len(), 8 * PAGE_SIZE as u64);
+
+        // Out-of-range pages are rejected before the file grows
+        assert!(matches!(
+            mapped.write_page(u64::MAX, &page),
+            Err(Error::InvalidInput(_))
+        ));
+        assert!(mapped.write_page(MAX_PAGE_ID + 1, &page).is_err());
+        assert_eq!(mapped.page_capacity(), 8);
+        Ok(())
+    }
+
+    #[test]
+    fn test_write_read_and_advise() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let mapped = MappedFile::open(temp_file.path(), small_chunks())?;
+
+        let mut page = Page::new();
+        page.header_mut().page_id = 3;
+        page.data_mut()[0] = 0x33;
+        page.calculate_checksum()?;
+        mapped.write_page(3, &page)?;
+
+        mapped.advise(0, 4, AccessPattern::Random)?;
+        mapped.advise(2, 100, AccessPattern::WillNeed)?;
+        mapped.advise(1, u64::MAX, AccessPattern::Sequential)?;
+        mapped.advise(u64::MAX, u64::MAX, AccessPattern::WillNeed)?;
+        assert!(matches!(mapped.page(u64::MAX), Err(Error::NotFound(_))));
+        assert!(mapped.ensure_capacity(u64::MAX).is_err());
+
+        let read = mapped.read_page(3)?;
+        assert_eq!(read.data()[0], 0x33);
+        assert_eq!(mapped.page(3)?[PAGE_SIZE - 1], 0);
+        assert_eq!(mapped.page(3)?.page_ref()?.data()[0], 0x33);
+        assert!(matches!(
+            mapped.page(1)?.page_ref(),
+            Err(Error::InvalidPageType(0))
+        ));
+        mapped.flush_page(3)?;
+        Ok(())
+    }
+}
@@ -1,8 +1,29 @@
 //! Storage layer implementation
 
+pub mod background_worker;
+pub mod buffer_pool;
 pub mod checksum;
+pub mod data_page;
+pub mod direct_file;
+pub mod file_growth;
+pub mod file_header;
+pub mod free_space_map;
+pub mod group_commit;
+pub mod lru_k_replacer;
+pub mod lsn;
+pub mod mapped_file;
+pub mod overflow;
 pub mod page;
+pub mod page_allocator;
 pub mod page_constants;
+pub mod page_file;
+pub mod page_flusher;
 pub mod page_header;
 pub mod page_io;
+pub mod page_pointer;
+pub mod page_ref;
 pub mod page_type;
+#[cfg(all(feature = "async", target_os = "linux"))]
+pub mod uring;
+pub mod verification;
+pub mod wal;
@@ -0,0 +1,501 @@
+//! Streaming storage for values too large for a data page
+//!
+//! A large value is split across a chain of `PageType::Overflow` pages.
+//! [`OverflowWriter`] takes the pages from whole extents of the
+//! [`PageAllocator`], so a value is a few runs of up to [`EXTENT_PAGES`]
+//! contiguous pages. Those runs are written with coalesced vectored writes
+//! and read back the same way. Pages left over in the last extent are
+//! returned to the allocator when the value is finished.
+//!
+//! Neither side holds the whole value. The writer buffers at most
+//! [`WRITE_BATCH_PAGES`] pages. [`OverflowReader`] holds a window of at most
+//! [`PREFETCH_PAGES`] pages. When it loads a window it asks the OS to start
+//! reading the following one, so the device works ahead of the consumer.
+//! [`OverflowReader::next_chunk`] hands out each page's bytes without
+//! copying them; the reader also implements [`std::io::Read`].
+//!
+//! A row refers to its value with an [`OverflowValue`]: the first page and
+//! the total length.
+//!
+//! Overflow page data area layout:
+//!
+//! | Offset | Size | Field                                 |
+//! |--------|------|---------------------------------------|
+//! | 0      | 2    | value bytes in this page (LE)         |
+//! | 8      | 8    | next page of the value, 0 at the end  |
+//! | 16     | n    | value bytes                           |
+//!
+//! Every page but the last is full, so the length determines how many
+//! pages follow, and the reader checks each page against it.
+
+use crate::common::error::Error;
+use crate::storage::page::Page;
+use crate::storage::page_allocator::{Extent, PageAllocator, EXTENT_PAGES};
+use crate::storage::page_constants::{PageId, INVALID_PAGE_ID, PAGE_USABLE_SIZE};
+use crate::storage::page_file::PageFile;
+use crate::storage::page_type::PageType;
+use std::collections::VecDeque;
+use std::io;
+
+/// Bytes before the value bytes in an overflow page's data area
+pub const OVERFLOW_HEADER_SIZE: usize = 16;
+
+/// Value bytes held by one overflow page
+pub const OVERFLOW_DATA_SIZE: usize = PAGE_USABLE_SIZE - OVERFLOW_HEADER_SIZE;
+
+/// Pages an [`OverflowReader`] reads, and hints, at a time
+pub const PREFETCH_PAGES: u64 = 16;
+
+/// Full pages an [`OverflowWriter`] buffers before writing them
+pub const WRITE_BATCH_PAGES: usize = 16;
+
+#[allow(clippy::cast_possible_truncation)]
+const WINDOW_CAPACITY: usize = PREFETCH_PAGES as usize;
+
+const LEN_OFFSET: usize = 0;
+const NEXT_OFFSET: usize = 8;
+
+/// Reference to a value stored in overflow pages
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct OverflowValue {
+    /// First page of the chain
+    pub first_page: PageId,
+    /// Length of the value in bytes
+    pub len: u64,
+}
+
+impl OverflowValue {
+    /// Bytes of an encoded reference
+    pub const ENCODED_LEN: usize = 16;
+
+    /// Encode the reference for storage in a row
+    pub fn encode(&self) -> [u8; Self::ENCODED_LEN] {
+        let mut bytes = [0u8; Self::ENCODED_LEN];
+        bytes[..8].copy_from_slice(&self.first_page.to_le_bytes());
+        bytes[8..].copy_from_slice(&self.len.to_le_bytes());
+        bytes
+    }
+
+    /// Decode a reference written by [`encode`](Self::encode)
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if `bytes` is too short or names no page
+    pub fn decode(bytes: &[u8]) -> Result<Self, Error> {
+        if bytes.len() < Self::ENCODED_LEN {
+            return Err(Error::corruption("Truncated overflow reference"));
+        }
+        let mut first_page = [0u8; 8];
+        let mut len = [0u8; 8];
+        first_page.copy_from_slice(&bytes[..8]);
+        len.copy_from_slice(&bytes[8..16]);
+        let value = Self {
+            first_page: u64::from_le_bytes(first_page),
+            len: u64::from_le_bytes(len),
+        };
+        if value.first_page == INVALID_PAGE_ID {
+            return Err(Error::corruption("Overflow reference has no first page"));
+        }
+        Ok(value)
+    }
+
+    /// Number of pages the value occupies
+    pub fn page_count(&self) -> u64 {
+        self.len.div_ceil(OVERFLOW_DATA_SIZE as u64).max(1)
+    }
+}
+
+fn page_len(page: &Page) -> usize {
+    let data = page.data();
+    usize::from(u16::from_le_bytes([data[LEN_OFFSET], data[LEN_OFFSET + 1]]))
+}
+
+fn next_page(page: &Page) -> PageId {
+    let mut bytes = [0u8; 8];
+    bytes.copy_from_slice(&page.data()[NEXT_OFFSET..NEXT_OFFSET + 8]);
+    u64::from_le_bytes(bytes)
+}
+
+fn set_next_page(page: &mut Page, next: PageId) {
+    page.data_mut()[NEXT_OFFSET..NEXT_OFFSET + 8].copy_from_slice(&next.to_le_bytes());
+}
+
+/// Pages from `page_id` to the end of its extent
+fn pages_to_extent_end(page_id: PageId) -> u64 {
+    EXTENT_PAGES - page_id % EXTENT_PAGES
+}
+
+/// Writes a large value into overflow pages as it is produced
+///
+/// Call [`finish`](Self::finish) to complete the value. Dropping the writer
+/// without finishing releases its pages.
+pub struct OverflowWriter<'a> {
+    file: &'a PageFile,
+    allocator: &'a PageAllocator,
+    /// Extents holding the value so far
+    extents: Vec<Extent>,
+    /// Pages handed out from the last extent
+    used: u64,
+    /// Pages not yet written; the last one is still being filled
+    pending: Vec<(PageId, Page)>,
+    len: u64,
+    finished: bool,
+}
+
+impl<'a> OverflowWriter<'a> {
+    /// Start a value, allocating its first extent
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if no extent can be allocated
+    pub fn new(file: &'a PageFile, allocator: &'a PageAllocator) -> Result<Self, Error> {
+        let mut writer = Self {
+            file,
+            allocator,
+            extents: Vec::new(),
+            used: 0,
+            pending: Vec::with_capacity(WRITE_BATCH_PAGES + 1),
+            len: 0,
+            finished: false,
+        };
+        writer.start_page()?;
+        Ok(writer)
+    }
+
+    /// Bytes written so far
+    pub fn len(&self) -> u64 {
+        self.len
+    }
+
+    /// Whether nothing has been written yet
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Append bytes to the value
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a page cannot be allocated or written
+    pub fn write_chunk(&mut self, mut bytes: &[u8]) -> Result<(), Error> {
+        while !bytes.is_empty() {
+            let Some((_, page)) = self.pending.last_mut() else {
+                return Err(Error::internal("Overflow writer has no open page"));
+            };
+            let filled = page_len(page);
+            if filled == OVERFLOW_DATA_SIZE {
+                self.start_page()?;
+                continue;
+            }
+            let count = bytes.len().min(OVERFLOW_DATA_SIZE - filled);
+            let start = OVERFLOW_HEADER_SIZE + filled;
+            let data = page.data_mut();
+            data[start..start + count].copy_from_slice(&bytes[..count]);
+            #[allow(clippy::cast_possible_truncation)]
+            data[LEN_OFFSET..LEN_OFFSET + 2]
+                .copy_from_slice(&((filled + count) as u16).to_le_bytes());
+            self.len += count as u64;
+            bytes = &bytes[count..];
+        }
+        Ok(())
+    }
+
+    /// Write the remaining pages and return the reference to the value
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a page cannot be written or released
+    pub fn finish(mut self) -> Result<OverflowValue, Error> {
+        self.flush(self.pending.len())?;
+        self.finished = true;
+        if let Some(last) = self.extents.last() {
+            for page_id in last.start + self.used..last.start + last.len {
+                self.allocator.free_page(page_id)?;
+            }
+        }
+        Ok(OverflowValue {
+            first_page: self.extents[0].start,
+            len: self.len,
+        })
+    }
+
+    /// Link a new page after the current one, writing out full pages once
+    /// a batch has built up
+    fn start_page(&mut self) -> Result<(), Error> {
+        let page_id = match self.extents.last() {
+            Some(extent) if self.used < extent.len => extent.start + self.used,
+            _ => {
+                let extent = self.allocator.allocate_extent()?;
+                self.extents.push(extent);
+                self.used = 0;
+                extent.start
+            }
+        };
+        self.used += 1;
+
+        if let Some((_, previous)) = self.pending.last_mut() {
+            set_next_page(previous, page_id);
+        }
+        let mut page = Page::new();
+        page.header_mut().set_page_id(page_id);
+        page.header_mut().page_type = PageType::Overflow;
+        self.pending.push((page_id, page));
+        if self.pending.len() > WRITE_BATCH_PAGES {
+            self.flush(WRITE_BATCH_PAGES)?;
+        }
+        Ok(())
+    }
+
+    /// Checksum and write the first `count` pending pages
+    fn flush(&mut self, count: usize) -> Result<(), Error> {
+        for (_, page) in &mut self.pending[..count] {
+            page.calculate_checksum_with(self.file.checksum_algorithm())?;
+        }
+        let batch: Vec<(PageId, &Page)> = self.pending[..count]
+            .iter()
+            .map(|(page_id, page)| (*page_id, page))
+            .collect();
+        self.file.write_pages(&batch)?;
+        self.pending.drain(..count);
+        Ok(())
+    }
+}
+
+impl io::Write for OverflowWriter<'_> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.write_chunk(buf).map_err(io::Error::other)?;
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+impl Drop for OverflowWriter<'_> {
+    fn drop(&mut self) {
+        if !self.finished {
+            for extent in &self.extents {
+                // Best effort: the pages are unreferenced either way
+                let _ = self.allocator.free_extent(*extent);
+            }
+        }
+    }
+}
+
+/// Reads a value from overflow pages a window at a time
+pub struct OverflowReader<'a> {
+    file: &'a PageFile,
+    /// Loaded pages in chain order; the front one is being consumed
+    window: VecDeque<(PageId, Page)>,
+    /// Bytes of the front page already returned
+    offset: usize,
+    /// Next page to load, 0 once the whole chain is loaded
+    next: PageId,
+    /// Value bytes not yet loaded
+    unloaded: u64,
+    /// Value bytes not yet returned
+    remaining: u64,
+}
+
+impl<'a> OverflowReader<'a> {
+    /// Start reading a value
+    pub fn new(file: &'a PageFile, value: OverflowValue) -> Self {
+        Self {
+            file,
+            window: VecDeque::with_capacity(WINDOW_CAPACITY),
+            offset: 0,
+            next: value.first_page,
+            unloaded: value.len,
+            remaining: value.len,
+        }
+    }
+
+    /// Value bytes not yet returned
+    pub fn remaining(&self) -> u64 {
+        self.remaining
+    }
+
+    /// The next run of value bytes, borrowed from the page that holds
+    /// them; `None` at the end of the value
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a page cannot be read, or `Error::Corruption`
+    /// if the chain does not match the value's length
+    pub fn next_chunk(&mut self) -> Result<Option<&[u8]>, Error> {
+        if self.remaining == 0 {
+            return Ok(None);
+        }
+        self.advance()?;
+        let (_, page) = &self.window[0];
+        let end = page_len(page);
+        let start = self.offset;
+        self.offset = end;
+        self.remaining -= (end - start) as u64;
+        Ok(Some(
+            &page.data()[OVERFLOW_HEADER_SIZE + start..OVERFLOW_HEADER_SIZE + end],
+        ))
+    }
+
+    /// Read the rest of the value into `out`, one page at a time
+    ///
+    /// # Errors
+    ///
+    /// Same as [`next_chunk`](Self::next_chunk), or an error from `out`
+    pub fn copy_to<W: io::Write>(&mut self, out: &mut W) -> Result<u64, Error> {
+        let mut copied = 0;
+        while let Some(chunk) = self.next_chunk()? {
+            out.write_all(chunk)?;
+            copied += chunk.len() as u64;
+        }
+        Ok(copied)
+    }
+
+    /// Make the front of the window a page with unread bytes
+    fn advance(&mut self) -> Result<(), Error> {
+        loop {
+            match self.window.front() {
+                Some((_, page)) if self.offset < page_len(page) => return Ok(()),
+                Some(_) => {
+                    self.window.pop_front();
+                    self.offset = 0;
+                }
+                None => self.load_window()?,
+            }
+        }
+    }
+
+    /// Read the next contiguous run of the chain and hint the one after it
+    fn load_window(&mut self) -> Result<(), Error> {
+        if self.next == INVALID_PAGE_ID {
+            return Err(Error::corruption("Overflow chain ends before the value"));
+        }
+        let run = Self::run_len(self.next, self.unloaded);
+        let end = self.next.checked_add(run).ok_or_else(|| {
+            Error::corruption(format!(
+                "Overflow chain points past the end at {}",
+                self.next
+            ))
+        })?;
+        let page_ids: Vec<PageId> = (self.next..end).collect();
+        let pages = self.file.read_pages(&page_ids)?;
+
+        for (page_id, page) in page_ids.into_iter().zip(pages) {
+            let expected = self.unloaded.min(OVERFLOW_DATA_SIZE as u64);
+            if page.header().page_type != PageType::Overflow
+                || !page.header().has_page_id(page_id)
+                || page_len(&page) as u64 != expected
+            {
+                return Err(Error::corruption(format!(
+                    "Page {page_id} does not continue the overflow chain"
+                )));
+            }
+            self.unloaded -= expected;
+            let next = next_page(&page);
+            if (next == INVALID_PAGE_ID) != (self.unloaded == 0) {
+                return Err(Error::corruption(format!(
+                    "Overflow page {page_id} has a bad next page {next}"
+                )));
+            }
+            self.window.push_back((page_id, page));
+            self.next = next;
+            // Chains normally only jump between extents, but stop the run
+            // wherever they do
+            if page_id.checked_add(1) != Some(next) {
+                break;
+            }
+        }
+
+        if self.next != INVALID_PAGE_ID {
+            self.file
+                .prefetch(self.next, Self::run_len(self.next, self.unloaded))?;
+        }
+        Ok(())
+    }
+
+    /// Pages to read from `page_id`: up to the window size, the end of the
+    /// extent, or the end of the value
+    fn run_len(page_id: PageId, unloaded: u64) -> u64 {
+        let value_pages = unloaded.div_ceil(OVERFLOW_DATA_SIZE as u64).max(1);
+        PREFETCH_PAGES
+            .min(pages_to_extent_end(page_id))
+            .min(value_pages)
+    }
+}
+
+impl io::Read for OverflowReader<'_> {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        if self.remaining == 0 || buf.is_empty() {
+            return Ok(0);
+        }
+        self.advance().map_err(io::Error::other)?;
+        let (_, page) = &self.window[0];
+        let count = buf.len().min(page_len(page) - self.offset);
+        let start = OVERFLOW_HEADER_SIZE + self.offset;
+        buf[..count].copy_from_slice(&page.data()[start..start + count]);
+        self.offset += count;
+        self.remaining -= count as u64;
+        Ok(count)
+    }
+}
+
+/// Return every page of a value to the allocator
+///
+/// Reads the chain to find the pages, a window at a time.
+///
+/// # Errors
+///
+/// Returns an error if the chain cannot be read or is damaged, in which
+/// case no page is freed
+pub fn free_value(
+    file: &PageFile,
+    allocator: &PageAllocator,
+    value: OverflowValue,
+) -> Result<(), Error> {
+    let mut reader = OverflowReader::new(file, value);
+    let mut page_ids = Vec::new();
+    loop {
+        reader.load_window()?;
+        page_ids.extend(reader.window.drain(..).map(|(page_id, _)| page_id));
+        if reader.next == INVALID_PAGE_ID {
+            break;
+        }
+    }
+    for page_id in page_ids {
+        allocator.free_page(page_id)?;
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_reference_round_trip() {
+        let value = OverflowValue {
+            first_page: 1 << 40,
+            len: 5_000_000,
+        };
+        assert_eq!(OverflowValue::decode(&value.encode()).unwrap(), value);
+        assert!(OverflowValue::decode(&[0; 8]).is_err());
+        assert!(OverflowValue::decode(&[0; 16]).is_err());
+    }
+
+    #[test]
+    fn test_page_counts() {
+        let value = |len| OverflowValue { first_page: 1, len };
+        assert_eq!(value(0).page_count(), 1);
+        assert_eq!(value(OVERFLOW_DATA_SIZE as u64).page_count(), 1);
+        assert_eq!(value(OVERFLOW_DATA_SIZE as u64 + 1).page_count(), 2);
+    }
+
+    #[test]
+    fn test_runs_stop_at_extent_end() {
+        assert_eq!(OverflowReader::run_len(64, 1 << 30), PREFETCH_PAGES);
+        assert_eq!(OverflowReader::run_len(125, 1 << 30), 3);
+        assert_eq!(OverflowReader::run_len(64, 10), 1);
+        assert_eq!(OverflowReader::run_len(64, 0), 1);
+    }
+}
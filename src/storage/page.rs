@@ -1,23 +1,52 @@
-//! Page structure - a 4KB aligned byte array with typed header access
+//! Page structure - a page-size aligned byte array with typed header access
+//!
+//! [`GenericPage`] is generic over its size so that databases can use larger
+//! pages (16 or 64 KiB) to cut B+Tree height and I/O count. The size is chosen
+//! per database file and recorded in its
+//! [`FileHeader`](crate::storage::file_header::FileHeader). [`Page`] is the
+//! default 4 KiB page used by the buffer pool, WAL and allocator.
 
 use crate::common::error::Error;
-use crate::storage::page_constants::{PAGE_HEADER_SIZE, PAGE_SIZE, PAGE_USABLE_SIZE};
+use crate::storage::checksum::{calculate_page_checksum_with, ChecksumAlgorithm};
+use crate::storage::page_constants::{is_valid_page_size, PAGE_HEADER_SIZE, PAGE_SIZE};
 use crate::storage::page_header::PageHeader;
-
-/// Page - 4KB aligned byte array with typed header access
+use crate::storage::page_ref::PageRef;
+
+/// Page of `N` bytes with typed header access
+///
+/// `N` must be a power of two between
+/// [`MIN_PAGE_SIZE`](crate::storage::page_constants::MIN_PAGE_SIZE) and
+/// [`MAX_PAGE_SIZE`](crate::storage::page_constants::MAX_PAGE_SIZE); other
+/// sizes fail to compile. Pages are 4096-byte aligned whatever their size,
+/// which satisfies direct I/O.
 #[repr(C, align(4096))]
-pub struct Page {
-    buffer: [u8; PAGE_SIZE],
+pub struct GenericPage<const N: usize> {
+    buffer: [u8; N],
 }
 
-impl Page {
+/// Default 4 KiB page
+pub type Page = GenericPage<PAGE_SIZE>;
+
+/// 16 KiB page
+pub type Page16K = GenericPage<16384>;
+
+/// 64 KiB page
+pub type Page64K = GenericPage<65536>;
+
+impl<const N: usize> GenericPage<N> {
+    const VALID_SIZE: () = assert!(is_valid_page_size(N), "unsupported page size");
+
+    /// Usable data size in bytes; fits the header's `u16` free-space field
+    #[allow(clippy::cast_possible_truncation)]
+    pub const USABLE_SIZE: u16 = (N - PAGE_HEADER_SIZE) as u16;
+
     /// Create a new zero-initialized page
     pub fn new() -> Self {
-        let mut page = Self {
-            buffer: [0; PAGE_SIZE],
-        };
+        let () = Self::VALID_SIZE;
+        let mut page = Self { buffer: [0; N] };
         // Initialize header to default
         *page.header_mut() = PageHeader::default();
+        page.header_mut().free_space = Self::USABLE_SIZE;
         page
     }
 
@@ -63,12 +92,12 @@ impl Page {
 
     /// Page size in bytes
     pub fn size(&self) -> usize {
-        PAGE_SIZE
+        N
     }
 
     /// Usable data size in bytes
     pub fn usable_size(&self) -> usize {
-        PAGE_USABLE_SIZE
+        N - PAGE_HEADER_SIZE
     }
 
     /// Calculate and store page checksum
@@ -77,17 +106,38 @@ impl Page {
     ///
     /// Returns an error if the page size is invalid (should never happen with Page struct)
     pub fn calculate_checksum(&mut self) -> Result<(), Error> {
-        let checksum = crate::storage::checksum::calculate_page_checksum(&self.buffer)?;
+        self.calculate_checksum_with(ChecksumAlgorithm::Crc32)
+    }
+
+    /// Calculate and store page checksum using the given algorithm
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the page size is invalid (should never happen with Page struct)
+    pub fn calculate_checksum_with(&mut self, algorithm: ChecksumAlgorithm) -> Result<(), Error> {
+        let checksum = calculate_page_checksum_with(algorithm, &self.buffer)?;
         self.header_mut().checksum = checksum;
         Ok(())
     }
 
     /// Verify page checksum
     pub fn verify_checksum(&self) -> bool {
-        match crate::storage::checksum::calculate_page_checksum(&self.buffer) {
+        self.verify_checksum_with(ChecksumAlgorithm::Crc32)
+    }
+
+    /// Verify page checksum using the given algorithm
+    pub fn verify_checksum_with(&self, algorithm: ChecksumAlgorithm) -> bool {
+        match calculate_page_checksum_with(algorithm, &self.buffer) {
             Ok(calculated) => {
-                // Copy checksum value to avoid unaligned access
-                let stored_checksum = self.header().checksum;
+                // Read the stored checksum (bytes 8-11) from the raw buffer:
+                // an unverified page may hold an invalid page type byte, so
+                // it must not be viewed as a `PageHeader` yet
+                let stored_checksum = u32::from_le_bytes([
+                    self.buffer[8],
+                    self.buffer[9],
+                    self.buffer[10],
+                    self.buffer[11],
+                ]);
                 calculated == stored_checksum
             }
             Err(_) => false,
@@ -100,7 +150,14 @@ impl Page {
     }
 }
 
-impl Default for Page {
+impl Page {
+    /// Borrow the page as a read-only [`PageRef`] view
+    pub fn as_page_ref(&self) -> PageRef<'_> {
+        PageRef::from_buffer(&self.buffer)
+    }
+}
+
+impl<const N: usize> Default for GenericPage<N> {
     fn default() -> Self {
         Self::new()
     }
@@ -109,6 +166,7 @@ impl Default for Page {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::storage::page_constants::PAGE_USABLE_SIZE;
     use crate::storage::page_type::PageType;
 
     #[test]
@@ -141,4 +199,23 @@ mod tests {
         let raw_page_type = page.buffer[4];
         assert_eq!(raw_page_type, PageType::BTreeLeaf as u8);
     }
+
+    #[test]
+    fn test_large_pages() {
+        assert_eq!(std::mem::align_of::<Page64K>(), 4096);
+        assert_eq!(std::mem::size_of::<Page16K>(), 16384);
+
+        let mut page = Page64K::new();
+        let free_space = page.header().free_space;
+        assert_eq!(usize::from(free_space), page.usable_size());
+        assert_eq!(page.usable_size(), 65536 - PAGE_HEADER_SIZE);
+        assert_eq!(Page::USABLE_SIZE as usize, PAGE_USABLE_SIZE);
+
+        page.data_mut()[60_000] = 0x5A;
+        page.calculate_checksum_with(ChecksumAlgorithm::Crc32c)
+            .unwrap();
+        assert!(page.verify_checksum_with(ChecksumAlgorithm::Crc32c));
+        page.data_mut()[60_000] = 0;
+        assert!(!page.verify_checksum_with(ChecksumAlgorithm::Crc32c));
+    }
 }
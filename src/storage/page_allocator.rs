@@ -0,0 +1,683 @@
+//! Page allocator with extent allocation, persisted in `FreeList` pages
+//!
+//! [`PageAllocator`] hands out page IDs so callers no longer pick them
+//! themselves. Free pages are tracked in memory as a bitmap with one 64-bit
+//! word per aligned run of [`EXTENT_PAGES`] pages, so freeing and testing a
+//! page is a single bit operation. Word indexes are also kept in two ordered
+//! sets, one for partially free words and one for wholly free words:
+//!
+//! - [`allocate_page`](PageAllocator::allocate_page) takes a page from the
+//!   lowest partially free word and only breaks up a free extent when none
+//!   is left
+//! - [`allocate_extent`](PageAllocator::allocate_extent) takes a wholly free
+//!   word, so extents are always aligned, contiguous 64-page runs that B+Tree
+//!   and data consumers can read and write with large sequential I/O
+//!
+//! When nothing suitable is free, the file grows at its end.
+//!
+//! [`save`](PageAllocator::save) persists the free set as run-length
+//! encoded `(start, length)` entries in a chain of `PageType::FreeList`
+//! pages. The new chain is written into free pages and synced before the
+//! header is updated to point at it. The previous chain's pages are only
+//! released after that, so a crash at any point leaves one complete chain.
+//! Allocation state is durable as of the last `save`, so call it as part of
+//! every checkpoint.
+//!
+//! `FreeList` page data area layout:
+//!
+//! | Offset | Size | Field                                          |
+//! |--------|------|------------------------------------------------|
+//! | 0      | 1    | kind ([`FREE_LIST_KIND_EXTENTS`] or `_WIDE`)   |
+//! | 4      | 4    | next `FreeList` page, low 32 bits (LE)         |
+//! | 8      | 2    | entry count (LE)                               |
+//! | 12     | 4    | next `FreeList` page, high 32 bits (LE)        |
+//! | 16     | 8n   | entries: first page u32, length u32            |
+//! | 16     | 12n  | `_WIDE` entries: first page u64, length u32    |
+//!
+//! The next page is 0 at the end of the chain. Files whose pages all have
+//! 32-bit IDs are written with the original narrow entries, and their high
+//! next-page bits are zero, so they keep the original format.
+
+use crate::common::error::Error;
+use crate::storage::file_header::FileHeader;
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PageId, INVALID_PAGE_ID, PAGE_USABLE_SIZE};
+use crate::storage::page_file::PageFile;
+use crate::storage::page_type::PageType;
+use parking_lot::Mutex;
+use std::collections::BTreeSet;
+use std::ops::Range;
+
+/// Pages in an extent; extents start at multiples of this
+pub const EXTENT_PAGES: u64 = 64;
+
+/// `FreeList` page kind: run-length encoded free page IDs
+pub const FREE_LIST_KIND_EXTENTS: u8 = 1;
+
+/// `FreeList` page kind: runs with 64-bit first page IDs
+pub const FREE_LIST_KIND_EXTENTS_WIDE: u8 = 2;
+
+/// `FreeList` page kind: free-space map categories, see
+/// [`free_space_map`](crate::storage::free_space_map)
+pub const FREE_LIST_KIND_SPACE_MAP: u8 = 3;
+
+const KIND_OFFSET: usize = 0;
+const NEXT_OFFSET: usize = 4;
+const COUNT_OFFSET: usize = 8;
+const NEXT_HIGH_OFFSET: usize = 12;
+const ENTRIES_OFFSET: usize = 16;
+const ENTRY_SIZE: usize = 8;
+const WIDE_ENTRY_SIZE: usize = 12;
+
+/// Longest run one entry can describe
+const MAX_RUN_PAGES: u64 = u32::MAX as u64;
+
+/// Free-run entries that fit in one `FreeList` page
+pub const FREE_LIST_ENTRIES_PER_PAGE: usize = (PAGE_USABLE_SIZE - ENTRIES_OFFSET) / ENTRY_SIZE;
+
+/// Wide free-run entries that fit in one `FreeList` page
+pub const FREE_LIST_WIDE_ENTRIES_PER_PAGE: usize =
+    (PAGE_USABLE_SIZE - ENTRIES_OFFSET) / WIDE_ENTRY_SIZE;
+
+/// A contiguous run of pages
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct Extent {
+    /// First page of the run
+    pub start: PageId,
+    /// Number of pages in the run
+    pub len: u64,
+}
+
+impl Extent {
+    /// Page IDs covered by the run
+    pub fn pages(&self) -> Range<PageId> {
+        self.start..self.start + self.len
+    }
+}
+
+/// Bitmap of free pages with per-word occupancy indexes
+#[derive(Debug, Default)]
+struct FreeMap {
+    /// Bit set = page free
+    words: Vec<u64>,
+    /// Words with some, but not all, pages free
+    partial: BTreeSet<usize>,
+    /// Words with every page free
+    full: BTreeSet<usize>,
+    free_count: u64,
+}
+
+impl FreeMap {
+    #[allow(clippy::cast_possible_truncation)]
+    fn position(page_id: PageId) -> (usize, u64) {
+        (
+            (page_id / EXTENT_PAGES) as usize,
+            1 << (page_id % EXTENT_PAGES),
+        )
+    }
+
+    fn contains(&self, page_id: PageId) -> bool {
+        let (word, bit) = Self::position(page_id);
+        self.words.get(word).is_some_and(|w| w & bit != 0)
+    }
+
+    /// Mark a page free; returns `false` if it already was
+    fn insert(&mut self, page_id: PageId) -> bool {
+        let (word, bit) = Self::position(page_id);
+        if self.words.len() <= word {
+            self.words.resize(word + 1, 0);
+        }
+        if self.words[word] & bit != 0 {
+            return false;
+        }
+        self.words[word] |= bit;
+        self.free_count += 1;
+        self.reclassify(word);
+        true
+    }
+
+    /// Mark a page in use; returns `false` if it was not free
+    fn remove(&mut self, page_id: PageId) -> bool {
+        let (word, bit) = Self::position(page_id);
+        match self.words.get_mut(word) {
+            Some(w) if *w & bit != 0 => {
+                *w &= !bit;
+                self.free_count -= 1;
+                self.reclassify(word);
+                true
+            }
+            _ => false,
+        }
+    }
+
+    fn reclassify(&mut self, word: usize) {
+        self.partial.remove(&word);
+        self.full.remove(&word);
+        match self.words[word] {
+            0 => {}
+            u64::MAX => {
+                self.full.insert(word);
+            }
+            _ => {
+                self.partial.insert(word);
+            }
+        }
+    }
+
+    /// Take the lowest free page, preferring words that are already broken up
+    fn take_page(&mut self) -> Option<PageId> {
+        let word = *self.partial.first().or_else(|| self.full.first())?;
+        let page_id = word as u64 * EXTENT_PAGES + u64::from(self.words[word].trailing_zeros());
+        self.remove(page_id);
+        Some(page_id)
+    }
+
+    /// Take the lowest wholly free extent
+    fn take_extent(&mut self) -> Option<Extent> {
+        let word = self.full.pop_first()?;
+        self.words[word] = 0;
+        self.free_count -= EXTENT_PAGES;
+        let start = word as u64 * EXTENT_PAGES;
+        Some(Extent {
+            start,
+            len: EXTENT_PAGES,
+        })
+    }
+
+    /// Free pages as maximal runs of up to `MAX_RUN_PAGES`, in page order
+    fn runs(&self) -> Vec<Extent> {
+        let mut runs: Vec<Extent> = Vec::new();
+        for (index, &word) in self.words.iter().enumerate() {
+            let mut bits = word;
+            while bits != 0 {
+                let offset = bits.trailing_zeros();
+                let len = (bits >> offset).trailing_ones();
+                let start = index as u64 * EXTENT_PAGES + u64::from(offset);
+                let run_len = u64::from(len);
+                match runs.last_mut() {
+                    Some(last)
+                        if last.start + last.len == start
+                            && last.len + run_len <= MAX_RUN_PAGES =>
+                    {
+                        last.len += run_len;
+                    }
+                    _ => runs.push(Extent {
+                        start,
+                        len: run_len,
+                    }),
+                }
+                bits &= if offset + len >= 64 {
+                    0
+                } else {
+                    !0 << (offset + len)
+                };
+            }
+        }
+        runs
+    }
+}
+
+#[derive(Debug)]
+struct AllocatorState {
+    free: FreeMap,
+    /// Pages `0..allocated_pages` exist; the file grows from here
+    allocated_pages: u64,
+    /// Pages holding the saved free list; neither free nor usable
+    chain: Vec<PageId>,
+}
+
+impl AllocatorState {
+    fn allocate_page(&mut self) -> Result<PageId, Error> {
+        if let Some(page_id) = self.free.take_page() {
+            return Ok(page_id);
+        }
+        let page_id = self.allocated_pages;
+        self.allocated_pages = page_id.checked_add(1).ok_or_else(exhausted)?;
+        Ok(page_id)
+    }
+
+    fn allocate_extent(&mut self) -> Result<Extent, Error> {
+        if let Some(extent) = self.free.take_extent() {
+            return Ok(extent);
+        }
+        let start = self
+            .allocated_pages
+            .checked_next_multiple_of(EXTENT_PAGES)
+            .ok_or_else(exhausted)?;
+        let end = start.checked_add(EXTENT_PAGES).ok_or_else(exhausted)?;
+        // Pages skipped to reach alignment become free single pages
+        for page_id in self.allocated_pages..start {
+            self.free.insert(page_id);
+        }
+        self.allocated_pages = end;
+        Ok(Extent {
+            start,
+            len: EXTENT_PAGES,
+        })
+    }
+
+    fn check_in_use(&self, page_id: PageId) -> Result<(), Error> {
+        if page_id == INVALID_PAGE_ID || page_id >= self.allocated_pages {
+            return Err(Error::invalid_input(format!(
+                "Page {page_id} was never allocated"
+            )));
+        }
+        if self.free.contains(page_id) {
+            return Err(Error::invalid_input(format!(
+                "Page {page_id} is already free"
+            )));
+        }
+        if self.chain.contains(&page_id) {
+            return Err(Error::invalid_input(format!(
+                "Page {page_id} holds the free list"
+            )));
+        }
+        Ok(())
+    }
+}
+
+fn exhausted() -> Error {
+    Error::internal("Page ID space exhausted")
+}
+
+/// Thread-safe allocator of page IDs and extents
+#[derive(Debug)]
+pub struct PageAllocator {
+    state: Mutex<AllocatorState>,
+}
+
+impl Default for PageAllocator {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl PageAllocator {
+    /// Allocator for a new database in which only the header page exists
+    pub fn new() -> Self {
+        Self {
+            state: Mutex::new(AllocatorState {
+                free: FreeMap::default(),
+                allocated_pages: 1,
+                chain: Vec::new(),
+            }),
+        }
+    }
+
+    /// Load the allocator state saved in a database file
+    ///
+    /// A header without saved state is treated as having every page up to
+    /// the end of the file in use.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Corruption` if the free list is damaged, or an I/O
+    /// error
+    pub fn load(file: &PageFile, header: &FileHeader) -> Result<Self, Error> {
+        let allocated_pages = if header.allocated_pages == 0 {
+            file.page_count()?.max(1)
+        } else {
+            header.allocated_pages
+        };
+        let mut free = FreeMap::default();
+        let mut chain = Vec::new();
+
+        let mut next = header.free_list_root;
+        while next != INVALID_PAGE_ID {
+            if next >= allocated_pages || chain.len() as u64 >= allocated_pages {
+                return Err(Error::corruption(format!(
+                    "Free list chain is broken at page {next}"
+                )));
+            }
+            let page = file.read_page(next)?;
+            let data = page.data();
+            if page.header().page_type != PageType::FreeList
+                || !matches!(
+                    data[KIND_OFFSET],
+                    FREE_LIST_KIND_EXTENTS | FREE_LIST_KIND_EXTENTS_WIDE
+                )
+            {
+                return Err(Error::corruption(format!(
+                    "Page {next} is not a free list page"
+                )));
+            }
+            let wide = data[KIND_OFFSET] == FREE_LIST_KIND_EXTENTS_WIDE;
+            let count = usize::from(read_u16(data, COUNT_OFFSET));
+            if count > entries_per_page(wide) {
+                return Err(Error::corruption(format!(
+                    "Free list page {next} has {count} entries"
+                )));
+            }
+            for entry in 0..count {
+                let (start, len) = read_entry(data, entry, wide);
+                let end = start.checked_add(len).filter(|&end| end <= allocated_pages);
+                if start == INVALID_PAGE_ID || end.is_none() {
+                    return Err(Error::corruption(format!(
+                        "Free list page {next} has invalid run {start}+{len}"
+                    )));
+                }
+                for page_id in start..start + len {
+                    if !free.insert(page_id) {
+                        return Err(Error::corruption(format!(
+                            "Page {page_id} appears twice in the free list"
+                        )));
+                    }
+                }
+            }
+            chain.push(next);
+            next = u64::from(read_u32(data, NEXT_OFFSET))
+                | u64::from(read_u32(data, NEXT_HIGH_OFFSET)) << 32;
+        }
+        if let Some(&page_id) = chain.iter().find(|&&page_id| free.contains(page_id)) {
+            return Err(Error::corruption(format!(
+                "Free list page {page_id} is listed as free"
+            )));
+        }
+
+        Ok(Self {
+            state: Mutex::new(AllocatorState {
+                free,
+                allocated_pages,
+                chain,
+            }),
+        })
+    }
+
+    /// Persist the free set and point `header` at it
+    ///
+    /// Writes a new `FreeList` chain, syncs it, then writes and syncs the
+    /// header. The previous chain's pages are recorded as free in the new
+    /// chain and become free in memory afterwards; they are only reused once
+    /// the header no longer points at them.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if a page or the header cannot be written
+    pub fn save(&self, file: &PageFile, header: &mut FileHeader) -> Result<(), Error> {
+        let mut state = self.state.lock();
+
+        // Taking chain pages from the free set changes the runs, so repeat
+        // until the chain is long enough for what remains. The previous
+        // chain is persisted as free but never taken for the new one.
+        let previous = state.chain.clone();
+        let mut chain: Vec<PageId> = Vec::new();
+        let (runs, wide) = loop {
+            for &page_id in &previous {
+                state.free.insert(page_id);
+            }
+            let runs = state.free.runs();
+            for &page_id in &previous {
+                state.free.remove(page_id);
+            }
+            // Narrow entries only while every page ID fits in 32 bits
+            let wide = state.allocated_pages > u64::from(u32::MAX);
+            if chain.len() * entries_per_page(wide) >= runs.len() {
+                break (runs, wide);
+            }
+            chain.push(state.allocate_page()?);
+        };
+
+        let mut pages = Vec::with_capacity(chain.len());
+        let mut entries = runs.chunks(entries_per_page(wide));
+        for (index, &page_id) in chain.iter().enumerate() {
+            let mut page = Page::new();
+            page.header_mut().set_page_id(page_id);
+            page.header_mut().page_type = PageType::FreeList;
+            let next = chain.get(index + 1).copied().unwrap_or(INVALID_PAGE_ID);
+            let runs = entries.next().unwrap_or_default();
+            let data = page.data_mut();
+            data[KIND_OFFSET] = if wide {
+                FREE_LIST_KIND_EXTENTS_WIDE
+            } else {
+                FREE_LIST_KIND_EXTENTS
+            };
+            let next = next.to_le_bytes();
+            data[NEXT_OFFSET..NEXT_OFFSET + 4].copy_from_slice(&next[..4]);
+            data[NEXT_HIGH_OFFSET..NEXT_HIGH_OFFSET + 4].copy_from_slice(&next[4..]);
+            #[allow(clippy::cast_possible_truncation)]
+            data[COUNT_OFFSET..COUNT_OFFSET + 2]
+                .copy_from_slice(&(runs.len() as u16).to_le_bytes());
+            for (entry, run) in runs.iter().enumerate() {
+                write_entry(data, entry, wide, *run);
+            }
+            page.calculate_checksum_with(file.checksum_algorithm())?;
+            pages.push(page);
+        }
+        let batch: Vec<(PageId, &Page)> = chain.iter().copied().zip(pages.iter()).collect();
+        file.write_pages(&batch)?;
+        file.sync_data()?;
+
+        let mut updated = *header;
+        updated.free_list_root = chain.first().copied().unwrap_or(INVALID_PAGE_ID);
+        updated.allocated_pages = state.allocated_pages;
+        updated.write(file)?;
+        file.sync_data()?;
+        *header = updated;
+
+        state.chain = chain;
+        for page_id in previous {
+            state.free.insert(page_id);
+        }
+        Ok(())
+    }
+
+    /// Allocate a single page
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Internal` if the page ID space is exhausted
+    pub fn allocate_page(&self) -> Result<PageId, Error> {
+        self.state.lock().allocate_page()
+    }
+
+    /// Allocate an aligned extent of [`EXTENT_PAGES`] contiguous pages
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::Internal` if the page ID space is exhausted
+    pub fn allocate_extent(&self) -> Result<Extent, Error> {
+        self.state.lock().allocate_extent()
+    }
+
+    /// Return a page to the free set
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the page is the header, was never
+    /// allocated, is already free, or holds the saved free list
+    pub fn free_page(&self, page_id: PageId) -> Result<(), Error> {
+        let mut state = self.state.lock();
+        state.check_in_use(page_id)?;
+        state.free.insert(page_id);
+        Ok(())
+    }
+
+    /// Return every page of an extent to the free set
+    ///
+    /// # Errors
+    ///
+    /// Same as [`free_page`](Self::free_page); nothing is freed if any page
+    /// of the extent is invalid
+    pub fn free_extent(&self, extent: Extent) -> Result<(), Error> {
+        let mut state = self.state.lock();
+        for page_id in extent.pages() {
+            state.check_in_use(page_id)?;
+        }
+        for page_id in extent.pages() {
+            state.free.insert(page_id);
+        }
+        Ok(())
+    }
+
+    /// Whether a page is currently free
+    pub fn is_free(&self, page_id: PageId) -> bool {
+        self.state.lock().free.contains(page_id)
+    }
+
+    /// Number of free pages below the allocated page count
+    pub fn free_pages(&self) -> u64 {
+        self.state.lock().free.free_count
+    }
+
+    /// Number of page IDs handed out so far, including the header page;
+    /// the file grows past this
+    pub fn allocated_pages(&self) -> u64 {
+        self.state.lock().allocated_pages
+    }
+
+    /// Drop free pages from the end of the allocated range so the file can
+    /// be truncated; returns the new allocated page count
+    pub fn trim_free_tail(&self) -> u64 {
+        let mut state = self.state.lock();
+        while state.allocated_pages > 1 {
+            let last = state.allocated_pages - 1;
+            if !state.free.remove(last) {
+                break;
+            }
+            state.allocated_pages = last;
+        }
+        state.allocated_pages
+    }
+
+    /// Extents whose pages are all free, in page order
+    pub fn free_extents(&self) -> Vec<Extent> {
+        let state = self.state.lock();
+        state
+            .free
+            .full
+            .iter()
+            .map(|&word| Extent {
+                start: word as u64 * EXTENT_PAGES,
+                len: EXTENT_PAGES,
+            })
+            .collect()
+    }
+}
+
+fn entries_per_page(wide: bool) -> usize {
+    if wide {
+        FREE_LIST_WIDE_ENTRIES_PER_PAGE
+    } else {
+        FREE_LIST_ENTRIES_PER_PAGE
+    }
+}
+
+fn read_entry(data: &[u8], entry: usize, wide: bool) -> (PageId, u64) {
+    if wide {
+        let offset = ENTRIES_OFFSET + entry * WIDE_ENTRY_SIZE;
+        let mut start = [0u8; 8];
+        start.copy_from_slice(&data[offset..offset + 8]);
+        (
+            u64::from_le_bytes(start),
+            u64::from(read_u32(data, offset + 8)),
+        )
+    } else {
+        let offset = ENTRIES_OFFSET + entry * ENTRY_SIZE;
+        (
+            u64::from(read_u32(data, offset)),
+            u64::from(read_u32(data, offset + 4)),
+        )
+    }
+}
+
+/// Encode a run; `runs` caps lengths and narrow pages only hold runs below
+/// 2^32, so the truncating casts are exact
+#[allow(clippy::cast_possible_truncation)]
+fn write_entry(data: &mut [u8], entry: usize, wide: bool, run: Extent) {
+    let len = (run.len as u32).to_le_bytes();
+    if wide {
+        let offset = ENTRIES_OFFSET + entry * WIDE_ENTRY_SIZE;
+        data[offset..offset + 8].copy_from_slice(&run.start.to_le_bytes());
+        data[offset + 8..offset + 12].copy_from_slice(&len);
+    } else {
+        let offset = ENTRIES_OFFSET + entry * ENTRY_SIZE;
+        data[offset..offset + 4].copy_from_slice(&(run.start as u32).to_le_bytes());
+        data[offset + 4..offset + 8].copy_from_slice(&len);
+    }
+}
+
+fn read_u16(data: &[u8], offset: usize) -> u16 {
+    u16::from_le_bytes([data[offset], data[offset + 1]])
+}
+
+fn read_u32(data: &[u8], offset: usize) -> u32 {
+    let mut bytes = [0u8; 4];
+    bytes.copy_from_slice(&data[offset..offset + 4]);
+    u32::from_le_bytes(bytes)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_free_map_prefers_partial_words() {
+        let mut free = FreeMap::default();
+        for page_id in 64..128 {
+            free.insert(page_id);
+        }
+        free.insert(200);
+        assert_eq!(free.full.len(), 1);
+        assert_eq!(free.partial.len(), 1);
+
+        // The lone page is used before the full extent is broken up
+        assert_eq!(free.take_page(), Some(200));
+        assert_eq!(
+            free.take_extent(),
+            Some(Extent {
+                start: 64,
+                len: EXTENT_PAGES
+            })
+        );
+        assert_eq!(free.take_page(), None);
+        assert_eq!(free.free_count, 0);
+    }
+
+    #[test]
+    fn test_free_map_runs_merge_across_words() {
+        let mut free = FreeMap::default();
+        for page_id in (60..70).chain([100, 127, 128]) {
+            free.insert(page_id);
+        }
+        assert_eq!(
+            free.runs(),
+            vec![
+                Extent { start: 60, len: 10 },
+                Extent { start: 100, len: 1 },
+                Extent { start: 127, len: 2 },
+            ]
+        );
+        assert!(free.remove(65));
+        assert!(!free.remove(65));
+        assert_eq!(free.runs()[0], Extent { start: 60, len: 5 });
+    }
+
+    #[test]
+    fn test_wide_entries_hold_64_bit_page_ids() {
+        let mut data = [0u8; PAGE_USABLE_SIZE];
+        let run = Extent {
+            start: (1 << 40) + 3,
+            len: 70,
+        };
+        write_entry(&mut data, 2, true, run);
+        assert_eq!(read_entry(&data, 2, true), (run.start, run.len));
+        assert_eq!(read_entry(&data, 1, true), (0, 0));
+
+        write_entry(&mut data, 0, false, Extent { start: 9, len: 2 });
+        assert_eq!(read_entry(&data, 0, false), (9, 2));
+    }
+
+    #[test]
+    fn test_extent_allocation_aligns_and_frees_gap() {
+        let mut state = AllocatorState {
+            free: FreeMap::default(),
+            allocated_pages: 1,
+            chain: Vec::new(),
+        };
+        let extent = state.allocate_extent().unwrap();
+        assert_eq!(extent.start, EXTENT_PAGES);
+        assert_eq!(state.allocated_pages, 2 * EXTENT_PAGES);
+        assert_eq!(state.free.free_count, EXTENT_PAGES - 1);
+        assert_eq!(state.allocate_page().unwrap(), 1);
+    }
+}
@@ -1,22 +1,43 @@
 //! Page constants and fundamental types for the storage layer
 
-/// Page size in bytes - must be power of 2 and >= 4KB
+/// Default page size in bytes
 pub const PAGE_SIZE: usize = 4096;
 
+/// Smallest supported page size
+pub const MIN_PAGE_SIZE: usize = 4096;
+
+/// Largest supported page size; the header's `u16` free-space field must be
+/// able to hold the usable size
+pub const MAX_PAGE_SIZE: usize = 65536;
+
 /// Page header size in bytes - MUST match plan/storage-format.md
 pub const PAGE_HEADER_SIZE: usize = 16;
 
 /// Usable space in page after header
 pub const PAGE_USABLE_SIZE: usize = PAGE_SIZE - PAGE_HEADER_SIZE;
 
-/// Page ID type - supports 16TB databases (4KB * 2^32)
-pub type PageId = u32;
+/// Page ID type - 64-bit, so databases are not capped at 16 TB
+///
+/// Page headers keep a 32-bit page ID field holding the low 32 bits (see
+/// [`PageHeader::set_page_id`](crate::storage::page_header::PageHeader::set_page_id)),
+/// and in-page child pointers use the compact encoding in
+/// [`page_pointer`](crate::storage::page_pointer).
+pub type PageId = u64;
 
 /// Invalid page ID sentinel value
 pub const INVALID_PAGE_ID: PageId = 0;
 
 /// Maximum valid page ID
-pub const MAX_PAGE_ID: PageId = u32::MAX;
+///
+/// Every page of every supported size must start at a byte offset that fits
+/// in a signed 64-bit file offset (`off_t`).
+pub const MAX_PAGE_ID: PageId = i64::MAX as u64 / MAX_PAGE_SIZE as u64;
+
+/// Whether `size` is a supported page size: a power of two from
+/// [`MIN_PAGE_SIZE`] to [`MAX_PAGE_SIZE`]
+pub const fn is_valid_page_size(size: usize) -> bool {
+    size.is_power_of_two() && size >= MIN_PAGE_SIZE && size <= MAX_PAGE_SIZE
+}
 
 #[cfg(test)]
 mod tests {
@@ -32,7 +53,7 @@ mod tests {
     #[test]
     fn test_page_id_constants() {
         assert_eq!(INVALID_PAGE_ID, 0);
-        assert_eq!(MAX_PAGE_ID, u32::MAX);
+        assert_eq!(MAX_PAGE_ID, (1 << 47) - 1);
     }
 
     #[test]
@@ -43,6 +64,16 @@ mod tests {
         assert_eq!(PAGE_SIZE, 4096);
     }
 
+    #[test]
+    fn test_valid_page_sizes() {
+        assert!(is_valid_page_size(PAGE_SIZE));
+        assert!(is_valid_page_size(16384));
+        assert!(is_valid_page_size(MAX_PAGE_SIZE));
+        assert!(!is_valid_page_size(2048));
+        assert!(!is_valid_page_size(12288));
+        assert!(!is_valid_page_size(2 * MAX_PAGE_SIZE));
+    }
+
     #[test]
     fn test_page_size_calculation() {
         // Ensure our constants are consistent
@@ -51,14 +82,14 @@ mod tests {
 
     #[test]
     fn test_database_size_calculation() {
-        // With 32-bit page IDs and 4KB pages, we can address:
-        // u32::MAX * 4KB = 17592186040320 bytes (approximately 16TB)
-        let max_database_size = u64::from(MAX_PAGE_ID) * (PAGE_SIZE as u64);
-        assert_eq!(max_database_size, 17_592_186_040_320);
-
-        // This is approximately 16TB (actually 16TB - 4096 bytes)
-        let sixteen_tb = 16u64 * 1024 * 1024 * 1024 * 1024;
-        assert_eq!(sixteen_tb, 17_592_186_044_416);
-        assert_eq!(sixteen_tb - max_database_size, 4096); // Exactly one page less
+        // 64-bit page IDs remove the 16 TB cap of 32-bit IDs with 4KB pages:
+        // u32::MAX * 4KB = 17592186040320 bytes
+        let old_limit = u64::from(u32::MAX) * (PAGE_SIZE as u64);
+        assert_eq!(old_limit, 17_592_186_040_320);
+
+        // The byte offset of any page that fits in a 64-bit file offset is
+        // addressable
+        let max_page: PageId = u64::MAX / PAGE_SIZE as u64;
+        assert!(max_page > u64::from(u32::MAX));
     }
 }
@@ -0,0 +1,506 @@
+//! Shareable page file handle using positional I/O
+//!
+//! The seek-based helpers in [`page_io`](crate::storage::page_io) need
+//! `&mut File`, which serialises every reader on one handle and costs an
+//! extra `lseek` per access. [`PageFile`] issues `pread`/`pwrite` style
+//! positional calls through `&self`, so it is `Send + Sync` and any number of
+//! threads can read pages from the same handle in parallel without a mutex.
+//!
+//! Checksums are verified with the handle's [`ChecksumAlgorithm`].
+//! [`PageFile::open_database`] takes it from the file header, so callers do
+//! not need to know which algorithm a database was created with.
+//!
+//! Pages are 4 KiB unless the header records another size, in which case
+//! pages are read and written as [`GenericPage`]s of that size; using a
+//! buffer of the wrong size is an error.
+//!
+//! With [`with_preallocation`](PageFile::with_preallocation) writes past the
+//! end of the file grow it in preallocated chunks through a
+//! [`FileGrowth`] instead of one page at a time.
+
+use crate::common::error::Error;
+use crate::storage::checksum::ChecksumAlgorithm;
+use crate::storage::file_growth::FileGrowth;
+use crate::storage::file_header::FileHeader;
+use crate::storage::page::{GenericPage, Page};
+use crate::storage::page_constants::{is_valid_page_size, PageId, PAGE_SIZE};
+use crate::storage::page_io::{self, calculate_page_offset_with, positional};
+use std::fs::{File, OpenOptions};
+use std::path::Path;
+
+/// A database file accessed with positional reads and writes
+#[derive(Debug)]
+pub struct PageFile {
+    file: File,
+    checksum: ChecksumAlgorithm,
+    page_size: usize,
+    growth: Option<FileGrowth>,
+}
+
+impl PageFile {
+    /// Open (or create) a database file for reading and writing
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be opened
+    pub fn open<P: AsRef<Path>>(path: P) -> Result<Self, Error> {
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(false)
+            .open(path)?;
+        Ok(Self::from_file(file))
+    }
+
+    /// Create a new database file and write its header
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be opened, already holds pages,
+    /// or the header cannot be written
+    pub fn create_database<P: AsRef<Path>>(path: P, header: &FileHeader) -> Result<Self, Error> {
+        let page_file = Self::open(path)?;
+        if page_file.page_count()? != 0 {
+            return Err(Error::invalid_input("Database file is not empty"));
+        }
+        header.write(&page_file)?;
+        page_file.sync_all()?;
+        page_file
+            .with_checksum_algorithm(header.checksum_algorithm)
+            .with_page_size(header.page_size)
+    }
+
+    /// Open an existing database file, configured from its header
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file cannot be opened or has no valid header
+    pub fn open_database<P: AsRef<Path>>(path: P) -> Result<(Self, FileHeader), Error> {
+        let page_file = Self::open(path)?;
+        let header = FileHeader::read(&page_file)?;
+        Ok((
+            page_file
+                .with_checksum_algorithm(header.checksum_algorithm)
+                .with_page_size(header.page_size)?,
+            header,
+        ))
+    }
+
+    /// Wrap an already opened file of 4 KiB pages, verifying with the
+    /// default algorithm
+    pub fn from_file(file: File) -> Self {
+        Self {
+            file,
+            checksum: ChecksumAlgorithm::default(),
+            page_size: PAGE_SIZE,
+            growth: None,
+        }
+    }
+
+    /// Use `algorithm` to verify pages read through this handle
+    #[must_use]
+    pub fn with_checksum_algorithm(mut self, algorithm: ChecksumAlgorithm) -> Self {
+        self.checksum = algorithm;
+        self
+    }
+
+    /// Use pages of `page_size` bytes
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the size is not supported or
+    /// preallocation was already enabled
+    pub fn with_page_size(mut self, page_size: usize) -> Result<Self, Error> {
+        if !is_valid_page_size(page_size) {
+            return Err(Error::invalid_input(format!(
+                "Unsupported page size {page_size}"
+            )));
+        }
+        if self.growth.is_some() && page_size != self.page_size {
+            return Err(Error::invalid_input(
+                "Page size must be set before enabling preallocation",
+            ));
+        }
+        self.page_size = page_size;
+        Ok(self)
+    }
+
+    /// Grow the file `chunk_bytes` at a time, preallocating each chunk
+    /// before the first write into it
+    ///
+    /// The file may already end in a preallocated tail, so the logical size
+    /// starts at the header's allocated page count, extended over any pages
+    /// holding data in the final chunk past it (written after the count was
+    /// last saved). Unwritten preallocated pages read as zeros.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file metadata or its final chunk cannot be
+    /// read
+    pub fn with_preallocation(mut self, chunk_bytes: u64) -> Result<Self, Error> {
+        let growth = FileGrowth::new(&self.file, self.page_size, chunk_bytes)?;
+        let physical = growth.physical_pages();
+        let recorded =
+            FileHeader::read_if_present(&self)?.map_or(0, |header| header.allocated_pages);
+        let floor = recorded
+            .min(physical)
+            .max(physical.saturating_sub(growth.chunk_pages()));
+        let high_water = self.last_written_page(floor, physical)?;
+        self.growth = Some(growth.with_high_water(high_water));
+        Ok(self)
+    }
+
+    /// One past the last page in `floor..end` holding any data, or `floor`
+    /// if they all read as zeros
+    ///
+    /// Reads 4 KiB at a time into an aligned [`Page`], so this also works
+    /// on files opened for direct I/O; every page size is a multiple of it.
+    fn last_written_page(&self, floor: u64, end: u64) -> Result<u64, Error> {
+        let mut buffer = Page::new();
+        for page_id in (floor..end).rev() {
+            let start = calculate_page_offset_with(page_id, self.page_size)?;
+            for offset in (start..start + self.page_size as u64).step_by(PAGE_SIZE) {
+                positional::read_exact_at(&self.file, buffer.raw_mut(), offset)?;
+                if buffer.raw().iter().any(|&byte| byte != 0) {
+                    return Ok(page_id + 1);
+                }
+            }
+        }
+        Ok(floor)
+    }
+
+    /// Page size in bytes
+    pub fn page_size(&self) -> usize {
+        self.page_size
+    }
+
+    /// Size tracking for chunked growth, if preallocation is enabled
+    pub fn growth(&self) -> Option<&FileGrowth> {
+        self.growth.as_ref()
+    }
+
+    /// Algorithm used to verify page checksums
+    pub fn checksum_algorithm(&self) -> ChecksumAlgorithm {
+        self.checksum
+    }
+
+    /// The underlying file
+    pub fn file(&self) -> &File {
+        &self.file
+    }
+
+    /// Number of pages in the file's logical extent
+    ///
+    /// With preallocation this is the [`FileGrowth::high_water`] mark, which
+    /// leaves out the unwritten pages of the current chunk; see
+    /// [`FileGrowth::physical_pages`] for the file's length.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file metadata cannot be read
+    pub fn page_count(&self) -> Result<u64, Error> {
+        match &self.growth {
+            Some(growth) => Ok(growth.high_water()),
+            None => Ok(self.file.metadata()?.len() / self.page_size as u64),
+        }
+    }
+
+    /// Read a 4 KiB page and verify its checksum
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file does not use 4 KiB pages, the read fails
+    /// or the checksum does not match
+    pub fn read_page(&self, page_id: PageId) -> Result<Page, Error> {
+        let mut page = Page::new();
+        self.read_page_into(page_id, &mut page)?;
+        Ok(page)
+    }
+
+    /// Read a page into an existing buffer and verify its checksum
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the buffer does not match the file's page size,
+    /// the read fails or the checksum does not match
+    pub fn read_page_into<const N: usize>(
+        &self,
+        page_id: PageId,
+        page: &mut GenericPage<N>,
+    ) -> Result<(), Error> {
+        self.read_page_unverified(page_id, page)?;
+        if !page.verify_checksum_with(self.checksum) {
+            return Err(Error::corruption(format!(
+                "Checksum verification failed for page {page_id}"
+            )));
+        }
+        Ok(())
+    }
+
+    /// Read a page into an existing buffer without checking its checksum
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the buffer does not match the file's page size or
+    /// the read fails
+    pub fn read_page_unverified<const N: usize>(
+        &self,
+        page_id: PageId,
+        page: &mut GenericPage<N>,
+    ) -> Result<(), Error> {
+        self.check_page_size(N)?;
+        positional::read_exact_at(
+            &self.file,
+            page.raw_mut(),
+            calculate_page_offset_with(page_id, N)?,
+        )?;
+        Ok(())
+    }
+
+    /// Write a page at its position in the file
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the buffer does not match the file's page size or
+    /// the write fails
+    pub fn write_page<const N: usize>(
+        &self,
+        page_id: PageId,
+        page: &GenericPage<N>,
+    ) -> Result<(), Error> {
+        self.check_page_size(N)?;
+        let offset = calculate_page_offset_with(page_id, N)?;
+        self.reserve_through(page_id)?;
+        positional::write_all_at(&self.file, page.raw(), offset)?;
+        Ok(())
+    }
+
+    /// Read the 4 KiB header page at the start of the file, whatever the
+    /// page size
+    pub(crate) fn read_header_page(&self, page: &mut Page) -> Result<(), Error> {
+        positional::read_exact_at(&self.file, page.raw_mut(), 0)?;
+        Ok(())
+    }
+
+    /// Write the 4 KiB header page at the start of the file
+    pub(crate) fn write_header_page(&self, page: &Page) -> Result<(), Error> {
+        positional::write_all_at(&self.file, page.raw(), 0)?;
+        Ok(())
+    }
+
+    /// Back pages up to and including `last_page` with the file when
+    /// preallocating, once the page is known to be addressable
+    fn reserve_through(&self, last_page: PageId) -> Result<(), Error> {
+        let Some(growth) = &self.growth else {
+            return Ok(());
+        };
+        calculate_page_offset_with(last_page, self.page_size)?;
+        let end = last_page.checked_add(1).ok_or_else(|| {
+            Error::invalid_input(format!(
+                "Page {last_page} is beyond the addressable file range"
+            ))
+        })?;
+        growth.reserve(&self.file, end)
+    }
+
+    fn check_page_size(&self, size: usize) -> Result<(), Error> {
+        if size != self.page_size {
+            return Err(Error::invalid_input(format!(
+                "{size}-byte page buffer used with a file of {}-byte pages",
+                self.page_size
+            )));
+        }
+        Ok(())
+    }
+
+    /// Read many pages with coalesced vectored reads (see [`page_io::read_pages`])
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the file does not use 4 KiB pages, or any read
+    /// or checksum verification fails
+    pub fn read_pages(&self, page_ids: &[PageId]) -> Result<Vec<Page>, Error> {
+        self.check_page_size(PAGE_SIZE)?;
+        let pages = page_io::read_pages_unverified(&self.file, page_ids)?;
+        for (page, &page_id) in pages.iter().zip(page_ids) {
+            if !page.verify_checksum_with(self.checksum) {
+                return Err(Error::corruption(format!(
+                    "Checksum verification failed for page {page_id}"
+                )));
+            }
+        }
+        Ok(pages)
+    }
+
+    /// Write many pages with coalesced vectored writes (see [`page_io::write_pages`])
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the buffers do not match the file's page size or
+    /// any write fails
+    pub fn write_pages<const N: usize>(
+        &self,
+        pages: &[(PageId, &GenericPage<N>)],
+    ) -> Result<(), Error> {
+        self.check_page_size(N)?;
+        if let Some(last) = pages.iter().map(|&(id, _)| id).max() {
+            self.reserve_through(last)?;
+        }
+        page_io::write_pages(&self.file, pages)
+    }
+
+    /// Ask the OS to start reading `count` pages from `page_id` into its
+    /// cache, so a later read of them does not wait on the device
+    ///
+    /// A no-op on platforms without a read-ahead hint.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the OS rejects the hint
+    pub fn prefetch(&self, page_id: PageId, count: u64) -> Result<(), Error> {
+        if count == 0 {
+            return Ok(());
+        }
+        readahead::advise(
+            &self.file,
+            calculate_page_offset_with(page_id, self.page_size)?,
+            count * self.page_size as u64,
+        )
+    }
+
+    /// Flush file data (not metadata) to stable storage - `fdatasync`
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the sync fails
+    pub fn sync_data(&self) -> Result<(), Error> {
+        self.file.sync_data()?;
+        Ok(())
+    }
+
+    /// Flush file data and metadata to stable storage - `fsync`
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the sync fails
+    pub fn sync_all(&self) -> Result<(), Error> {
+        self.file.sync_all()?;
+        Ok(())
+    }
+}
+
+#[cfg(any(target_os = "linux", target_os = "android"))]
+mod readahead {
+    use crate::common::error::Error;
+    use std::fs::File;
+    use std::io;
+    use std::os::unix::io::AsRawFd;
+
+    pub(super) fn advise(file: &File, offset: u64, len: u64) -> Result<(), Error> {
+        let (Ok(offset), Ok(len)) = (libc::off_t::try_from(offset), libc::off_t::try_from(len))
+        else {
+            return Err(Error::invalid_input("File range exceeds off_t"));
+        };
+        // SAFETY: posix_fadvise only operates on the descriptor
+        match unsafe {
+            libc::posix_fadvise(file.as_raw_fd(), offset, len, libc::POSIX_FADV_WILLNEED)
+        } {
+            0 => Ok(()),
+            errno => Err(io::Error::from_raw_os_error(errno).into()),
+        }
+    }
+}
+
+#[cfg(any(target_os = "macos", target_os = "ios"))]
+mod readahead {
+    use crate::common::error::Error;
+    use std::fs::File;
+    use std::io;
+    use std::os::unix::io::AsRawFd;
+
+    pub(super) fn advise(file: &File, offset: u64, len: u64) -> Result<(), Error> {
+        let advice = libc::radvisory {
+            ra_offset: libc::off_t::try_from(offset)
+                .map_err(|_| Error::invalid_input("File range exceeds off_t"))?,
+            ra_count: libc::c_int::try_from(len).unwrap_or(libc::c_int::MAX),
+        };
+        // SAFETY: F_RDADVISE only reads the radvisory we pass
+        if unsafe { libc::fcntl(file.as_raw_fd(), libc::F_RDADVISE, &advice) } == -1 {
+            return Err(io::Error::last_os_error().into());
+        }
+        Ok(())
+    }
+}
+
+#[cfg(not(any(
+    target_os = "linux",
+    target_os = "android",
+    target_os = "macos",
+    target_os = "ios"
+)))]
+mod readahead {
+    use crate::common::error::Error;
+    use std::fs::File;
+
+    pub(super) fn advise(_file: &File, _offset: u64, _len: u64) -> Result<(), Error> {
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::storage::page_type::PageType;
+    use tempfile::NamedTempFile;
+
+    fn assert_send_sync<T: Send + Sync>() {}
+
+    #[test]
+    fn test_page_file_is_send_sync() {
+        assert_send_sync::<PageFile>();
+    }
+
+    #[test]
+    fn test_database_header_selects_algorithm() -> Result<(), Error> {
+        let temp_dir = tempfile::tempdir()?;
+        let path = temp_dir.path().join("xxh3.db");
+        let header = FileHeader::new(ChecksumAlgorithm::Xxh3);
+        let created = PageFile::create_database(&path, &header)?;
+        assert_eq!(created.checksum_algorithm(), ChecksumAlgorithm::Xxh3);
+
+        let mut page = Page::new();
+        page.header_mut().page_type = PageType::Data;
+        page.calculate_checksum_with(ChecksumAlgorithm::Xxh3)?;
+        created.write_page(1, &page)?;
+        assert!(PageFile::create_database(&path, &header).is_err());
+        drop(created);
+
+        let (opened, read_header) = PageFile::open_database(&path)?;
+        assert_eq!(read_header, header);
+        assert!(opened.read_page(1).is_ok());
+        assert!(opened.read_pages(&[1]).is_ok());
+        let crc32 = PageFile::open(&path)?;
+        assert!(matches!(crc32.read_page(1), Err(e) if e.is_corruption()));
+        Ok(())
+    }
+
+    #[test]
+    fn test_positional_round_trip() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let page_file = PageFile::open(temp_file.path())?;
+
+        let mut page = Page::new();
+        page.header_mut().page_type = PageType::Data;
+        page.header_mut().page_id = 6;
+        page.calculate_checksum()?;
+        page_file.write_page(6, &page)?;
+        assert_eq!(page_file.page_count()?, 7);
+
+        let read = page_file.read_page(6)?;
+        let page_id = read.header().page_id;
+        assert_eq!(page_id, 6);
+        assert!(matches!(page_file.read_page(7), Err(e) if e.is_io()));
+        Ok(())
+    }
+}
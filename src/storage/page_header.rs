@@ -1,15 +1,25 @@
 //! Page header structure - exactly 16 bytes at the beginning of each page
 //! MUST match plan/storage-format.md specification
 
-use crate::storage::page_constants::{PageId, INVALID_PAGE_ID, PAGE_USABLE_SIZE};
+use crate::storage::page_constants::{PageId, PAGE_USABLE_SIZE};
 use crate::storage::page_type::PageType;
 use bytemuck::{Pod, Zeroable};
 
+/// Flag bit: page has been modified in memory and must be written back
+pub const PAGE_FLAG_DIRTY: u8 = 0x01;
+
+/// Flag bit: page is pinned in a buffer pool frame and must not be evicted
+pub const PAGE_FLAG_PINNED: u8 = 0x02;
+
+/// Flag bits that only describe in-memory state and are excluded from checksums
+pub const PAGE_FLAGS_TRANSIENT: u8 = PAGE_FLAG_DIRTY | PAGE_FLAG_PINNED;
+
 /// Page header - exactly 16 bytes as specified in plan/storage-format.md
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
 #[repr(C, packed(1))]
 pub struct PageHeader {
-    /// Page number (4 bytes)
+    /// Low 32 bits of the page number (4 bytes); set with
+    /// [`set_page_id`](Self::set_page_id)
     pub page_id: u32,
     /// Page type enum (1 byte)
     pub page_type: PageType,
@@ -19,7 +29,8 @@ pub struct PageHeader {
     pub free_space: u16,
     /// CRC32 of page content (4 bytes)
     pub checksum: u32,
-    /// Log sequence number (4 bytes)
+    /// Low 32 bits of the page's log sequence number (4 bytes); see
+    /// [`lsn`](crate::storage::lsn)
     pub lsn: u32,
     // Total: 16 bytes (exactly as specified)
 }
@@ -33,7 +44,7 @@ impl Default for PageHeader {
     #[allow(clippy::cast_possible_truncation)]
     fn default() -> Self {
         Self {
-            page_id: INVALID_PAGE_ID,
+            page_id: 0,
             page_type: PageType::Header, // Default to Header type
             flags: 0,
             free_space: PAGE_USABLE_SIZE as u16, // PAGE_USABLE_SIZE is 4080, fits in u16
@@ -46,38 +57,56 @@ impl Default for PageHeader {
 impl PageHeader {
     /// Create a new page header with the given type and ID
     pub fn new(page_type: PageType, page_id: PageId) -> Self {
-        Self {
-            page_id,
+        let mut header = Self {
             page_type,
             ..Default::default()
-        }
+        };
+        header.set_page_id(page_id);
+        header
+    }
+
+    /// Record the page's ID
+    ///
+    /// Only the low 32 bits fit in the header. The full ID is implied by the
+    /// page's position in the file; the stored bits let readers detect a
+    /// page written to the wrong place.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn set_page_id(&mut self, page_id: PageId) {
+        self.page_id = page_id as u32;
+    }
+
+    /// Whether the stored ID bits match `page_id`
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn has_page_id(&self, page_id: PageId) -> bool {
+        let stored = self.page_id;
+        stored == page_id as u32
     }
 
     /// Check if the page is marked as dirty (needs to be written)
     pub fn is_dirty(&self) -> bool {
-        self.flags & 0x01 != 0
+        self.flags & PAGE_FLAG_DIRTY != 0
     }
 
     /// Mark the page as dirty
     pub fn set_dirty(&mut self, dirty: bool) {
         if dirty {
-            self.flags |= 0x01;
+            self.flags |= PAGE_FLAG_DIRTY;
         } else {
-            self.flags &= !0x01;
+            self.flags &= !PAGE_FLAG_DIRTY;
         }
     }
 
     /// Check if the page is pinned in memory
     pub fn is_pinned(&self) -> bool {
-        self.flags & 0x02 != 0
+        self.flags & PAGE_FLAG_PINNED != 0
     }
 
     /// Set the pinned flag
     pub fn set_pinned(&mut self, pinned: bool) {
         if pinned {
-            self.flags |= 0x02;
+            self.flags |= PAGE_FLAG_PINNED;
         } else {
-            self.flags &= !0x02;
+            self.flags &= !PAGE_FLAG_PINNED;
         }
     }
 }
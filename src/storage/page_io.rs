@@ -1,16 +1,43 @@
 //! Page I/O operations for reading and writing pages to storage
+//!
+//! Functions that take a page buffer are generic over the page size and place
+//! page `n` at byte `n * N`. Functions that return a new page read default
+//! 4 KiB [`Page`]s; for other sizes read into a [`GenericPage`] with
+//! [`read_page_into`].
 
 use crate::common::error::Error;
-use crate::storage::page::Page;
-use crate::storage::page_constants::PAGE_SIZE;
+use crate::storage::file_growth;
+use crate::storage::page::{GenericPage, Page};
+use crate::storage::page_constants::{MAX_PAGE_ID, PAGE_SIZE};
 use memmap2::MmapOptions;
 use std::fs::File;
 use std::io::{Read, Seek, SeekFrom, Write};
 use std::path::Path;
 
 /// Calculate the byte offset for a given page ID
-pub fn calculate_page_offset(page_id: u64) -> u64 {
-    page_id * PAGE_SIZE as u64
+///
+/// # Errors
+///
+/// Returns an error if `page_id` is above [`MAX_PAGE_ID`]
+pub fn calculate_page_offset(page_id: u64) -> Result<u64, Error> {
+    calculate_page_offset_with(page_id, PAGE_SIZE)
+}
+
+/// Calculate the byte offset of a page in a file of `page_size` pages
+///
+/// # Errors
+///
+/// Returns an error if `page_id` is above [`MAX_PAGE_ID`] or the offset
+/// does not fit in a `u64`
+pub fn calculate_page_offset_with(page_id: u64, page_size: usize) -> Result<u64, Error> {
+    (page_id <= MAX_PAGE_ID)
+        .then(|| page_id.checked_mul(page_size as u64))
+        .flatten()
+        .ok_or_else(|| {
+            Error::invalid_input(format!(
+                "Page {page_id} is beyond the addressable file range"
+            ))
+        })
 }
 
 /// Write a page to a file at the specified page ID
@@ -18,8 +45,12 @@ pub fn calculate_page_offset(page_id: u64) -> u64 {
 /// # Errors
 ///
 /// Returns an error if the file seek or write operation fails
-pub fn write_page_to_file(file: &mut File, page_id: u64, page: &Page) -> Result<(), Error> {
-    let offset = calculate_page_offset(page_id);
+pub fn write_page_to_file<const N: usize>(
+    file: &mut File,
+    page_id: u64,
+    page: &GenericPage<N>,
+) -> Result<(), Error> {
+    let offset = calculate_page_offset_with(page_id, N)?;
     write_page_at_offset(file, offset, page)
 }
 
@@ -28,7 +59,11 @@ pub fn write_page_to_file(file: &mut File, page_id: u64, page: &Page) -> Result<
 /// # Errors
 ///
 /// Returns an error if the file seek or write operation fails
-pub fn write_page_at_offset(file: &mut File, offset: u64, page: &Page) -> Result<(), Error> {
+pub fn write_page_at_offset<const N: usize>(
+    file: &mut File,
+    offset: u64,
+    page: &GenericPage<N>,
+) -> Result<(), Error> {
     file.seek(SeekFrom::Start(offset))?;
     file.write_all(page.raw())?;
     Ok(())
@@ -40,10 +75,9 @@ pub fn write_page_at_offset(file: &mut File, offset: u64, page: &Page) -> Result
 ///
 /// Returns an error if the file seek or read operation fails, or if checksum verification fails
 pub fn read_page_from_file(file: &mut File, page_id: u64) -> Result<Page, Error> {
-    let offset = calculate_page_offset(page_id);
-    let page = read_page_at_offset(file, offset)?;
+    let page = read_page_unverified_at(file, calculate_page_offset(page_id)?)?;
 
-    // Verify checksum
+    // Verify checksum (once - the unverified read does not check it)
     if !page.verify_checksum() {
         return Err(Error::corruption(format!(
             "Checksum verification failed for page {page_id}"
@@ -59,10 +93,7 @@ pub fn read_page_from_file(file: &mut File, page_id: u64) -> Result<Page, Error>
 ///
 /// Returns an error if the file seek or read operation fails, or if checksum verification fails
 pub fn read_page_at_offset(file: &mut File, offset: u64) -> Result<Page, Error> {
-    file.seek(SeekFrom::Start(offset))?;
-
-    let mut page = Page::new();
-    file.read_exact(page.raw_mut())?;
+    let page = read_page_unverified_at(file, offset)?;
 
     // Verify checksum
     if !page.verify_checksum() {
@@ -75,6 +106,39 @@ pub fn read_page_at_offset(file: &mut File, offset: u64) -> Result<Page, Error>
     Ok(page)
 }
 
+/// Seek to `offset` and read one page without checking its checksum
+fn read_page_unverified_at(file: &mut File, offset: u64) -> Result<Page, Error> {
+    file.seek(SeekFrom::Start(offset))?;
+    let mut page = Page::new();
+    file.read_exact(page.raw_mut())?;
+    Ok(page)
+}
+
+/// Read a page from a file into an existing page buffer
+///
+/// Used by the buffer pool to load pages straight into their frames without
+/// an intermediate copy.
+///
+/// # Errors
+///
+/// Returns an error if the file seek or read operation fails, or if checksum verification fails
+pub fn read_page_into<const N: usize>(
+    file: &mut File,
+    page_id: u64,
+    page: &mut GenericPage<N>,
+) -> Result<(), Error> {
+    file.seek(SeekFrom::Start(calculate_page_offset_with(page_id, N)?))?;
+    file.read_exact(page.raw_mut())?;
+
+    if !page.verify_checksum() {
+        return Err(Error::corruption(format!(
+            "Checksum verification failed for page {page_id}"
+        )));
+    }
+
+    Ok(())
+}
+
 /// Read a page by page ID (convenience function)
 ///
 /// # Errors
@@ -86,10 +150,20 @@ pub fn read_page_by_id(file: &mut File, page_id: u64) -> Result<Page, Error> {
 
 /// Write a page with explicit sync to ensure durability
 ///
+/// Issues a full `fsync` per call. When many pages need to be durable, use
+/// [`GroupCommit`](crate::storage::group_commit::GroupCommit), which shares
+/// one `fdatasync` across concurrent writers. For durable page changes
+/// without in-place writes, log them to the [`Wal`](crate::storage::wal::Wal)
+/// and let the buffer pool write pages back lazily.
+///
 /// # Errors
 ///
 /// Returns an error if the write or sync operation fails
-pub fn write_page_sync(file: &mut File, page_id: u64, page: &Page) -> Result<(), Error> {
+pub fn write_page_sync<const N: usize>(
+    file: &mut File,
+    page_id: u64,
+    page: &GenericPage<N>,
+) -> Result<(), Error> {
     write_page_to_file(file, page_id, page)?;
     file.sync_all()?;
     Ok(())
@@ -97,28 +171,32 @@ pub fn write_page_sync(file: &mut File, page_id: u64, page: &Page) -> Result<(),
 
 /// Write a page using memory-mapped I/O
 ///
+/// Maps, copies and unmaps a single page per call. For repeated access use
+/// [`MappedFile`](crate::storage::mapped_file::MappedFile), which keeps the
+/// mapping alive and grows the file in preallocated chunks.
+///
 /// # Errors
 ///
 /// Returns an error if file operations or memory mapping fails
-pub fn write_page_mmap<P: AsRef<Path>>(path: P, page_id: u64, page: &Page) -> Result<(), Error> {
+pub fn write_page_mmap<P: AsRef<Path>, const N: usize>(
+    path: P,
+    page_id: u64,
+    page: &GenericPage<N>,
+) -> Result<(), Error> {
     let file = std::fs::OpenOptions::new()
         .read(true)
         .write(true)
         .open(path)?;
 
-    let offset = calculate_page_offset(page_id);
-    let len = offset + PAGE_SIZE as u64;
+    let offset = calculate_page_offset_with(page_id, N)?;
+    let len = offset + N as u64;
 
-    // Ensure file is large enough
-    if file.metadata()?.len() < len {
-        file.set_len(len)?;
-    }
+    // Ensure file is large enough, with blocks allocated so stores through
+    // the mapping cannot fault on a full disk
+    file_growth::preallocate(&file, len)?;
 
     unsafe {
-        let mut mmap = MmapOptions::new()
-            .offset(offset)
-            .len(PAGE_SIZE)
-            .map_mut(&file)?;
+        let mut mmap = MmapOptions::new().offset(offset).len(N).map_mut(&file)?;
 
         mmap.copy_from_slice(page.raw());
         mmap.flush()?;
@@ -129,12 +207,16 @@ pub fn write_page_mmap<P: AsRef<Path>>(path: P, page_id: u64, page: &Page) -> Re
 
 /// Read a page using memory-mapped I/O
 ///
+/// Maps, copies and unmaps a single page per call. For repeated access use
+/// [`MappedFile`](crate::storage::mapped_file::MappedFile), which keeps the
+/// mapping alive and grows the file in preallocated chunks.
+///
 /// # Errors
 ///
 /// Returns an error if file operations or memory mapping fails, or if checksum verification fails
 pub fn read_page_mmap<P: AsRef<Path>>(path: P, page_id: u64) -> Result<Page, Error> {
     let file = File::open(path)?;
-    let offset = calculate_page_offset(page_id);
+    let offset = calculate_page_offset(page_id)?;
 
     unsafe {
         let mmap = MmapOptions::new()
@@ -163,11 +245,18 @@ pub fn read_page_mmap<P: AsRef<Path>>(path: P, page_id: u64) -> Result<Page, Err
 /// - File offset must be sector-aligned (usually 512 bytes)
 /// - Transfer size must be sector-aligned
 ///
+/// Opens a new descriptor per call; use
+/// [`DirectFile`](crate::storage::direct_file::DirectFile) to keep one open.
+///
 /// # Errors
 ///
 /// Returns an error if file operations fail
 #[cfg(target_os = "linux")]
-pub fn write_page_direct<P: AsRef<Path>>(path: P, page_id: u64, page: &Page) -> Result<(), Error> {
+pub fn write_page_direct<P: AsRef<Path>, const N: usize>(
+    path: P,
+    page_id: u64,
+    page: &GenericPage<N>,
+) -> Result<(), Error> {
     use std::os::unix::fs::OpenOptionsExt;
 
     let mut file = std::fs::OpenOptions::new()
@@ -188,7 +277,11 @@ pub fn write_page_direct<P: AsRef<Path>>(path: P, page_id: u64, page: &Page) ->
 ///
 /// Returns an error if file operations fail
 #[cfg(not(target_os = "linux"))]
-pub fn write_page_direct<P: AsRef<Path>>(path: P, page_id: u64, page: &Page) -> Result<(), Error> {
+pub fn write_page_direct<P: AsRef<Path>, const N: usize>(
+    path: P,
+    page_id: u64,
+    page: &GenericPage<N>,
+) -> Result<(), Error> {
     // Fallback to regular I/O with sync on non-Linux platforms
     let mut file = std::fs::OpenOptions::new()
         .write(true)
@@ -203,6 +296,9 @@ pub fn write_page_direct<P: AsRef<Path>>(path: P, page_id: u64, page: &Page) ->
 
 /// Read a page using direct I/O (bypasses OS cache)
 ///
+/// Opens a new descriptor per call; use
+/// [`DirectFile`](crate::storage::direct_file::DirectFile) to keep one open.
+///
 /// # Errors
 ///
 /// Returns an error if file operations fail, or if checksum verification fails
@@ -230,17 +326,320 @@ pub fn read_page_direct<P: AsRef<Path>>(path: P, page_id: u64) -> Result<Page, E
     read_page_from_file(&mut file, page_id)
 }
 
+/// Maximum number of pages moved by a single vectored system call
+pub const MAX_PAGES_PER_VECTORED_IO: usize = 1024;
+
+/// Split sorted request positions into runs of adjacent page IDs
+///
+/// `order` holds indices into `page_ids`, sorted by page ID. Each returned
+/// range covers consecutive page IDs (no duplicates) and at most
+/// `MAX_PAGES_PER_VECTORED_IO` pages.
+fn contiguous_runs(page_ids: &[u64], order: &[usize]) -> Vec<std::ops::Range<usize>> {
+    let mut runs = Vec::new();
+    let mut start = 0;
+    for i in 1..=order.len() {
+        let extends = i < order.len()
+            && i - start < MAX_PAGES_PER_VECTORED_IO
+            && page_ids[order[i]] == page_ids[order[i - 1]] + 1;
+        if !extends {
+            runs.push(start..i);
+            start = i;
+        }
+    }
+    runs
+}
+
+/// Read many pages, merging adjacent page IDs into single `preadv` calls
+///
+/// Requests are sorted by page ID and each run of consecutive IDs is read
+/// with one vectored call. Pages are returned in the order requested and
+/// every page's checksum is verified.
+///
+/// # Errors
+///
+/// Returns an error if any read fails or any page fails checksum verification
+pub fn read_pages(file: &File, page_ids: &[u64]) -> Result<Vec<Page>, Error> {
+    let pages = read_pages_unverified(file, page_ids)?;
+    for (page, &page_id) in pages.iter().zip(page_ids) {
+        if !page.verify_checksum() {
+            return Err(Error::corruption(format!(
+                "Checksum verification failed for page {page_id}"
+            )));
+        }
+    }
+    Ok(pages)
+}
+
+/// [`read_pages`] without checksum verification, for callers that verify
+/// with a non-default algorithm
+pub(crate) fn read_pages_unverified<const N: usize>(
+    file: &File,
+    page_ids: &[u64],
+) -> Result<Vec<GenericPage<N>>, Error> {
+    let mut pages: Vec<GenericPage<N>> = page_ids.iter().map(|_| GenericPage::new()).collect();
+    let mut order: Vec<usize> = (0..page_ids.len()).collect();
+    order.sort_by_key(|&i| page_ids[i]);
+    // Derive every buffer pointer in one pass, so taking a later page's
+    // pointer does not invalidate an earlier one
+    let raw: Vec<*mut u8> = pages
+        .iter_mut()
+        .map(|page| page.raw_mut().as_mut_ptr())
+        .collect();
+
+    for run in contiguous_runs(page_ids, &order) {
+        let first_page = page_ids[order[run.start]];
+        let buffers: Vec<*mut u8> = order[run].iter().map(|&i| raw[i]).collect();
+        // SAFETY: each pointer addresses a distinct N-byte page buffer in
+        // `pages`, which is neither moved nor otherwise borrowed meanwhile
+        unsafe {
+            vectored::read_run(
+                file,
+                calculate_page_offset_with(first_page, N)?,
+                N,
+                &buffers,
+            )?;
+        };
+    }
+    Ok(pages)
+}
+
+/// Write many pages, merging adjacent page IDs into single `pwritev` calls
+///
+/// Pages must already carry valid checksums. If the same page ID appears more
+/// than once, the writes happen in an unspecified order.
+///
+/// # Errors
+///
+/// Returns an error if any write fails
+pub fn write_pages<const N: usize>(
+    file: &File,
+    pages: &[(u64, &GenericPage<N>)],
+) -> Result<(), Error> {
+    let page_ids: Vec<u64> = pages.iter().map(|&(page_id, _)| page_id).collect();
+    let mut order: Vec<usize> = (0..pages.len()).collect();
+    order.sort_by_key(|&i| page_ids[i]);
+
+    for run in contiguous_runs(&page_ids, &order) {
+        let first_page = page_ids[order[run.start]];
+        let buffers: Vec<&[u8]> = order[run].iter().map(|&i| pages[i].1.raw()).collect();
+        vectored::write_run(file, calculate_page_offset_with(first_page, N)?, &buffers)?;
+    }
+    Ok(())
+}
+
+/// Positional vectored I/O primitives for runs of adjacent pages
+#[cfg(any(target_os = "linux", target_os = "android"))]
+mod vectored {
+    use crate::common::error::Error;
+    use std::fs::File;
+    use std::io;
+    use std::os::unix::io::AsRawFd;
+
+    /// Fill page buffers from consecutive file pages starting at `offset`
+    ///
+    /// # Safety
+    ///
+    /// Every pointer must address a distinct, writable `page_size` buffer
+    pub(super) unsafe fn read_run(
+        file: &File,
+        offset: u64,
+        page_size: usize,
+        buffers: &[*mut u8],
+    ) -> Result<(), Error> {
+        let mut iovecs: Vec<libc::iovec> = buffers
+            .iter()
+            .map(|&ptr| libc::iovec {
+                iov_base: ptr.cast(),
+                iov_len: page_size,
+            })
+            .collect();
+        transfer_all(offset, &mut iovecs, |iov, count, at| {
+            libc::preadv(file.as_raw_fd(), iov, count, at)
+        })
+    }
+
+    /// Write page buffers to consecutive file pages starting at `offset`
+    pub(super) fn write_run(file: &File, offset: u64, buffers: &[&[u8]]) -> Result<(), Error> {
+        let mut iovecs: Vec<libc::iovec> = buffers
+            .iter()
+            .map(|buffer| libc::iovec {
+                iov_base: buffer.as_ptr() as *mut libc::c_void,
+                iov_len: buffer.len(),
+            })
+            .collect();
+        // SAFETY: the iovecs point into live page buffers that pwritev only reads
+        unsafe {
+            transfer_all(offset, &mut iovecs, |iov, count, at| {
+                libc::pwritev(file.as_raw_fd(), iov, count, at)
+            })
+        }
+    }
+
+    /// Repeat a vectored call until every iovec is fully transferred
+    unsafe fn transfer_all<F>(
+        mut offset: u64,
+        iovecs: &mut [libc::iovec],
+        mut call: F,
+    ) -> Result<(), Error>
+    where
+        F: FnMut(*const libc::iovec, libc::c_int, libc::off_t) -> libc::ssize_t,
+    {
+        let mut first = 0;
+        while first < iovecs.len() {
+            let remaining = &mut iovecs[first..];
+            #[allow(clippy::cast_possible_truncation, clippy::cast_possible_wrap)]
+            let transferred = call(
+                remaining.as_ptr(),
+                remaining.len() as libc::c_int,
+                offset as libc::off_t,
+            );
+            if transferred < 0 {
+                let err = io::Error::last_os_error();
+                if err.kind() == io::ErrorKind::Interrupted {
+                    continue;
+                }
+                return Err(err.into());
+            }
+            if transferred == 0 {
+                return Err(io::Error::from(io::ErrorKind::UnexpectedEof).into());
+            }
+
+            #[allow(clippy::cast_sign_loss)]
+            let mut transferred = transferred as usize;
+            offset += transferred as u64;
+            while transferred > 0 {
+                let iov = &mut iovecs[first];
+                let step = transferred.min(iov.iov_len);
+                iov.iov_base = iov.iov_base.cast::<u8>().add(step).cast();
+                iov.iov_len -= step;
+                transferred -= step;
+                if iov.iov_len == 0 {
+                    first += 1;
+                }
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Page-at-a-time fallback where `preadv`/`pwritev` are unavailable
+///
+/// Uses positional I/O so concurrent runs on a shared file never race on
+/// its cursor.
+#[cfg(not(any(target_os = "linux", target_os = "android")))]
+mod vectored {
+    use super::positional;
+    use crate::common::error::Error;
+    use std::fs::File;
+
+    /// Fill page buffers from consecutive file pages starting at `offset`
+    ///
+    /// # Safety
+    ///
+    /// Every pointer must address a distinct, writable `page_size` buffer
+    pub(super) unsafe fn read_run(
+        file: &File,
+        offset: u64,
+        page_size: usize,
+        buffers: &[*mut u8],
+    ) -> Result<(), Error> {
+        let mut at = offset;
+        for &ptr in buffers {
+            positional::read_exact_at(file, std::slice::from_raw_parts_mut(ptr, page_size), at)?;
+            at += page_size as u64;
+        }
+        Ok(())
+    }
+
+    /// Write page buffers to consecutive file pages starting at `offset`
+    pub(super) fn write_run(file: &File, offset: u64, buffers: &[&[u8]]) -> Result<(), Error> {
+        let mut at = offset;
+        for buffer in buffers {
+            positional::write_all_at(file, buffer, at)?;
+            at += buffer.len() as u64;
+        }
+        Ok(())
+    }
+}
+
+/// Positional reads and writes that leave the shared file cursor alone
+#[cfg(unix)]
+pub(crate) mod positional {
+    use std::fs::File;
+    use std::io;
+    use std::os::unix::fs::FileExt;
+
+    pub(crate) fn read_exact_at(file: &File, buf: &mut [u8], offset: u64) -> io::Result<()> {
+        file.read_exact_at(buf, offset)
+    }
+
+    pub(crate) fn write_all_at(file: &File, buf: &[u8], offset: u64) -> io::Result<()> {
+        file.write_all_at(buf, offset)
+    }
+}
+
+/// Positional reads and writes that leave the shared file cursor alone
+#[cfg(windows)]
+pub(crate) mod positional {
+    use std::fs::File;
+    use std::io;
+    use std::os::windows::fs::FileExt;
+
+    pub(crate) fn read_exact_at(
+        file: &File,
+        mut buf: &mut [u8],
+        mut offset: u64,
+    ) -> io::Result<()> {
+        while !buf.is_empty() {
+            match file.seek_read(buf, offset) {
+                Ok(0) => return Err(io::ErrorKind::UnexpectedEof.into()),
+                Ok(n) => {
+                    buf = &mut buf[n..];
+                    offset += n as u64;
+                }
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+                Err(e) => return Err(e),
+            }
+        }
+        Ok(())
+    }
+
+    pub(crate) fn write_all_at(file: &File, mut buf: &[u8], mut offset: u64) -> io::Result<()> {
+        while !buf.is_empty() {
+            match file.seek_write(buf, offset) {
+                Ok(0) => return Err(io::ErrorKind::WriteZero.into()),
+                Ok(n) => {
+                    buf = &buf[n..];
+                    offset += n as u64;
+                }
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+                Err(e) => return Err(e),
+            }
+        }
+        Ok(())
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::storage::page_constants::MAX_PAGE_SIZE;
     use crate::storage::page_type::PageType;
     use tempfile::NamedTempFile;
 
     #[test]
     fn test_calculate_page_offset() {
-        assert_eq!(calculate_page_offset(0), 0);
-        assert_eq!(calculate_page_offset(1), PAGE_SIZE as u64);
-        assert_eq!(calculate_page_offset(100), 100 * PAGE_SIZE as u64);
+        assert_eq!(calculate_page_offset(0).unwrap(), 0);
+        assert_eq!(calculate_page_offset(1).unwrap(), PAGE_SIZE as u64);
+        assert_eq!(calculate_page_offset(100).unwrap(), 100 * PAGE_SIZE as u64);
+    }
+
+    #[test]
+    fn test_page_offset_out_of_range() {
+        let last = calculate_page_offset_with(MAX_PAGE_ID, MAX_PAGE_SIZE).unwrap();
+        assert!(i64::try_from(last).is_ok());
+        assert!(calculate_page_offset(MAX_PAGE_ID + 1).is_err());
+        assert!(calculate_page_offset(u64::MAX).is_err());
     }
 
     #[test]
@@ -289,4 +688,43 @@ mod tests {
 
         Ok(())
     }
+
+    #[test]
+    fn test_contiguous_runs() {
+        let page_ids = [7, 3, 4, 9, 5, 5];
+        let mut order: Vec<usize> = (0..page_ids.len()).collect();
+        order.sort_by_key(|&i| page_ids[i]);
+
+        // Sorted: 3 4 5 5 7 9 -> runs [3,4,5] [5] [7] [9]
+        let runs = contiguous_runs(&page_ids, &order);
+        assert_eq!(runs, vec![0..3, 3..4, 4..5, 5..6]);
+    }
+
+    #[test]
+    fn test_vectored_round_trip() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let file = std::fs::OpenOptions::new()
+            .read(true)
+            .write(true)
+            .open(temp_file.path())?;
+
+        let pages: Vec<Page> = (0..6u32)
+            .map(|i| {
+                let mut page = Page::new();
+                page.header_mut().page_id = i;
+                page.calculate_checksum().unwrap();
+                page
+            })
+            .collect();
+        let batch: Vec<(u64, &Page)> = pages
+            .iter()
+            .map(|p| (u64::from(p.header().page_id), p))
+            .collect();
+        write_pages(&file, &batch)?;
+
+        let read = read_pages(&file, &[5, 0, 1, 2, 4])?;
+        let ids: Vec<u32> = read.iter().map(|p| p.header().page_id).collect();
+        assert_eq!(ids, vec![5, 0, 1, 2, 4]);
+        Ok(())
+    }
 }
@@ -0,0 +1,145 @@
+//! Compact encoding of page IDs stored inside pages
+//!
+//! With 64-bit [`PageId`]s a fixed-width child pointer would take twice the
+//! space of the old 32-bit ones and cut B+Tree fan-out. Pointers are instead
+//! stored relative to the page that holds them: the signed distance is
+//! zigzag encoded and written as an LEB128 varint. Children allocated from
+//! the same extent as their parent, the common case with extent allocation,
+//! take one or two bytes; the largest distance still fits in
+//! [`MAX_POINTER_LEN`] bytes.
+//!
+//! | Distance from base page | Bytes |
+//! |-------------------------|-------|
+//! | -64 ..= 63              | 1     |
+//! | -8192 ..= 8191          | 2     |
+//! | -2^20 ..= 2^20 - 1      | 3     |
+//! | any                     | ≤ 10  |
+
+use crate::common::error::Error;
+use crate::storage::page_constants::PageId;
+
+/// Longest encoding of a varint or page pointer
+pub const MAX_POINTER_LEN: usize = 10;
+
+/// Bytes [`encode_varint`] writes for `value`
+pub fn varint_len(value: u64) -> usize {
+    (64 - (value | 1).leading_zeros() as usize).div_ceil(7)
+}
+
+/// Write `value` as an LEB128 varint; returns the bytes written
+///
+/// # Errors
+///
+/// Returns `Error::InvalidInput` if `out` is too short
+pub fn encode_varint(mut value: u64, out: &mut [u8]) -> Result<usize, Error> {
+    let len = varint_len(value);
+    if out.len() < len {
+        return Err(Error::invalid_input(format!(
+            "Varint needs {len} bytes, {} available",
+            out.len()
+        )));
+    }
+    for byte in &mut out[..len - 1] {
+        #[allow(clippy::cast_possible_truncation)]
+        let low = value as u8;
+        *byte = low | 0x80;
+        value >>= 7;
+    }
+    #[allow(clippy::cast_possible_truncation)]
+    let last = value as u8;
+    out[len - 1] = last;
+    Ok(len)
+}
+
+/// Read an LEB128 varint; returns the value and the bytes consumed
+///
+/// # Errors
+///
+/// Returns `Error::Corruption` if the input ends mid-varint or the varint
+/// does not fit in 64 bits
+pub fn decode_varint(input: &[u8]) -> Result<(u64, usize), Error> {
+    let mut value = 0u64;
+    for (index, &byte) in input.iter().take(MAX_POINTER_LEN).enumerate() {
+        let bits = u64::from(byte & 0x7F);
+        if index == MAX_POINTER_LEN - 1 && bits > 1 {
+            break;
+        }
+        value |= bits << (7 * index);
+        if byte & 0x80 == 0 {
+            return Ok((value, index + 1));
+        }
+    }
+    Err(Error::corruption("Truncated or oversized varint"))
+}
+
+/// Signed distance from `base` to `target`, zigzag encoded
+fn zigzag_delta(base: PageId, target: PageId) -> u64 {
+    #[allow(clippy::cast_possible_wrap)]
+    let delta = target.wrapping_sub(base) as i64;
+    #[allow(clippy::cast_sign_loss)]
+    let encoded = ((delta << 1) ^ (delta >> 63)) as u64;
+    encoded
+}
+
+/// Bytes [`encode_pointer`] writes for a pointer from `base` to `target`
+pub fn pointer_len(base: PageId, target: PageId) -> usize {
+    varint_len(zigzag_delta(base, target))
+}
+
+/// Write a pointer to `target` stored in page `base`; returns the bytes
+/// written
+///
+/// # Errors
+///
+/// Returns `Error::InvalidInput` if `out` is too short
+pub fn encode_pointer(base: PageId, target: PageId, out: &mut [u8]) -> Result<usize, Error> {
+    encode_varint(zigzag_delta(base, target), out)
+}
+
+/// Read a pointer stored in page `base`; returns the target page and the
+/// bytes consumed
+///
+/// # Errors
+///
+/// Returns `Error::Corruption` if the encoding is truncated or invalid
+pub fn decode_pointer(base: PageId, input: &[u8]) -> Result<(PageId, usize), Error> {
+    let (encoded, len) = decode_varint(input)?;
+    #[allow(clippy::cast_possible_wrap)]
+    let delta = (encoded >> 1) as i64 ^ -((encoded & 1) as i64);
+    #[allow(clippy::cast_sign_loss)]
+    let target = base.wrapping_add(delta as u64);
+    Ok((target, len))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_varint_lengths() {
+        assert_eq!(varint_len(0), 1);
+        assert_eq!(varint_len(127), 1);
+        assert_eq!(varint_len(128), 2);
+        assert_eq!(varint_len(u64::from(u32::MAX)), 5);
+        assert_eq!(varint_len(u64::MAX), MAX_POINTER_LEN);
+    }
+
+    #[test]
+    fn test_zigzag_keeps_small_distances_small() {
+        assert_eq!(zigzag_delta(100, 100), 0);
+        assert_eq!(zigzag_delta(100, 99), 1);
+        assert_eq!(zigzag_delta(100, 101), 2);
+        assert_eq!(zigzag_delta(0, u64::MAX), 1);
+        assert_eq!(zigzag_delta(u64::MAX, 0), 2);
+    }
+
+    #[test]
+    fn test_decode_rejects_overlong_input() {
+        let mut bytes = [0xFF; MAX_POINTER_LEN + 1];
+        assert!(decode_varint(&bytes).is_err());
+        bytes[MAX_POINTER_LEN - 1] = 0x02;
+        assert!(decode_varint(&bytes).is_err());
+        bytes[MAX_POINTER_LEN - 1] = 0x01;
+        assert_eq!(decode_varint(&bytes).unwrap(), (u64::MAX, MAX_POINTER_LEN));
+    }
+}
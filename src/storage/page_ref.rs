@@ -0,0 +1,152 @@
+//! Zero-copy borrowed page view
+//!
+//! [`PageRef`] exposes the same read API as [`Page`] (`header()`, `data()`,
+//! checksum verification) over bytes owned by someone else - a buffer pool
+//! frame or a [`MappedFile`](crate::storage::mapped_file::MappedFile) region.
+//! Its lifetime is tied to whatever guard keeps those bytes pinned, so
+//! searches and scans can inspect pages without copying them.
+
+use crate::common::error::Error;
+use crate::storage::checksum::{calculate_page_checksum_with, ChecksumAlgorithm};
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PAGE_HEADER_SIZE, PAGE_SIZE, PAGE_USABLE_SIZE};
+use crate::storage::page_header::PageHeader;
+use crate::storage::page_type::PageType;
+
+/// Read-only view of a page stored elsewhere
+#[derive(Clone, Copy)]
+pub struct PageRef<'a> {
+    buffer: &'a [u8; PAGE_SIZE],
+}
+
+impl<'a> PageRef<'a> {
+    /// Wrap a page-sized byte slice
+    ///
+    /// The page type byte is validated up front so that [`header`](Self::header)
+    /// can hand out a typed reference.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if `bytes` is not exactly `PAGE_SIZE`
+    /// long, or `Error::InvalidPageType` if the header holds an unknown type
+    pub fn new(bytes: &'a [u8]) -> Result<Self, Error> {
+        let buffer: &[u8; PAGE_SIZE] = bytes.try_into().map_err(|_| {
+            Error::invalid_input(format!(
+                "Invalid page size: expected {}, got {}",
+                PAGE_SIZE,
+                bytes.len()
+            ))
+        })?;
+        PageType::try_from(buffer[4])?;
+        Ok(Self { buffer })
+    }
+
+    /// Wrap a buffer that is known to hold a valid page header
+    pub(crate) fn from_buffer(buffer: &'a [u8; PAGE_SIZE]) -> Self {
+        Self { buffer }
+    }
+
+    /// Get page header
+    pub fn header(&self) -> &'a PageHeader {
+        // SAFETY: PageHeader is packed(1), so any address is suitably aligned,
+        // the buffer holds at least PAGE_HEADER_SIZE bytes, and the only field
+        // with invalid bit patterns (page_type) was validated in `new`.
+        unsafe { &*(self.buffer.as_ptr().cast::<PageHeader>()) }
+    }
+
+    /// Get page data area
+    pub fn data(&self) -> &'a [u8] {
+        &self.buffer[PAGE_HEADER_SIZE..]
+    }
+
+    /// Get raw page buffer
+    pub fn raw(&self) -> &'a [u8] {
+        self.buffer
+    }
+
+    /// Page size in bytes
+    pub fn size(&self) -> usize {
+        PAGE_SIZE
+    }
+
+    /// Usable data size in bytes
+    pub fn usable_size(&self) -> usize {
+        PAGE_USABLE_SIZE
+    }
+
+    /// Verify page checksum
+    pub fn verify_checksum(&self) -> bool {
+        self.verify_checksum_with(ChecksumAlgorithm::Crc32)
+    }
+
+    /// Verify page checksum using the given algorithm
+    pub fn verify_checksum_with(&self, algorithm: ChecksumAlgorithm) -> bool {
+        calculate_page_checksum_with(algorithm, self.buffer)
+            .is_ok_and(|calculated| calculated == self.header().checksum)
+    }
+
+    /// Check if page is corrupted
+    pub fn is_corrupted(&self) -> bool {
+        !self.verify_checksum()
+    }
+
+    /// Copy the referenced bytes into an owned page
+    pub fn to_page(&self) -> Page {
+        let mut page = Page::new();
+        page.raw_mut().copy_from_slice(self.buffer);
+        page
+    }
+}
+
+impl<'a> From<&'a Page> for PageRef<'a> {
+    fn from(page: &'a Page) -> Self {
+        page.as_page_ref()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_page_ref_matches_page() {
+        let mut page = Page::new();
+        page.header_mut().page_type = PageType::BTreeLeaf;
+        page.header_mut().page_id = 9;
+        page.data_mut()[1] = 0x11;
+        page.calculate_checksum().unwrap();
+
+        let page_ref = PageRef::from(&page);
+        let page_id = page_ref.header().page_id;
+        assert_eq!(page_id, 9);
+        assert_eq!(page_ref.header().page_type, PageType::BTreeLeaf);
+        assert_eq!(page_ref.data()[1], 0x11);
+        assert_eq!(page_ref.raw().as_ptr(), page.raw().as_ptr());
+        assert!(page_ref.verify_checksum());
+    }
+
+    #[test]
+    fn test_page_ref_validation() {
+        let bytes = vec![0u8; PAGE_SIZE];
+        // Page type 0 is not a valid PageType
+        assert!(matches!(
+            PageRef::new(&bytes),
+            Err(Error::InvalidPageType(0))
+        ));
+        assert!(matches!(
+            PageRef::new(&bytes[..100]),
+            Err(Error::InvalidInput(_))
+        ));
+    }
+
+    #[test]
+    fn test_page_ref_unaligned_buffer() {
+        let page = Page::new();
+        let mut bytes = vec![0u8; PAGE_SIZE + 1];
+        bytes[1..].copy_from_slice(page.raw());
+
+        let page_ref = PageRef::new(&bytes[1..]).unwrap();
+        assert_eq!(page_ref.header().page_type, PageType::Header);
+        assert_eq!(page_ref.to_page().raw(), page.raw());
+    }
+}
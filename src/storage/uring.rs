@@ -0,0 +1,564 @@
+//! `io_uring` page I/O backend (Linux, `async` feature)
+//!
+//! [`UringPageIo`] keeps many page reads and writes in flight from a single
+//! thread. Its buffers are aligned [`Page`] frames registered with the kernel
+//! as fixed buffers, so each operation is a `READ_FIXED` / `WRITE_FIXED`
+//! without per-I/O page pinning. Completions are reaped from the completion
+//! ring and reported through a callback - no thread per request.
+//!
+//! The ring is driven directly through the `io_uring_setup`, `io_uring_enter`
+//! and `io_uring_register` system calls.
+
+use crate::common::error::Error;
+use crate::storage::checksum::ChecksumAlgorithm;
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PageId, PAGE_SIZE};
+use crate::storage::page_io::calculate_page_offset;
+use std::fs::File;
+use std::io;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+use std::ptr::{self, NonNull};
+use std::sync::atomic::{AtomicU32, Ordering};
+
+/// Default number of in-flight operations (and registered page buffers)
+pub const DEFAULT_QUEUE_DEPTH: u32 = 32;
+
+const IORING_OFF_SQ_RING: libc::off_t = 0;
+const IORING_OFF_CQ_RING: libc::off_t = 0x0800_0000;
+const IORING_OFF_SQES: libc::off_t = 0x1000_0000;
+const IORING_ENTER_GETEVENTS: u32 = 1;
+const IORING_REGISTER_BUFFERS: u32 = 0;
+const IORING_OP_READ_FIXED: u8 = 4;
+const IORING_OP_WRITE_FIXED: u8 = 5;
+
+#[repr(C)]
+#[derive(Default)]
+struct SqRingOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    flags: u32,
+    dropped: u32,
+    array: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct CqRingOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    overflow: u32,
+    cqes: u32,
+    flags: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct UringParams {
+    sq_entries: u32,
+    cq_entries: u32,
+    flags: u32,
+    sq_thread_cpu: u32,
+    sq_thread_idle: u32,
+    features: u32,
+    wq_fd: u32,
+    resv: [u32; 3],
+    sq_off: SqRingOffsets,
+    cq_off: CqRingOffsets,
+}
+
+/// Submission queue entry (`struct io_uring_sqe`)
+#[repr(C)]
+#[derive(Default, Clone, Copy)]
+struct Sqe {
+    opcode: u8,
+    flags: u8,
+    ioprio: u16,
+    fd: i32,
+    off: u64,
+    addr: u64,
+    len: u32,
+    rw_flags: u32,
+    user_data: u64,
+    buf_index: u16,
+    personality: u16,
+    splice_fd_in: i32,
+    addr3: u64,
+    pad: u64,
+}
+
+/// Completion queue entry (`struct io_uring_cqe`)
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct Cqe {
+    user_data: u64,
+    res: i32,
+    flags: u32,
+}
+
+/// A shared-memory region mapped from the ring file descriptor
+struct RingMap {
+    ptr: NonNull<u8>,
+    len: usize,
+}
+
+impl RingMap {
+    fn new(fd: &OwnedFd, len: usize, offset: libc::off_t) -> io::Result<Self> {
+        // SAFETY: mapping a region the kernel exported for this ring fd
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED | libc::MAP_POPULATE,
+                fd.as_raw_fd(),
+                offset,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(Self {
+            ptr: NonNull::new(ptr.cast()).ok_or_else(io::Error::last_os_error)?,
+            len,
+        })
+    }
+
+    /// Pointer to a `T` at a kernel-provided byte offset
+    fn at<T>(&self, offset: u32) -> *mut T {
+        // SAFETY: offsets come from io_uring_params and lie inside the mapping
+        unsafe { self.ptr.as_ptr().add(offset as usize).cast() }
+    }
+}
+
+impl Drop for RingMap {
+    fn drop(&mut self) {
+        // SAFETY: unmapping exactly the region mapped in `new`
+        unsafe { libc::munmap(self.ptr.as_ptr().cast(), self.len) };
+    }
+}
+
+/// Kind of operation occupying a buffer
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Op {
+    Read,
+    Write,
+}
+
+/// Batched page I/O over a single `io_uring` instance
+pub struct UringPageIo {
+    file: File,
+    // Field order matters for drop: ring mappings go before the ring fd.
+    sq_map: RingMap,
+    cq_map: RingMap,
+    entries_map: RingMap,
+    ring_fd: OwnedFd,
+    sq_mask: u32,
+    cq_mask: u32,
+    sq_off: SqRingOffsets,
+    cq_off: CqRingOffsets,
+    buffers: Box<[Page]>,
+    free_buffers: Vec<u16>,
+    /// Operation and page currently assigned to each buffer
+    slots: Vec<Option<(Op, PageId)>>,
+    in_flight: usize,
+    unsubmitted: u32,
+    checksum: ChecksumAlgorithm,
+}
+
+// SAFETY: the ring memory is only touched through `&mut self`
+unsafe impl Send for UringPageIo {}
+
+impl UringPageIo {
+    /// Create a ring with `queue_depth` entries and as many registered page buffers
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if `io_uring` is unavailable or buffer registration fails
+    pub fn new(file: File, queue_depth: u32) -> Result<Self, Error> {
+        let queue_depth = queue_depth.clamp(1, u32::from(u16::MAX));
+        let mut params = UringParams::default();
+        // SAFETY: io_uring_setup only writes into `params`
+        let fd = unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_setup,
+                queue_depth,
+                ptr::addr_of_mut!(params),
+            )
+        };
+        if fd < 0 {
+            return Err(io::Error::last_os_error().into());
+        }
+        #[allow(clippy::cast_possible_truncation)]
+        // SAFETY: the kernel returned a fresh descriptor that we now own
+        let ring_fd = unsafe { OwnedFd::from_raw_fd(fd as i32) };
+
+        let sq_len = params.sq_off.array as usize + params.sq_entries as usize * 4;
+        let cq_len =
+            params.cq_off.cqes as usize + params.cq_entries as usize * std::mem::size_of::<Cqe>();
+        let entries_len = params.sq_entries as usize * std::mem::size_of::<Sqe>();
+        let sq_map = RingMap::new(&ring_fd, sq_len, IORING_OFF_SQ_RING)?;
+        let cq_map = RingMap::new(&ring_fd, cq_len, IORING_OFF_CQ_RING)?;
+        let entries_map = RingMap::new(&ring_fd, entries_len, IORING_OFF_SQES)?;
+
+        // SAFETY: the ring masks are plain u32 values inside the mappings
+        let sq_mask = unsafe { *sq_map.at::<u32>(params.sq_off.ring_mask) };
+        // SAFETY: see above
+        let cq_mask = unsafe { *cq_map.at::<u32>(params.cq_off.ring_mask) };
+
+        let buffers: Box<[Page]> = (0..queue_depth).map(|_| Page::new()).collect();
+        let iovecs: Vec<libc::iovec> = buffers
+            .iter()
+            .map(|page| libc::iovec {
+                iov_base: page.raw().as_ptr() as *mut libc::c_void,
+                iov_len: PAGE_SIZE,
+            })
+            .collect();
+        // SAFETY: the iovecs describe live, page-aligned buffers owned by `buffers`,
+        // which stay allocated until the ring is dropped
+        let registered = unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_register,
+                ring_fd.as_raw_fd(),
+                IORING_REGISTER_BUFFERS,
+                iovecs.as_ptr(),
+                iovecs.len(),
+            )
+        };
+        if registered < 0 {
+            return Err(io::Error::last_os_error().into());
+        }
+
+        #[allow(clippy::cast_possible_truncation)]
+        let free_buffers = (0..queue_depth as u16).rev().collect();
+        Ok(Self {
+            file,
+            sq_map,
+            cq_map,
+            entries_map,
+            ring_fd,
+            sq_mask,
+            cq_mask,
+            sq_off: params.sq_off,
+            cq_off: params.cq_off,
+            buffers,
+            free_buffers,
+            slots: vec![None; queue_depth as usize],
+            in_flight: 0,
+            unsubmitted: 0,
+            checksum: ChecksumAlgorithm::default(),
+        })
+    }
+
+    /// Use `algorithm` to verify pages returned by [`read_pages`](Self::read_pages)
+    #[must_use]
+    pub fn with_checksum_algorithm(mut self, algorithm: ChecksumAlgorithm) -> Self {
+        self.checksum = algorithm;
+        self
+    }
+
+    /// Maximum number of operations kept in flight
+    pub fn queue_depth(&self) -> usize {
+        self.buffers.len()
+    }
+
+    /// The file the ring reads from and writes to
+    pub fn file(&self) -> &File {
+        &self.file
+    }
+
+    /// Read many pages, keeping up to `queue_depth` reads in flight
+    ///
+    /// `on_page` is called once per page, in completion order, with the page
+    /// still in its registered buffer. Checksums are verified before the
+    /// callback runs.
+    ///
+    /// # Errors
+    ///
+    /// Returns the first I/O, short-read, checksum or callback error. All
+    /// in-flight operations are drained before returning.
+    pub fn read_pages<F>(&mut self, page_ids: &[PageId], mut on_page: F) -> Result<(), Error>
+    where
+        F: FnMut(PageId, &Page) -> Result<(), Error>,
+    {
+        for &page_id in page_ids {
+            calculate_page_offset(page_id)?;
+        }
+        let mut first_error = None;
+        let mut next = 0;
+        while next < page_ids.len() || self.in_flight > 0 {
+            while first_error.is_none() && next < page_ids.len() {
+                let Some(buffer) = self.free_buffers.pop() else {
+                    break;
+                };
+                self.push(Op::Read, page_ids[next], buffer);
+                next += 1;
+            }
+
+            if let Err(err) = self.submit_and_wait(1) {
+                first_error.get_or_insert(err);
+                self.drain();
+                break;
+            }
+            let checksum = self.checksum;
+            self.reap(|op, page_id, page, result| {
+                let outcome = result.and_then(|()| {
+                    if op != Op::Read {
+                        return Ok(());
+                    }
+                    if !page.verify_checksum_with(checksum) {
+                        return Err(Error::corruption(format!(
+                            "Checksum verification failed for page {page_id}"
+                        )));
+                    }
+                    on_page(page_id, page)
+                });
+                if let Err(err) = outcome {
+                    first_error.get_or_insert(err);
+                }
+            });
+            if first_error.is_some() && self.in_flight == 0 {
+                break;
+            }
+        }
+        first_error.map_or(Ok(()), Err)
+    }
+
+    /// Write many pages, keeping up to `queue_depth` writes in flight
+    ///
+    /// Each page is copied into a registered buffer before submission.
+    /// Durability still requires a subsequent `sync_data` on the file.
+    ///
+    /// # Errors
+    ///
+    /// Returns the first I/O or short-write error. All in-flight operations
+    /// are drained before returning.
+    pub fn write_pages(&mut self, pages: &[(PageId, &Page)]) -> Result<(), Error> {
+        for &(page_id, _) in pages {
+            calculate_page_offset(page_id)?;
+        }
+        let mut first_error = None;
+        let mut next = 0;
+        while next < pages.len() || self.in_flight > 0 {
+            while first_error.is_none() && next < pages.len() {
+                let Some(buffer) = self.free_buffers.pop() else {
+                    break;
+                };
+                let (page_id, page) = pages[next];
+                self.buffers[buffer as usize]
+                    .raw_mut()
+                    .copy_from_slice(page.raw());
+                self.push(Op::Write, page_id, buffer);
+                next += 1;
+            }
+
+            if let Err(err) = self.submit_and_wait(1) {
+                first_error.get_or_insert(err);
+                self.drain();
+                break;
+            }
+            self.reap(|_, _, _, result| {
+                if let Err(err) = result {
+                    first_error.get_or_insert(err);
+                }
+            });
+            if first_error.is_some() && self.in_flight == 0 {
+                break;
+            }
+        }
+        first_error.map_or(Ok(()), Err)
+    }
+
+    /// Queue one fixed-buffer operation in the submission ring
+    ///
+    /// `page_id` must already have passed [`calculate_page_offset`].
+    fn push(&mut self, op: Op, page_id: PageId, buffer: u16) {
+        let sqe = Sqe {
+            opcode: match op {
+                Op::Read => IORING_OP_READ_FIXED,
+                Op::Write => IORING_OP_WRITE_FIXED,
+            },
+            fd: self.file.as_raw_fd(),
+            off: page_id * PAGE_SIZE as u64,
+            addr: self.buffers[buffer as usize].raw().as_ptr() as u64,
+            #[allow(clippy::cast_possible_truncation)]
+            len: PAGE_SIZE as u32,
+            user_data: u64::from(buffer),
+            buf_index: buffer,
+            ..Sqe::default()
+        };
+
+        // SAFETY: head/tail/array pointers come from the kernel-provided
+        // offsets. At most `queue_depth` operations are outstanding, so the
+        // ring (sized to `queue_depth`) always has a free slot.
+        unsafe {
+            let tail_ptr = &*self.sq_map.at::<AtomicU32>(self.sq_off.tail);
+            let tail = tail_ptr.load(Ordering::Relaxed);
+            let index = tail & self.sq_mask;
+            *self.entries_map.at::<Sqe>(0).add(index as usize) = sqe;
+            *self.sq_map.at::<u32>(self.sq_off.array).add(index as usize) = index;
+            tail_ptr.store(tail.wrapping_add(1), Ordering::Release);
+        }
+
+        self.slots[buffer as usize] = Some((op, page_id));
+        self.in_flight += 1;
+        self.unsubmitted += 1;
+    }
+
+    /// Submit queued entries and wait for at least `min_complete` completions
+    fn submit_and_wait(&mut self, min_complete: u32) -> Result<(), Error> {
+        loop {
+            // SAFETY: plain io_uring_enter call on our ring fd
+            let submitted = unsafe {
+                libc::syscall(
+                    libc::SYS_io_uring_enter,
+                    self.ring_fd.as_raw_fd(),
+                    self.unsubmitted,
+                    min_complete,
+                    IORING_ENTER_GETEVENTS,
+                    ptr::null::<libc::sigset_t>(),
+                    0usize,
+                )
+            };
+            if submitted < 0 {
+                let err = io::Error::last_os_error();
+                if err.kind() == io::ErrorKind::Interrupted {
+                    continue;
+                }
+                return Err(err.into());
+            }
+            #[allow(clippy::cast_possible_truncation, clippy::cast_sign_loss)]
+            {
+                self.unsubmitted -= (submitted as u32).min(self.unsubmitted);
+            }
+            return Ok(());
+        }
+    }
+
+    /// Wait for every in-flight operation, discarding the results
+    ///
+    /// Gives up only when waiting fails without any completion arriving, so
+    /// registered buffers are not reused while the kernel still owns them.
+    fn drain(&mut self) {
+        while self.in_flight > 0 {
+            let waited = self.submit_and_wait(1);
+            let before = self.in_flight;
+            self.reap(|_, _, _, _| {});
+            if waited.is_err() && self.in_flight == before {
+                break;
+            }
+        }
+    }
+
+    /// Pop all available completions, hand them to `handle` and free their buffers
+    fn reap<F>(&mut self, mut handle: F)
+    where
+        F: FnMut(Op, PageId, &Page, Result<(), Error>),
+    {
+        // SAFETY: head/tail/cqes pointers come from the kernel-provided offsets;
+        // entries between head and tail are owned by us until head is advanced.
+        unsafe {
+            let head_ptr = &*self.cq_map.at::<AtomicU32>(self.cq_off.head);
+            let tail_ptr = &*self.cq_map.at::<AtomicU32>(self.cq_off.tail);
+            let mut head = head_ptr.load(Ordering::Relaxed);
+            let tail = tail_ptr.load(Ordering::Acquire);
+
+            while head != tail {
+                let cqe = *self
+                    .cq_map
+                    .at::<Cqe>(self.cq_off.cqes)
+                    .add((head & self.cq_mask) as usize);
+                head = head.wrapping_add(1);
+
+                #[allow(clippy::cast_possible_truncation)]
+                let buffer = cqe.user_data as u16;
+                let Some((op, page_id)) = self.slots[buffer as usize].take() else {
+                    continue;
+                };
+                let result = match usize::try_from(cqe.res) {
+                    Ok(PAGE_SIZE) => Ok(()),
+                    Ok(transferred) => Err(Error::io(format!(
+                        "Short {op:?} of {transferred} bytes for page {page_id}"
+                    ))),
+                    Err(_) => Err(io::Error::from_raw_os_error(-cqe.res).into()),
+                };
+                handle(op, page_id, &self.buffers[buffer as usize], result);
+                self.free_buffers.push(buffer);
+                self.in_flight -= 1;
+            }
+            head_ptr.store(head, Ordering::Release);
+        }
+    }
+}
+
+impl Drop for UringPageIo {
+    fn drop(&mut self) {
+        // The kernel may still be writing into registered buffers
+        self.drain();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::storage::page_type::PageType;
+    use tempfile::NamedTempFile;
+
+    #[test]
+    fn test_abi_sizes() {
+        assert_eq!(std::mem::size_of::<Sqe>(), 64);
+        assert_eq!(std::mem::size_of::<Cqe>(), 16);
+        assert_eq!(std::mem::size_of::<UringParams>(), 120);
+    }
+
+    #[test]
+    fn test_write_then_read_batch() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let file = std::fs::OpenOptions::new()
+            .read(true)
+            .write(true)
+            .open(temp_file.path())?;
+        let mut ring = UringPageIo::new(file, 4)?;
+
+        let pages: Vec<Page> = (0..10u64)
+            .map(|i| {
+                let mut page = Page::new();
+                page.header_mut().page_type = PageType::Data;
+                page.header_mut().set_page_id(i);
+                page.calculate_checksum().unwrap();
+                page
+            })
+            .collect();
+        let batch: Vec<(PageId, &Page)> = pages.iter().zip(0..).map(|(p, i)| (i, p)).collect();
+        ring.write_pages(&batch)?;
+
+        let ids: Vec<PageId> = (0..10).rev().collect();
+        let mut seen = Vec::new();
+        ring.read_pages(&ids, |page_id, page| {
+            let stored = page.header().page_id;
+            assert_eq!(u64::from(stored), page_id);
+            seen.push(page_id);
+            Ok(())
+        })?;
+        seen.sort_unstable();
+        assert_eq!(seen, (0..10).collect::<Vec<_>>());
+        Ok(())
+    }
+
+    #[test]
+    fn test_read_past_eof_is_short() -> Result<(), Error> {
+        let temp_file = NamedTempFile::new()?;
+        let mut ring = UringPageIo::new(File::open(temp_file.path())?, 2)?;
+        let result = ring.read_pages(&[0, 1, 2], |_, _| Ok(()));
+        assert!(matches!(result, Err(Error::Io(_))));
+        assert_eq!(ring.queue_depth(), 2);
+        Ok(())
+    }
+}
@@ -0,0 +1,106 @@
+//! Checksum verification policy
+//!
+//! Verifying a full page checksum on every access is wasted work once a page
+//! is known to be intact. [`VerificationPolicy`] selects when page caches
+//! check checksums:
+//!
+//! - [`Always`](VerificationPolicy::Always) - every read from storage or a
+//!   mapping is verified
+//! - [`OnLoad`](VerificationPolicy::OnLoad) - a page is verified the first
+//!   time it is read; later reads of the same unmodified page are trusted
+//! - [`Deferred`](VerificationPolicy::Deferred) - pages are handed out without
+//!   inline verification and checked later by a background queue
+//!
+//! Under every policy a page is verified before it may be modified, so a
+//! corrupt page is never rewritten with a fresh checksum.
+
+use crate::storage::page_constants::PageId;
+use parking_lot::RwLock;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// When page checksums are verified
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Default)]
+pub enum VerificationPolicy {
+    /// Verify on every read
+    Always,
+    /// Verify when a page is first loaded; trust resident, unmodified pages
+    #[default]
+    OnLoad,
+    /// Skip inline verification and verify from a background queue
+    ///
+    /// Corruption is reported asynchronously, so readers may briefly see a
+    /// damaged page. Writes still verify first.
+    Deferred,
+}
+
+/// Concurrent bitmap of pages whose checksums have been verified
+#[derive(Debug, Default)]
+pub(crate) struct VerifiedPages {
+    words: RwLock<Vec<AtomicU64>>,
+}
+
+impl VerifiedPages {
+    pub(crate) fn contains(&self, page_id: PageId) -> bool {
+        let (word, bit) = Self::position(page_id);
+        self.words
+            .read()
+            .get(word)
+            .is_some_and(|w| w.load(Ordering::Acquire) & bit != 0)
+    }
+
+    pub(crate) fn insert(&self, page_id: PageId) {
+        let (word, bit) = Self::position(page_id);
+        {
+            let words = self.words.read();
+            if let Some(w) = words.get(word) {
+                w.fetch_or(bit, Ordering::AcqRel);
+                return;
+            }
+        }
+        let mut words = self.words.write();
+        if words.len() <= word {
+            words.resize_with(word + 1, AtomicU64::default);
+        }
+        words[word].fetch_or(bit, Ordering::AcqRel);
+    }
+
+    pub(crate) fn remove(&self, page_id: PageId) {
+        let (word, bit) = Self::position(page_id);
+        if let Some(w) = self.words.read().get(word) {
+            w.fetch_and(!bit, Ordering::AcqRel);
+        }
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    fn position(page_id: PageId) -> (usize, u64) {
+        ((page_id / 64) as usize, 1 << (page_id % 64))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_verified_pages() {
+        let verified = VerifiedPages::default();
+        assert!(!verified.contains(0));
+        assert!(!verified.contains(1000));
+
+        verified.insert(3);
+        verified.insert(1000);
+        assert!(verified.contains(3));
+        assert!(verified.contains(1000));
+        assert!(!verified.contains(4));
+
+        verified.remove(3);
+        verified.remove(5000);
+        assert!(!verified.contains(3));
+        assert!(verified.contains(1000));
+    }
+
+    #[test]
+    fn test_default_policy() {
+        assert_eq!(VerificationPolicy::default(), VerificationPolicy::OnLoad);
+    }
+}
@@ -0,0 +1,1165 @@
+//! Write-ahead log
+//!
+//! Page changes are appended to a sequential log before the pages themselves
+//! reach the database file, so dirty pages can be written back lazily (by
+//! eviction or the background flusher) instead of with a synchronous
+//! in-place write per change. After a crash, [`Wal::recover`] replays the log
+//! from the last checkpoint onto the database file.
+//!
+//! The log is a directory of fixed-size segment files named after their
+//! segment number (`0000000000000003.wal`). An [`Lsn`] is the byte position
+//! of a record in the concatenated segments, so LSNs are 64-bit and never
+//! wrap; pages store the low 32 bits (see [`lsn`](crate::storage::lsn)).
+//! Records never span segments. Each segment starts with a header:
+//!
+//! | Offset | Size | Field               |
+//! |--------|------|---------------------|
+//! | 0      | 8    | magic `LUMNWAL\0`   |
+//! | 8      | 8    | segment number (LE) |
+//! | 16     | 8    | segment size (LE)   |
+//!
+//! followed by records with a 25-byte header:
+//!
+//! | Offset | Size | Field                                  |
+//! |--------|------|----------------------------------------|
+//! | 0      | 4    | record length, header included (LE)    |
+//! | 4      | 4    | CRC32C of bytes 8..length (LE)         |
+//! | 8      | 8    | LSN of the record (LE)                 |
+//! | 16     | 1    | record kind                            |
+//! | 17     | 8    | page ID (LE)                           |
+//!
+//! A page is logged as a full after-image on its first change after it was
+//! last written clean, and as byte-range deltas afterwards. Together with a
+//! bound on the log length between checkpoints, this keeps every 32-bit page
+//! LSN compared during replay within one epoch of the end of the log, and it
+//! repairs pages torn by a crash during write-back.
+
+use crate::common::error::Error;
+use crate::storage::checksum::calculate_crc32c;
+use crate::storage::lsn::{page_lsn, widen, Lsn, LSN_WINDOW};
+use crate::storage::page::Page;
+use crate::storage::page_constants::{PageId, PAGE_SIZE};
+use crate::storage::page_file::PageFile;
+use crate::storage::page_header::PAGE_FLAGS_TRANSIENT;
+use parking_lot::Mutex;
+use std::collections::hash_map::Entry;
+use std::collections::{HashMap, HashSet};
+use std::fs::{self, File, OpenOptions};
+use std::io::Write;
+use std::ops::Range;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{self, Receiver, SyncSender};
+use std::sync::Arc;
+
+/// Default size of a log segment file (16 MiB)
+pub const DEFAULT_SEGMENT_SIZE: u64 = 16 * 1024 * 1024;
+
+/// Smallest allowed segment size (64 KiB)
+pub const MIN_SEGMENT_SIZE: u64 = 64 * 1024;
+
+/// Default log volume after which a checkpoint is due (1 GiB)
+pub const DEFAULT_CHECKPOINT_DISTANCE: u64 = 1024 * 1024 * 1024;
+
+/// Magic bytes at the start of every segment
+pub const SEGMENT_MAGIC: [u8; 8] = *b"LUMNWAL\0";
+
+/// Size of the segment header
+pub const SEGMENT_HEADER_SIZE: usize = 24;
+
+/// Size of a record header
+pub const RECORD_HEADER_SIZE: usize = 25;
+
+/// Buffered log bytes that trigger a write to the segment file
+const WRITE_BUFFER_BYTES: usize = 256 * 1024;
+
+/// Segment batches queued per redo worker during recovery; bounds the log
+/// held in memory
+const REDO_BATCHES_IN_FLIGHT: usize = 2;
+
+/// Pages the redo workers together hold before writing them back (32 MiB)
+const REDO_PAGE_BUDGET: usize = 8192;
+
+/// Kind of a log record
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[repr(u8)]
+enum RecordKind {
+    /// Full after-image of a page
+    PageImage = 1,
+    /// Bytes written at an offset within a page
+    PageDelta = 2,
+    /// Checkpoint carrying the LSN from which recovery replays
+    Checkpoint = 3,
+    /// Several byte ranges within a page, applied together
+    PageRanges = 4,
+}
+
+impl RecordKind {
+    fn from_u8(value: u8) -> Option<Self> {
+        match value {
+            1 => Some(Self::PageImage),
+            2 => Some(Self::PageDelta),
+            3 => Some(Self::Checkpoint),
+            4 => Some(Self::PageRanges),
+            _ => None,
+        }
+    }
+}
+
+/// Write-ahead log configuration
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct WalConfig {
+    /// Size of each segment file; fixed when the log is created
+    pub segment_size: u64,
+    /// Log bytes after the last checkpoint at which
+    /// [`needs_checkpoint`](Wal::needs_checkpoint) reports true
+    pub checkpoint_distance: u64,
+}
+
+impl Default for WalConfig {
+    fn default() -> Self {
+        Self {
+            segment_size: DEFAULT_SEGMENT_SIZE,
+            checkpoint_distance: DEFAULT_CHECKPOINT_DISTANCE,
+        }
+    }
+}
+
+impl WalConfig {
+    /// Check that the sizes are usable
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if the segment size is out of range or
+    /// the checkpoint distance does not fit in the 32-bit page LSN window
+    pub fn validate(&self) -> Result<(), Error> {
+        if self.segment_size < MIN_SEGMENT_SIZE || self.segment_size >= LSN_WINDOW {
+            return Err(Error::invalid_input(format!(
+                "WAL segment size {} must be at least {MIN_SEGMENT_SIZE} and below {LSN_WINDOW}",
+                self.segment_size
+            )));
+        }
+        if self.checkpoint_distance == 0 || self.checkpoint_distance >= LSN_WINDOW / 2 {
+            return Err(Error::invalid_input(format!(
+                "WAL checkpoint distance {} must be non-zero and below {}",
+                self.checkpoint_distance,
+                LSN_WINDOW / 2
+            )));
+        }
+        Ok(())
+    }
+}
+
+/// Summary of a [`Wal::recover`] run
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct RecoveryStats {
+    /// LSN replay started from
+    pub redo_lsn: Lsn,
+    /// End of the log at the time of recovery
+    pub end_lsn: Lsn,
+    /// Records read
+    pub records: usize,
+    /// Full page images applied
+    pub images: usize,
+    /// Deltas applied
+    pub deltas_applied: usize,
+    /// Deltas skipped because the page already contained them
+    pub deltas_skipped: usize,
+    /// Pages written back; a page evicted to stay within the memory budget
+    /// and touched again is counted once per write
+    pub pages: usize,
+    /// Pages read from the database file and checksum-verified
+    pub pages_verified: usize,
+}
+
+impl RecoveryStats {
+    /// Add the per-page counters of a redo worker
+    fn merge(&mut self, other: &Self) {
+        self.images += other.images;
+        self.deltas_applied += other.deltas_applied;
+        self.deltas_skipped += other.deltas_skipped;
+        self.pages += other.pages;
+        self.pages_verified += other.pages_verified;
+    }
+}
+
+/// A decoded log record borrowing its payload from a segment buffer
+struct Record<'a> {
+    lsn: Lsn,
+    kind: RecordKind,
+    page_id: u64,
+    payload: &'a [u8],
+    size: usize,
+}
+
+/// A page record located in a shared segment buffer
+#[derive(Clone)]
+struct RedoRecord {
+    lsn: Lsn,
+    kind: RecordKind,
+    page_id: PageId,
+    payload: Range<usize>,
+}
+
+/// One segment's records for a single redo worker
+struct RedoBatch {
+    segment: Arc<Vec<u8>>,
+    records: Vec<RedoRecord>,
+}
+
+#[derive(Debug)]
+struct WalWriter {
+    /// Current segment, opened for appending
+    segment: Arc<File>,
+    segment_no: u64,
+    /// LSN just past the bytes already written to `segment`
+    written_lsn: Lsn,
+    /// Records not yet written to `segment`; they start at `written_lsn`
+    buffer: Vec<u8>,
+    /// LSN of the next record
+    next_lsn: Lsn,
+    /// Error from a failed write or sync; poisons the log
+    failure: Option<Error>,
+}
+
+/// Segmented, append-only write-ahead log
+#[derive(Debug)]
+pub struct Wal {
+    dir: PathBuf,
+    config: WalConfig,
+    writer: Mutex<WalWriter>,
+    /// Serializes `fdatasync` calls so concurrent flushes share one
+    sync_lock: Mutex<()>,
+    /// Mirrors `WalWriter::next_lsn` for lock-free readers
+    next_lsn: AtomicU64,
+    /// Every record before this LSN is on stable storage
+    durable_lsn: AtomicU64,
+    /// Redo point of the last checkpoint
+    redo_lsn: AtomicU64,
+}
+
+impl Wal {
+    /// Open the log in `dir`, creating the directory and first segment if
+    /// needed
+    ///
+    /// A torn record at the end of the last segment (from a crash during an
+    /// append) is truncated away.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` for a bad configuration or a segment size
+    /// that differs from the existing log's, `Error::Corruption` if a segment
+    /// other than the last is damaged or missing, or an I/O error
+    pub fn open<P: AsRef<Path>>(dir: P, config: WalConfig) -> Result<Self, Error> {
+        config.validate()?;
+        let dir = dir.as_ref().to_path_buf();
+        fs::create_dir_all(&dir)?;
+
+        let segments = list_segments(&dir)?;
+        if let Some(pair) = segments.windows(2).find(|pair| pair[1] != pair[0] + 1) {
+            return Err(Error::corruption(format!(
+                "WAL segments {} to {} are missing",
+                pair[0] + 1,
+                pair[1] - 1
+            )));
+        }
+
+        let size = config.segment_size;
+        let first_segment = segments.first().copied().unwrap_or(0);
+        let mut redo_lsn = first_segment * size + SEGMENT_HEADER_SIZE as u64;
+        let mut end_lsn = redo_lsn;
+        let mut segment_no = first_segment;
+        for (index, &number) in segments.iter().enumerate() {
+            let last = index + 1 == segments.len();
+            let path = segment_path(&dir, number);
+            let data = fs::read(&path)?;
+            let base = number * size;
+            segment_no = number;
+            if last && data.len() < SEGMENT_HEADER_SIZE {
+                // Crashed while creating the segment
+                create_segment(&dir, number, size)?;
+                end_lsn = base + SEGMENT_HEADER_SIZE as u64;
+                break;
+            }
+            check_segment_header(&data, number, size)?;
+
+            let scan_end = scan_segment(&data, base, &mut |record| {
+                if record.kind == RecordKind::Checkpoint {
+                    redo_lsn = read_u64(record.payload, 0);
+                }
+                Ok(())
+            })?;
+            if scan_end < data.len() {
+                if !last {
+                    return Err(Error::corruption(format!(
+                        "WAL segment {number} is damaged at offset {scan_end}"
+                    )));
+                }
+                log::warn!(
+                    "Truncating {} bytes of torn WAL tail in segment {number}",
+                    data.len() - scan_end
+                );
+                OpenOptions::new()
+                    .write(true)
+                    .open(&path)?
+                    .set_len(scan_end as u64)?;
+            }
+            end_lsn = base + scan_end as u64;
+        }
+        if segments.is_empty() {
+            create_segment(&dir, 0, size)?;
+        }
+
+        let segment = OpenOptions::new()
+            .append(true)
+            .open(segment_path(&dir, segment_no))?;
+        segment.sync_data()?;
+        Ok(Self {
+            dir,
+            config,
+            writer: Mutex::new(WalWriter {
+                segment: Arc::new(segment),
+                segment_no,
+                written_lsn: end_lsn,
+                buffer: Vec::with_capacity(WRITE_BUFFER_BYTES),
+                next_lsn: end_lsn,
+                failure: None,
+            }),
+            sync_lock: Mutex::new(()),
+            next_lsn: AtomicU64::new(end_lsn),
+            durable_lsn: AtomicU64::new(end_lsn),
+            redo_lsn: AtomicU64::new(redo_lsn),
+        })
+    }
+
+    /// Directory holding the segment files
+    pub fn dir(&self) -> &Path {
+        &self.dir
+    }
+
+    /// Configuration the log was opened with
+    pub fn config(&self) -> WalConfig {
+        self.config
+    }
+
+    /// LSN the next record will be assigned (the end of the log)
+    pub fn next_lsn(&self) -> Lsn {
+        self.next_lsn.load(Ordering::Acquire)
+    }
+
+    /// Every record before this LSN is on stable storage
+    pub fn durable_lsn(&self) -> Lsn {
+        self.durable_lsn.load(Ordering::Acquire)
+    }
+
+    /// LSN from which recovery would replay
+    pub fn redo_lsn(&self) -> Lsn {
+        self.redo_lsn.load(Ordering::Acquire)
+    }
+
+    /// Whether the log has grown past the configured checkpoint distance
+    pub fn needs_checkpoint(&self) -> bool {
+        self.next_lsn() - self.redo_lsn() >= self.config.checkpoint_distance
+    }
+
+    /// Log a full after-image of a page and stamp the record's LSN into it
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the log is poisoned, a segment write fails, or the
+    /// log needs a checkpoint before it can grow further
+    pub fn log_page_image(&self, page_id: PageId, page: &mut Page) -> Result<Lsn, Error> {
+        self.append(RecordKind::PageImage, page_id, PAGE_SIZE, |lsn, buffer| {
+            page.header_mut().lsn = page_lsn(lsn);
+            buffer.extend_from_slice(page.raw());
+        })
+    }
+
+    /// Log the bytes of `page` in `range` (raw page offsets) and stamp the
+    /// record's LSN into the page
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` for an empty or out-of-bounds range, or
+    /// the errors of [`log_page_image`](Self::log_page_image)
+    pub fn log_page_delta(
+        &self,
+        page_id: PageId,
+        page: &mut Page,
+        range: Range<usize>,
+    ) -> Result<Lsn, Error> {
+        if range.is_empty() || range.end > PAGE_SIZE {
+            return Err(Error::invalid_input(format!(
+                "Invalid page delta range {range:?}"
+            )));
+        }
+        #[allow(clippy::cast_possible_truncation)]
+        let offset = range.start as u16;
+        self.append(
+            RecordKind::PageDelta,
+            page_id,
+            2 + range.len(),
+            |lsn, buffer| {
+                buffer.extend_from_slice(&offset.to_le_bytes());
+                buffer.extend_from_slice(&page.raw()[range]);
+                page.header_mut().lsn = page_lsn(lsn);
+            },
+        )
+    }
+
+    /// Log the bytes of `page` in each of `ranges` (raw page offsets) as one
+    /// record and stamp its LSN into the page
+    ///
+    /// Recovery applies all of the ranges or none of them, so a change to
+    /// separate parts of a page is logged without the bytes between them.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if there are no ranges, any is empty or
+    /// out of bounds, or together they are too large for one segment, or the
+    /// errors of [`log_page_image`](Self::log_page_image)
+    pub fn log_page_ranges(
+        &self,
+        page_id: PageId,
+        page: &mut Page,
+        ranges: &[Range<usize>],
+    ) -> Result<Lsn, Error> {
+        if ranges.is_empty()
+            || ranges
+                .iter()
+                .any(|range| range.is_empty() || range.end > PAGE_SIZE)
+        {
+            return Err(Error::invalid_input(format!(
+                "Invalid page delta ranges {ranges:?}"
+            )));
+        }
+        let payload_len = ranges.iter().map(|range| 4 + range.len()).sum();
+        self.append(
+            RecordKind::PageRanges,
+            page_id,
+            payload_len,
+            |lsn, buffer| {
+                for range in ranges {
+                    #[allow(clippy::cast_possible_truncation)]
+                    let (offset, len) = (range.start as u16, range.len() as u16);
+                    buffer.extend_from_slice(&offset.to_le_bytes());
+                    buffer.extend_from_slice(&len.to_le_bytes());
+                    buffer.extend_from_slice(&page.raw()[range.clone()]);
+                }
+                page.header_mut().lsn = page_lsn(lsn);
+            },
+        )
+    }
+
+    /// Make every record at or before `lsn` durable
+    ///
+    /// Concurrent callers share a single `fdatasync`.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the write or sync fails; the log is then poisoned
+    pub fn flush_to(&self, lsn: Lsn) -> Result<(), Error> {
+        if self.durable_lsn() > lsn {
+            return Ok(());
+        }
+        let _sync = self.sync_lock.lock();
+        if self.durable_lsn() > lsn {
+            return Ok(());
+        }
+
+        let (segment, target) = {
+            let mut writer = self.writer.lock();
+            writer.write_buffer()?;
+            (Arc::clone(&writer.segment), writer.next_lsn)
+        };
+        if let Err(err) = segment.sync_data() {
+            let err = Error::from(err);
+            self.writer.lock().failure = Some(err.clone());
+            return Err(err);
+        }
+        self.durable_lsn.fetch_max(target, Ordering::AcqRel);
+        Ok(())
+    }
+
+    /// Make the whole log durable
+    ///
+    /// # Errors
+    ///
+    /// Same as [`flush_to`](Self::flush_to)
+    pub fn flush(&self) -> Result<(), Error> {
+        self.flush_to(self.next_lsn())
+    }
+
+    /// Record that every change before `redo_lsn` is on disk
+    ///
+    /// Appends and flushes a checkpoint record, then deletes segments that
+    /// only hold records before `redo_lsn`. Returns the checkpoint record's
+    /// LSN. The redo point never moves backwards.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` if `redo_lsn` lies past the end of the
+    /// log, or an I/O error
+    pub fn checkpoint(&self, redo_lsn: Lsn) -> Result<Lsn, Error> {
+        if redo_lsn > self.next_lsn() {
+            return Err(Error::invalid_input(format!(
+                "Checkpoint redo LSN {redo_lsn} is past the end of the log"
+            )));
+        }
+        let redo_lsn = redo_lsn.max(self.redo_lsn());
+        let lsn = self.append(RecordKind::Checkpoint, 0, 8, |_, buffer| {
+            buffer.extend_from_slice(&redo_lsn.to_le_bytes());
+        })?;
+        self.flush_to(lsn)?;
+        self.redo_lsn.fetch_max(redo_lsn, Ordering::AcqRel);
+
+        let first_needed = redo_lsn / self.config.segment_size;
+        for number in list_segments(&self.dir)? {
+            if number < first_needed {
+                fs::remove_file(segment_path(&self.dir, number))?;
+            }
+        }
+        Ok(lsn)
+    }
+
+    /// Replay the log from the last checkpoint onto `file`, using every
+    /// available core
+    ///
+    /// Same as [`recover_with_threads`](Self::recover_with_threads) with the
+    /// machine's available parallelism.
+    ///
+    /// # Errors
+    ///
+    /// Same as [`recover_with_threads`](Self::recover_with_threads)
+    pub fn recover(&self, file: &PageFile) -> Result<RecoveryStats, Error> {
+        let threads = std::thread::available_parallelism().map_or(1, std::num::NonZeroUsize::get);
+        self.recover_with_threads(file, threads)
+    }
+
+    /// Replay the log from the last checkpoint onto `file` with `threads`
+    /// redo workers
+    ///
+    /// The log is read once, sequentially. Records are partitioned by page
+    /// ID, so each worker owns a disjoint set of pages and applies its
+    /// records in LSN order without coordination. Whole segments are shared
+    /// with the workers, and at most a few per worker are in flight.
+    ///
+    /// Full page images are applied unconditionally. A page first touched by
+    /// a delta is loaded by its worker and checksum-verified; because every
+    /// page a crash may have torn gets a full image before its deltas, a
+    /// mismatch is real corruption. A delta is applied only if the page's
+    /// LSN shows it does not contain the change yet. Every page touched is
+    /// rewritten with a fresh checksum by its worker, the file is synced,
+    /// and a checkpoint at the end of the log is recorded so the same
+    /// records are not replayed again. Workers write their pages back early
+    /// once they hold their share of a fixed page budget; a page touched
+    /// again is reloaded, and its LSN keeps deltas from being applied twice.
+    ///
+    /// Call this before the database is used, with no concurrent appends.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::InvalidInput` for zero threads, `Error::Corruption` if
+    /// a page needed by a delta fails verification, or an I/O error
+    pub fn recover_with_threads(
+        &self,
+        file: &PageFile,
+        threads: usize,
+    ) -> Result<RecoveryStats, Error> {
+        if threads == 0 {
+            return Err(Error::invalid_input("Recovery needs at least one thread"));
+        }
+        let redo_lsn = self.redo_lsn();
+        let end_lsn = self.next_lsn();
+        let page_count = file.page_count()?;
+        let page_budget = (REDO_PAGE_BUDGET / threads).max(1);
+
+        let (scanned, workers) = std::thread::scope(|scope| {
+            let mut senders = Vec::with_capacity(threads);
+            let mut handles = Vec::with_capacity(threads);
+            for _ in 0..threads {
+                let (sender, batches) = mpsc::sync_channel(REDO_BATCHES_IN_FLIGHT);
+                senders.push(sender);
+                handles.push(scope.spawn(move || {
+                    redo_partition(file, page_count, end_lsn, page_budget, &batches)
+                }));
+            }
+            let scanned = self.partition_records(redo_lsn, end_lsn, &senders);
+            drop(senders);
+            let workers: Vec<Result<RecoveryStats, Error>> = handles
+                .into_iter()
+                .map(|handle| {
+                    handle
+                        .join()
+                        .unwrap_or_else(|_| Err(Error::internal("Redo worker panicked")))
+                })
+                .collect();
+            (scanned, workers)
+        });
+
+        // A worker's own error explains why the scan could not hand it work
+        let mut stats = RecoveryStats::default();
+        for worker in workers {
+            stats.merge(&worker?);
+        }
+        stats.records = scanned?;
+        stats.redo_lsn = redo_lsn;
+        stats.end_lsn = end_lsn;
+        file.sync_data()?;
+
+        self.checkpoint(end_lsn)?;
+        Ok(stats)
+    }
+
+    /// Read the records in `[from, to)` and send them, batched per segment,
+    /// to the worker owning their page; returns the number of records read
+    fn partition_records(
+        &self,
+        from: Lsn,
+        to: Lsn,
+        workers: &[SyncSender<RedoBatch>],
+    ) -> Result<usize, Error> {
+        let mut records = 0;
+        let size = self.config.segment_size;
+        let mut number = from / size;
+        while number * size < to {
+            let segment = Arc::new(fs::read(segment_path(&self.dir, number))?);
+            check_segment_header(&segment, number, size)?;
+            let base = number * size;
+            let mut batches: Vec<Vec<RedoRecord>> = vec![Vec::new(); workers.len()];
+            scan_segment(&segment, base, &mut |record| {
+                if record.lsn < from || record.lsn >= to {
+                    return Ok(());
+                }
+                records += 1;
+                if record.kind == RecordKind::Checkpoint {
+                    return Ok(());
+                }
+                let page_id = record.page_id;
+                #[allow(clippy::cast_possible_truncation)]
+                let start = (record.lsn - base) as usize + RECORD_HEADER_SIZE;
+                #[allow(clippy::cast_possible_truncation)]
+                let worker = (page_id % workers.len() as u64) as usize;
+                batches[worker].push(RedoRecord {
+                    lsn: record.lsn,
+                    kind: record.kind,
+                    page_id,
+                    payload: start..start + record.payload.len(),
+                });
+                Ok(())
+            })?;
+
+            for (worker, records) in workers.iter().zip(batches) {
+                if records.is_empty() {
+                    continue;
+                }
+                let batch = RedoBatch {
+                    segment: Arc::clone(&segment),
+                    records,
+                };
+                if worker.send(batch).is_err() {
+                    return Err(Error::internal("Redo worker stopped early"));
+                }
+            }
+            number += 1;
+        }
+        Ok(records)
+    }
+
+    /// Append one record; `fill` receives the record's LSN and must push
+    /// exactly `payload_len` bytes
+    fn append<F>(
+        &self,
+        kind: RecordKind,
+        page_id: PageId,
+        payload_len: usize,
+        fill: F,
+    ) -> Result<Lsn, Error>
+    where
+        F: FnOnce(Lsn, &mut Vec<u8>),
+    {
+        let size = RECORD_HEADER_SIZE + payload_len;
+        let segment_size = self.config.segment_size;
+        // Records never span segments, so one that cannot fit after a
+        // segment header could never be written
+        if (SEGMENT_HEADER_SIZE + size) as u64 > segment_size {
+            return Err(Error::invalid_input(format!(
+                "{size}-byte WAL record does not fit in a {segment_size}-byte segment"
+            )));
+        }
+        let mut writer = self.writer.lock();
+        if let Some(err) = &writer.failure {
+            return Err(err.clone());
+        }
+
+        if writer.next_lsn % segment_size + size as u64 > segment_size {
+            writer.switch_segment(&self.dir, segment_size, &self.durable_lsn)?;
+        }
+        let lsn = writer.next_lsn;
+        // Checkpoint records are exempt so a full log can always be trimmed
+        if kind != RecordKind::Checkpoint && lsn + size as u64 - self.redo_lsn() >= LSN_WINDOW {
+            return Err(Error::internal(
+                "Write-ahead log is full; a checkpoint is required",
+            ));
+        }
+
+        let start = writer.buffer.len();
+        let buffer = &mut writer.buffer;
+        #[allow(clippy::cast_possible_truncation)]
+        buffer.extend_from_slice(&(size as u32).to_le_bytes());
+        buffer.extend_from_slice(&[0; 4]);
+        buffer.extend_from_slice(&lsn.to_le_bytes());
+        buffer.push(kind as u8);
+        buffer.extend_from_slice(&page_id.to_le_bytes());
+        fill(lsn, buffer);
+        debug_assert_eq!(buffer.len() - start, size);
+        let crc = calculate_crc32c(&buffer[start + 8..]);
+        buffer[start + 4..start + 8].copy_from_slice(&crc.to_le_bytes());
+
+        writer.next_lsn += size as u64;
+        self.next_lsn.store(writer.next_lsn, Ordering::Release);
+        if writer.buffer.len() >= WRITE_BUFFER_BYTES {
+            writer.write_buffer()?;
+        }
+        Ok(lsn)
+    }
+}
+
+impl WalWriter {
+    /// Write buffered records to the current segment
+    fn write_buffer(&mut self) -> Result<(), Error> {
+        if let Some(err) = &self.failure {
+            return Err(err.clone());
+        }
+        if self.buffer.is_empty() {
+            return Ok(());
+        }
+        // A partial append cannot be retried without duplicating bytes
+        if let Err(err) = (&*self.segment).write_all(&self.buffer) {
+            let err = Error::from(err);
+            self.failure = Some(err.clone());
+            return Err(err);
+        }
+        self.written_lsn += self.buffer.len() as u64;
+        self.buffer.clear();
+        Ok(())
+    }
+
+    /// Seal the current segment and continue in a new one
+    fn switch_segment(
+        &mut self,
+        dir: &Path,
+        segment_size: u64,
+        durable_lsn: &AtomicU64,
+    ) -> Result<(), Error> {
+        self.write_buffer()?;
+        let switched = self
+            .segment
+            .sync_data()
+            .map_err(Error::from)
+            .and_then(|()| {
+                durable_lsn.fetch_max(self.written_lsn, Ordering::AcqRel);
+                create_segment(dir, self.segment_no + 1, segment_size)?;
+                Ok(OpenOptions::new()
+                    .append(true)
+                    .open(segment_path(dir, self.segment_no + 1))?)
+            });
+        match switched {
+            Ok(segment) => {
+                self.segment = Arc::new(segment);
+                self.segment_no += 1;
+                self.written_lsn = self.segment_no * segment_size + SEGMENT_HEADER_SIZE as u64;
+                self.next_lsn = self.written_lsn;
+                Ok(())
+            }
+            Err(err) => {
+                self.failure = Some(err.clone());
+                Err(err)
+            }
+        }
+    }
+}
+
+/// Apply one worker's share of the log and write its pages back, holding at
+/// most `page_budget` pages at a time
+fn redo_partition(
+    file: &PageFile,
+    page_count: u64,
+    end_lsn: Lsn,
+    page_budget: usize,
+    batches: &Receiver<RedoBatch>,
+) -> Result<RecoveryStats, Error> {
+    let mut stats = RecoveryStats::default();
+    let mut pages: HashMap<PageId, Page> = HashMap::new();
+    // Pages past the original end of the file that an early write-back put
+    // on disk, so they are read back rather than started afresh
+    let mut appended: HashSet<PageId> = HashSet::new();
+    for batch in batches {
+        for record in &batch.records {
+            if pages.len() >= page_budget && !pages.contains_key(&record.page_id) {
+                stats.pages += write_back(file, &mut pages)?;
+                appended.extend(
+                    pages
+                        .drain()
+                        .map(|(page_id, _)| page_id)
+                        .filter(|&page_id| page_id >= page_count),
+                );
+            }
+            let payload = &batch.segment[record.payload.clone()];
+            if record.kind == RecordKind::PageImage {
+                let page = pages.entry(record.page_id).or_default();
+                page.raw_mut().copy_from_slice(payload);
+                stats.images += 1;
+                continue;
+            }
+
+            let page = match pages.entry(record.page_id) {
+                Entry::Occupied(entry) => entry.into_mut(),
+                Entry::Vacant(entry) => {
+                    let mut page = Page::new();
+                    if record.page_id < page_count || appended.contains(&record.page_id) {
+                        file.read_page_into(record.page_id, &mut page)?;
+                        stats.pages_verified += 1;
+                    }
+                    entry.insert(page)
+                }
+            };
+            if widen(page.header().lsn, end_lsn) >= record.lsn {
+                stats.deltas_skipped += 1;
+                continue;
+            }
+            if record.kind == RecordKind::PageRanges {
+                let mut at = 0;
+                while at < payload.len() {
+                    let offset = usize::from(read_u16(payload, at));
+                    let bytes = &payload[at + 4..at + 4 + usize::from(read_u16(payload, at + 2))];
+                    page.raw_mut()[offset..offset + bytes.len()].copy_from_slice(bytes);
+                    at += 4 + bytes.len();
+                }
+            } else {
+                let offset = usize::from(read_u16(payload, 0));
+                let bytes = &payload[2..];
+                page.raw_mut()[offset..offset + bytes.len()].copy_from_slice(bytes);
+            }
+            page.header_mut().lsn = page_lsn(record.lsn);
+            stats.deltas_applied += 1;
+        }
+    }
+
+    stats.pages += write_back(file, &mut pages)?;
+    Ok(stats)
+}
+
+/// Checksum `pages` and write them in page order; returns how many were
+/// written
+fn write_back(file: &PageFile, pages: &mut HashMap<PageId, Page>) -> Result<usize, Error> {
+    let mut page_ids: Vec<PageId> = pages.keys().copied().collect();
+    page_ids.sort_unstable();
+    for page in pages.values_mut() {
+        page.header_mut().flags &= !PAGE_FLAGS_TRANSIENT;
+        page.calculate_checksum_with(file.checksum_algorithm())?;
+    }
+    let batch: Vec<(PageId, &Page)> = page_ids
+        .iter()
+        .map(|page_id| (*page_id, &pages[page_id]))
+        .collect();
+    file.write_pages(&batch)?;
+    Ok(batch.len())
+}
+
+fn segment_path(dir: &Path, number: u64) -> PathBuf {
+    dir.join(format!("{number:016X}.wal"))
+}
+
+/// Segment numbers present in `dir`, ascending
+fn list_segments(dir: &Path) -> Result<Vec<u64>, Error> {
+    let mut segments = Vec::new();
+    for entry in fs::read_dir(dir)? {
+        let name = entry?.file_name();
+        let Some(stem) = name.to_str().and_then(|name| name.strip_suffix(".wal")) else {
+            continue;
+        };
+        if stem.len() == 16 {
+            if let Ok(number) = u64::from_str_radix(stem, 16) {
+                segments.push(number);
+            }
+        }
+    }
+    segments.sort_unstable();
+    Ok(segments)
+}
+
+/// Create (or reset) a segment file containing only its header and make it
+/// durable
+fn create_segment(dir: &Path, number: u64, segment_size: u64) -> Result<(), Error> {
+    let mut header = [0u8; SEGMENT_HEADER_SIZE];
+    header[0..8].copy_from_slice(&SEGMENT_MAGIC);
+    header[8..16].copy_from_slice(&number.to_le_bytes());
+    header[16..24].copy_from_slice(&segment_size.to_le_bytes());
+
+    let mut file = OpenOptions::new()
+        .write(true)
+        .create(true)
+        .truncate(true)
+        .open(segment_path(dir, number))?;
+    file.write_all(&header)?;
+    file.sync_all()?;
+    #[cfg(unix)]
+    File::open(dir)?.sync_all()?;
+    Ok(())
+}
+
+fn check_segment_header(data: &[u8], number: u64, segment_size: u64) -> Result<(), Error> {
+    if data.len() < SEGMENT_HEADER_SIZE
+        || data[0..8] != SEGMENT_MAGIC
+        || read_u64(data, 8) != number
+    {
+        return Err(Error::corruption(format!(
+            "Invalid header in WAL segment {number}"
+        )));
+    }
+    let recorded = read_u64(data, 16);
+    if recorded != segment_size {
+        return Err(Error::invalid_input(format!(
+            "WAL was created with {recorded}-byte segments, not {segment_size}"
+        )));
+    }
+    Ok(())
+}
+
+/// Visit the valid records of a segment; returns the offset just past the
+/// last one
+///
+/// The writer only ever appends, so a clean segment ends exactly at the end
+/// of `data`; any bytes left over are a torn record.
+fn scan_segment<'a>(
+    data: &'a [u8],
+    base: Lsn,
+    visit: &mut dyn FnMut(Record<'a>) -> Result<(), Error>,
+) -> Result<usize, Error> {
+    let mut offset = SEGMENT_HEADER_SIZE;
+    while let Some(record) = parse_record(data, offset, base) {
+        offset += record.size;
+        visit(record)?;
+    }
+    Ok(offset)
+}
+
+fn parse_record(data: &[u8], offset: usize, base: Lsn) -> Option<Record<'_>> {
+    let header = data.get(offset..offset + RECORD_HEADER_SIZE)?;
+    let size = read_u32(header, 0) as usize;
+    let bytes = data.get(offset..offset.checked_add(size)?)?;
+    if size < RECORD_HEADER_SIZE || calculate_crc32c(&bytes[8..]) != read_u32(header, 4) {
+        return None;
+    }
+    let lsn = read_u64(header, 8);
+    if lsn != base + offset as u64 {
+        return None;
+    }
+    let kind = RecordKind::from_u8(header[16])?;
+    let payload = &bytes[RECORD_HEADER_SIZE..];
+    let well_formed = match kind {
+        RecordKind::PageImage => payload.len() == PAGE_SIZE,
+        RecordKind::PageDelta => {
+            payload.len() > 2 && usize::from(read_u16(payload, 0)) + payload.len() - 2 <= PAGE_SIZE
+        }
+        RecordKind::Checkpoint => payload.len() == 8,
+        RecordKind::PageRanges => ranges_well_formed(payload),
+    };
+    well_formed.then_some(Record {
+        lsn,
+        kind,
+        page_id: read_u64(header, 17),
+        payload,
+        size,
+    })
+}
+
+/// Whether a page ranges payload is a non-empty run of
+/// `offset u16, length u16, bytes` entries, each within the page
+fn ranges_well_formed(payload: &[u8]) -> bool {
+    let mut at = 0;
+    while at < payload.len() {
+        let Some(header) = payload.get(at..at + 4) else {
+            return false;
+        };
+        let offset = usize::from(read_u16(header, 0));
+        let len = usize::from(read_u16(header, 2));
+        if len == 0 || offset + len > PAGE_SIZE || at + 4 + len > payload.len() {
+            return false;
+        }
+        at += 4 + len;
+    }
+    at > 0
+}
+
+fn read_u16(data: &[u8], offset: usize) -> u16 {
+    u16::from_le_bytes([data[offset], data[offset + 1]])
+}
+
+fn read_u32(data: &[u8], offset: usize) -> u32 {
+    let mut bytes = [0u8; 4];
+    bytes.copy_from_slice(&data[offset..offset + 4]);
+    u32::from_le_bytes(bytes)
+}
+
+fn read_u64(data: &[u8], offset: usize) -> u64 {
+    let mut bytes = [0u8; 8];
+    bytes.copy_from_slice(&data[offset..offset + 8]);
+    u64::from_le_bytes(bytes)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tempfile::TempDir;
+
+    fn small_config() -> WalConfig {
+        WalConfig {
+            segment_size: MIN_SEGMENT_SIZE,
+            ..WalConfig::default()
+        }
+    }
+
+    #[test]
+    fn test_config_validation() {
+        assert!(WalConfig::default().validate().is_ok());
+        let tiny = WalConfig {
+            segment_size: 4096,
+            ..WalConfig::default()
+        };
+        assert!(matches!(tiny.validate(), Err(Error::InvalidInput(_))));
+        let too_far = WalConfig {
+            checkpoint_distance: LSN_WINDOW,
+            ..WalConfig::default()
+        };
+        assert!(matches!(too_far.validate(), Err(Error::InvalidInput(_))));
+    }
+
+    #[test]
+    fn test_records_round_trip_through_scan() {
+        let dir = TempDir::new().unwrap();
+        let wal = Wal::open(dir.path(), small_config()).unwrap();
+        let mut page = Page::new();
+        page.data_mut()[0] = 0xAB;
+        let image = wal.log_page_image(7, &mut page).unwrap();
+        assert_eq!(image, SEGMENT_HEADER_SIZE as u64);
+        let stamped = page.header().lsn;
+        assert_eq!(stamped, page_lsn(image));
+        let delta = wal.log_page_delta(7, &mut page, 16..20).unwrap();
+        assert_eq!(delta, image + (RECORD_HEADER_SIZE + PAGE_SIZE) as u64);
+        let ranges = wal
+            .log_page_ranges(7, &mut page, &[16..20, 4000..4003])
+            .unwrap();
+        assert!(wal.log_page_ranges(7, &mut page, &[]).is_err());
+        assert!(wal
+            .log_page_ranges(7, &mut page, &[16..20, 30..30])
+            .is_err());
+        // 16 full pages of payload overrun a 64 KiB segment
+        let oversized = vec![0..PAGE_SIZE; 16];
+        let before = wal.next_lsn();
+        assert!(matches!(
+            wal.log_page_ranges(7, &mut page, &oversized),
+            Err(Error::InvalidInput(_))
+        ));
+        assert_eq!(wal.next_lsn(), before);
+        wal.flush().unwrap();
+        assert_eq!(wal.durable_lsn(), wal.next_lsn());
+
+        let data = fs::read(segment_path(dir.path(), 0)).unwrap();
+        let mut seen = Vec::new();
+        let end = scan_segment(&data, 0, &mut |record| {
+            seen.push((
+                record.lsn,
+                record.kind,
+                record.page_id,
+                record.payload.len(),
+            ));
+            Ok(())
+        })
+        .unwrap();
+        assert_eq!(end, data.len());
+        assert_eq!(
+            seen,
+            vec![
+                (image, RecordKind::PageImage, 7, PAGE_SIZE),
+                (delta, RecordKind::PageDelta, 7, 6),
+                (ranges, RecordKind::PageRanges, 7, 15),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_parse_rejects_damaged_records() {
+        let dir = TempDir::new().unwrap();
+        let wal = Wal::open(dir.path(), small_config()).unwrap();
+        let mut page = Page::new();
+        wal.log_page_delta(1, &mut page, 100..104).unwrap();
+        wal.flush().unwrap();
+
+        let mut data = fs::read(segment_path(dir.path(), 0)).unwrap();
+        assert!(parse_record(&data, SEGMENT_HEADER_SIZE, 0).is_some());
+        assert!(parse_record(&data, SEGMENT_HEADER_SIZE, 1).is_none());
+        let last = data.len() - 1;
+        data[last] ^= 0xFF;
+        assert!(parse_record(&data, SEGMENT_HEADER_SIZE, 0).is_none());
+        assert!(parse_record(&data[..last], SEGMENT_HEADER_SIZE, 0).is_none());
+    }
+
+    #[test]
+    fn test_delta_range_validation() {
+        let dir = TempDir::new().unwrap();
+        let wal = Wal::open(dir.path(), small_config()).unwrap();
+        let mut page = Page::new();
+        assert!(matches!(
+            wal.log_page_delta(1, &mut page, 10..10),
+            Err(Error::InvalidInput(_))
+        ));
+        assert!(matches!(
+            wal.log_page_delta(1, &mut page, PAGE_SIZE - 1..PAGE_SIZE + 1),
+            Err(Error::InvalidInput(_))
+        ));
+    }
+
+    #[test]
+    fn test_redo_evicts_pages_past_budget() {
+        use crate::storage::file_header::FileHeader;
+
+        let dir = TempDir::new().unwrap();
+        let wal = Wal::open(dir.path(), small_config()).unwrap();
+        let path = dir.path().join("data.db");
+        let file = PageFile::create_database(&path, &FileHeader::default()).unwrap();
+        let page_count = file.page_count().unwrap();
+
+        // Pages past the end of the file, each touched again after eviction
+        let mut pages: Vec<(PageId, Page)> = (page_count..page_count + 3)
+            .map(|page_id| {
+                let mut page = Page::new();
+                page.header_mut().set_page_id(page_id);
+                page.raw_mut()[200] = 0xAB;
+                wal.log_page_image(page_id, &mut page).unwrap();
+                (page_id, page)
+            })
+            .collect();
+        for (fill, (page_id, page)) in (1u8..).zip(pages.iter_mut()) {
+            page.raw_mut()[100] = fill;
+            wal.log_page_delta(*page_id, page, 100..110).unwrap();
+        }
+        let (first_id, first) = &mut pages[0];
+        first.raw_mut()[101] = 0xEE;
+        wal.log_page_delta(*first_id, first, 100..110).unwrap();
+        wal.flush().unwrap();
+
+        let end_lsn = wal.next_lsn();
+        let (sender, batches) = mpsc::sync_channel(4);
+        wal.partition_records(wal.redo_lsn(), end_lsn, &[sender])
+            .unwrap();
+        let stats = redo_partition(&file, page_count, end_lsn, 1, &batches).unwrap();
+
+        assert_eq!(stats.deltas_applied, 4);
+        assert_eq!(stats.pages, 7);
+        for (page_id, page) in &pages {
+            assert_eq!(file.read_page(*page_id).unwrap().data(), page.data());
+        }
+    }
+}
@@ -0,0 +1,65 @@
+//! Helpers shared by the storage and index test binaries
+//!
+//! Each test binary includes this module with `mod common;` and uses only
+//! part of it.
+
+#![allow(dead_code)]
+
+use lumen::storage::buffer_pool::{BufferPool, BufferPoolConfig};
+use lumen::storage::page::Page;
+use lumen::storage::page_constants::{PageId, PAGE_SIZE};
+use lumen::storage::page_io::write_page_to_file;
+use lumen::storage::page_type::PageType;
+use std::fs::File;
+use std::path::Path;
+use std::sync::Arc;
+use tempfile::NamedTempFile;
+
+/// Checksummed data page whose first eight data bytes hold its page ID
+pub fn make_page(page_id: PageId) -> Page {
+    let mut page = Page::new();
+    page.header_mut().page_type = PageType::Data;
+    page.header_mut().set_page_id(page_id);
+    page.data_mut()[0..8].copy_from_slice(&page_id.to_le_bytes());
+    page.calculate_checksum().unwrap();
+    page
+}
+
+/// Checksummed data page whose data area is filled with `fill`
+pub fn filled_page(page_id: PageId, fill: u8) -> Page {
+    let mut page = make_page(page_id);
+    page.data_mut().fill(fill);
+    page.calculate_checksum().unwrap();
+    page
+}
+
+/// Write pages `0..count` made by [`make_page`], corrupting the data of
+/// `corrupt` after checksumming
+pub fn write_pages(
+    path: &Path,
+    count: u64,
+    corrupt: Option<PageId>,
+) -> Result<(), Box<dyn std::error::Error>> {
+    let mut file = File::create(path)?;
+    for page_id in 0..count {
+        let mut page = make_page(page_id);
+        if corrupt == Some(page_id) {
+            page.data_mut()[10] ^= 0xFF;
+        }
+        write_page_to_file(&mut file, page_id, &page)?;
+    }
+    Ok(())
+}
+
+/// Pool configuration with room for `frames` pages
+pub fn config(frames: usize) -> BufferPoolConfig {
+    BufferPoolConfig {
+        memory_budget: frames * PAGE_SIZE,
+        ..Default::default()
+    }
+}
+
+/// Shared pool over `temp` with room for `frames` pages
+pub fn pool(temp: &NamedTempFile, frames: usize) -> Arc<BufferPool> {
+    Arc::new(BufferPool::open(temp.path(), config(frames)).unwrap())
+}
@@ -0,0 +1,277 @@
+//! Tests for the disk-resident B+Tree
+
+mod common;
+
+use common::pool;
+use lumen::common::error::Error;
+use lumen::index::btree::BTree;
+use lumen::index::btree_node::{NodeRef, MAX_KEY_LEN, MAX_VALUE_LEN};
+use lumen::storage::page_allocator::PageAllocator;
+use lumen::storage::page_constants::PAGE_SIZE;
+use lumen::storage::page_file::PageFile;
+use lumen::storage::page_type::PageType;
+use lumen::storage::wal::{Wal, WalConfig};
+use std::collections::BTreeMap;
+use std::sync::Arc;
+use tempfile::{NamedTempFile, TempDir};
+
+/// Deterministic permutation of `0..count`; 7919 is prime and must not
+/// divide `count`
+fn shuffled(count: u64) -> impl Iterator<Item = u64> {
+    (0..count).map(move |i| i * 7919 % count)
+}
+
+#[test]
+fn test_random_inserts_match_reference() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    // Few frames, so nodes are evicted and reloaded along the way
+    let tree = BTree::create(pool(&temp, 32), Arc::new(PageAllocator::new()))?;
+    let mut reference = BTreeMap::new();
+    for i in shuffled(20_000) {
+        let key = format!("user:{i:08}").into_bytes();
+        let value = i.to_le_bytes().repeat(1 + (i % 5) as usize);
+        assert_eq!(tree.insert(&key, &value)?, None);
+        reference.insert(key, value);
+    }
+    for (key, value) in &reference {
+        assert_eq!(tree.get(key)?.as_ref(), Some(value));
+    }
+    assert_eq!(tree.get(b"user:")?, None);
+    assert_eq!(tree.get(b"user:99999999")?, None);
+    assert!(tree.height()? <= 3);
+    Ok(())
+}
+
+#[test]
+fn test_failed_split_leaves_tree_unchanged() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let pool = pool(&temp, 8);
+    let allocator = Arc::new(PageAllocator::new());
+    let tree = BTree::create(Arc::clone(&pool), Arc::clone(&allocator))?;
+    // Three of these fill the root leaf; a fourth splits it into two
+    let value = vec![7u8; MAX_VALUE_LEN];
+    for i in 0..3u8 {
+        tree.insert(&[i], &value)?;
+    }
+    assert_eq!(tree.height()?, 1);
+
+    // Leave one free frame, so the first new node is created and the
+    // second runs out of memory
+    let held: Vec<_> = (0..pool.capacity() - 2)
+        .map(|_| pool.new_page(allocator.allocate_page()?, PageType::BTreeLeaf))
+        .collect::<Result<_, Error>>()?;
+    let free_before = allocator.free_pages();
+    assert!(matches!(tree.insert(&[3], &value), Err(Error::OutOfMemory)));
+    assert_eq!(allocator.free_pages(), free_before + 2);
+    drop(held);
+
+    assert_eq!(tree.height()?, 1);
+    for i in 0..3u8 {
+        assert_eq!(tree.get(&[i])?, Some(value.clone()));
+    }
+    assert_eq!(tree.get(&[3])?, None);
+    // The discarded node's page ID is reused without a clash
+    assert_eq!(tree.insert(&[3], &value)?, None);
+    assert_eq!(tree.height()?, 2);
+    for i in 0..4u8 {
+        assert_eq!(tree.get(&[i])?, Some(value.clone()));
+    }
+    Ok(())
+}
+
+#[test]
+fn test_replace_and_remove() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let tree = BTree::create(pool(&temp, 64), Arc::new(PageAllocator::new()))?;
+    for i in 0..3000u32 {
+        tree.insert(&i.to_be_bytes(), b"first")?;
+    }
+    assert_eq!(
+        tree.insert(&7u32.to_be_bytes(), &[9; 500])?,
+        Some(b"first".to_vec())
+    );
+    assert_eq!(tree.get(&7u32.to_be_bytes())?, Some(vec![9; 500]));
+
+    for i in (0..3000u32).step_by(2) {
+        assert!(tree.remove(&i.to_be_bytes())?.is_some());
+    }
+    assert_eq!(tree.remove(&2u32.to_be_bytes())?, None);
+    for i in 0..3000u32 {
+        assert_eq!(tree.get(&i.to_be_bytes())?.is_some(), i % 2 == 1);
+    }
+    // Removed space is reused
+    for i in (0..3000u32).step_by(2) {
+        tree.insert(&i.to_be_bytes(), b"again")?;
+    }
+    assert_eq!(tree.get_with(&4u32.to_be_bytes(), <[u8]>::len)?, Some(5));
+    Ok(())
+}
+
+#[test]
+fn test_large_entries_and_limits() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let tree = BTree::create(pool(&temp, 64), Arc::new(PageAllocator::new()))?;
+    for i in shuffled(300) {
+        let mut key = vec![b'k'; MAX_KEY_LEN];
+        key[MAX_KEY_LEN - 8..].copy_from_slice(&i.to_be_bytes());
+        tree.insert(&key, &vec![i as u8; MAX_VALUE_LEN])?;
+    }
+    let mut key = vec![b'k'; MAX_KEY_LEN];
+    key[MAX_KEY_LEN - 8..].copy_from_slice(&123u64.to_be_bytes());
+    assert_eq!(tree.get(&key)?, Some(vec![123; MAX_VALUE_LEN]));
+
+    assert!(matches!(
+        tree.insert(&[0; MAX_KEY_LEN + 1], b""),
+        Err(Error::InvalidInput(_))
+    ));
+    assert!(matches!(
+        tree.insert(b"k", &[0; MAX_VALUE_LEN + 1]),
+        Err(Error::InvalidInput(_))
+    ));
+    Ok(())
+}
+
+#[test]
+fn test_prefix_compression_raises_fan_out() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let pool = pool(&temp, 256);
+    let tree = BTree::create(Arc::clone(&pool), Arc::new(PageAllocator::new()))?;
+    // 40-byte keys sharing a long prefix, 8-byte values
+    for i in 0..20_000u64 {
+        let key = format!("tenant-0042/orders/2026-10-16/{i:010}");
+        tree.insert(key.as_bytes(), &i.to_le_bytes())?;
+    }
+    let guard = pool.read_page(tree.root())?;
+    let root = NodeRef::new(tree.root(), &guard)?;
+    let leaf_id = root.leftmost_child();
+    drop(guard);
+    let guard = pool.read_page(leaf_id)?;
+    let leaf = NodeRef::new(leaf_id, &guard)?;
+    assert!(leaf.prefix().len() >= 30);
+    // Uncompressed, even a full leaf would hold only 75 of these entries
+    assert!(leaf.len() > 75, "{} entries", leaf.len());
+    assert_eq!(tree.height()?, 2);
+    Ok(())
+}
+
+#[test]
+fn test_tree_survives_reopen() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let allocator = Arc::new(PageAllocator::new());
+    let root = {
+        let tree = BTree::create(pool(&temp, 16), Arc::clone(&allocator))?;
+        for i in 0..5000u32 {
+            tree.insert(&i.to_be_bytes(), &i.to_le_bytes())?;
+        }
+        tree.root()
+    };
+    let tree = BTree::open(pool(&temp, 16), allocator, root)?;
+    for i in (0..5000u32).step_by(97) {
+        assert_eq!(tree.get(&i.to_be_bytes())?, Some(i.to_le_bytes().to_vec()));
+    }
+    Ok(())
+}
+
+#[test]
+fn test_logged_tree_recovers_after_crash() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let dir = TempDir::new()?;
+    let allocator = Arc::new(PageAllocator::new());
+    let root = {
+        let pool = pool(&temp, 256);
+        let wal = Arc::new(Wal::open(dir.path(), WalConfig::default())?);
+        pool.attach_wal(Arc::clone(&wal))?;
+        let tree = BTree::create(pool, Arc::clone(&allocator))?;
+        for i in shuffled(3000) {
+            tree.insert(&i.to_be_bytes(), &[i as u8; 24])?;
+        }
+        for i in (0..3000u64).step_by(3) {
+            tree.remove(&i.to_be_bytes())?;
+        }
+        // Deltas leave out each node's free space and unchanged entries
+        assert!(wal.next_lsn() < 4000 * PAGE_SIZE as u64 / 4);
+        wal.flush()?;
+        let root = tree.root();
+        // Crash without writing back any node
+        std::mem::forget(tree);
+        root
+    };
+
+    Wal::open(dir.path(), WalConfig::default())?.recover(&PageFile::open(temp.path())?)?;
+    let tree = BTree::open(pool(&temp, 64), allocator, root)?;
+    for i in 0..3000u64 {
+        let expected = (i % 3 != 0).then(|| vec![i as u8; 24]);
+        assert_eq!(tree.get(&i.to_be_bytes())?, expected, "key {i}");
+    }
+    Ok(())
+}
+
+#[test]
+fn test_concurrent_readers_during_writes() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let tree = Arc::new(BTree::create(
+        pool(&temp, 128),
+        Arc::new(PageAllocator::new()),
+    )?);
+    for i in 0..1000u32 {
+        tree.insert(&i.to_be_bytes(), &i.to_le_bytes())?;
+    }
+    std::thread::scope(|scope| {
+        for _ in 0..4 {
+            let tree = Arc::clone(&tree);
+            scope.spawn(move || {
+                for round in 0..20 {
+                    for i in (round..1000u32).step_by(20) {
+                        assert_eq!(
+                            tree.get(&i.to_be_bytes()).unwrap(),
+                            Some(i.to_le_bytes().to_vec())
+                        );
+                    }
+                }
+            });
+        }
+        for i in 1000..6000u32 {
+            tree.insert(&i.to_be_bytes(), &i.to_le_bytes()).unwrap();
+        }
+    });
+    Ok(())
+}
+
+#[test]
+fn test_concurrent_writers_and_readers() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    // Small enough that nodes are evicted while others are read
+    let tree = BTree::create(pool(&temp, 48), Arc::new(PageAllocator::new()))?;
+    let writers = 4u32;
+    let per_writer = 3000u32;
+    std::thread::scope(|scope| {
+        for writer in 0..writers {
+            let tree = &tree;
+            scope.spawn(move || {
+                for i in 0..per_writer {
+                    let key = (i * writers + writer).to_be_bytes();
+                    tree.insert(&key, &key).unwrap();
+                    if i % 3 == 0 {
+                        assert_eq!(tree.remove(&key).unwrap(), Some(key.to_vec()));
+                    }
+                }
+            });
+        }
+        for _ in 0..2 {
+            let tree = &tree;
+            scope.spawn(move || {
+                for i in 0..writers * per_writer {
+                    // Keys never change value, so any hit must match
+                    if let Some(value) = tree.get(&i.to_be_bytes()).unwrap() {
+                        assert_eq!(value, i.to_be_bytes());
+                    }
+                }
+            });
+        }
+    });
+    for i in 0..writers * per_writer {
+        let expected = (!(i / writers).is_multiple_of(3)).then(|| i.to_be_bytes().to_vec());
+        assert_eq!(tree.get(&i.to_be_bytes())?, expected);
+    }
+    Ok(())
+}
@@ -0,0 +1,266 @@
+//! Tests for B+Tree range scans and leaf sibling links
+
+mod common;
+
+use common::pool;
+use lumen::index::btree::BTree;
+use lumen::index::btree_loader::BulkLoadConfig;
+use lumen::index::btree_node::NodeRef;
+use lumen::storage::buffer_pool::BufferPool;
+use lumen::storage::page::Page;
+use lumen::storage::page_allocator::PageAllocator;
+use lumen::storage::page_constants::{PageId, INVALID_PAGE_ID};
+use std::collections::BTreeMap;
+use std::ops::{Bound, RangeBounds};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Arc;
+use std::thread;
+use tempfile::NamedTempFile;
+
+fn key(i: u64) -> Vec<u8> {
+    format!("item:{i:08}").into_bytes()
+}
+
+type Entries = Vec<(Vec<u8>, Vec<u8>)>;
+type Bounds<'a> = (Bound<&'a [u8]>, Bound<&'a [u8]>);
+
+fn scan(tree: &BTree, start: Bound<&[u8]>, end: Bound<&[u8]>, rev: bool) -> Entries {
+    let cursor = if rev {
+        tree.range_rev(start, end)
+    } else {
+        tree.range(start, end)
+    };
+    cursor.collect::<Result<_, _>>().unwrap()
+}
+
+fn expected(
+    map: &BTreeMap<Vec<u8>, Vec<u8>>,
+    start: Bound<&[u8]>,
+    end: Bound<&[u8]>,
+    rev: bool,
+) -> Entries {
+    // `BTreeMap::range` rejects inverted bounds, which a scan accepts
+    let entries: Entries = map
+        .iter()
+        .filter(|(k, _)| (start, end).contains(k.as_slice()))
+        .map(|(k, v)| (k.clone(), v.clone()))
+        .collect();
+    if rev {
+        entries.into_iter().rev().collect()
+    } else {
+        entries
+    }
+}
+
+/// Leaves from the leftmost one along the next links, checking each
+/// leaf's previous link on the way
+fn leaf_chain(pool: &BufferPool, tree: &BTree) -> Vec<PageId> {
+    let mut page = Page::new();
+    let mut page_id = tree.root();
+    loop {
+        pool.read_versioned(page_id, &mut page).unwrap();
+        let node = NodeRef::new(page_id, &page).unwrap();
+        if node.is_leaf() {
+            break;
+        }
+        page_id = node.leftmost_child();
+    }
+    let mut chain = Vec::new();
+    let mut prev = INVALID_PAGE_ID;
+    while page_id != INVALID_PAGE_ID {
+        pool.read_versioned(page_id, &mut page).unwrap();
+        let node = NodeRef::new(page_id, &page).unwrap();
+        assert!(node.is_leaf());
+        assert_eq!(node.prev_leaf(), prev);
+        chain.push(page_id);
+        prev = page_id;
+        page_id = node.next_leaf();
+    }
+    chain
+}
+
+#[test]
+fn test_scans_match_reference_in_both_directions() {
+    let temp = NamedTempFile::new().unwrap();
+    // Few frames, so leaves are evicted and read back during scans
+    let pool = pool(&temp, 24);
+    let tree = BTree::create(Arc::clone(&pool), Arc::new(PageAllocator::new())).unwrap();
+    let mut map = BTreeMap::new();
+    for i in (0..3000u64).map(|i| i * 7919 % 3000) {
+        let value = vec![(i % 251) as u8; 20 + (i % 40) as usize];
+        tree.insert(&key(i * 2), &value).unwrap();
+        map.insert(key(i * 2), value);
+    }
+    assert!(tree.height().unwrap() >= 2);
+
+    let (low, high) = (key(1000), key(4000));
+    let (missing, beyond) = (key(1001), key(99_999));
+    let bounds: Vec<Bounds<'_>> = vec![
+        (Bound::Unbounded, Bound::Unbounded),
+        (Bound::Included(&low), Bound::Included(&high)),
+        (Bound::Excluded(&low), Bound::Excluded(&high)),
+        (Bound::Included(&missing), Bound::Unbounded),
+        (Bound::Unbounded, Bound::Excluded(&missing)),
+        (Bound::Included(&beyond), Bound::Unbounded),
+        (Bound::Included(&low), Bound::Excluded(&low)),
+        (Bound::Included(&high), Bound::Included(&low)),
+        (Bound::Included(b""), Bound::Included(&beyond)),
+    ];
+    for (start, end) in bounds {
+        for rev in [false, true] {
+            assert_eq!(
+                scan(&tree, start, end, rev),
+                expected(&map, start, end, rev),
+                "{start:?}..{end:?} rev={rev}"
+            );
+        }
+    }
+}
+
+#[test]
+fn test_split_leaves_stay_linked() {
+    let temp = NamedTempFile::new().unwrap();
+    let pool = pool(&temp, 64);
+    let tree = BTree::create(Arc::clone(&pool), Arc::new(PageAllocator::new())).unwrap();
+    // Descending inserts split at the left edge, ascending ones at the right
+    for i in (0..1500u64).rev().chain(3000..4500) {
+        tree.insert(&key(i), &[3; 48]).unwrap();
+    }
+    let chain = leaf_chain(&pool, &tree);
+    assert!(chain.len() > 20);
+
+    // Emptied leaves stay in the chain and are skipped
+    for i in 200..1300 {
+        tree.remove(&key(i)).unwrap();
+    }
+    assert_eq!(leaf_chain(&pool, &tree), chain);
+    let keys: Vec<Vec<u8>> = scan(&tree, Bound::Unbounded, Bound::Unbounded, true)
+        .into_iter()
+        .map(|(k, _)| k)
+        .collect();
+    let reference: Vec<Vec<u8>> = (0..200)
+        .chain(1300..1500)
+        .chain(3000..4500)
+        .rev()
+        .map(key)
+        .collect();
+    assert_eq!(keys, reference);
+}
+
+#[test]
+fn test_scan_of_bulk_loaded_tree() {
+    let temp = NamedTempFile::new().unwrap();
+    let pool = pool(&temp, 16);
+    let tree = BTree::bulk_load(
+        Arc::clone(&pool),
+        Arc::new(PageAllocator::new()),
+        BulkLoadConfig::default(),
+        (0..20_000u64).map(|i| (key(i), i.to_le_bytes())),
+    )
+    .unwrap();
+
+    let chain = leaf_chain(&pool, &tree);
+    assert!(chain.len() > 64);
+    // Leaves were laid out in order, so the chain mostly steps by one page
+    let sequential = chain
+        .windows(2)
+        .filter(|pair| pair[1] == pair[0] + 1)
+        .count();
+    assert!(sequential * 10 >= chain.len() * 9);
+
+    let mut count = 0u64;
+    for (i, entry) in tree.range(Bound::Unbounded, Bound::Unbounded).enumerate() {
+        let (k, v) = entry.unwrap();
+        assert_eq!(k, key(i as u64));
+        assert_eq!(v, (i as u64).to_le_bytes());
+        count += 1;
+    }
+    assert_eq!(count, 20_000);
+
+    let (start, end) = (key(12_345), key(6_000));
+    let keys: Vec<Vec<u8>> = scan(&tree, Bound::Excluded(&end), Bound::Included(&start), true)
+        .into_iter()
+        .map(|(k, _)| k)
+        .collect();
+    assert_eq!(keys, (6_001..=12_345).rev().map(key).collect::<Vec<_>>());
+
+    // Inserts into the loaded tree keep the chain intact
+    for i in 0..2000u64 {
+        tree.insert(format!("item:{:08}+", i * 10).as_bytes(), &[1; 30])
+            .unwrap();
+    }
+    assert!(leaf_chain(&pool, &tree).len() > chain.len());
+    assert_eq!(
+        tree.range(Bound::Unbounded, Bound::Unbounded).count(),
+        22_000
+    );
+}
+
+#[test]
+fn test_scans_during_concurrent_inserts() {
+    let temp = NamedTempFile::new().unwrap();
+    let pool = pool(&temp, 64);
+    let tree = Arc::new(BTree::create(pool, Arc::new(PageAllocator::new())).unwrap());
+    // Even keys exist throughout; writers add odd keys while scans run
+    for i in 0..2000u64 {
+        tree.insert(&key(i * 2), &[0; 24]).unwrap();
+    }
+
+    let running = Arc::new(AtomicBool::new(true));
+    let writers: Vec<_> = (0..2u64)
+        .map(|writer| {
+            let tree = Arc::clone(&tree);
+            thread::spawn(move || {
+                for i in (writer..2000).step_by(2) {
+                    tree.insert(&key(i * 2 + 1), &[1; 64]).unwrap();
+                }
+            })
+        })
+        .collect();
+    let scanners: Vec<_> = [false, true]
+        .into_iter()
+        .map(|rev| {
+            let tree = Arc::clone(&tree);
+            let running = Arc::clone(&running);
+            thread::spawn(move || {
+                let mut scans = 0;
+                while running.load(Ordering::Acquire) || scans == 0 {
+                    let keys: Vec<Vec<u8>> = scan(&tree, Bound::Unbounded, Bound::Unbounded, rev)
+                        .into_iter()
+                        .map(|(k, _)| k)
+                        .collect();
+                    let ordered = keys.windows(2).all(|pair| (pair[0] < pair[1]) != rev);
+                    assert!(ordered, "scan out of order");
+                    let even = keys
+                        .iter()
+                        .filter(|k| k.last().is_some_and(|b| b % 2 == 0))
+                        .count();
+                    assert_eq!(even, 2000);
+                    scans += 1;
+                }
+            })
+        })
+        .collect();
+    for writer in writers {
+        writer.join().unwrap();
+    }
+    running.store(false, Ordering::Release);
+    for scanner in scanners {
+        scanner.join().unwrap();
+    }
+    assert_eq!(tree.range(Bound::Unbounded, Bound::Unbounded).count(), 4000);
+}
+
+#[test]
+fn test_empty_tree_scans_nothing() {
+    let temp = NamedTempFile::new().unwrap();
+    let tree = BTree::create(pool(&temp, 8), Arc::new(PageAllocator::new())).unwrap();
+    assert_eq!(tree.range(Bound::Unbounded, Bound::Unbounded).count(), 0);
+    assert_eq!(
+        tree.range_rev(Bound::Unbounded, Bound::Unbounded).count(),
+        0
+    );
+    tree.insert(b"only", b"one").unwrap();
+    let found = scan(&tree, Bound::Included(b"a"), Bound::Included(b"z"), true);
+    assert_eq!(found, vec![(b"only".to_vec(), b"one".to_vec())]);
+}
@@ -0,0 +1,123 @@
+//! Tests for bulk loading B+Trees from sorted input
+
+mod common;
+
+use common::pool;
+use lumen::common::error::Error;
+use lumen::index::btree::BTree;
+use lumen::index::btree_loader::{BulkLoadConfig, BulkLoader};
+use lumen::storage::page_allocator::PageAllocator;
+use std::sync::Arc;
+use tempfile::NamedTempFile;
+
+/// Pages in use, header page included
+fn used_pages(allocator: &PageAllocator) -> u64 {
+    allocator.allocated_pages() - allocator.free_pages()
+}
+
+fn key(i: u32) -> Vec<u8> {
+    format!("order:{i:09}").into_bytes()
+}
+
+fn load(temp: &NamedTempFile, count: u32, fill_percent: usize) -> (BTree, Arc<PageAllocator>) {
+    let allocator = Arc::new(PageAllocator::new());
+    let tree = BTree::bulk_load(
+        pool(temp, 32),
+        Arc::clone(&allocator),
+        BulkLoadConfig { fill_percent },
+        (0..count).map(|i| (key(i), i.to_le_bytes())),
+    )
+    .unwrap();
+    (tree, allocator)
+}
+
+#[test]
+fn test_loaded_tree_finds_every_key() {
+    let temp = NamedTempFile::new().unwrap();
+    let (tree, _) = load(&temp, 200_000, 100);
+    assert_eq!(tree.height().unwrap(), 3);
+    for i in (0..200_000).step_by(7) {
+        assert_eq!(tree.get(&key(i)).unwrap(), Some(i.to_le_bytes().to_vec()));
+    }
+    assert_eq!(tree.get(b"order:").unwrap(), None);
+    assert_eq!(tree.get(&key(200_000)).unwrap(), None);
+}
+
+#[test]
+fn test_fill_factor_leaves_room() {
+    let dense_file = NamedTempFile::new().unwrap();
+    let (_, dense) = load(&dense_file, 50_000, 100);
+    let sparse_file = NamedTempFile::new().unwrap();
+    let (_, sparse) = load(&sparse_file, 50_000, 50);
+    let (dense, sparse) = (used_pages(&dense), used_pages(&sparse));
+    assert!(sparse * 10 > dense * 19 && sparse * 10 < dense * 21);
+}
+
+#[test]
+fn test_loaded_tree_takes_inserts_and_reopens() {
+    let temp = NamedTempFile::new().unwrap();
+    let (tree, allocator) = load(&temp, 20_000, 70);
+    for i in (0..20_000).step_by(2) {
+        let mut between = key(i);
+        between.push(b'+');
+        tree.insert(&between, b"later").unwrap();
+    }
+    assert_eq!(
+        tree.insert(&key(10), b"replaced").unwrap(),
+        Some(10u32.to_le_bytes().to_vec())
+    );
+    let root = tree.root();
+    drop(tree);
+
+    let tree = BTree::open(pool(&temp, 32), allocator, root).unwrap();
+    assert_eq!(tree.get(&key(10)).unwrap(), Some(b"replaced".to_vec()));
+    assert_eq!(
+        tree.get(b"order:000004242+").unwrap(),
+        Some(b"later".to_vec())
+    );
+    assert_eq!(
+        tree.get(&key(19_999)).unwrap(),
+        Some(19_999u32.to_le_bytes().to_vec())
+    );
+}
+
+#[test]
+fn test_empty_load_gives_empty_leaf() {
+    let temp = NamedTempFile::new().unwrap();
+    let (tree, allocator) = load(&temp, 0, 90);
+    assert_eq!(tree.height().unwrap(), 1);
+    assert_eq!(tree.get(b"anything").unwrap(), None);
+    // The header and the root; the rest of the extent was returned
+    assert_eq!(used_pages(&allocator), 2);
+}
+
+#[test]
+fn test_rejects_unsorted_input_and_bad_config() {
+    let temp = NamedTempFile::new().unwrap();
+    let pool = pool(&temp, 32);
+    let allocator = Arc::new(PageAllocator::new());
+    let mut loader = BulkLoader::new(
+        Arc::clone(&pool),
+        Arc::clone(&allocator),
+        BulkLoadConfig::default(),
+    )
+    .unwrap();
+    loader.push(b"b", b"1").unwrap();
+    assert!(matches!(
+        loader.push(b"b", b"2"),
+        Err(Error::InvalidInput(_))
+    ));
+    assert!(matches!(
+        loader.push(b"a", b"2"),
+        Err(Error::InvalidInput(_))
+    ));
+    assert_eq!(loader.len(), 1);
+    // Abandoning the load gives its pages back
+    drop(loader);
+    assert_eq!(used_pages(&allocator), 1);
+
+    assert!(matches!(
+        BulkLoader::new(pool, allocator, BulkLoadConfig { fill_percent: 101 }),
+        Err(Error::InvalidInput(_))
+    ));
+}
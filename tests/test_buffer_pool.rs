@@ -0,0 +1,319 @@
+//! Tests for the buffer pool
+
+mod common;
+
+use common::{config, filled_page, make_page, write_pages};
+use lumen::storage::buffer_pool::*;
+use lumen::storage::checksum::ChecksumAlgorithm;
+use lumen::storage::file_header::FileHeader;
+use lumen::storage::page::Page;
+use lumen::storage::page_constants::PAGE_SIZE;
+use lumen::storage::page_file::PageFile;
+use lumen::storage::page_io::*;
+use lumen::storage::page_type::PageType;
+use std::fs::File;
+use std::sync::Arc;
+use tempfile::NamedTempFile;
+
+#[test]
+fn test_fetch_existing_pages() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    write_pages(temp_file.path(), 8, None)?;
+
+    let pool = BufferPool::open(temp_file.path(), config(4))?;
+    for i in 0..8u64 {
+        let pinned = pool.fetch_page(i)?;
+        let page = pinned.read();
+        let page_id = page.header().page_id;
+        assert_eq!(u64::from(page_id), i);
+        assert_eq!(page.data()[0], i as u8);
+    }
+    assert_eq!(pool.capacity(), 4);
+    assert_eq!(pool.resident_pages(), 4);
+
+    Ok(())
+}
+
+#[test]
+fn test_hot_page_survives_scan() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    write_pages(temp_file.path(), 32, None)?;
+
+    let pool = BufferPool::open(temp_file.path(), config(4))?;
+    // Page 0 plays the role of a B+Tree root: referenced repeatedly
+    drop(pool.fetch_page(0)?);
+    drop(pool.fetch_page(0)?);
+
+    for i in 1..32 {
+        drop(pool.fetch_page(i)?);
+    }
+    assert!(pool.is_resident(0));
+
+    Ok(())
+}
+
+#[test]
+fn test_flush_persists_changes() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    {
+        let pool = BufferPool::open(temp_file.path(), config(4))?;
+        let pinned = pool.new_page(2, PageType::BTreeLeaf)?;
+        pinned.write()?.data_mut()[10] = 0xCD;
+        drop(pinned);
+        assert!(pool.flush_page(2)?);
+        assert!(!pool.flush_page(99)?);
+    }
+
+    let mut file = File::open(temp_file.path())?;
+    let page = read_page_from_file(&mut file, 2)?;
+    let page_type = page.header().page_type;
+    assert_eq!(page_type, PageType::BTreeLeaf);
+    assert_eq!(page.data()[10], 0xCD);
+    assert!(!page.header().is_dirty());
+    assert!(!page.header().is_pinned());
+
+    Ok(())
+}
+
+#[test]
+fn test_concurrent_readers() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    write_pages(temp_file.path(), 16, None)?;
+    let pool = Arc::new(BufferPool::open(temp_file.path(), config(8))?);
+
+    let handles: Vec<_> = (0..4)
+        .map(|t| {
+            let pool = Arc::clone(&pool);
+            std::thread::spawn(move || {
+                for round in 0..200u64 {
+                    let id = (round * 7 + t) % 16;
+                    let pinned = pool.fetch_page(id).unwrap();
+                    assert_eq!(pinned.read().data()[0], id as u8);
+                }
+            })
+        })
+        .collect();
+    for handle in handles {
+        handle.join().unwrap();
+    }
+
+    Ok(())
+}
+
+#[test]
+fn test_versioned_reads_see_changes_and_evictions() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    write_pages(temp_file.path(), 8, None)?;
+    // One frame, so fetching any other page evicts the one read
+    let pool = BufferPool::open(temp_file.path(), config(1))?;
+
+    let mut copy = Page::new();
+    // Not resident yet: loaded under a latch
+    let first = pool.read_versioned(3, &mut copy)?;
+    assert_eq!(copy.data()[0], 3);
+    assert_eq!(first.page_id(), 3);
+    // Resident: copied optimistically at the same version
+    let second = pool.read_versioned(3, &mut copy)?;
+    assert_eq!(second, first);
+    assert!(pool.is_unchanged(&first));
+
+    {
+        let pinned = pool.fetch_page(3)?;
+        let mut guard = pinned.write()?;
+        assert!(guard.is_unchanged_since(&first));
+        guard.data_mut()[0] = 42;
+    }
+    assert!(!pool.is_unchanged(&first));
+    let changed = pool.read_versioned(3, &mut copy)?;
+    assert_eq!(copy.data()[0], 42);
+    {
+        let pinned = pool.fetch_page(3)?;
+        assert!(!pinned.write()?.is_unchanged_since(&first));
+    }
+
+    // Evicting the page invalidates its version too
+    let latest = pool.read_versioned(3, &mut copy)?;
+    assert_ne!(latest, changed);
+    pool.fetch_page(4)?;
+    assert!(!pool.is_unchanged(&latest));
+    pool.read_versioned(3, &mut copy)?;
+    assert_eq!(copy.data()[0], 42);
+    Ok(())
+}
+
+#[test]
+fn test_latch_dirties_only_on_change() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    write_pages(temp_file.path(), 8, None)?;
+    let pool = BufferPool::open(temp_file.path(), config(4))?;
+
+    let mut copy = Page::new();
+    let version = pool.read_versioned(3, &mut copy)?;
+    {
+        let pinned = pool.fetch_page(3)?;
+        let guard = pinned.latch()?;
+        assert!(guard.is_unchanged_since(&version));
+        assert!(!guard.is_changed());
+    }
+    // Backing off after the check leaves the page clean and the copy current
+    assert!(pool.is_unchanged(&version));
+    assert_eq!(pool.dirty_pages(), 0);
+
+    {
+        let pinned = pool.fetch_page(3)?;
+        let mut guard = pinned.latch()?;
+        assert!(guard.is_unchanged_since(&version));
+        guard.data_mut()[0] = 42;
+        assert!(guard.is_changed());
+        assert!(guard.is_unchanged_since(&version));
+    }
+    assert!(!pool.is_unchanged(&version));
+    assert_eq!(pool.dirty_pages(), 1);
+    pool.read_versioned(3, &mut copy)?;
+    assert_eq!(copy.data()[0], 42);
+    Ok(())
+}
+
+#[test]
+fn test_unbuffered_writes_drop_clean_copies() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    write_pages(temp_file.path(), 8, None)?;
+    let pool = BufferPool::open(temp_file.path(), config(4))?;
+
+    let mut copy = Page::new();
+    let version = pool.read_versioned(2, &mut copy)?;
+    pool.fetch_page(3)?;
+    assert_eq!(pool.resident_pages(), 2);
+    let mut pages = vec![(2, filled_page(2, 0xA2)), (3, filled_page(3, 0xA3))];
+    pool.write_unbuffered(&mut pages)?;
+    assert_eq!(pool.resident_pages(), 0);
+    assert!(!pool.is_unchanged(&version));
+    pool.read_versioned(2, &mut copy)?;
+    assert_eq!(copy.data()[0], 0xA2);
+    assert_eq!(pool.fetch_page(3)?.read().data()[0], 0xA3);
+
+    // Pinned or dirty copies cannot be dropped; nothing is written
+    let mut pages = vec![(4, filled_page(4, 0xB4)), (2, filled_page(2, 0xB2))];
+    {
+        let pinned = pool.fetch_page(2)?;
+        assert!(pool.write_unbuffered(&mut pages).is_err());
+        pinned.write()?.data_mut()[1] = 7;
+    }
+    assert!(pool.write_unbuffered(&mut pages).is_err());
+    pool.flush_all()?;
+    pool.write_unbuffered(&mut pages)?;
+    assert_eq!(pool.fetch_page(2)?.read().data()[0], 0xB2);
+    assert_eq!(pool.fetch_page(4)?.read().data()[0], 0xB4);
+    Ok(())
+}
+
+#[test]
+fn test_prefetch_hints_do_not_load_pages() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    write_pages(temp_file.path(), 16, None)?;
+    let pool = BufferPool::open(temp_file.path(), config(4))?;
+    pool.fetch_page(2)?;
+
+    // Resident, duplicated and scattered pages in any order
+    pool.prefetch(&[9, 2, 3, 4, 4, 12, 5, 2])?;
+    pool.prefetch(&[])?;
+    assert_eq!(pool.resident_pages(), 1);
+    for page_id in [3, 9, 12] {
+        assert_eq!(pool.fetch_page(page_id)?.read().data()[0], page_id as u8);
+    }
+    Ok(())
+}
+
+#[test]
+fn test_concurrent_writers_under_eviction() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    write_pages(temp_file.path(), 32, None)?;
+    // Far fewer frames than pages, so most fetches write back a dirty victim
+    let pool = Arc::new(BufferPool::open(temp_file.path(), config(4))?);
+
+    let handles: Vec<_> = (0..4u64)
+        .map(|t| {
+            let pool = Arc::clone(&pool);
+            std::thread::spawn(move || {
+                for round in 1..=50u8 {
+                    // Each thread owns the pages congruent to it mod 4
+                    for id in (t..32).step_by(4) {
+                        let pinned = pool.fetch_page(id).unwrap();
+                        let mut page = pinned.write().unwrap();
+                        assert_eq!(page.data()[1], round - 1);
+                        page.data_mut()[1] = round;
+                    }
+                }
+            })
+        })
+        .collect();
+    for handle in handles {
+        handle.join().unwrap();
+    }
+
+    pool.flush_all()?;
+    for id in 0..32 {
+        let pinned = pool.fetch_page(id)?;
+        let page = pinned.read();
+        assert_eq!((page.data()[0], page.data()[1]), (id as u8, 50));
+    }
+    Ok(())
+}
+
+#[test]
+fn test_pool_follows_file_header() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let header = FileHeader {
+        checksum_algorithm: ChecksumAlgorithm::Xxh3,
+        ..FileHeader::default()
+    };
+    let file = PageFile::create_database(temp_file.path(), &header)?;
+    let mut page = make_page(1);
+    page.calculate_checksum_with(ChecksumAlgorithm::Xxh3)?;
+    file.write_page(1, &page)?;
+    drop(file);
+
+    // The configured algorithm is the default; the header's wins
+    let pool = BufferPool::open(temp_file.path(), config(4))?;
+    assert_eq!(pool.fetch_page(1)?.read().data()[0], 1);
+    drop(pool.new_page(2, PageType::Data)?);
+    pool.flush_all()?;
+    drop(pool);
+    let (file, _) = PageFile::open_database(temp_file.path())?;
+    assert_eq!(file.read_page(2)?.header().page_type, PageType::Data);
+    Ok(())
+}
+
+#[test]
+fn test_pool_opens_bare_file_starting_with_default_page() -> Result<(), Box<dyn std::error::Error>>
+{
+    let temp_file = NamedTempFile::new()?;
+    // A default page has the header page type but no file magic
+    let mut page = Page::new();
+    page.calculate_checksum()?;
+    let mut file = File::create(temp_file.path())?;
+    write_page_to_file(&mut file, 0, &page)?;
+    write_page_to_file(&mut file, 1, &make_page(1))?;
+    drop(file);
+
+    let pool = BufferPool::open(temp_file.path(), config(4))?;
+    assert_eq!(pool.fetch_page(1)?.read().data()[0], 1);
+    let file = PageFile::open(temp_file.path())?.with_preallocation(16 * PAGE_SIZE as u64)?;
+    assert_eq!(file.page_count()?, 2);
+    Ok(())
+}
+
+#[test]
+fn test_pool_rejects_other_page_sizes() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let header = FileHeader {
+        page_size: 16 * 1024,
+        ..FileHeader::default()
+    };
+    drop(PageFile::create_database(temp_file.path(), &header)?);
+    assert!(matches!(
+        BufferPool::open(temp_file.path(), config(4)),
+        Err(lumen::Error::InvalidInput(_))
+    ));
+    Ok(())
+}
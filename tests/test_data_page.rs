@@ -0,0 +1,191 @@
+//! Tests for the slotted data page layout
+
+use lumen::common::error::Error;
+use lumen::storage::data_page::{DataPage, DataPageRef, SlotId, DATA_PAGE_HEADER_SIZE, SLOT_SIZE};
+use lumen::storage::page::{Page, Page16K};
+use lumen::storage::page_constants::PAGE_USABLE_SIZE;
+use lumen::storage::page_type::PageType;
+
+#[test]
+fn test_insert_and_read_back() {
+    let mut page = Page::new();
+    let mut view = DataPage::init(&mut page);
+    let tuples: Vec<Vec<u8>> = (0..20u8).map(|i| vec![i; usize::from(i) + 1]).collect();
+    let slots: Vec<SlotId> = tuples.iter().map(|t| view.insert(t).unwrap()).collect();
+    assert_eq!(slots, (0..20).collect::<Vec<_>>());
+    for (slot, tuple) in slots.iter().zip(&tuples) {
+        assert_eq!(view.get(*slot).unwrap(), tuple.as_slice());
+    }
+    assert!(view.get(20).is_none());
+
+    let reader = DataPageRef::new(page.data()).unwrap();
+    assert_eq!(reader.iter().count(), 20);
+    assert_eq!(reader.get(7).unwrap(), tuples[7].as_slice());
+}
+
+#[test]
+fn test_fill_page_exactly() {
+    let mut page = Page::new();
+    let mut view = DataPage::init(&mut page);
+    let tuple_len = PAGE_USABLE_SIZE - DATA_PAGE_HEADER_SIZE - SLOT_SIZE;
+    assert!(view.insert(&vec![1; tuple_len + 1]).is_none());
+    assert_eq!(view.insert(&vec![1; tuple_len]), Some(0));
+    assert_eq!(view.free_space(), 0);
+    assert!(view.insert(&[]).is_none());
+}
+
+#[test]
+fn test_delete_leaves_tombstone() {
+    let mut page = Page::new();
+    let mut view = DataPage::init(&mut page);
+    let a = view.insert(b"alpha").unwrap();
+    let b = view.insert(b"beta").unwrap();
+    view.delete(a).unwrap();
+    assert!(view.get(a).is_none());
+    assert_eq!(view.get(b).unwrap(), b"beta");
+    assert_eq!(view.slot_count(), 2);
+    assert!(matches!(view.delete(a), Err(Error::NotFound(_))));
+    assert!(matches!(view.delete(9), Err(Error::NotFound(_))));
+    assert_eq!(view.insert(b"gamma"), Some(a));
+}
+
+#[test]
+fn test_insert_compacts_when_only_fragmented_space_fits() {
+    let mut page = Page::new();
+    let mut view = DataPage::init(&mut page);
+    let slots: Vec<SlotId> = (0..8u8).map(|b| view.insert(&[b; 500]).unwrap()).collect();
+    // Two scattered holes, each below the compaction threshold on its own
+    view.delete(slots[2]).unwrap();
+    view.delete(slots[5]).unwrap();
+    assert_eq!(view.fragmented_bytes(), 1000);
+    assert!(view.contiguous_free() < 900);
+
+    let slot = view.insert(&[0xEE; 900]).unwrap();
+    assert_eq!(view.fragmented_bytes(), 0);
+    assert_eq!(view.get(slot).unwrap(), &[0xEE; 900][..]);
+    for &kept in &[0, 1, 3, 4, 6, 7] {
+        assert_eq!(view.get(slots[kept]).unwrap(), &[kept as u8; 500][..]);
+    }
+}
+
+#[test]
+fn test_deletes_past_threshold_compact() {
+    let mut page = Page::new();
+    let mut view = DataPage::init(&mut page);
+    let slots: Vec<SlotId> = (0..30u8).map(|b| view.insert(&[b; 100]).unwrap()).collect();
+    for &slot in slots.iter().step_by(2) {
+        view.delete(slot).unwrap();
+        assert!(view.fragmented_bytes() <= PAGE_USABLE_SIZE / 4);
+    }
+    for &slot in slots.iter().skip(1).step_by(2) {
+        assert_eq!(view.get(slot).unwrap(), &[slot as u8; 100][..]);
+    }
+}
+
+#[test]
+fn test_update_in_place_and_relocate() {
+    let mut page = Page::new();
+    let mut view = DataPage::init(&mut page);
+    let slot = view.insert(b"hello world").unwrap();
+    let other = view.insert(b"neighbour").unwrap();
+
+    assert!(view.update(slot, b"hi").unwrap());
+    assert_eq!(view.get(slot).unwrap(), b"hi");
+    assert_eq!(view.fragmented_bytes(), 9);
+
+    assert!(view.update(slot, &[7; 300]).unwrap());
+    assert_eq!(view.get(slot).unwrap(), &[7; 300][..]);
+    assert_eq!(view.get(other).unwrap(), b"neighbour");
+
+    let free = view.free_space();
+    assert!(!view.update(slot, &vec![0; free + 301]).unwrap());
+    assert_eq!(view.get(slot).unwrap(), &[7; 300][..]);
+    assert!(view.update(slot, &vec![9; free + 300]).unwrap());
+    assert_eq!(view.free_space(), 0);
+    assert!(matches!(view.update(5, b"x"), Err(Error::NotFound(_))));
+}
+
+#[test]
+fn test_open_validates_page() {
+    let mut page = Page::new();
+    page.header_mut().page_type = PageType::BTreeLeaf;
+    assert!(matches!(
+        DataPage::open(&mut page),
+        Err(Error::InvalidPageType(_))
+    ));
+
+    let mut view = DataPage::init(&mut page);
+    view.insert(b"row").unwrap();
+    assert_eq!(DataPage::open(&mut page).unwrap().get(0).unwrap(), b"row");
+
+    // Free-slot chain starting past the last slot
+    page.data_mut()[6..8].copy_from_slice(&2u16.to_le_bytes());
+    assert!(matches!(
+        DataPage::open(&mut page),
+        Err(Error::Corruption(_))
+    ));
+    page.data_mut()[6..8].copy_from_slice(&0u16.to_le_bytes());
+
+    // More fragmented bytes than the tuple area holds
+    page.data_mut()[4..6].copy_from_slice(&4u16.to_le_bytes());
+    assert!(matches!(
+        DataPage::open(&mut page),
+        Err(Error::Corruption(_))
+    ));
+    page.data_mut()[4..6].copy_from_slice(&0u16.to_le_bytes());
+
+    // Slot count running into the tuple area
+    page.data_mut()[0..2].copy_from_slice(&2000u16.to_le_bytes());
+    assert!(matches!(
+        DataPage::open(&mut page),
+        Err(Error::Corruption(_))
+    ));
+}
+
+#[test]
+fn test_open_checks_free_chain_and_byte_counts() {
+    let corrupt = |page: &mut Page| matches!(DataPage::open(page), Err(Error::Corruption(_)));
+    let mut page = Page::new();
+    let mut view = DataPage::init(&mut page);
+    for byte in 0..3u8 {
+        view.insert(&[byte; 10]).unwrap();
+    }
+    view.delete(1).unwrap();
+    assert!(!corrupt(&mut page));
+    let slot = |slot: usize| DATA_PAGE_HEADER_SIZE + slot * SLOT_SIZE;
+
+    // Free-slot head at a live slot
+    page.data_mut()[6..8].copy_from_slice(&1u16.to_le_bytes());
+    assert!(corrupt(&mut page));
+    page.data_mut()[6..8].copy_from_slice(&2u16.to_le_bytes());
+
+    // Tombstone linking to a live slot, then to itself
+    let link = slot(1) + 2;
+    page.data_mut()[link..link + 2].copy_from_slice(&3u16.to_le_bytes());
+    assert!(corrupt(&mut page));
+    page.data_mut()[link..link + 2].copy_from_slice(&2u16.to_le_bytes());
+    assert!(corrupt(&mut page));
+    page.data_mut()[link..link + 2].copy_from_slice(&0u16.to_le_bytes());
+    assert!(!corrupt(&mut page));
+
+    // Fragmented bytes that do not add up with the live tuples
+    page.data_mut()[4..6].copy_from_slice(&11u16.to_le_bytes());
+    assert!(corrupt(&mut page));
+    page.data_mut()[4..6].copy_from_slice(&9u16.to_le_bytes());
+    assert!(corrupt(&mut page));
+    page.data_mut()[4..6].copy_from_slice(&10u16.to_le_bytes());
+    assert!(!corrupt(&mut page));
+}
+
+#[test]
+fn test_large_page_sizes() {
+    let mut page = Page16K::new();
+    let mut view = DataPage::init(&mut page);
+    let slot = view.insert(&[3; 12_000]).unwrap();
+    assert_eq!(view.get(slot).unwrap().len(), 12_000);
+    let free_space = page.header().free_space;
+    assert_eq!(
+        usize::from(free_space),
+        Page16K::USABLE_SIZE as usize - DATA_PAGE_HEADER_SIZE - SLOT_SIZE - 12_000
+    );
+}
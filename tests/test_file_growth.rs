@@ -0,0 +1,162 @@
+//! Tests for chunked file preallocation and compaction
+
+use lumen::storage::file_growth::{punch_hole, FileGrowth};
+use lumen::storage::file_header::FileHeader;
+use lumen::storage::page::Page;
+use lumen::storage::page_allocator::{PageAllocator, EXTENT_PAGES};
+use lumen::storage::page_constants::{MAX_PAGE_ID, PAGE_SIZE};
+use lumen::storage::page_file::PageFile;
+use tempfile::NamedTempFile;
+
+const CHUNK_PAGES: u64 = 16;
+
+#[test]
+fn test_page_file_grows_in_chunks() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let file =
+        PageFile::open(temp_file.path())?.with_preallocation(CHUNK_PAGES * PAGE_SIZE as u64)?;
+
+    let mut page = Page::new();
+    page.calculate_checksum()?;
+    file.write_page(3, &page)?;
+    let growth = file.growth().unwrap();
+    assert_eq!(growth.high_water(), 4);
+    assert_eq!(growth.physical_pages(), CHUNK_PAGES);
+    assert_eq!(file.page_count()?, 4);
+
+    file.write_pages(&[(20, &page), (21, &page)])?;
+    assert_eq!(growth.high_water(), 22);
+    assert_eq!(growth.physical_pages(), 2 * CHUNK_PAGES);
+    assert_eq!(file.page_count()?, 22);
+
+    // Preallocated pages read back as zeros
+    let mut unwritten = Page::new();
+    file.read_page_unverified(25, &mut unwritten)?;
+    assert!(unwritten.raw().iter().all(|&byte| byte == 0));
+    file.read_page(21)?;
+
+    // Out-of-range pages are rejected before anything is preallocated
+    assert!(file.write_page(u64::MAX, &page).is_err());
+    assert!(file
+        .write_pages(&[(1, &page), (MAX_PAGE_ID + 1, &page)])
+        .is_err());
+    assert_eq!(growth.high_water(), 22);
+    assert_eq!(growth.physical_pages(), 2 * CHUNK_PAGES);
+    Ok(())
+}
+
+#[test]
+fn test_high_water_is_independent_of_physical_size() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    temp_file
+        .as_file()
+        .set_len(CHUNK_PAGES * PAGE_SIZE as u64)?;
+    let growth = FileGrowth::new(
+        temp_file.as_file(),
+        PAGE_SIZE,
+        CHUNK_PAGES * PAGE_SIZE as u64,
+    )?
+    .with_high_water(5);
+    assert_eq!(growth.high_water(), 5);
+    assert_eq!(growth.physical_pages(), CHUNK_PAGES);
+
+    growth.reserve(temp_file.as_file(), 9)?;
+    assert_eq!(growth.high_water(), 9);
+    assert_eq!(growth.physical_pages(), CHUNK_PAGES);
+    Ok(())
+}
+
+#[test]
+fn test_reopen_leaves_out_preallocated_tail() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let mut header = FileHeader::default();
+    let chunk = CHUNK_PAGES * PAGE_SIZE as u64;
+    let file = PageFile::create_database(temp_file.path(), &header)?.with_preallocation(chunk)?;
+    let mut page = Page::new();
+    page.calculate_checksum()?;
+    for page_id in 1..6 {
+        file.write_page(page_id, &page)?;
+    }
+    assert_eq!(file.growth().unwrap().physical_pages(), CHUNK_PAGES);
+    drop(file);
+
+    // No saved page count: the logical end follows the last written page
+    let reopen = || -> Result<(PageFile, FileHeader), Box<dyn std::error::Error>> {
+        let (file, header) = PageFile::open_database(temp_file.path())?;
+        Ok((file.with_preallocation(chunk)?, header))
+    };
+    let (file, loaded) = reopen()?;
+    assert_eq!(file.page_count()?, 6);
+    let allocator = PageAllocator::load(&file, &loaded)?;
+    assert_eq!(allocator.allocated_pages(), 6);
+
+    // A saved count is used, extended over pages written after the save
+    allocator.save(&file, &mut header)?;
+    file.write_page(8, &page)?;
+    drop(file);
+    let (file, loaded) = reopen()?;
+    assert_eq!(loaded.allocated_pages, 6);
+    assert_eq!(file.page_count()?, 9);
+    Ok(())
+}
+
+#[test]
+fn test_compact_truncates_free_tail() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let mut header = FileHeader::default();
+    let file = PageFile::create_database(temp_file.path(), &header)?
+        .with_preallocation(4 * EXTENT_PAGES * PAGE_SIZE as u64)?;
+
+    let allocator = PageAllocator::new();
+    let first = allocator.allocate_extent()?;
+    let second = allocator.allocate_extent()?;
+    let mut page = Page::new();
+    page.calculate_checksum()?;
+    for page_id in first.pages().chain(second.pages()) {
+        file.write_page(page_id, &page)?;
+    }
+    allocator.free_extent(second)?;
+
+    let growth = file.growth().unwrap();
+    let physical = growth.physical_pages();
+    let stats = growth.compact(&file, &allocator, &mut header)?;
+    assert_eq!(allocator.allocated_pages(), first.start + first.len);
+    assert_eq!(growth.physical_pages(), allocator.allocated_pages());
+    assert_eq!(growth.high_water(), allocator.allocated_pages());
+    assert_eq!(
+        stats.truncated_pages,
+        physical - allocator.allocated_pages()
+    );
+    assert_eq!(file.page_count()?, allocator.allocated_pages());
+
+    // The header was updated before the file was cut, and the shorter
+    // range survives a reload
+    assert_eq!(header.allocated_pages, allocator.allocated_pages());
+    drop(file);
+    let (file, header) = PageFile::open_database(temp_file.path())?;
+    let file = file.with_preallocation(4 * EXTENT_PAGES * PAGE_SIZE as u64)?;
+    assert_eq!(file.page_count()?, header.allocated_pages);
+    let loaded = PageAllocator::load(&file, &header)?;
+    assert_eq!(loaded.allocated_pages(), allocator.allocated_pages());
+    Ok(())
+}
+
+#[test]
+fn test_punched_hole_reads_as_zeros() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let file = PageFile::open(temp_file.path())?;
+    let mut page = Page::new();
+    page.raw_mut().fill(0xAB);
+    for page_id in 0..4 {
+        file.write_page(page_id, &page)?;
+    }
+
+    if punch_hole(file.file(), PAGE_SIZE as u64, 2 * PAGE_SIZE as u64)? {
+        file.read_page_unverified(1, &mut page)?;
+        assert!(page.raw().iter().all(|&byte| byte == 0));
+        file.read_page_unverified(3, &mut page)?;
+        assert!(page.raw().iter().all(|&byte| byte == 0xAB));
+    }
+    assert_eq!(file.page_count()?, 4);
+    Ok(())
+}
@@ -0,0 +1,85 @@
+//! Tests for the database file header and checksum algorithm selection
+
+use lumen::storage::buffer_pool::{BufferPool, BufferPoolConfig};
+use lumen::storage::checksum::ChecksumAlgorithm;
+use lumen::storage::file_header::{FileHeader, HEADER_PAGE_ID};
+use lumen::storage::page::{Page, Page16K};
+use lumen::storage::page_file::PageFile;
+use lumen::storage::page_type::PageType;
+use tempfile::tempdir;
+
+#[test]
+fn test_file_header_persists_algorithm() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_dir = tempdir()?;
+    let path = temp_dir.path().join("crc32c.db");
+
+    let header = FileHeader::new(ChecksumAlgorithm::Crc32c);
+    drop(PageFile::create_database(&path, &header)?);
+
+    let (page_file, read_header) = PageFile::open_database(&path)?;
+    assert_eq!(read_header.checksum_algorithm, ChecksumAlgorithm::Crc32c);
+    assert_eq!(page_file.checksum_algorithm(), ChecksumAlgorithm::Crc32c);
+
+    // The header page itself always verifies with the default algorithm
+    let header_page = PageFile::open(&path)?.read_page(HEADER_PAGE_ID)?;
+    assert_eq!(header_page.header().page_type, PageType::Header);
+    Ok(())
+}
+
+#[test]
+fn test_buffer_pool_uses_configured_algorithm() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_dir = tempdir()?;
+    let path = temp_dir.path().join("xxh3.db");
+    let header = FileHeader::new(ChecksumAlgorithm::Xxh3);
+    drop(PageFile::create_database(&path, &header)?);
+
+    let config = BufferPoolConfig {
+        checksum: header.checksum_algorithm,
+        ..Default::default()
+    };
+    {
+        let pool = BufferPool::open(&path, config)?;
+        let pinned = pool.new_page(1, PageType::Data)?;
+        pinned.write()?.data_mut()[0] = 0x5C;
+        drop(pinned);
+        pool.flush_all()?;
+    }
+
+    let (page_file, _) = PageFile::open_database(&path)?;
+    let page = page_file.read_page(1)?;
+    assert!(page.verify_checksum_with(ChecksumAlgorithm::Xxh3));
+    assert!(!page.verify_checksum());
+    assert_eq!(page.data()[0], 0x5C);
+
+    let pool = BufferPool::open(&path, config)?;
+    assert_eq!(pool.fetch_page(1)?.read().data()[0], 0x5C);
+    Ok(())
+}
+
+#[test]
+fn test_file_header_persists_page_size() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_dir = tempdir()?;
+    let path = temp_dir.path().join("large_pages.db");
+
+    let header = FileHeader::new(ChecksumAlgorithm::Xxh3).with_page_size(16384);
+    let page_file = PageFile::create_database(&path, &header)?;
+    assert_eq!(page_file.page_size(), 16384);
+
+    let mut page = Page16K::new();
+    page.header_mut().page_type = PageType::Data;
+    page.data_mut()[10_000] = 0x77;
+    page.calculate_checksum_with(ChecksumAlgorithm::Xxh3)?;
+    page_file.write_page(2, &page)?;
+    assert!(page_file.write_page(3, &Page::new()).is_err());
+    drop(page_file);
+    assert_eq!(std::fs::metadata(&path)?.len(), 3 * 16384);
+
+    let (page_file, read_header) = PageFile::open_database(&path)?;
+    assert_eq!(read_header.page_size, 16384);
+    assert_eq!(page_file.page_count()?, 3);
+    let mut read_back = Page16K::new();
+    page_file.read_page_into(2, &mut read_back)?;
+    assert_eq!(read_back.data()[10_000], 0x77);
+    assert!(page_file.read_page(2).is_err());
+    Ok(())
+}
@@ -0,0 +1,159 @@
+//! Tests for the persisted free-space map
+
+use lumen::common::error::Error;
+use lumen::storage::data_page::DataPage;
+use lumen::storage::file_header::FileHeader;
+use lumen::storage::free_space_map::{FreeSpaceMap, SPACE_MAP_PAGES_PER_PAGE};
+use lumen::storage::page::Page;
+use lumen::storage::page_allocator::PageAllocator;
+use lumen::storage::page_file::PageFile;
+use std::fs::File;
+use tempfile::NamedTempFile;
+
+#[test]
+fn test_inserts_find_pages_with_room() -> Result<(), Box<dyn std::error::Error>> {
+    let map = FreeSpaceMap::new(4096)?;
+    let allocator = PageAllocator::new();
+    let row = [7u8; 300];
+
+    // Fill pages through the map the way a table heap would
+    let mut pages: Vec<(u64, Page)> = Vec::new();
+    for _ in 0..100 {
+        let index = match map.find(row.len() + 4) {
+            Some(page_id) => pages.iter().position(|(id, _)| *id == page_id).unwrap(),
+            None => {
+                let page_id = allocator.allocate_page()?;
+                let mut page = Page::new();
+                DataPage::init(&mut page);
+                pages.push((page_id, page));
+                pages.len() - 1
+            }
+        };
+        let (page_id, page) = &mut pages[index];
+        let mut view = DataPage::open(page)?;
+        assert!(view.insert(&row).is_some());
+        map.update(*page_id, view.free_space());
+    }
+    // 13 rows fit per 4 KiB page; the map wastes at most a row per page
+    assert!(pages.len() <= 100usize.div_ceil(12));
+
+    let (page_id, page) = &mut pages[3];
+    DataPage::open(page)?.delete(0)?;
+    map.update(*page_id, DataPage::open(page)?.free_space());
+    assert_eq!(map.find(row.len() + 4), Some(*page_id));
+
+    map.remove(*page_id);
+    assert_ne!(map.find(row.len() + 4), Some(*page_id));
+    assert_eq!(map.find(4096), None);
+    Ok(())
+}
+
+#[test]
+fn test_map_persists_across_reopen() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let file = PageFile::create_database(temp.path(), &FileHeader::default())?;
+    let mut header = FileHeader::read(&file)?;
+    let allocator = PageAllocator::new();
+    let map = FreeSpaceMap::new(4096)?;
+
+    let far = SPACE_MAP_PAGES_PER_PAGE as u64 + 40;
+    for _ in 0..far + 1 {
+        allocator.allocate_page()?;
+    }
+    map.update(5, 1000);
+    map.update(far, 3000);
+    map.save(&file, &allocator, &mut header)?;
+    allocator.save(&file, &mut header)?;
+
+    let header = FileHeader::read(&file)?;
+    let allocator = PageAllocator::load(&file, &header)?;
+    let loaded = FreeSpaceMap::load(&file, &header, &allocator)?;
+    assert_eq!(loaded.free_space(5), map.free_space(5));
+    assert_eq!(loaded.find(2000), Some(far));
+    assert_eq!(loaded.find(500), Some(5));
+
+    // Saving again releases the previous chain
+    let mut header = header;
+    let old_root = header.space_map_root;
+    loaded.save(&file, &allocator, &mut header)?;
+    assert_ne!(header.space_map_root, old_root);
+    assert!(allocator.is_free(old_root));
+    Ok(())
+}
+
+#[test]
+fn test_stale_map_is_discarded() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let file = PageFile::create_database(temp.path(), &FileHeader::default())?;
+    let mut header = FileHeader::read(&file)?;
+    let allocator = PageAllocator::new();
+    allocator.save(&file, &mut header)?;
+
+    // Map saved, then a crash before the allocator state caught up
+    let map = FreeSpaceMap::new(4096)?;
+    map.update(1, 2000);
+    map.save(&file, &PageAllocator::load(&file, &header)?, &mut header)?;
+
+    let header = FileHeader::read(&file)?;
+    let allocator = PageAllocator::load(&file, &header)?;
+    let loaded = FreeSpaceMap::load(&file, &header, &allocator)?;
+    assert_eq!(loaded.find(1), None);
+    Ok(())
+}
+
+#[test]
+fn test_rejects_bad_page_size() {
+    assert!(matches!(
+        FreeSpaceMap::new(5000),
+        Err(Error::InvalidInput(_))
+    ));
+}
+
+#[test]
+fn test_failed_save_frees_new_chain() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let mut header = FileHeader::default();
+    drop(PageFile::create_database(temp.path(), &header)?);
+    // Read-only, so writing the chain fails after its pages are allocated
+    let file = PageFile::from_file(File::open(temp.path())?);
+    let allocator = PageAllocator::new();
+    let map = FreeSpaceMap::new(4096)?;
+    let far = SPACE_MAP_PAGES_PER_PAGE as u64 + 40;
+    for _ in 0..far + 1 {
+        allocator.allocate_page()?;
+    }
+    map.update(far, 3000);
+    let allocated = allocator.allocated_pages();
+
+    assert!(map.save(&file, &allocator, &mut header).is_err());
+    assert_eq!(header.space_map_root, FileHeader::default().space_map_root);
+    // The two chain pages it allocated are back on the free list
+    assert_eq!(allocator.free_pages(), 2);
+    assert!(allocator.is_free(allocated) && allocator.is_free(allocated + 1));
+    Ok(())
+}
+
+#[test]
+fn test_chain_needs_4k_pages() -> Result<(), Box<dyn std::error::Error>> {
+    let temp = NamedTempFile::new()?;
+    let mut header = FileHeader {
+        page_size: 8192,
+        ..FileHeader::default()
+    };
+    let file = PageFile::create_database(temp.path(), &header)?;
+    let allocator = PageAllocator::new();
+    let map = FreeSpaceMap::new(header.page_size)?;
+    map.update(1, 4000);
+
+    // Refused before any chain page is taken from the allocator
+    assert!(matches!(
+        map.save(&file, &allocator, &mut header),
+        Err(Error::InvalidInput(_))
+    ));
+    assert_eq!(allocator.allocated_pages(), 1);
+    assert!(matches!(
+        FreeSpaceMap::load(&file, &header, &allocator),
+        Err(Error::InvalidInput(_))
+    ));
+    Ok(())
+}
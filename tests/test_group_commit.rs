@@ -0,0 +1,101 @@
+//! Tests for group commit durability batching
+
+mod common;
+
+use common::filled_page;
+use lumen::storage::group_commit::{CommitTicket, GroupCommit};
+use lumen::storage::page::Page;
+use lumen::storage::page_constants::PageId;
+use tempfile::NamedTempFile;
+
+#[test]
+fn test_group_commit_concurrent_writers() -> Result<(), Box<dyn std::error::Error>> {
+    const THREADS: u64 = 8;
+    const COMMITS_PER_THREAD: u64 = 25;
+
+    let temp_file = NamedTempFile::new()?;
+    let commit = GroupCommit::open(temp_file.path())?;
+
+    std::thread::scope(|scope| {
+        for t in 0..THREADS {
+            let commit = &commit;
+            scope.spawn(move || {
+                for i in 0..COMMITS_PER_THREAD {
+                    let page_id = t * COMMITS_PER_THREAD + i;
+                    commit
+                        .commit_page(page_id, &filled_page(page_id, t as u8))
+                        .unwrap();
+                }
+            });
+        }
+    });
+
+    // Never more than one flush per commit, usually far fewer
+    assert!(commit.sync_count() <= (THREADS * COMMITS_PER_THREAD));
+    assert_eq!(
+        commit.durable_ticket().sequence(),
+        (THREADS * COMMITS_PER_THREAD)
+    );
+
+    for page_id in 0..THREADS * COMMITS_PER_THREAD {
+        let page = commit.file().read_page(page_id)?;
+        assert_eq!(page.data()[0], (page_id / COMMITS_PER_THREAD) as u8);
+    }
+    Ok(())
+}
+
+#[test]
+fn test_group_commit_batch_ticket() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let commit = GroupCommit::open(temp_file.path())?;
+
+    let pages: Vec<Page> = (0..4).map(|id| filled_page(id, 0xAB)).collect();
+    let batch: Vec<(PageId, &Page)> = (0..4).zip(pages.iter()).collect();
+    let ticket = commit.write_pages(&batch)?;
+    assert!(commit.durable_ticket() < ticket);
+
+    commit.wait(ticket)?;
+    assert_eq!(commit.durable_ticket(), ticket);
+    assert_eq!(commit.sync_count(), 1);
+    assert_eq!(commit.file().read_page(3)?.data()[10], 0xAB);
+    Ok(())
+}
+
+#[test]
+fn test_one_flush_covers_queued_tickets() -> Result<(), Box<dyn std::error::Error>> {
+    const WRITERS: u64 = 6;
+
+    let temp_file = NamedTempFile::new()?;
+    let commit = GroupCommit::open(temp_file.path())?;
+
+    // Every ticket is issued before anyone waits, so the first flush covers all
+    let tickets = std::thread::scope(|scope| {
+        let handles: Vec<_> = (0..WRITERS)
+            .map(|page_id| {
+                let commit = &commit;
+                scope.spawn(move || commit.write_page(page_id, &filled_page(page_id, 0x5A)))
+            })
+            .collect();
+        handles
+            .into_iter()
+            .map(|h| h.join().unwrap())
+            .collect::<Result<Vec<CommitTicket>, _>>()
+    })?;
+    assert_eq!(commit.sync_count(), 0);
+    assert!(tickets
+        .iter()
+        .all(|&ticket| commit.durable_ticket() < ticket));
+
+    std::thread::scope(|scope| {
+        for &ticket in &tickets {
+            let commit = &commit;
+            scope.spawn(move || commit.wait(ticket).unwrap());
+        }
+    });
+    assert_eq!(commit.sync_count(), 1);
+    assert_eq!(commit.durable_ticket().sequence(), WRITERS);
+    for page_id in 0..WRITERS {
+        assert_eq!(commit.file().read_page(page_id)?.data()[0], 0x5A);
+    }
+    Ok(())
+}
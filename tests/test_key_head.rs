@@ -0,0 +1,66 @@
+//! Tests for fixed-width key heads
+
+use lumen::index::key_head::{
+    count_below, count_below_scalar, encode_head, equal_range, head_at, key_head, HEAD_SIZE,
+};
+
+#[test]
+fn test_heads_order_like_keys() {
+    let keys: [&[u8]; 9] = [
+        b"",
+        b"\0",
+        b"a",
+        b"a\0",
+        b"ab",
+        b"abcd",
+        b"abcde",
+        b"abce",
+        b"\xff\xff\xff\xff\xff",
+    ];
+    for pair in keys.windows(2) {
+        assert!(pair[0] < pair[1]);
+        assert!(key_head(pair[0]) <= key_head(pair[1]));
+    }
+    // Padding and bytes past the head tie; the full key decides
+    assert_eq!(key_head(b"a"), key_head(b"a\0"));
+    assert_eq!(key_head(b"abcd"), key_head(b"abcde"));
+    assert_eq!(key_head(b"abce"), 0x6162_6365);
+}
+
+#[test]
+fn test_equal_range_brackets_key() {
+    let mut keys: Vec<Vec<u8>> = (0..1000u32)
+        .map(|i| format!("{:x}", i.wrapping_mul(2_654_435_761) % 5000).into_bytes())
+        .collect();
+    keys.sort();
+    keys.dedup();
+    let heads: Vec<u8> = keys
+        .iter()
+        .flat_map(|key| encode_head(key_head(key)))
+        .collect();
+    for (index, key) in keys.iter().enumerate() {
+        let (low, high) = equal_range(&heads, key_head(key));
+        assert!(low <= index && index < high);
+        assert!(keys[low..high]
+            .iter()
+            .all(|other| key_head(other) == key_head(key)));
+        assert_eq!(head_at(&heads, index), key_head(key));
+    }
+    assert_eq!(equal_range(&heads, 0), (0, 0));
+}
+
+#[test]
+fn test_count_below_handles_any_length() {
+    let heads: Vec<u8> = (0..67u32)
+        .flat_map(|i| encode_head(i.wrapping_mul(0x8765_4321)))
+        .collect();
+    for end in 0..=heads.len() / HEAD_SIZE {
+        for target in [0, 0x4000_0000, 0x8000_0000, 0xC000_0001, u32::MAX] {
+            let window = &heads[..end * HEAD_SIZE];
+            assert_eq!(
+                count_below(window, target),
+                count_below_scalar(window, target)
+            );
+        }
+    }
+}
@@ -0,0 +1,80 @@
+//! Tests for the long-lived memory-mapped file
+
+use lumen::storage::mapped_file::*;
+use lumen::storage::page::Page;
+use lumen::storage::page_constants::PAGE_SIZE;
+use lumen::storage::page_io::*;
+use lumen::storage::page_type::PageType;
+use std::fs::File;
+use tempfile::NamedTempFile;
+
+fn config() -> MappedFileConfig {
+    MappedFileConfig {
+        growth_chunk: 16 * PAGE_SIZE as u64,
+        ..Default::default()
+    }
+}
+
+#[test]
+fn test_mapped_file_reads_existing_pages() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    {
+        let mut file = File::create(temp_file.path())?;
+        for i in 0..4u64 {
+            let mut page = Page::new();
+            page.header_mut().page_type = PageType::BTreeLeaf;
+            page.header_mut().set_page_id(i);
+            page.calculate_checksum()?;
+            write_page_to_file(&mut file, i, &page)?;
+        }
+    }
+
+    let mapped = MappedFile::open(temp_file.path(), config())?;
+    assert_eq!(mapped.page_capacity(), 4);
+    for i in 0..4u64 {
+        let page = mapped.read_page(i)?;
+        let page_id = page.header().page_id;
+        assert_eq!(u64::from(page_id), i);
+    }
+
+    Ok(())
+}
+
+#[test]
+fn test_mapped_file_persists_writes() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    {
+        let mapped = MappedFile::open(temp_file.path(), config())?;
+        let mut page = Page::new();
+        page.header_mut().page_type = PageType::Data;
+        page.header_mut().page_id = 20;
+        page.data_mut()[7] = 0x70;
+        page.calculate_checksum()?;
+        mapped.write_page(20, &page)?;
+        mapped.flush()?;
+        assert_eq!(mapped.page_capacity(), 32);
+    }
+
+    let mut file = File::open(temp_file.path())?;
+    let page = read_page_from_file(&mut file, 20)?;
+    assert_eq!(page.data()[7], 0x70);
+
+    Ok(())
+}
+
+#[test]
+fn test_mapped_file_detects_corruption() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let mapped = MappedFile::open(temp_file.path(), config())?;
+
+    let mut page = Page::new();
+    page.calculate_checksum()?;
+    page.data_mut()[0] = 0xFF; // Modify after checksumming
+    mapped.write_page(1, &page)?;
+
+    let result = mapped.read_page(1);
+    assert!(matches!(result, Err(lumen::Error::Corruption(_))));
+    mapped.advise(0, 2, AccessPattern::Sequential)?;
+
+    Ok(())
+}
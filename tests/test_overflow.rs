@@ -0,0 +1,124 @@
+//! Tests for streaming overflow values
+
+use lumen::common::error::Error;
+use lumen::storage::file_header::FileHeader;
+use lumen::storage::overflow::{
+    free_value, OverflowReader, OverflowValue, OverflowWriter, OVERFLOW_DATA_SIZE,
+};
+use lumen::storage::page_allocator::{PageAllocator, EXTENT_PAGES};
+use lumen::storage::page_file::PageFile;
+use std::io::{Read, Write};
+use tempfile::NamedTempFile;
+
+fn setup() -> Result<(NamedTempFile, PageFile), Error> {
+    let temp = NamedTempFile::new()?;
+    let file = PageFile::create_database(temp.path(), &FileHeader::default())?;
+    Ok((temp, file))
+}
+
+fn pattern(len: usize) -> Vec<u8> {
+    (0..len).map(|i| (i * 31 % 251) as u8).collect()
+}
+
+#[test]
+fn test_multi_extent_value_streams_back() -> Result<(), Box<dyn std::error::Error>> {
+    let (_temp, file) = setup()?;
+    let allocator = PageAllocator::new();
+    // Spans three extents and ends mid-page
+    let expected = pattern(OVERFLOW_DATA_SIZE * (2 * EXTENT_PAGES as usize + 5) + 123);
+
+    let mut writer = OverflowWriter::new(&file, &allocator)?;
+    for piece in expected.chunks(10_000) {
+        writer.write_all(piece)?;
+    }
+    let value = writer.finish()?;
+    assert_eq!(value.len, expected.len() as u64);
+    assert_eq!(value.page_count(), 2 * EXTENT_PAGES + 6);
+    // Unused pages of the last extent went back to the allocator
+    assert_eq!(allocator.free_pages(), EXTENT_PAGES - 1 + EXTENT_PAGES - 6);
+
+    let mut reader = OverflowReader::new(&file, value);
+    let mut offset = 0;
+    while let Some(chunk) = reader.next_chunk()? {
+        assert!(chunk.len() <= OVERFLOW_DATA_SIZE);
+        assert_eq!(chunk, &expected[offset..offset + chunk.len()]);
+        offset += chunk.len();
+    }
+    assert_eq!(offset, expected.len());
+
+    let mut copy = Vec::new();
+    OverflowReader::new(&file, value).read_to_end(&mut copy)?;
+    assert_eq!(copy, expected);
+    Ok(())
+}
+
+#[test]
+fn test_small_and_empty_values() -> Result<(), Box<dyn std::error::Error>> {
+    let (_temp, file) = setup()?;
+    let allocator = PageAllocator::new();
+
+    let empty = OverflowWriter::new(&file, &allocator)?.finish()?;
+    assert_eq!(empty.len, 0);
+    assert!(OverflowReader::new(&file, empty).next_chunk()?.is_none());
+
+    let mut writer = OverflowWriter::new(&file, &allocator)?;
+    writer.write_chunk(b"hello")?;
+    let value = writer.finish()?;
+    let mut out = Vec::new();
+    assert_eq!(OverflowReader::new(&file, value).copy_to(&mut out)?, 5);
+    assert_eq!(out, b"hello");
+
+    let decoded = OverflowValue::decode(&value.encode())?;
+    assert_eq!(decoded, value);
+    Ok(())
+}
+
+#[test]
+fn test_free_and_abandon_release_pages() -> Result<(), Box<dyn std::error::Error>> {
+    let (_temp, file) = setup()?;
+    let allocator = PageAllocator::new();
+
+    let mut writer = OverflowWriter::new(&file, &allocator)?;
+    writer.write_chunk(&pattern(OVERFLOW_DATA_SIZE * 70))?;
+    let value = writer.finish()?;
+    let free_before = allocator.free_pages();
+    free_value(&file, &allocator, value)?;
+    assert_eq!(allocator.free_pages(), free_before + value.page_count());
+
+    let mut abandoned = OverflowWriter::new(&file, &allocator)?;
+    abandoned.write_chunk(&pattern(100))?;
+    let free_during = allocator.free_pages();
+    drop(abandoned);
+    assert_eq!(allocator.free_pages(), free_during + EXTENT_PAGES);
+    Ok(())
+}
+
+#[test]
+fn test_length_mismatch_is_corruption() -> Result<(), Box<dyn std::error::Error>> {
+    let (_temp, file) = setup()?;
+    let allocator = PageAllocator::new();
+    let mut writer = OverflowWriter::new(&file, &allocator)?;
+    writer.write_chunk(&pattern(OVERFLOW_DATA_SIZE + 10))?;
+    let value = writer.finish()?;
+
+    let shorter = OverflowValue {
+        len: value.len - 5,
+        ..value
+    };
+    let mut reader = OverflowReader::new(&file, shorter);
+    assert!(matches!(reader.next_chunk(), Err(Error::Corruption(_))));
+    Ok(())
+}
+
+#[test]
+fn test_chain_past_last_page_is_corruption() -> Result<(), Box<dyn std::error::Error>> {
+    let (_temp, file) = setup()?;
+    // A run from the last extent of the page ID space would wrap
+    let corrupt = OverflowValue {
+        first_page: u64::MAX - 1,
+        len: 4 * OVERFLOW_DATA_SIZE as u64,
+    };
+    let mut reader = OverflowReader::new(&file, corrupt);
+    assert!(matches!(reader.next_chunk(), Err(Error::Corruption(_))));
+    Ok(())
+}
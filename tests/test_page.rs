@@ -49,7 +49,7 @@ fn test_page_initialization() {
     let lsn = page.header().lsn;
 
     assert_eq!(page_type, PageType::Header);
-    assert_eq!(page_id, INVALID_PAGE_ID);
+    assert_eq!(u64::from(page_id), INVALID_PAGE_ID);
     assert_eq!(lsn, 0);
 
     // Check that data area is zeroed
@@ -0,0 +1,146 @@
+//! Tests for the page allocator and its persisted free list
+
+use lumen::common::error::Error;
+use lumen::storage::file_header::FileHeader;
+use lumen::storage::page::Page;
+use lumen::storage::page_allocator::{
+    Extent, PageAllocator, EXTENT_PAGES, FREE_LIST_ENTRIES_PER_PAGE,
+};
+use lumen::storage::page_file::PageFile;
+use lumen::storage::page_type::PageType;
+use tempfile::NamedTempFile;
+
+#[test]
+fn test_allocation_grows_file_and_reuses_freed_pages() -> Result<(), Box<dyn std::error::Error>> {
+    let allocator = PageAllocator::new();
+    assert_eq!(allocator.allocate_page()?, 1);
+    assert_eq!(allocator.allocate_page()?, 2);
+    assert_eq!(allocator.allocated_pages(), 3);
+
+    allocator.free_page(1)?;
+    assert!(allocator.is_free(1));
+    assert_eq!(allocator.allocate_page()?, 1);
+    assert_eq!(allocator.free_pages(), 0);
+
+    assert!(matches!(
+        allocator.free_page(0),
+        Err(Error::InvalidInput(_))
+    ));
+    assert!(matches!(
+        allocator.free_page(3),
+        Err(Error::InvalidInput(_))
+    ));
+    allocator.free_page(2)?;
+    assert!(matches!(
+        allocator.free_page(2),
+        Err(Error::InvalidInput(_))
+    ));
+    Ok(())
+}
+
+#[test]
+fn test_extents_are_aligned_and_contiguous() -> Result<(), Box<dyn std::error::Error>> {
+    let allocator = PageAllocator::new();
+    let first = allocator.allocate_extent()?;
+    let second = allocator.allocate_extent()?;
+    assert_eq!(first.start % EXTENT_PAGES, 0);
+    assert_eq!(first.len, EXTENT_PAGES);
+    assert_eq!(second.start, first.start + EXTENT_PAGES);
+
+    // Single pages fill the alignment gap before breaking up extents
+    let singles: Vec<u64> = (0..EXTENT_PAGES - 1)
+        .map(|_| allocator.allocate_page())
+        .collect::<Result<_, _>>()?;
+    assert!(singles.iter().all(|&page_id| page_id < first.start));
+
+    allocator.free_extent(first)?;
+    assert_eq!(allocator.allocate_extent()?, first);
+
+    allocator.free_page(second.start + 3)?;
+    let overlapping = Extent {
+        start: second.start,
+        len: EXTENT_PAGES,
+    };
+    assert!(allocator.free_extent(overlapping).is_err());
+    assert!(!allocator.is_free(second.start));
+    Ok(())
+}
+
+#[test]
+fn test_save_and_load_round_trip() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let mut header = FileHeader::default();
+    let file = PageFile::create_database(temp_file.path(), &header)?;
+
+    let allocator = PageAllocator::new();
+    let extents: Vec<Extent> = (0..40)
+        .map(|_| allocator.allocate_extent())
+        .collect::<Result<_, _>>()?;
+    // Free every other page so the free list needs several chain pages
+    let mut freed = Vec::new();
+    for extent in &extents {
+        for page_id in extent.pages().step_by(2) {
+            allocator.free_page(page_id)?;
+            freed.push(page_id);
+        }
+    }
+    assert!(freed.len() > 2 * FREE_LIST_ENTRIES_PER_PAGE);
+    allocator.save(&file, &mut header)?;
+    assert_ne!(header.free_list_root, 0);
+    assert_eq!(header.allocated_pages, allocator.allocated_pages());
+    let root = file.read_page(header.free_list_root)?;
+    assert_eq!(root.header().page_type, PageType::FreeList);
+    drop(file);
+
+    let (file, header) = PageFile::open_database(temp_file.path())?;
+    let loaded = PageAllocator::load(&file, &header)?;
+    assert_eq!(loaded.allocated_pages(), allocator.allocated_pages());
+    assert_eq!(loaded.free_pages(), allocator.free_pages());
+    for page_id in 1..allocator.allocated_pages() {
+        assert_eq!(loaded.is_free(page_id), allocator.is_free(page_id));
+    }
+    // Chain pages are reserved while they hold the saved list
+    assert!(matches!(
+        loaded.free_page(header.free_list_root),
+        Err(Error::InvalidInput(_))
+    ));
+    Ok(())
+}
+
+#[test]
+fn test_resave_releases_previous_chain() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let mut header = FileHeader::default();
+    let file = PageFile::create_database(temp_file.path(), &header)?;
+
+    let allocator = PageAllocator::new();
+    let extent = allocator.allocate_extent()?;
+    allocator.free_page(extent.start + 5)?;
+    allocator.save(&file, &mut header)?;
+    let first_root = header.free_list_root;
+    assert!(!allocator.is_free(first_root));
+
+    allocator.save(&file, &mut header)?;
+    assert_ne!(header.free_list_root, first_root);
+    assert!(allocator.is_free(first_root));
+
+    // The new chain records the previous one as free, so nothing leaks
+    let loaded = PageAllocator::load(&file, &header)?;
+    assert!(loaded.is_free(first_root));
+    assert_eq!(loaded.free_pages(), allocator.free_pages());
+    Ok(())
+}
+
+#[test]
+fn test_load_without_saved_state_uses_file_size() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let header = FileHeader::default();
+    let file = PageFile::create_database(temp_file.path(), &header)?;
+    file.write_page(4, &Page::new())?;
+
+    let allocator = PageAllocator::load(&file, &header)?;
+    assert_eq!(allocator.allocated_pages(), 5);
+    assert_eq!(allocator.free_pages(), 0);
+    assert_eq!(allocator.allocate_page()?, 5);
+    Ok(())
+}
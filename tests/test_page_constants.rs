@@ -12,7 +12,8 @@ fn test_page_constants() {
 #[test]
 fn test_page_id_constants() {
     assert_eq!(INVALID_PAGE_ID, 0);
-    assert_eq!(MAX_PAGE_ID, u32::MAX);
+    assert_eq!(MAX_PAGE_ID, (1 << 47) - 1);
+    assert!((MAX_PAGE_ID + 1).checked_mul(MAX_PAGE_SIZE as u64).unwrap() > i64::MAX as u64);
 }
 
 #[test]
@@ -0,0 +1,73 @@
+//! Tests for the shareable positional page file
+
+mod common;
+
+use common::make_page;
+use lumen::storage::page::Page;
+use lumen::storage::page_constants::PageId;
+use lumen::storage::page_file::PageFile;
+use std::sync::Arc;
+use tempfile::NamedTempFile;
+
+#[test]
+fn test_page_file_parallel_readers() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let page_file = Arc::new(PageFile::open(temp_file.path())?);
+    for page_id in 0..64 {
+        page_file.write_page(page_id, &make_page(page_id))?;
+    }
+
+    // Many readers share one handle without any locking
+    std::thread::scope(|scope| {
+        for t in 0..8u64 {
+            let page_file = Arc::clone(&page_file);
+            scope.spawn(move || {
+                for round in 0..256u64 {
+                    let page_id = (round * 13 + t) % 64;
+                    let page = page_file.read_page(page_id).unwrap();
+                    let stored = page.header().page_id;
+                    assert_eq!(u64::from(stored), page_id);
+                    assert_eq!(page.data()[0], (page_id % 256) as u8);
+                }
+            });
+        }
+    });
+
+    Ok(())
+}
+
+#[test]
+fn test_page_file_batched_io() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let page_file = PageFile::open(temp_file.path())?;
+
+    let pages: Vec<Page> = (0..8).map(make_page).collect();
+    let batch: Vec<(PageId, &Page)> = (0..8).zip(pages.iter()).collect();
+    page_file.write_pages(&batch)?;
+    page_file.sync_data()?;
+
+    let read = page_file.read_pages(&[7, 3, 4])?;
+    assert_eq!(read[0].data()[0], 7);
+    assert_eq!(read[1].data()[0], 3);
+    assert_eq!(read[2].data()[0], 4);
+    assert_eq!(page_file.page_count()?, 8);
+
+    Ok(())
+}
+
+#[test]
+fn test_page_file_detects_corruption() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let page_file = PageFile::open(temp_file.path())?;
+
+    let mut page = make_page(2);
+    page.data_mut()[100] ^= 0xFF;
+    page_file.write_page(2, &page)?;
+
+    assert!(matches!(page_file.read_page(2), Err(e) if e.is_corruption()));
+    let mut raw = Page::new();
+    page_file.read_page_unverified(2, &mut raw)?;
+    assert_eq!(raw.data()[100], 0xFF);
+
+    Ok(())
+}
@@ -0,0 +1,92 @@
+//! Tests for background flushing and fuzzy checkpoints
+
+mod common;
+
+use common::config;
+use lumen::storage::buffer_pool::BufferPool;
+use lumen::storage::page_file::PageFile;
+use lumen::storage::page_flusher::{BackgroundFlusher, FlusherConfig};
+use lumen::storage::page_type::PageType;
+use std::sync::Arc;
+use std::time::Duration;
+use tempfile::NamedTempFile;
+
+fn stamp(pool: &BufferPool, page_id: u64, lsn: u32, byte: u8) {
+    let pinned = pool.fetch_page(page_id).unwrap();
+    let mut page = pinned.write().unwrap();
+    page.header_mut().lsn = lsn;
+    page.data_mut()[0] = byte;
+}
+
+#[test]
+fn test_checkpoint_lsn_tracks_oldest_dirty_page() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let pool = BufferPool::open(temp_file.path(), config(8))?;
+    for page_id in 1..=4 {
+        drop(pool.new_page(page_id, PageType::Data)?);
+        stamp(&pool, page_id, 5, 0);
+    }
+    assert_eq!(pool.dirty_pages(), 4);
+    assert_eq!(pool.checkpoint()?, 5);
+    assert_eq!(pool.dirty_pages(), 0);
+
+    stamp(&pool, 3, 40, 0x33);
+    stamp(&pool, 2, 30, 0x22);
+
+    // Page-ID order: page 2 goes first, page 3 (LSN 40) is still dirty
+    assert_eq!(pool.flush_dirty(1)?, 1);
+    assert_eq!(pool.checkpoint_lsn(), 40);
+    assert_eq!(pool.dirty_pages(), 1);
+
+    assert_eq!(pool.checkpoint()?, 40);
+    assert_eq!(pool.dirty_pages(), 0);
+
+    let page_file = PageFile::open(temp_file.path())?;
+    assert_eq!(page_file.read_page(2)?.data()[0], 0x22);
+    assert_eq!(page_file.read_page(3)?.data()[0], 0x33);
+    Ok(())
+}
+
+#[test]
+fn test_background_flusher_with_concurrent_writers() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let pool = Arc::new(BufferPool::open(temp_file.path(), config(32))?);
+    for page_id in 0..16 {
+        drop(pool.new_page(page_id, PageType::Data)?);
+    }
+
+    let flusher = BackgroundFlusher::spawn(
+        &pool,
+        FlusherConfig {
+            threads: 3,
+            interval: Duration::from_millis(1),
+            batch_pages: 4,
+        },
+    )?;
+
+    std::thread::scope(|scope| {
+        for t in 0..4u64 {
+            let pool = &pool;
+            scope.spawn(move || {
+                for round in 1..=50u32 {
+                    let page_id = (u64::from(round) + t) % 16;
+                    stamp(pool, page_id, round, page_id as u8);
+                    let _ = pool.read_page(page_id).unwrap().data()[0];
+                }
+            });
+        }
+    });
+
+    flusher.wake();
+    while pool.dirty_pages() > 0 {
+        std::thread::sleep(Duration::from_millis(1));
+    }
+    flusher.stop();
+    assert!(pool.checkpoint_lsn() >= 1);
+
+    let page_file = PageFile::open(temp_file.path())?;
+    for page_id in 0..16u64 {
+        assert_eq!(page_file.read_page(page_id)?.data()[0], page_id as u8);
+    }
+    Ok(())
+}
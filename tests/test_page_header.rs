@@ -73,7 +73,7 @@ fn test_page_header_default() {
     assert_eq!(page_type, PageType::Header); // Default to Header type
     assert_eq!(flags, 0);
     assert_eq!(free_space, PAGE_USABLE_SIZE as u16);
-    assert_eq!(page_id, INVALID_PAGE_ID);
+    assert_eq!(u64::from(page_id), INVALID_PAGE_ID);
     assert_eq!(checksum, 0);
     assert_eq!(lsn, 0);
 }
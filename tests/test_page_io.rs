@@ -100,7 +100,7 @@ fn test_page_io_offset_calculations() -> Result<(), Box<dyn std::error::Error>>
         page.header_mut().page_id = id;
         page.calculate_checksum()?;
 
-        let offset = calculate_page_offset(id as u64);
+        let offset = calculate_page_offset(id as u64)?;
         write_page_at_offset(&mut file, offset, &page)?;
     }
 
@@ -204,3 +204,57 @@ fn test_page_io_file_too_small() {
     let result = read_page_from_file(&mut file, 0);
     assert!(result.is_err());
 }
+
+#[test]
+fn test_page_io_vectored_batches() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let file = fs::OpenOptions::new()
+        .read(true)
+        .write(true)
+        .open(temp_file.path())?;
+
+    // Two runs (10..15 and 40..42) submitted out of order
+    let ids: Vec<u64> = vec![41, 12, 10, 14, 40, 11, 13];
+    let pages: Vec<Page> = ids
+        .iter()
+        .map(|&id| {
+            let mut page = Page::new();
+            page.header_mut().page_type = PageType::Data;
+            page.header_mut().page_id = id as u32;
+            page.data_mut()[0] = id as u8;
+            page.calculate_checksum().unwrap();
+            page
+        })
+        .collect();
+    let batch: Vec<(u64, &Page)> = ids.iter().copied().zip(pages.iter()).collect();
+    write_pages(&file, &batch)?;
+
+    let read = read_pages(&file, &[14, 40, 10, 41])?;
+    let read_ids: Vec<u8> = read.iter().map(|page| page.data()[0]).collect();
+    assert_eq!(read_ids, vec![14, 40, 10, 41]);
+
+    Ok(())
+}
+
+#[test]
+fn test_page_io_vectored_errors() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let file = fs::OpenOptions::new()
+        .read(true)
+        .write(true)
+        .open(temp_file.path())?;
+
+    let mut page = Page::new();
+    page.calculate_checksum()?;
+    let mut corrupted = Page::new();
+    corrupted.calculate_checksum()?;
+    corrupted.data_mut()[0] = 0x01;
+    write_pages(&file, &[(0, &page), (1, &corrupted)])?;
+
+    assert_eq!(read_pages(&file, &[0])?.len(), 1);
+    assert!(matches!(read_pages(&file, &[0, 1]), Err(e) if e.is_corruption()));
+    // Page 2 lies past the end of the file
+    assert!(matches!(read_pages(&file, &[1, 2]), Err(e) if e.is_io()));
+
+    Ok(())
+}
@@ -0,0 +1,76 @@
+//! Tests for compact in-page page pointers
+
+use lumen::common::error::Error;
+use lumen::storage::page_constants::{PageId, MAX_PAGE_ID};
+use lumen::storage::page_pointer::{
+    decode_pointer, decode_varint, encode_pointer, encode_varint, pointer_len, MAX_POINTER_LEN,
+};
+
+#[test]
+fn test_pointers_round_trip() -> Result<(), Box<dyn std::error::Error>> {
+    let ids: [PageId; 8] = [
+        0,
+        1,
+        63,
+        64,
+        u64::from(u32::MAX),
+        u64::from(u32::MAX) + 1,
+        1 << 45,
+        MAX_PAGE_ID,
+    ];
+    let mut buffer = [0u8; MAX_POINTER_LEN];
+    for &base in &ids {
+        for &target in &ids {
+            let len = encode_pointer(base, target, &mut buffer)?;
+            assert_eq!(len, pointer_len(base, target));
+            assert_eq!(decode_pointer(base, &buffer[..len])?, (target, len));
+        }
+    }
+    Ok(())
+}
+
+#[test]
+fn test_nearby_pointers_are_compact() {
+    // Pages in the same 64-page extent as their parent
+    let parent: PageId = 1 << 40;
+    for child in parent - 63..=parent + 63 {
+        assert!(pointer_len(parent, child) <= 2);
+    }
+    assert_eq!(pointer_len(parent, parent + 63), 1);
+    // Even far-apart pages beyond 32 bits stay well under 8 bytes
+    assert!(pointer_len(parent, parent + (1 << 30)) <= 5);
+}
+
+#[test]
+fn test_pointer_sequences_decode_in_order() -> Result<(), Box<dyn std::error::Error>> {
+    let base: PageId = 5_000_000_000;
+    let children = [base + 1, base - 20_000, 7, base + (1 << 33)];
+    let mut buffer = vec![0u8; children.len() * MAX_POINTER_LEN];
+    let mut written = 0;
+    for &child in &children {
+        written += encode_pointer(base, child, &mut buffer[written..])?;
+    }
+
+    let mut read = 0;
+    for &child in &children {
+        let (decoded, len) = decode_pointer(base, &buffer[read..written])?;
+        assert_eq!(decoded, child);
+        read += len;
+    }
+    assert_eq!(read, written);
+    Ok(())
+}
+
+#[test]
+fn test_errors() {
+    let mut small = [0u8; 1];
+    assert!(matches!(
+        encode_varint(300, &mut small),
+        Err(Error::InvalidInput(_))
+    ));
+    assert!(matches!(
+        decode_varint(&[0x80, 0x80]),
+        Err(Error::Corruption(_))
+    ));
+    assert!(matches!(decode_pointer(0, &[]), Err(Error::Corruption(_))));
+}
@@ -0,0 +1,65 @@
+//! Tests for zero-copy page references
+
+use lumen::storage::buffer_pool::{BufferPool, BufferPoolConfig};
+use lumen::storage::mapped_file::{MappedFile, MappedFileConfig};
+use lumen::storage::page::Page;
+use lumen::storage::page_constants::PAGE_SIZE;
+use lumen::storage::page_ref::PageRef;
+use lumen::storage::page_type::PageType;
+use tempfile::NamedTempFile;
+
+#[test]
+fn test_page_ref_from_mapping() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let mapped = MappedFile::open(temp_file.path(), MappedFileConfig::default())?;
+
+    let mut page = Page::new();
+    page.header_mut().page_type = PageType::BTreeInternal;
+    page.header_mut().page_id = 4;
+    page.data_mut()[..4].copy_from_slice(b"lumn");
+    page.calculate_checksum()?;
+    mapped.write_page(4, &page)?;
+
+    let guard = mapped.page(4)?;
+    let page_ref = guard.page_ref()?;
+    assert_eq!(page_ref.header().page_type, PageType::BTreeInternal);
+    assert_eq!(&page_ref.data()[..4], b"lumn");
+    assert!(page_ref.verify_checksum());
+    assert_eq!(page_ref.raw().as_ptr(), guard.as_ptr());
+
+    Ok(())
+}
+
+#[test]
+fn test_page_ref_from_buffer_pool() -> Result<(), Box<dyn std::error::Error>> {
+    let temp_file = NamedTempFile::new()?;
+    let config = BufferPoolConfig {
+        memory_budget: 4 * PAGE_SIZE,
+        ..Default::default()
+    };
+    let pool = BufferPool::open(temp_file.path(), config)?;
+    {
+        let pinned = pool.new_page(1, PageType::Data)?;
+        pinned.write()?.data_mut()[0] = 0xAA;
+    }
+
+    let guard = pool.read_page(1)?;
+    let page_ref: PageRef<'_> = guard.page_ref();
+    assert_eq!(page_ref.data()[0], 0xAA);
+    assert_eq!(page_ref.size(), PAGE_SIZE);
+    assert_eq!(guard.page_id(), 1);
+
+    Ok(())
+}
+
+#[test]
+fn test_page_ref_detects_corruption() {
+    let mut page = Page::new();
+    page.header_mut().page_type = PageType::Data;
+    page.calculate_checksum().unwrap();
+
+    let mut bytes = page.raw().to_vec();
+    bytes[PAGE_SIZE - 1] ^= 0x01;
+    let page_ref = PageRef::new(&bytes).unwrap();
+    assert!(page_ref.is_corrupted());
+}
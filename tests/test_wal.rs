@@ -0,0 +1,349 @@
+//! Tests for the write-ahead log and crash recovery
+
+use lumen::common::error::Error;
+use lumen::storage::buffer_pool::{BufferPool, BufferPoolConfig};
+use lumen::storage::lsn::page_lsn;
+use lumen::storage::page::Page;
+use lumen::storage::page_constants::{PAGE_HEADER_SIZE, PAGE_SIZE};
+use lumen::storage::page_file::PageFile;
+use lumen::storage::page_type::PageType;
+use lumen::storage::wal::{Wal, WalConfig, MIN_SEGMENT_SIZE, RECORD_HEADER_SIZE};
+use std::fs::OpenOptions;
+use std::io::Write;
+use std::sync::Arc;
+use tempfile::{NamedTempFile, TempDir};
+
+fn small_segments() -> WalConfig {
+    WalConfig {
+        segment_size: MIN_SEGMENT_SIZE,
+        ..WalConfig::default()
+    }
+}
+
+fn segment_count(dir: &TempDir) -> usize {
+    std::fs::read_dir(dir.path()).unwrap().count()
+}
+
+#[test]
+fn test_reopen_truncates_torn_tail() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    let end = {
+        let wal = Wal::open(dir.path(), small_segments())?;
+        let mut page = Page::new();
+        wal.log_page_image(1, &mut page)?;
+        wal.log_page_delta(1, &mut page, 100..110)?;
+        wal.flush()?;
+        wal.next_lsn()
+    };
+
+    // A record cut short by a crash
+    let segment = std::fs::read_dir(dir.path())?.next().unwrap()?.path();
+    OpenOptions::new()
+        .append(true)
+        .open(&segment)?
+        .write_all(&[0x40, 0, 0, 0, 0xDE, 0xAD])?;
+
+    let wal = Wal::open(dir.path(), small_segments())?;
+    assert_eq!(wal.next_lsn(), end);
+    assert_eq!(std::fs::metadata(&segment)?.len() % MIN_SEGMENT_SIZE, end);
+    let mut page = Page::new();
+    assert_eq!(wal.log_page_image(2, &mut page)?, end);
+    Ok(())
+}
+
+#[test]
+fn test_recover_replays_images_and_deltas() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    let db = NamedTempFile::new()?;
+    {
+        let wal = Wal::open(dir.path(), small_segments())?;
+        for page_id in 1..=3u64 {
+            let mut page = Page::new();
+            page.header_mut().set_page_id(page_id);
+            page.header_mut().page_type = PageType::Data;
+            page.data_mut()[0] = page_id as u8;
+            wal.log_page_image(page_id, &mut page)?;
+            page.data_mut()[1] = 0xD0 | page_id as u8;
+            let offset = PAGE_HEADER_SIZE + 1;
+            wal.log_page_delta(page_id, &mut page, offset..offset + 1)?;
+            page.data_mut()[2] = 0xE0 | page_id as u8;
+            page.raw_mut()[PAGE_SIZE - 1] = 0xF0 | page_id as u8;
+            let ranges = [offset + 1..offset + 2, PAGE_SIZE - 1..PAGE_SIZE];
+            wal.log_page_ranges(page_id, &mut page, &ranges)?;
+        }
+        wal.flush()?;
+        // Crash: the pages themselves never reached the database file
+    }
+
+    let file = PageFile::open(db.path())?;
+    let wal = Wal::open(dir.path(), small_segments())?;
+    let stats = wal.recover(&file)?;
+    assert_eq!(stats.images, 3);
+    assert_eq!(stats.deltas_applied, 6);
+    assert_eq!(stats.deltas_skipped, 0);
+    assert_eq!(stats.pages, 3);
+    for page_id in 1..=3u64 {
+        let page = file.read_page(page_id)?;
+        assert_eq!(page.data()[0], page_id as u8);
+        assert_eq!(page.data()[1], 0xD0 | page_id as u8);
+        assert_eq!(page.data()[2], 0xE0 | page_id as u8);
+        assert_eq!(page.raw()[PAGE_SIZE - 1], 0xF0 | page_id as u8);
+    }
+
+    // The recovery checkpoint means nothing is replayed a second time
+    let stats = Wal::open(dir.path(), small_segments())?.recover(&file)?;
+    assert_eq!(stats.pages, 0);
+    assert_eq!(stats.records, 1);
+    Ok(())
+}
+
+#[test]
+fn test_recover_skips_deltas_already_on_disk() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    let db = NamedTempFile::new()?;
+    let file = PageFile::open(db.path())?;
+    let wal = Wal::open(dir.path(), small_segments())?;
+
+    let mut page = Page::new();
+    page.header_mut().page_id = 4;
+    page.data_mut()[10] = 0xAA;
+    let offset = PAGE_HEADER_SIZE + 10;
+    let first = wal.log_page_delta(4, &mut page, offset..offset + 1)?;
+    page.calculate_checksum()?;
+    file.write_page(4, &page)?;
+
+    page.data_mut()[11] = 0xBB;
+    let second = wal.log_page_delta(4, &mut page, offset + 1..offset + 2)?;
+    wal.flush()?;
+    drop(wal);
+
+    let wal = Wal::open(dir.path(), small_segments())?;
+    let stats = wal.recover(&file)?;
+    assert_eq!(stats.deltas_skipped, 1);
+    assert_eq!(stats.deltas_applied, 1);
+    let recovered = file.read_page(4)?;
+    assert_eq!(&recovered.data()[10..12], &[0xAA, 0xBB]);
+    let lsn = recovered.header().lsn;
+    assert_eq!(lsn, page_lsn(second));
+    assert!(second > first);
+    Ok(())
+}
+
+#[test]
+fn test_checkpoint_removes_old_segments() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    let wal = Wal::open(dir.path(), small_segments())?;
+    let mut page = Page::new();
+    for page_id in 0..40 {
+        wal.log_page_image(page_id, &mut page)?;
+    }
+    // Records never straddle a segment boundary
+    let per_segment = (MIN_SEGMENT_SIZE as usize - 24) / (RECORD_HEADER_SIZE + PAGE_SIZE);
+    assert_eq!(segment_count(&dir), 40_usize.div_ceil(per_segment));
+
+    let redo = wal.next_lsn();
+    wal.checkpoint(redo)?;
+    assert_eq!(segment_count(&dir), 1);
+    assert_eq!(wal.redo_lsn(), redo);
+
+    // The redo point never moves backwards
+    wal.checkpoint(0)?;
+    assert_eq!(wal.redo_lsn(), redo);
+    assert!(wal.checkpoint(wal.next_lsn() + 1).is_err());
+
+    drop(wal);
+    let wal = Wal::open(dir.path(), small_segments())?;
+    assert_eq!(wal.redo_lsn(), redo);
+    Ok(())
+}
+
+#[test]
+fn test_needs_checkpoint() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    let config = WalConfig {
+        checkpoint_distance: 3 * PAGE_SIZE as u64,
+        ..small_segments()
+    };
+    let wal = Wal::open(dir.path(), config)?;
+    let mut page = Page::new();
+    wal.log_page_image(1, &mut page)?;
+    assert!(!wal.needs_checkpoint());
+    wal.log_page_image(1, &mut page)?;
+    wal.log_page_image(1, &mut page)?;
+    assert!(wal.needs_checkpoint());
+    wal.checkpoint(wal.next_lsn())?;
+    assert!(!wal.needs_checkpoint());
+    Ok(())
+}
+
+#[test]
+fn test_buffer_pool_logs_images_then_deltas() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    let db = NamedTempFile::new()?;
+    let wal = Arc::new(Wal::open(dir.path(), small_segments())?);
+    let pool = BufferPool::open(
+        db.path(),
+        BufferPoolConfig {
+            memory_budget: PAGE_SIZE,
+            ..Default::default()
+        },
+    )?;
+    pool.attach_wal(Arc::clone(&wal))?;
+    assert!(pool.attach_wal(Arc::clone(&wal)).is_err());
+
+    let offset = PAGE_HEADER_SIZE;
+    let pinned = pool.new_page(1, PageType::Data)?;
+    let image = {
+        let mut page = pinned.write()?;
+        page.data_mut()[0] = 0x11;
+        page.log_change(offset..offset + 1)?
+    };
+    let delta = {
+        let mut page = pinned.write()?;
+        page.data_mut()[1] = 0x22;
+        page.log_change(offset + 1..offset + 2)?
+    };
+    assert_eq!(delta - image, (RECORD_HEADER_SIZE + PAGE_SIZE) as u64);
+    assert_eq!(wal.next_lsn() - delta, RECORD_HEADER_SIZE as u64 + 3);
+    assert!(wal.durable_lsn() <= delta);
+    drop(pinned);
+
+    // Evicting page 1 writes it back, which must flush the log first
+    drop(pool.new_page(2, PageType::Data)?);
+    assert!(wal.durable_lsn() > delta);
+
+    // The first change after the page went clean logs a new image
+    {
+        let pinned = pool.fetch_page(1)?;
+        let mut page = pinned.write()?;
+        page.data_mut()[2] = 0x33;
+        let lsn = page.log_change(offset + 2..offset + 3)?;
+        assert_eq!(
+            wal.next_lsn() - lsn,
+            (RECORD_HEADER_SIZE + PAGE_SIZE) as u64
+        );
+    }
+
+    assert!(pool.checkpoint()? > delta);
+    assert_eq!(pool.checkpoint_lsn(), wal.redo_lsn());
+    Ok(())
+}
+
+#[test]
+fn test_buffer_pool_changes_survive_crash() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    let db = NamedTempFile::new()?;
+    {
+        let pool = BufferPool::open(db.path(), BufferPoolConfig::default())?;
+        pool.attach_wal(Arc::new(Wal::open(dir.path(), small_segments())?))?;
+        for page_id in 1..=8u64 {
+            let pinned = pool.new_page(page_id, PageType::Data)?;
+            for round in 0..4 {
+                let mut page = pinned.write()?;
+                let offset = PAGE_HEADER_SIZE + round;
+                page.raw_mut()[offset] = page_id as u8 + round as u8;
+                page.log_change(offset..offset + 1)?;
+            }
+        }
+        pool.wal().unwrap().flush()?;
+        // Crash without writing back any page
+        std::mem::forget(pool);
+    }
+
+    let file = PageFile::open(db.path())?;
+    let stats = Wal::open(dir.path(), small_segments())?.recover(&file)?;
+    assert_eq!(stats.images, 8);
+    assert_eq!(stats.deltas_applied, 24);
+    for page_id in 1..=8u64 {
+        let page = file.read_page(page_id)?;
+        assert_eq!(page.header().page_type, PageType::Data);
+        assert!(!page.header().is_dirty());
+        for round in 0..4 {
+            assert_eq!(page.data()[round], page_id as u8 + round as u8);
+        }
+    }
+    Ok(())
+}
+
+fn copy_dir(from: &TempDir) -> TempDir {
+    let to = TempDir::new().unwrap();
+    for entry in std::fs::read_dir(from.path()).unwrap() {
+        let entry = entry.unwrap();
+        std::fs::copy(entry.path(), to.path().join(entry.file_name())).unwrap();
+    }
+    to
+}
+
+#[test]
+fn test_parallel_recovery_matches_serial() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    {
+        let wal = Wal::open(dir.path(), small_segments())?;
+        let mut pages: Vec<Page> = (0..64).map(|_| Page::new()).collect();
+        for (page_id, page) in (0u64..).zip(pages.iter_mut()) {
+            page.header_mut().set_page_id(page_id);
+            wal.log_page_image(page_id, page)?;
+        }
+        // Interleave deltas across pages, including later deltas that
+        // overwrite earlier ones
+        for round in 0..20usize {
+            for (page_id, page) in (0u64..).zip(pages.iter_mut()) {
+                let offset = PAGE_HEADER_SIZE + (round * 7 + page_id as usize) % 64;
+                page.raw_mut()[offset] = (round as u8) ^ (page_id as u8);
+                wal.log_page_delta(page_id, page, offset..offset + 1)?;
+            }
+        }
+        wal.flush()?;
+    }
+    let parallel_dir = copy_dir(&dir);
+
+    let serial_db = NamedTempFile::new()?;
+    let serial_file = PageFile::open(serial_db.path())?;
+    let serial = Wal::open(dir.path(), small_segments())?.recover_with_threads(&serial_file, 1)?;
+
+    let parallel_db = NamedTempFile::new()?;
+    let parallel_file = PageFile::open(parallel_db.path())?;
+    let parallel = Wal::open(parallel_dir.path(), small_segments())?
+        .recover_with_threads(&parallel_file, 4)?;
+
+    assert_eq!(serial, parallel);
+    assert_eq!(parallel.pages, 64);
+    assert_eq!(parallel.images, 64);
+    assert_eq!(parallel.deltas_applied, 64 * 20);
+    for page_id in 0..64u64 {
+        let expected = serial_file.read_page(page_id)?;
+        let actual = parallel_file.read_page(page_id)?;
+        assert_eq!(expected.raw(), actual.raw());
+    }
+    Ok(())
+}
+
+#[test]
+fn test_recovery_verifies_pages_loaded_for_deltas() -> Result<(), Box<dyn std::error::Error>> {
+    let dir = TempDir::new()?;
+    let db = NamedTempFile::new()?;
+    let file = PageFile::open(db.path())?;
+
+    let mut page = Page::new();
+    page.header_mut().page_id = 2;
+    page.calculate_checksum()?;
+    file.write_page(2, &page)?;
+    let wal = Wal::open(dir.path(), small_segments())?;
+    let offset = PAGE_HEADER_SIZE;
+    wal.log_page_delta(2, &mut page, offset..offset + 1)?;
+    wal.flush()?;
+    assert!(matches!(
+        wal.recover_with_threads(&file, 0),
+        Err(Error::InvalidInput(_))
+    ));
+
+    // Damage the page on disk without fixing its checksum
+    let mut damaged = page;
+    damaged.data_mut()[100] ^= 0xFF;
+    file.write_page(2, &damaged)?;
+    assert!(matches!(
+        wal.recover_with_threads(&file, 2),
+        Err(Error::Corruption(_))
+    ));
+    Ok(())
+}